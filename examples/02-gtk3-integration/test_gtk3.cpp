@@ -31,6 +31,10 @@ std::string generate_demo_html() {
     return dom.get_html();
 }
 
+static void pdf_saved(phtml::PDFprinter *, bool ok, void *) {
+    g_print(ok ? "Saved demo_gtk3.pdf\n" : "Unable to save demo_gtk3.pdf\n");
+}
+
 int main(int argc, char *argv[]) {
 
     gtk_init(&argc, &argv);
@@ -54,11 +58,11 @@ int main(int argc, char *argv[]) {
     gtk_widget_show_all(window);
 
     // 2. The Library Part (The Printer)
-    // Even while the window is open, your Pimpl engine does its work
+    // Prints the view on screen once it has loaded, no second view or load
     phtml::PDFprinter pdf;
     std::string       out_path = std::filesystem::current_path().string() + "/demo_gtk3.pdf";
-    pdf.set_param(html.c_str(), out_path.c_str());
-    pdf.make_pdf();
+    pdf.layout("A4", "portrait");
+    pdf.make_pdf_from_view(WEBKIT_WEB_VIEW(webview), out_path.c_str(), pdf_saved, nullptr);
 
     gtk_main();
     return 0;
@@ -28,6 +28,11 @@ std::string generate_demo_html() {
     return dom.get_html();
 }
 
+static void pdf_saved(phtml::PDFprinter *printer, bool ok, void *) {
+    g_print(ok ? "Saved demo_gtk4.pdf\n" : "Unable to save demo_gtk4.pdf\n");
+    delete printer;
+}
+
 static void activate(GtkApplication *app, gpointer) {
     std::string html = generate_demo_html();
 
@@ -51,12 +56,11 @@ static void activate(GtkApplication *app, gpointer) {
 
     gtk_window_set_child(GTK_WINDOW(window), webview);
 
-    // 3. The Printer (Runs alongside the UI)
-    phtml::PDFprinter pdf;
-    std::string       out_path = std::filesystem::current_path().string() + "/demo_gtk4.pdf";
-    pdf.set_param(html.c_str(), out_path.c_str());
-
-    pdf.make_pdf();
+    // 3. The Printer: prints the view on screen, no second view or load
+    auto       *pdf      = new phtml::PDFprinter();
+    std::string out_path = std::filesystem::current_path().string() + "/demo_gtk4.pdf";
+    pdf->layout("A4", "portrait");
+    pdf->make_pdf_from_view(WEBKIT_WEB_VIEW(webview), out_path.c_str(), pdf_saved, nullptr);
 
     gtk_window_present(GTK_WINDOW(window));
 }
@@ -0,0 +1,83 @@
+#include <string>
+#include <wk2gtkpdf/ichtmltopdf++.h>
+#include <wk2gtkpdf/pdf_stamper.h>
+#include <wk2gtkpdf/pretty_html.h>
+
+using namespace phtml;
+
+/**
+ * @brief main
+ * @return
+ *
+ * Print a two page letter once, then write a personalised copy for each
+ * recipient without going back through WebKit.
+ */
+int main() {
+    icGTK::init();
+
+    html_tree  dom("html");
+    html_tree *head = dom.new_node("head");
+    head->new_node("link rel=\"stylesheet\" href=\"/usr/share/wk2gtkpdf/A4-portrait-lite.css\"");
+
+    html_tree *body = dom.new_node("body");
+    for (int i = 1; i != 3; ++i) {
+        html_tree *page = body->new_node("div class=\"page\"")->new_node("div class=\"subpage\"");
+        page->new_node("h2")->set_node_content("Dear customer");
+        page->new_node("p")->set_node_content("The body of the letter is the same for everybody.");
+    }
+
+    /**
+     * Render the base document once, into memory.
+     */
+    PDFprinter pdf;
+    pdf.set_param(dom.get_html());
+    pdf.layout("A4", "portrait");
+    pdf.make_pdf();
+
+    PDF_Blob    base = pdf.get_blob();
+    pdf_stamper stamper(base.data, base.size);
+    PDF_FreeBlob(base);
+
+    /**
+     * A4 is 794 x 1123 CSS pixels at 96 pixels to the inch.
+     */
+    for (int r = 1; r != 6; ++r) {
+        std::string watermark = "COPY FOR RECIPIENT " + std::to_string(r);
+        std::string serial    = "Serial: WK-" + std::to_string(10000 + r);
+
+        PDF_Overlay overlays[3] = {};
+
+        overlays[0].text     = watermark.c_str();
+        overlays[0].pageNo   = 0;
+        overlays[0].xPos     = 0;
+        overlays[0].yPos     = 520;
+        overlays[0].w        = 794;
+        overlays[0].h        = 60;
+        overlays[0].fontSize = 40;
+        overlays[0].colour   = 0xd0d0d0;
+        overlays[0].align    = 1;
+
+        overlays[1].text     = serial.c_str();
+        overlays[1].pageNo   = 1;
+        overlays[1].xPos     = 560;
+        overlays[1].yPos     = 40;
+        overlays[1].w        = 190;
+        overlays[1].h        = 20;
+        overlays[1].fontSize = 12;
+        overlays[1].align    = 2;
+
+        overlays[2].text     = "Page {page} of {pages}";
+        overlays[2].pageNo   = 0;
+        overlays[2].xPos     = 0;
+        overlays[2].yPos     = 1070;
+        overlays[2].w        = 794;
+        overlays[2].h        = 20;
+        overlays[2].fontSize = 11;
+        overlays[2].align    = 1;
+
+        std::string outFile = "recipient-" + std::to_string(r) + ".pdf";
+        stamper.stamp(overlays, 3, outFile.c_str());
+    }
+
+    return 0;
+}
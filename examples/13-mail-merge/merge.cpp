@@ -0,0 +1,49 @@
+#include <string>
+#include <vector>
+#include <wk2gtkpdf/ichtmltopdf++.h>
+#include <wk2gtkpdf/pretty_html.h>
+
+using namespace phtml;
+
+/**
+ * @brief main
+ * @return
+ *
+ * One statement template, one statement per customer.  WebKit loads and
+ * lays out the template once; each record only changes the text of the
+ * data-field elements before it is printed.
+ */
+int main() {
+    icGTK::init();
+
+    html_tree  dom("html");
+    html_tree *head = dom.new_node("head");
+    head->new_node("link rel=\"stylesheet\" href=\"/usr/share/wk2gtkpdf/A4-portrait-lite.css\"");
+
+    html_tree *page = dom.new_node("body")->new_node("div class=\"page\"")->new_node("div class=\"subpage\"");
+    page->new_node("h2")->set_node_content("Statement");
+    page->new_node("p data-field=\"name\"")->set_node_content("Customer name");
+    page->new_node("p data-field=\"account\"")->set_node_content("Account");
+    page->new_node("p")->set_node_content("Balance due:");
+    page->new_node("h3 data-field=\"balance\"")->set_node_content("0.00");
+    page->new_node("p data-field=\"note\"")->set_node_content("Thank you for your custom.");
+
+    /**
+     * Fields a record leaves out keep the template text ("note" here).
+     */
+    std::vector<std::string> records = {
+        R"({"name": "Ann Archer", "account": "WK-10001", "balance": "12.50"})",
+        R"({"name": "Bob Baker", "account": "WK-10002", "balance": "0.00", "note": "Nothing to pay this month."})",
+        R"({"name": "Cai Carter", "account": "WK-10003", "balance": "310.75"})",
+    };
+    std::vector<const char *> data;
+    for (const auto &record : records)
+        data.push_back(record.c_str());
+
+    PDFprinter pdf;
+    pdf.set_param(dom.get_html(), "statement.pdf");
+    pdf.layout("A4", "portrait");
+    pdf.merge(data.data(), data.size());
+
+    return 0;
+}
@@ -5,10 +5,6 @@
 #include <wk2gtkpdf/ichtmltopdf++.h>
 #include <wk2gtkpdf/iclog.h>
 #include <wk2gtkpdf/pretty_html.h>
-#ifndef MAGICKCORE_HDRI_ENABLE
-#define MAGICKCORE_HDRI_ENABLE 1
-#endif
-#include <Magick++.h>
 
 using namespace std;
 using namespace phtml;
@@ -135,49 +131,19 @@ int main() {
     pdf.make_pdf();
 
     /**
-     * @brief pdfBLB
+     * @brief pdfGS
      *
-     * Post process with ImageMagick to make grayscale.
+     * The same page again with the greyscale post-print pass, colours
+     * and images become grey while text and vectors stay vectors.
      */
-    PDFprinter pdfBLB;
-
-    /**
-     * By not providing an output file we are implicitly
-     * telling PDFprinter we want a BLOB (Binary Large
-     * Object)
-     * */
-    pdfBLB.set_param(html);
-    pdfBLB.layout("A5", "portrait");
-    pdfBLB.make_pdf();
-
-    /**
-     * @brief binDat
-     *
-     * Get the PDF from PDFprinter
-     */
-    PDF_Blob binDat = pdfBLB.get_blob();
-
-    /**
-     * @brief blb
-     *
-     * Hand it to image magick
-     */
-    Magick::Blob blb(binDat.data, binDat.size);
-
-    /**
-     * @brief img
-     *
-     * Convert it to grayscale with image magick
-     */
-    Magick::Image img;
-    img.magick("PDF");
-    img.read(blb);
-    img.type(Magick::GrayscaleType);
-    img.write(std::filesystem::current_path().string() + "/output_gs.pdf");
+    PDFprinter pdfGS;
+    pdfGS.set_param(html, (std::filesystem::current_path().string() + "/output_gs.pdf").c_str());
+    pdfGS.layout("A5", "portrait");
+    pdfGS.post_process(PDF_PASS_GREYSCALE);
+    pdfGS.make_pdf();
 
     /**
      * Clean up.
      */
-    PDF_FreeBlob(binDat);
     PDF_FreeHTML(html);
 }
@@ -0,0 +1,118 @@
+/**
+ * base64_bench
+ *
+ * Times the image encoder of encode_image for 10 KB to 20 MB of random
+ * bytes, against the one it replaced (byte at a time, then a "\r\n"
+ * inserted every 72 characters) up to 1 MB; that one is quadratic and
+ * takes minutes beyond.  Every size is checked against the old output.
+ *
+ *   make && ./base64_bench
+ */
+#include "../../src/wk2gtkpdf/base64.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string legacy_encode(const unsigned char *bytes, size_t len, bool insertBreaks = true) {
+        std::string   ret;
+        int           i = 0;
+        unsigned char a3[3];
+        unsigned char a4[4];
+
+        while (len--) {
+            a3[i++] = *(bytes++);
+            if (i == 3) {
+                a4[0] = (a3[0] & 0xfc) >> 2;
+                a4[1] = static_cast<unsigned char>(((a3[0] & 0x03) << 4) + ((a3[1] & 0xf0) >> 4));
+                a4[2] = static_cast<unsigned char>(((a3[1] & 0x0f) << 2) + ((a3[2] & 0xc0) >> 6));
+                a4[3] = a3[2] & 0x3f;
+                for (i = 0; i < 4; i++)
+                    ret += table[a4[i]];
+                i = 0;
+            }
+        }
+        if (i) {
+            for (int j = i; j < 3; j++)
+                a3[j] = '\0';
+            a4[0] = (a3[0] & 0xfc) >> 2;
+            a4[1] = static_cast<unsigned char>(((a3[0] & 0x03) << 4) + ((a3[1] & 0xf0) >> 4));
+            a4[2] = static_cast<unsigned char>(((a3[1] & 0x0f) << 2) + ((a3[2] & 0xc0) >> 6));
+            for (int j = 0; j < i + 1; j++)
+                ret += table[a4[j]];
+            while (i++ < 3)
+                ret += '=';
+        }
+
+        if (!insertBreaks)
+            return ret;
+
+        for (unsigned k = 72; k < ret.size(); k += 72) {
+            ret.insert(k, "\r\n");
+            k += 2;
+        }
+        return ret;
+    }
+
+    // The expected text for any size, wrapped in linear time
+    std::string reference(const unsigned char *bytes, size_t len) {
+        std::string flat = legacy_encode(bytes, len, false);
+        std::string wrapped;
+        for (size_t k = 0; k < flat.size(); k += 72) {
+            if (k)
+                wrapped += "\r\n";
+            wrapped.append(flat, k, 72);
+        }
+        return wrapped;
+    }
+
+    template <typename F> double best_ms(F &&f, int runs) {
+        double best = 1e30;
+        for (int r = 0; r < runs; ++r) {
+            auto start = std::chrono::steady_clock::now();
+            f();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best      = ms < best ? ms : best;
+        }
+        return best;
+    }
+} // namespace
+
+int main() {
+    const size_t sizes[] = {10 << 10, 100 << 10, 1 << 20, 5 << 20, 20 << 20};
+
+    std::mt19937               rng(42);
+    std::vector<unsigned char> data(sizes[4] + 2);
+    for (auto &b : data)
+        b = static_cast<unsigned char>(rng());
+
+    std::printf("kernel: %s\n\n", phtml::base64_kernel());
+    std::printf("%10s %14s %14s %10s %12s\n", "bytes", "legacy ms", "new ms", "speed up", "new MB/s");
+
+    bool ok = true;
+    for (size_t size : sizes) {
+        // Odd lengths too, for the padding
+        for (size_t len : {size, size + 1, size + 2}) {
+            if (reference(data.data(), len) != phtml::base64_encode(data.data(), len, 72)) {
+                std::printf("MISMATCH at %zu bytes\n", len);
+                ok = false;
+            }
+        }
+
+        std::string sink;
+        double      newMs = best_ms([&] { sink = phtml::base64_encode(data.data(), size, 72); }, 10);
+        if (size > (1 << 20)) {
+            std::printf("%10zu %14s %14.3f %10s %12.0f\n", size, "-", newMs, "-", size / 1048576.0 / (newMs / 1000));
+            continue;
+        }
+        double oldMs = best_ms([&] { sink = legacy_encode(data.data(), size); }, 3);
+        std::printf("%10zu %14.3f %14.3f %9.1fx %12.0f\n", size, oldMs, newMs, oldMs / newMs, size / 1048576.0 / (newMs / 1000));
+    }
+
+    return ok ? 0 : 1;
+}
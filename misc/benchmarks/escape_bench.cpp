@@ -0,0 +1,107 @@
+/**
+ * escape_bench
+ *
+ * Times the escaping of set_node_content(..., true) against the one it
+ * replaced (a find / replace pass per entity) for 1 KB to 8 MB of plain
+ * prose and of markup heavy text, and checks both give the same text.
+ * The old escaper is quadratic in the number of escapes, it is only timed
+ * up to 1 MB.
+ *
+ *   make escape_bench && ./escape_bench
+ */
+#include "../../src/wk2gtkpdf/html_escape.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    std::string legacy_escape(std::string text) {
+        std::string subjectString(text);
+
+        struct FIND_REPLACE {
+                std::string search;
+                std::string replace;
+        };
+
+        std::vector<FIND_REPLACE> FRStrings{
+            {"&",  "&amp;" },
+            {"\"", "&quot;"},
+            {"'",  "&apos;"},
+            {"<",  "&lt;"  },
+            {">",  "&gt;"  },
+            {"/",  "&#x2F;"}
+        };
+
+        for (FIND_REPLACE &it : FRStrings) {
+            size_t start_pos = 0;
+            while ((start_pos = subjectString.find(it.search, start_pos)) != std::string::npos) {
+                subjectString.replace(start_pos, it.search.length(), it.replace);
+                start_pos += it.replace.length();
+            }
+        }
+        return subjectString;
+    }
+
+    // One character in @p every is special
+    std::string make_text(size_t size, unsigned every) {
+        const char   special[] = "&\"'<>/";
+        std::mt19937 rng(7);
+        std::string  text(size, ' ');
+        for (char &c : text) {
+            unsigned r = rng();
+            c          = r % every == 0 ? special[(r / every) % 6] : static_cast<char>('a' + (r >> 8) % 26);
+        }
+        return text;
+    }
+
+    template <typename F> double best_ms(F &&f, int runs) {
+        double best = 1e30;
+        for (int r = 0; r < runs; ++r) {
+            auto start = std::chrono::steady_clock::now();
+            f();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best      = ms < best ? ms : best;
+        }
+        return best;
+    }
+} // namespace
+
+int main() {
+    const size_t sizes[] = {1 << 10, 64 << 10, 1 << 20, 8 << 20};
+
+    std::printf("kernel: %s\n\n", phtml::html_escape_kernel());
+    std::printf("%-6s %10s %12s %12s %10s %10s\n", "text", "bytes", "legacy ms", "new ms", "speed up", "new MB/s");
+
+    bool ok = true;
+    for (unsigned every : {200u, 4u}) {
+        for (size_t size : sizes) {
+            std::string text = make_text(size, every);
+            std::string now  = phtml::html_escape(text.data(), text.size());
+
+            // The old escaper is too slow to check at 8 MB of markup
+            if (size <= (1 << 20) || every > 4) {
+                for (size_t len : {size, size - 5}) {
+                    if (legacy_escape(text.substr(0, len)) != phtml::html_escape(text.data(), len)) {
+                        std::printf("MISMATCH at %zu bytes\n", len);
+                        ok = false;
+                    }
+                }
+            }
+
+            std::string sink;
+            double      newMs = best_ms([&] { sink = phtml::html_escape(text.data(), text.size()); }, 10);
+            const char *shape = every > 4 ? "prose" : "markup";
+            if (size > (1 << 20)) {
+                std::printf("%-6s %10zu %12s %12.3f %10s %10.0f\n", shape, size, "-", newMs, "-", size / 1048576.0 / (newMs / 1000));
+                continue;
+            }
+            double oldMs = best_ms([&] { sink = legacy_escape(text); }, 3);
+            std::printf("%-6s %10zu %12.3f %12.3f %9.1fx %10.0f\n", shape, size, oldMs, newMs, oldMs / newMs, size / 1048576.0 / (newMs / 1000));
+        }
+    }
+
+    return ok ? 0 : 1;
+}
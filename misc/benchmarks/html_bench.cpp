@@ -0,0 +1,104 @@
+/**
+ * html_bench
+ *
+ * Times building, streaming to /dev/null, process_nodes() and freeing
+ * html_tree documents of 1 thousand to 1 million nodes, in two shapes:
+ * one table with a row of three cells per record (a wide parent) and the
+ * calibration pages of wkgtk-html2pdf (330 lines per page).  Each should
+ * take the same time per node at any size, and the stream must match
+ * get_html().  The size of the compact() page is shown next to it.
+ *
+ *   make html_bench && ./html_bench
+ */
+#include "../../src/wk2gtkpdf/pretty_html.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+using phtml::html_tree;
+
+namespace {
+    // 4 nodes per row
+    std::unique_ptr<html_tree> make_table(size_t nodes) {
+        auto       dom   = std::make_unique<html_tree>("html");
+        html_tree *table = dom->new_node("body")->new_node("table");
+        for (size_t row = 0; row < nodes / 4; ++row) {
+            html_tree *tr = table->new_node("tr");
+            tr->new_node_f("td class=\"sku\"")->set_node_content_f("SKU-%zu", row);
+            tr->new_node("td")->set_node_content("Product description");
+            tr->new_node("td class=\"price\"")->set_node_content_f("%zu.99", row % 1000);
+        }
+        return dom;
+    }
+
+    // 332 nodes per page, as the calibration document
+    std::unique_ptr<html_tree> make_pages(size_t nodes) {
+        auto       dom  = std::make_unique<html_tree>("html");
+        html_tree *body = dom->new_node("body");
+        for (size_t p = 0; p < nodes / 332 + 1; ++p) {
+            html_tree *page = body->new_node("div class=\"page\"")->new_node("div class=\"subpage\"");
+            for (int i = 0; i != 30; ++i) {
+                page->new_node_f("div class=\"grid-line\" style=\"top: %dmm\"", (i + 1) * 10)->set_node_content_f("%dmm", (i + 1) * 10);
+                for (int mm = 0; mm != 10; ++mm)
+                    page->new_node_f("div class=\"grid-line-mm\" style=\"top: %dmm\"", (i + 1) * 10 + (mm + 1));
+            }
+        }
+        return dom;
+    }
+
+    bool append(const char *data, size_t size, void *out) {
+        static_cast<std::string *>(out)->append(data, size);
+        return true;
+    }
+
+    bool count(const char *, size_t size, void *out) {
+        *static_cast<size_t *>(out) += size;
+        return true;
+    }
+
+    template <typename F> double ms(F &&f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+} // namespace
+
+int main() {
+    const size_t sizes[] = {1000, 10000, 100000, 1000000};
+
+    const int devNull = open("/dev/null", O_WRONLY);
+    bool      ok      = true;
+
+    std::printf("%-6s %10s %12s %14s %10s %10s %14s %10s\n", "shape", "nodes", "html bytes", "compact bytes", "build ms", "stream ms", "serialise ms", "free ms");
+    for (auto make : {make_table, make_pages}) {
+        for (size_t nodes : sizes) {
+            std::unique_ptr<html_tree> dom;
+            double                     build  = ms([&] { dom = make(nodes); });
+            double                     stream = ms([&] { phtml::process_nodes(dom.get(), devNull); });
+
+            std::string streamed;
+            phtml::process_nodes(dom.get(), append, &streamed);
+
+            size_t compact = 0;
+            dom->compact();
+            phtml::process_nodes(dom.get(), count, &compact);
+            dom->compact(false);
+
+            double serialise = ms([&] { phtml::process_nodes(dom.get()); });
+            size_t bytes     = std::strlen(dom->get_html());
+            ok               = ok && streamed == dom->get_html();
+            double teardown  = ms([&] { dom.reset(); });
+            std::printf("%-6s %10zu %12zu %14zu %10.3f %10.3f %14.3f %10.3f\n", make == make_table ? "table" : "pages", nodes, bytes, compact, build, stream, serialise, teardown);
+        }
+    }
+    close(devNull);
+
+    if (!ok)
+        std::printf("MISMATCH between the stream and get_html()\n");
+    return ok ? 0 : 1;
+}
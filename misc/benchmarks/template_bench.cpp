@@ -0,0 +1,142 @@
+/**
+ * template_bench
+ *
+ * A five page invoice made again and again with other values: built as a
+ * tree and processed each time, against an html_template compiled once
+ * and rendered with the values.  Both must give the same page.
+ *
+ *   make template_bench && ./template_bench
+ */
+#include "../../src/wk2gtkpdf/pretty_html.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using phtml::html_template;
+using phtml::html_tree;
+
+namespace {
+    const int pages = 5;
+    const int rows  = 40;
+
+    /**
+     * With @p values nullptr value i is the slot named i: the customer
+     * and invoice number (on every page), then the description, quantity
+     * and price of each row.
+     */
+    void make_invoice(html_tree &dom, const std::vector<std::string> *values) {
+        auto put = [&](html_tree *node, size_t value) {
+            if (values)
+                node->set_node_content((*values)[value].c_str(), false, true);
+            else
+                node->set_node_slot(std::to_string(value).c_str());
+        };
+
+        html_tree *head = dom.new_node("head");
+        head->new_node("meta charset=\"utf-8\"");
+        head->new_node("link rel=\"stylesheet\" href=\"/usr/share/wk2gtkpdf/A4-portrait-lite.css\"");
+        head->new_node("title")->set_node_content("Invoice");
+
+        html_tree *body = dom.new_node("body");
+        size_t     next = 2;
+        for (int p = 0; p != pages; ++p) {
+            html_tree *page   = body->new_node("div class=\"page\"")->new_node("div class=\"subpage\"");
+            html_tree *header = page->new_node("div class=\"header\"");
+            put(header->new_node("h2"), 0);
+            put(header->new_node("p class=\"number\""), 1);
+
+            html_tree *table = page->new_node("table class=\"lines\"");
+            html_tree *tr    = table->new_node("thead")->new_node("tr");
+            tr->new_node("th")->set_node_content("Description");
+            tr->new_node("th")->set_node_content("Quantity");
+            tr->new_node("th")->set_node_content("Price");
+
+            html_tree *tbody = table->new_node("tbody");
+            for (int r = 0; r != rows; ++r) {
+                tr = tbody->new_node("tr");
+                put(tr->new_node("td"), next++);
+                put(tr->new_node("td class=\"qty\""), next++);
+                put(tr->new_node("td class=\"price\""), next++);
+            }
+            page->new_node("div class=\"page-number\"")->set_node_content_f("Page %d of %d", p + 1, pages);
+        }
+    }
+
+    std::vector<std::string> make_values(int invoice) {
+        std::vector<std::string> values{"Customer " + std::to_string(invoice) + " & Sons", "INV-" + std::to_string(100000 + invoice)};
+        for (int i = 0; i != pages * rows; ++i) {
+            values.push_back("Item <" + std::to_string(i) + "> for customer " + std::to_string(invoice));
+            values.push_back(std::to_string(i % 7 + 1));
+            values.push_back(std::to_string(invoice + i) + ".99");
+        }
+        return values;
+    }
+
+    template <typename F> double us(F &&f, int runs) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i != runs; ++i)
+            f(i);
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / runs;
+    }
+} // namespace
+
+int main() {
+    const int runs = 2000;
+
+    std::vector<std::vector<std::string>> values;
+    for (int i = 0; i != 16; ++i)
+        values.push_back(make_values(i));
+
+    html_tree templateDom("html");
+    make_invoice(templateDom, nullptr);
+    html_template invoice(&templateDom);
+    double        compileUs = us([&](int) { html_template again(&templateDom); }, 100);
+
+    std::vector<const char *> args(invoice.slot_count());
+    auto                      bind = [&](const std::vector<std::string> &v) {
+        for (size_t i = 0; i != args.size(); ++i)
+            args[i] = v[std::stoul(invoice.slot_name(i))].c_str();
+    };
+
+    bool ok = true;
+    for (const auto &v : values) {
+        html_tree dom("html");
+        make_invoice(dom, &v);
+        phtml::process_nodes(&dom);
+        bind(v);
+        char *html = invoice.render(args.data());
+        ok         = ok && std::strcmp(html, dom.get_html()) == 0;
+        PDF_FreeHTML(html);
+    }
+
+    size_t bytes   = 0;
+    double buildUs = us([&](int i) {
+        html_tree dom("html");
+        make_invoice(dom, &values[i % values.size()]);
+        phtml::process_nodes(&dom);
+        bytes = std::strlen(dom.get_html());
+    }, runs);
+
+    std::vector<std::vector<const char *>> bound;
+    for (const auto &v : values) {
+        bind(v);
+        bound.push_back(args);
+    }
+    double renderUs = us([&](int i) {
+        char *html = invoice.render(bound[i % bound.size()].data());
+        PDF_FreeHTML(html);
+    }, runs);
+
+    std::printf("%d page invoice, %zu slots, %zu bytes of html\n\n", pages, invoice.slot_count(), bytes);
+    std::printf("compile once          %10.1f us\n", compileUs);
+    std::printf("tree + process_nodes  %10.1f us\n", buildUs);
+    std::printf("template render       %10.1f us  (%.1fx)\n", renderUs, buildUs / renderUs);
+
+    if (!ok)
+        std::printf("MISMATCH between the template and the tree\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+/**
+ * image_swap_test
+ *
+ * Builds the script that swaps downscaled images into the page from data
+ * URIs encoded the way encode_image does it (base64 over 72 character
+ * lines) and runs it with node against a stand-in document: it must
+ * parse, swap every usable URI in whole and leave out the rest.
+ * Skipped when node is not installed.
+ *
+ *   make image_swap_test && ./image_swap_test
+ */
+#include "../../src/wk2gtkpdf/base64.h"
+#include "../../src/wk2gtkpdf/image_swap.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const char *what) {
+        if (!ok) {
+            std::printf("FAIL %s\n", what);
+            ++failures;
+        }
+    }
+
+    std::string uri(const char *mime, size_t bytes) {
+        std::vector<unsigned char> data(bytes);
+        for (size_t i = 0; i < bytes; ++i)
+            data[i] = static_cast<unsigned char>(i * 7 + 3);
+        return "\"data:" + std::string(mime) + ";base64," + phtml::base64_encode(data.data(), data.size(), 72) + "\"";
+    }
+
+    std::string run(const char *command) {
+        std::string out;
+        FILE       *pipe = popen(command, "r");
+        if (!pipe)
+            return out;
+        char buf[256];
+        while (fgets(buf, sizeof(buf), pipe))
+            out += buf;
+        pclose(pipe);
+        return out;
+    }
+} // namespace
+
+int main() {
+    if (std::system("node --version > /dev/null 2>&1") != 0) {
+        std::printf("image_swap: node not found, skipped\n");
+        return 0;
+    }
+
+    // 54 bytes is the last size that fits on one line
+    const size_t             sizes[] = {1, 54, 55, 1000, 200000};
+    std::vector<std::string> uris;
+    for (size_t size : sizes)
+        uris.push_back(uri("image/jpeg", size));
+    uris.push_back("\"data:image/png;base64,\"");     // unreadable file
+    uris.push_back(uri("", 1000));                     // unknown extension
+
+    std::vector<phtml::image_swap> swaps;
+    std::string                    expected;
+    for (size_t i = 0; i < uris.size(); ++i) {
+        swaps.push_back({"[" + std::to_string(i) + "]", uris[i]});
+        if (i < std::size(sizes))
+            expected += " " + std::to_string(std::string("data:image/jpeg;base64,").size() + phtml::base64_size(sizes[i]));
+        else
+            expected += " 0";
+    }
+
+    const std::string script = phtml::image_swap_script(swaps);
+    check(script.find('\n') == std::string::npos && script.find('\r') == std::string::npos, "no line breaks in the script");
+
+    // webkit_web_view_call_async_javascript_function() runs it as the body of an async function
+    const char   *path = "image_swap_test.js";
+    std::ofstream js(path);
+    js << "const document = { images: Array.from({ length: " << uris.size() << " }, () => ({ "
+       << "src: '', removeAttribute() {}, decode() { return Promise.resolve(); } })) };\n"
+       << "(async function () { " << script << " })().then(n => console.log(n + document.images.map(i => ' ' + i.src.length).join('')));\n";
+    js.close();
+
+    check(run("node --check image_swap_test.js 2>&1").empty(), "the script parses");
+    std::string out = run("node image_swap_test.js 2>&1");
+    check(out == std::to_string(std::size(sizes)) + expected + "\n", "every usable image is swapped in whole");
+    if (out != std::to_string(std::size(sizes)) + expected + "\n")
+        std::printf("  got: %s", out.c_str());
+    std::remove(path);
+
+    if (failures) {
+        std::printf("%d failed\n", failures);
+        return 1;
+    }
+    std::printf("image_swap: all passed\n");
+    return 0;
+}
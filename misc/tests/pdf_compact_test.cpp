@@ -0,0 +1,444 @@
+/**
+ * pdf_compact_test
+ *
+ * Round trips small generated documents through every pdf_compact pass
+ * and reads the results back with pdf_compact itself: page order, the
+ * outline chain of merged files, overlaid pages, where the metadata is,
+ * and that damaged input is refused rather than crashing.  Built with
+ * ASan and UBSan by default.
+ *
+ *   make pdf_compact_test && ./pdf_compact_test
+ */
+#include "../../src/wk2gtkpdf/pdf_compact.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const char *what) {
+        if (!ok) {
+            std::printf("FAIL %s\n", what);
+            ++failures;
+        }
+    }
+
+    /*
+     * A document with a classic cross-reference table, laid out the way
+     * cairo does it: catalog, an inherited /MediaBox on the page tree,
+     * one uncompressed content stream per page naming the page, a shared
+     * font, top level bookmarks and document information.  With @p links
+     * each page links to the next, the last to the first, alternating
+     * between /Dest and a /GoTo action.
+     */
+    std::string make_pdf(const char *name, unsigned pages, unsigned bookmarks, bool links = false) {
+        std::vector<std::string> objects(4);
+        const unsigned           font      = 4;
+        const unsigned           firstPage = 5; // page, contents, page, contents ...
+        const unsigned           firstItem = firstPage + pages * 2;
+        const unsigned           firstLink = firstItem + bookmarks;
+        const unsigned           info      = firstLink + (links ? pages : 0);
+
+        objects[1] = "<< /Type /Catalog /Pages 2 0 R" + std::string(bookmarks ? " /Outlines 3 0 R" : "") + " >>";
+        std::string kids;
+        for (unsigned p = 0; p < pages; ++p)
+            kids += std::to_string(firstPage + p * 2) + " 0 R ";
+        objects[2] = "<< /Type /Pages /Kids [ " + kids + "] /Count " + std::to_string(pages) + " /MediaBox [ 0 0 595 842 ] >>";
+        objects[3] = "<< /Type /Outlines";
+        if (bookmarks)
+            objects[3] += " /First " + std::to_string(firstItem) + " 0 R /Last " + std::to_string(firstItem + bookmarks - 1) + " 0 R /Count " + std::to_string(bookmarks);
+        objects[3] += " >>";
+        objects.push_back("<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>");
+
+        for (unsigned p = 0; p < pages; ++p) {
+            std::string text = "BT /F1 12 Tf 72 720 Td (" + std::string(name) + "-p" + std::to_string(p + 1) + ") Tj ET";
+            std::string annots = links ? " /Annots [ " + std::to_string(firstLink + p) + " 0 R ]" : "";
+            objects.push_back("<< /Type /Page /Parent 2 0 R /Resources << /Font << /F1 " + std::to_string(font) + " 0 R >> >> /Contents " + std::to_string(firstPage + p * 2 + 1) + " 0 R" + annots + " >>");
+            objects.push_back("<< /Length " + std::to_string(text.size()) + " >>\nstream\n" + text + "\nendstream");
+        }
+
+        for (unsigned b = 0; b < bookmarks; ++b) {
+            std::string item = "<< /Title (" + std::string(name) + std::to_string(b + 1) + ") /Parent 3 0 R /Dest [ " + std::to_string(firstPage + (b % pages) * 2) + " 0 R /XYZ 0 842 0 ]";
+            if (b)
+                item += " /Prev " + std::to_string(firstItem + b - 1) + " 0 R";
+            if (b + 1 < bookmarks)
+                item += " /Next " + std::to_string(firstItem + b + 1) + " 0 R";
+            objects.push_back(item + " >>");
+        }
+        for (unsigned p = 0; links && p < pages; ++p) {
+            std::string dest = "[ " + std::to_string(firstPage + (p + 1) % pages * 2) + " 0 R /XYZ 0 842 0 ]";
+            objects.push_back("<< /Type /Annot /Subtype /Link /Rect [ 72 700 200 720 ] " + (p % 2 ? "/A << /S /GoTo /D " + dest + " >>" : "/Dest " + dest) + " >>");
+        }
+        objects.push_back("<< /Producer (pdf_compact_test) /Title (" + std::string(name) + ") /CreationDate (D:20240102030405Z) /ModDate (D:20240102030405Z) >>");
+
+        std::string         pdf = "%PDF-1.4\n%\xE2\xE3\xCF\xD3\n";
+        std::vector<size_t> offsets(objects.size(), 0);
+        for (size_t num = 1; num < objects.size(); ++num) {
+            offsets[num] = pdf.size();
+            pdf += std::to_string(num) + " 0 obj\n" + objects[num] + "\nendobj\n";
+        }
+        size_t xref = pdf.size();
+        pdf += "xref\n0 " + std::to_string(objects.size()) + "\n0000000000 65535 f \n";
+        for (size_t num = 1; num < objects.size(); ++num) {
+            char line[24];
+            std::snprintf(line, sizeof(line), "%010zu 00000 n \n", offsets[num]);
+            pdf += line;
+        }
+        pdf += "trailer\n<< /Size " + std::to_string(objects.size()) + " /Root 1 0 R /Info " + std::to_string(info) + " 0 R /ID [ <0123456789abcdef> <0123456789abcdef> ] >>\nstartxref\n" + std::to_string(xref) + "\n%%EOF\n";
+        return pdf;
+    }
+
+    /*
+     * The page names of @p pdf in page order, read by splitting it into
+     * single pages.  Empty if pdf_compact can not read it.
+     */
+    std::vector<std::string> page_names(const std::string &pdf) {
+        std::vector<size_t> firstPages;
+        for (size_t p = 1; p < 64; ++p)
+            firstPages.push_back(p);
+
+        std::vector<std::string> names;
+        pdf_compact              splitter;
+        splitter.split(pdf, firstPages, [&names](size_t, std::string &part) {
+            size_t b = part.find(") Tj");
+            size_t a = part.rfind('(', b);
+            names.push_back(b == std::string::npos || a == std::string::npos ? std::string("?") : part.substr(a + 1, b - a - 1));
+        });
+        return names;
+    }
+
+    std::vector<std::string> expected(const char *name, unsigned pages) {
+        std::vector<std::string> names;
+        for (unsigned p = 0; p < pages; ++p)
+            names.push_back(name + std::string("-p") + std::to_string(p + 1));
+        return names;
+    }
+
+    std::vector<std::string> operator+(std::vector<std::string> a, const std::vector<std::string> &b) {
+        a.insert(a.end(), b.begin(), b.end());
+        return a;
+    }
+
+    /*
+     * The body of object @p num in a file with a classic cross-reference
+     * table, as merge(), splice() and split() write them.
+     */
+    std::string object(const std::string &pdf, unsigned num) {
+        std::string head = "\n" + std::to_string(num) + " 0 obj\n";
+        size_t      b    = pdf.find(head);
+        if (b == std::string::npos)
+            return std::string();
+        b       += head.size();
+        size_t e = pdf.find("\nendobj", b);
+        return pdf.substr(b, e - b);
+    }
+
+    unsigned ref(const std::string &body, const char *key) {
+        size_t at = body.find(std::string(key) + " ");
+        return at == std::string::npos ? 0 : static_cast<unsigned>(std::strtoul(body.c_str() + at + std::strlen(key) + 1, nullptr, 10));
+    }
+
+    long number(const std::string &body, const char *key) {
+        size_t at = body.find(std::string(key) + " ");
+        return at == std::string::npos ? -1 : std::strtol(body.c_str() + at + std::strlen(key) + 1, nullptr, 10);
+    }
+
+    /*
+     * Walks the top level bookmarks from the catalog, checking /Prev
+     * against the walk and /Last and /Count against the outline root.
+     */
+    std::vector<std::string> bookmarks(const std::string &pdf) {
+        std::vector<std::string> titles;
+        std::string              outlines = object(pdf, ref(object(pdf, 1), "/Outlines"));
+        unsigned                 prev     = 0;
+        for (unsigned item = ref(outlines, "/First"); item && titles.size() < 100; item = ref(object(pdf, item), "/Next")) {
+            std::string body = object(pdf, item);
+            size_t      b    = body.find("/Title (");
+            size_t      e    = body.find(')', b);
+            titles.push_back(b == std::string::npos ? std::string("?") : body.substr(b + 8, e - b - 8));
+            if (ref(body, "/Prev") != prev)
+                titles.push_back("(bad /Prev)");
+            prev = item;
+        }
+        if (ref(outlines, "/Last") != prev)
+            titles.push_back("(bad /Last)");
+        if (number(outlines, "/Count") != static_cast<long>(titles.size()))
+            titles.push_back("(bad /Count)");
+        return titles;
+    }
+
+    std::string append_all(const std::vector<std::string> &pdfs) {
+        std::string out;
+        pdf_compact joiner;
+        auto        sink = [&out](const std::string &data) { out += data; };
+        for (const std::string &pdf : pdfs) {
+            if (!joiner.append(pdf, sink))
+                return std::string();
+        }
+        joiner.finish(sink);
+        return out;
+    }
+
+    void test_pack() {
+        const std::string pdf = make_pdf("A", 5, 2);
+
+        std::string packed = pdf;
+        check(pdf_compact().pack_objects(packed), "pack_objects");
+        check(packed.find("/Type /ObjStm") != std::string::npos, "pack_objects writes object streams");
+        check(packed.find("/Type /XRef") != std::string::npos, "pack_objects writes a cross-reference stream");
+        check(page_names(packed) == expected("A", 5), "pack_objects keeps the pages");
+
+        // Reading object and cross-reference streams back
+        std::string again = packed;
+        check(pdf_compact().pack_objects(again), "pack_objects of a packed file");
+        check(page_names(again) == expected("A", 5), "pack_objects of a packed file keeps the pages");
+
+        std::string linear = pdf;
+        check(pdf_compact().linearise(linear), "linearise");
+        check(linear.find("/Linearized") < 1024, "linearise writes the parameter dictionary first");
+        check(page_names(linear) == expected("A", 5), "linearise keeps the pages");
+
+        std::string relinear = packed;
+        check(pdf_compact().linearise(relinear), "linearise of a packed file");
+        check(page_names(relinear) == expected("A", 5), "linearise of a packed file keeps the pages");
+
+        pdf_compact reused;
+        std::string first = make_pdf("B", 2, 0), second = pdf;
+        check(reused.pack_objects(first) && reused.pack_objects(second), "pack_objects twice on one instance");
+        check(page_names(second) == expected("A", 5), "a second pack_objects does not see the first document");
+    }
+
+    void test_split() {
+        const std::string        pdf = make_pdf("A", 7, 0);
+        std::vector<std::string> parts;
+        check(pdf_compact().split(pdf, {3, 5}, [&parts](size_t, std::string &data) { parts.push_back(data); }), "split");
+        check(parts.size() == 3, "split into three parts");
+        if (parts.size() == 3) {
+            check(page_names(parts[0]) == std::vector<std::string>{"A-p1", "A-p2", "A-p3"}, "split part 1");
+            check(page_names(parts[1]) == std::vector<std::string>{"A-p4", "A-p5"}, "split part 2");
+            check(page_names(parts[2]) == std::vector<std::string>{"A-p6", "A-p7"}, "split part 3");
+        }
+
+        // Links within a part stay, links out of it go
+        parts.clear();
+        check(pdf_compact().split(make_pdf("L", 4, 0, true), {2}, [&parts](size_t, std::string &data) { parts.push_back(data); }), "split with links");
+        check(parts.size() == 2, "split with links into two parts");
+        for (const std::string &part : parts) {
+            size_t links = 0;
+            for (size_t at = part.find("/Subtype /Link"); at != std::string::npos; at = part.find("/Subtype /Link", at + 1))
+                ++links;
+            check(links == 1, "split keeps only the link within the part");
+            check(part.find("null") == std::string::npos, "split writes no null references");
+            check(page_names(part).size() == 2, "split with links keeps the pages");
+        }
+
+        parts.clear();
+        check(pdf_compact().split(pdf, {0, 9, 2, 2}, [&parts](size_t, std::string &data) { parts.push_back(data); }), "split with out of range and repeated starts");
+        check(parts.size() == 2, "split ignores out of range and repeated starts");
+    }
+
+    void test_merge() {
+        const std::string a = make_pdf("A", 2, 3), b = make_pdf("B", 3, 3), c = make_pdf("C", 1, 3);
+        const auto        pages  = expected("A", 2) + expected("B", 3) + expected("C", 1);
+        const auto        titles = std::vector<std::string>{"A1", "A2", "A3", "B1", "B2", "B3", "C1", "C2", "C3"};
+
+        std::string merged;
+        check(pdf_compact().merge({a, b, c}, merged), "merge");
+        check(page_names(merged) == pages, "merge keeps the pages in order");
+        check(bookmarks(merged) == titles, "merge joins the outlines");
+
+        std::string appended = append_all({a, b, c});
+        check(page_names(appended) == pages, "append keeps the pages in order");
+        check(bookmarks(appended) == titles, "append joins the outlines");
+
+        // An input without bookmarks between two with
+        check(pdf_compact().merge({a, make_pdf("X", 1, 0), c}, merged), "merge with an input without bookmarks");
+        check(bookmarks(merged) == std::vector<std::string>{"A1", "A2", "A3", "C1", "C2", "C3"}, "merge skips an input without bookmarks");
+
+        std::string packed = b;
+        pdf_compact().pack_objects(packed);
+        check(pdf_compact().merge({a, packed}, merged), "merge a packed file");
+        check(page_names(merged) == expected("A", 2) + expected("B", 3), "merge a packed file keeps the pages");
+    }
+
+    void test_splice() {
+        const std::string   pdf = make_pdf("A", 4, 1), x = make_pdf("X", 3, 0), y = make_pdf("Y", 1, 0);
+        std::string         out;
+        std::vector<size_t> pageMap;
+        check(pdf_compact().splice(pdf, {{2, &y}, {1, &x}}, out, &pageMap), "splice");
+        check(page_names(out) == std::vector<std::string>{"A-p1", "X-p1", "X-p2", "X-p3", "Y-p1", "A-p4"}, "splice replaces the placeholders");
+        check(pageMap == std::vector<size_t>{0, 1, 4, 5}, "splice page map");
+        check(bookmarks(out) == std::vector<std::string>{"A1"}, "splice keeps the outline of the document");
+    }
+
+    /*
+     * The decoded stream of the form XObject drawn on @p page by
+     * overlay(), empty if there is none.
+     */
+    std::string stamp_of(const std::string &pdf, unsigned page) {
+        std::string body  = object(pdf, page);
+        size_t      at    = body.find("/wk2gtkpdfStamp");
+        at                = body.find(' ', at);
+        std::string form  = at == std::string::npos ? std::string() : object(pdf, static_cast<unsigned>(std::strtoul(body.c_str() + at, nullptr, 10)));
+        size_t      start = form.find(">>\nstream\n");
+        long        len   = number(form, "/Length");
+        if (form.find("/Subtype /Form") == std::string::npos || start == std::string::npos || len < 0)
+            return std::string();
+
+        std::string data(65536, '\0');
+        uLongf      size = data.size();
+        if (uncompress(reinterpret_cast<Bytef *>(data.data()), &size, reinterpret_cast<const Bytef *>(form.data() + start + 10), len) != Z_OK)
+            return std::string();
+        data.resize(size);
+        return data;
+    }
+
+    void test_overlay() {
+        const std::string base = make_pdf("A", 3, 2), over = make_pdf("S", 2, 0);
+
+        pdf_compact stamper;
+        check(stamper.open_base(base), "open_base");
+        check(stamper.base_pages() == 3, "base_pages");
+        double box[4] = {};
+        check(stamper.base_media_box(1, box) && box[0] == 0 && box[1] == 0 && box[2] == 595 && box[3] == 842, "base_media_box reads the inherited /MediaBox");
+        check(!stamper.base_media_box(3, box), "base_media_box of a missing page");
+
+        // Pages 1 and 3 are objects 5 and 9
+        std::string out;
+        check(stamper.overlay(over, {0, 2}, out), "overlay");
+        check(page_names(out) == expected("A", 3), "overlay keeps the pages");
+        check(bookmarks(out) == std::vector<std::string>{"A1", "A2"}, "overlay keeps the outline");
+        check(stamp_of(out, 5).find("(S-p1) Tj") != std::string::npos, "overlay draws its first page on page 1");
+        check(stamp_of(out, 9).find("(S-p2) Tj") != std::string::npos, "overlay draws its second page on page 3");
+        check(object(out, 7).find("/wk2gtkpdfStamp") == std::string::npos, "overlay leaves page 2 alone");
+        check(object(out, 5).find("/Contents [ ") != std::string::npos && object(out, 5).find(" 6 0 R ") != std::string::npos, "overlay keeps the page contents");
+
+        // The base is read once, each copy starts from it
+        std::string second;
+        check(stamper.overlay(over, {1, 0}, second), "overlay a second copy");
+        check(stamp_of(second, 7).find("(S-p1) Tj") != std::string::npos && stamp_of(second, 9).empty(), "a second copy does not see the first");
+
+        // Stamping a stamped file uses a new name for the form
+        pdf_compact again;
+        std::string twice;
+        check(again.open_base(out) && again.overlay(make_pdf("T", 1, 0), {0}, twice), "overlay a stamped file");
+        check(object(twice, 5).find("/wk2gtkpdfStamp1 ") != std::string::npos, "overlay keeps the earlier stamp");
+        check(page_names(twice) == expected("A", 3), "overlay a stamped file keeps the pages");
+
+        std::string copy;
+        check(stamper.overlay(std::string(), {}, copy) && page_names(copy) == expected("A", 3), "overlay with no pages copies the base");
+        check(!stamper.overlay(over, {0}, copy), "overlay refuses a page count mismatch");
+        check(!stamper.overlay(over, {0, 3}, copy), "overlay refuses a missing base page");
+        check(!pdf_compact().overlay(over, {0, 1}, copy), "overlay refuses without a base");
+    }
+
+    void test_metadata() {
+        // The names look like metadata, in the content streams and the /Title
+        const std::string                      pdf = make_pdf("/ID [<AB>] /ModDate (D:1)", 2, 0);
+        std::vector<std::pair<size_t, size_t>> dates, ids;
+        auto                                   text = [](const std::string &pdf, const std::pair<size_t, size_t> &at) {
+            return pdf.substr(at.first, at.second - at.first);
+        };
+
+        check(pdf_compact().metadata(pdf, dates, ids), "metadata");
+        check(ids.size() == 1 && text(pdf, ids[0]) == "[ <0123456789abcdef> <0123456789abcdef> ]", "metadata finds the trailer /ID");
+        check(dates.size() == 2, "metadata finds both dates");
+        for (const auto &date : dates)
+            check(text(pdf, date) == "(D:20240102030405Z)", "metadata finds the dates of the information dictionary");
+
+        std::string packed = pdf;
+        pdf_compact().pack_objects(packed);
+        check(pdf_compact().metadata(packed, dates, ids), "metadata of a packed file");
+        check(ids.size() == 1 && text(packed, ids[0]).compare(0, 3, "[ <") == 0, "metadata finds the /ID of a cross-reference stream");
+        check(dates.empty(), "metadata leaves dates in an object stream alone");
+
+        check(!pdf_compact().metadata(pdf.substr(0, pdf.size() / 2), dates, ids), "metadata refuses a truncated file");
+    }
+
+    /*
+     * Truncated files and flipped bytes must be refused or read, never
+     * read out of bounds.
+     */
+    void test_damaged() {
+        const std::string good = make_pdf("A", 3, 2);
+        std::string       packed = good, linear = good;
+        pdf_compact().pack_objects(packed);
+        pdf_compact().linearise(linear);
+
+        auto run = [&good](const std::string &bad) {
+            std::string copy = bad;
+            pdf_compact().pack_objects(copy);
+            copy = bad;
+            pdf_compact().linearise(copy);
+            pdf_compact().split(bad, {1}, [](size_t, std::string &) {});
+            std::string out;
+            pdf_compact().merge({good, bad}, out);
+            pdf_compact().splice(good, {{1, &bad}}, out);
+            pdf_compact joiner;
+            joiner.append(bad, [](const std::string &) {});
+            joiner.finish([](const std::string &) {});
+            pdf_compact stamper;
+            if (stamper.open_base(good))
+                stamper.overlay(bad, {0}, out);
+            if (stamper.open_base(bad))
+                stamper.overlay(good, {0, stamper.base_pages() - 1, 0}, out);
+            std::vector<std::pair<size_t, size_t>> dates, ids;
+            pdf_compact().metadata(bad, dates, ids);
+        };
+
+        unsigned long seed = 12345;
+        auto          rnd  = [&seed]() {
+            seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+            return static_cast<size_t>(seed >> 33);
+        };
+
+        for (const std::string *pdf : {&good, static_cast<const std::string *>(&packed), static_cast<const std::string *>(&linear)}) {
+            for (size_t len = 0; len < pdf->size(); len += 1 + len / 16)
+                run(pdf->substr(0, len));
+            for (int i = 0; i < 400; ++i) {
+                std::string bad = *pdf;
+                bad[rnd() % bad.size()] = static_cast<char>(rnd());
+                run(bad);
+            }
+            // Damage where the parser looks first
+            for (size_t at = pdf->rfind("startxref"); at < pdf->size(); ++at) {
+                std::string bad = *pdf;
+                bad[at]         = '9';
+                run(bad);
+            }
+        }
+
+        const std::string noObjects = "%PDF-1.4\nxref\n0 0\ntrailer\n<< /Size 0 >>\nstartxref\n9\n%%EOF\n";
+        std::string       copy      = noObjects;
+        check(!pdf_compact().split(noObjects, {}, [](size_t, std::string &) {}), "split refuses a file without objects");
+        pdf_compact().pack_objects(copy);
+
+        std::string pastEnd = good;
+        pastEnd.replace(pastEnd.find(" 00000 n \n", pastEnd.find("xref")) - 10, 10, "9999999999");
+        copy = pastEnd;
+        check(!pdf_compact().pack_objects(copy), "pack_objects refuses an offset past the end");
+        check(copy == pastEnd, "pack_objects leaves a refused file untouched");
+    }
+} // namespace
+
+int main() {
+    test_pack();
+    test_split();
+    test_merge();
+    test_splice();
+    test_overlay();
+    test_metadata();
+    test_damaged();
+
+    if (failures) {
+        std::printf("%d failed\n", failures);
+        return 1;
+    }
+    std::printf("pdf_compact: all passed\n");
+    return 0;
+}
@@ -2,8 +2,11 @@
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <iterator>
+#include <sstream>
 #include <systemd/sd-journal.h>
 #include <unistd.h>
+#include <vector>
 #include <wk2gtkpdf/ichtmltopdf++.h>
 #include <wk2gtkpdf/iclog.h>
 #include <wk2gtkpdf/pretty_html.h>
@@ -178,7 +181,6 @@ void calibrate_ansi_a(html_tree *dom) {
         page->new_node("div class=\"page-number\"")
             ->set_node_content_f("Page %d | ANSI A Calibration | %s", p + 1, get_calibration_datestamp().c_str());
     }
-    process_nodes(dom);
 }
 
 void calibrate(html_tree *dom) {
@@ -199,8 +201,6 @@ void calibrate(html_tree *dom) {
         }
         page->new_node("div class=\"page-number\"")->set_node_content_f("page %d - Calibration timestamp %s", p + 1, get_calibration_datestamp().c_str());
     }
-
-    process_nodes(dom);
 }
 
 void help() {
@@ -217,6 +217,24 @@ void help() {
     printf("*        --index                      create anchor points                *\n");
     printf("*                                       \"classic\" or \"enhanced\"           *\n");
     printf("*    -r  --relative-uri               look for assets in current folder   *\n");
+    printf("*        --optimise                   post-process the PDF (comma list)   *\n");
+    printf("*                                       \"compact\"   object streams        *\n");
+    printf("*                                       \"linearise\" fast web view         *\n");
+    printf("*                                       \"dedupe\"    merge repeated images *\n");
+    printf("*                                       \"recompress\" parallel deflate     *\n");
+    printf("*                                       \"greyscale\"  grey, text kept      *\n");
+    printf("*        --compression N              deflate level for recompress %-7s*\n", ("(0-" + std::to_string(PDFprinter::max_compression_level()) + ")").c_str());
+    printf("*        --split                      one PDF per data-split page group   *\n");
+    printf("*        --insert-pdf KEY=FILE        fill data-cached-pages=\"KEY\" pages  *\n");
+    printf("*        --chunks N                   print N pieces at once (0 = cores)  *\n");
+    printf("*        --pages RANGES               only these pages, e.g. \"1-3,40-45\"  *\n");
+    printf("*        --raster FORMAT              page images, \"png\" or \"jpeg\"        *\n");
+    printf("*        --dpi N                      image resolution (Default 96)       *\n");
+    printf("*        --window N                   print N pages at a time, in turn    *\n");
+    printf("*        --deterministic              fixed dates and ID, same bytes      *\n");
+    printf("*        --cache-dir DIR              reuse identical renders kept here   *\n");
+    printf("*        --image-dpi N                downscale local images to N DPI     *\n");
+    printf("*        --image-quality N            JPEG quality for them (0 = PNG)     *\n");
     printf("*        --version                    show the version                    *\n");
     printf("*                                                                         *\n");
     printf("*        --calibrate                  ISOgenerate a self test pdf         *\n");
@@ -247,25 +265,65 @@ int main(int argc, char *argv[]) {
     string     pageSize    = "A4";
     index_mode idxMode     = index_mode::OFF;
     string     baseURI     = "file:///";
+    unsigned   passes      = PDF_PASS_NONE;
+    int        level       = 9;
+    bool       doSplit     = false;
+    unsigned   chunks      = 1;
+    unsigned   window      = 0;
+    string     pageRanges;
+    string     rasterFormat;
+    double     dpi         = 96;
+    bool       fixed       = false;
+    string     cacheDir;
+    unsigned   imageDpi    = 0;
+    int        imgQuality  = 85;
+
+    std::vector<std::pair<string, string>> inserts;
 
     typedef enum {
         DO_INDEX = 256,
         OPT_VERSION,
-        OPT_CALIBRATE
+        OPT_CALIBRATE,
+        OPT_OPTIMISE,
+        OPT_COMPRESSION,
+        OPT_SPLIT,
+        OPT_INSERT_PDF,
+        OPT_CHUNKS,
+        OPT_WINDOW,
+        OPT_PAGES,
+        OPT_RASTER,
+        OPT_DPI,
+        OPT_DETERMINISTIC,
+        OPT_CACHE_DIR,
+        OPT_IMAGE_DPI,
+        OPT_IMAGE_QUALITY
 
     } longopt;
     static struct option long_options[] = {
-        {"help",         no_argument,       0, 'h'                   },
-        {"infile",       required_argument, 0, 'i'                   },
-        {"outfile",      required_argument, 0, 'o'                   },
-        {"orientation",  required_argument, 0, 'O'                   },
-        {"relative-uri", no_argument,       0, 'r'                   },
-        {"size",         required_argument, 0, 's'                   },
-        {"verbose",      required_argument, 0, 'v'                   },
-        {"index",        required_argument, 0, longopt::DO_INDEX     },
-        {"version",      no_argument,       0, longopt::OPT_VERSION  },
-        {"calibrate",    required_argument, 0, longopt::OPT_CALIBRATE},
-        {NULL,           0,                 0, 0                     }
+        {"help",          no_argument,       0, 'h'                       },
+        {"infile",        required_argument, 0, 'i'                       },
+        {"outfile",       required_argument, 0, 'o'                       },
+        {"orientation",   required_argument, 0, 'O'                       },
+        {"relative-uri",  no_argument,       0, 'r'                       },
+        {"size",          required_argument, 0, 's'                       },
+        {"verbose",       required_argument, 0, 'v'                       },
+        {"index",         required_argument, 0, longopt::DO_INDEX         },
+        {"version",       no_argument,       0, longopt::OPT_VERSION      },
+        {"calibrate",     required_argument, 0, longopt::OPT_CALIBRATE    },
+        {"optimise",      required_argument, 0, longopt::OPT_OPTIMISE     },
+        {"compression",   required_argument, 0, longopt::OPT_COMPRESSION  },
+        {"split",         no_argument,       0, longopt::OPT_SPLIT        },
+        {"insert-pdf",    required_argument, 0, longopt::OPT_INSERT_PDF   },
+        {"chunks",        required_argument, 0, longopt::OPT_CHUNKS       },
+        {"window",        required_argument, 0, longopt::OPT_WINDOW       },
+        {"pages",         required_argument, 0, longopt::OPT_PAGES        },
+        {"raster",        required_argument, 0, longopt::OPT_RASTER       },
+        {"dpi",           required_argument, 0, longopt::OPT_DPI          },
+        {"deterministic", no_argument,       0, longopt::OPT_DETERMINISTIC},
+        {"cache-dir",     required_argument, 0, longopt::OPT_CACHE_DIR    },
+        {"image-dpi",     required_argument, 0, longopt::OPT_IMAGE_DPI    },
+        {"image-quality", required_argument, 0, longopt::OPT_IMAGE_QUALITY},
+        {NULL,            0,                 0, 0                         }
     };
     int  value        = 0;
     int  option_index = 0;
@@ -344,6 +402,94 @@ int main(int argc, char *argv[]) {
                 doCalibrate = true;
                 break;
             }
+            case longopt::OPT_OPTIMISE: { /**< Comma separated list of post-print passes */
+                std::stringstream list(optarg);
+                string            pass;
+                while (std::getline(list, pass, ',')) {
+                    if (pass.compare("compact") == 0)
+                        passes |= PDF_PASS_OPTIMISE;
+                    else if (pass.compare("linearise") == 0 || pass.compare("linearize") == 0)
+                        passes |= PDF_PASS_LINEARISE;
+                    else if (pass.compare("dedupe") == 0)
+                        passes |= PDF_PASS_DEDUPLICATE;
+                    else if (pass.compare("recompress") == 0)
+                        passes |= PDF_PASS_RECOMPRESS;
+                    else if (pass.compare("greyscale") == 0 || pass.compare("grayscale") == 0)
+                        passes |= PDF_PASS_GREYSCALE;
+                    else
+                        std::cerr << "Unknown optimisation: " << pass << std::endl;
+                }
+                break;
+            }
+            case longopt::OPT_COMPRESSION: { /**< Deflate level for the recompress pass */
+                const int maxLevel = PDFprinter::max_compression_level();
+                char     *end      = nullptr;
+                long      value    = optarg ? strtol(optarg, &end, 10) : -1;
+                if (!optarg || end == optarg || *end || value < 0 || value > maxLevel) {
+                    std::cerr << "--compression takes a level from 0 to " << maxLevel << ": " << (optarg ? optarg : "") << std::endl;
+                    break;
+                }
+                level = static_cast<int>(value);
+                break;
+            }
+            case longopt::OPT_SPLIT: { /**< One file per data-split group */
+                doSplit = true;
+                break;
+            }
+            case longopt::OPT_INSERT_PDF: { /**< KEY=FILE, pages for data-cached-pages placeholders */
+                std::string arg = optarg ? optarg : "";
+                size_t      eq  = arg.find('=');
+                if (eq == std::string::npos || eq == 0) {
+                    std::cerr << "Expected KEY=FILE: " << arg << std::endl;
+                    break;
+                }
+                inserts.emplace_back(arg.substr(0, eq), arg.substr(eq + 1));
+                break;
+            }
+            case longopt::OPT_CHUNKS: { /**< Parallel pieces, 0 = one per core */
+                if (optarg)
+                    chunks = static_cast<unsigned>(atoi(optarg));
+                break;
+            }
+            case longopt::OPT_WINDOW: { /**< Pages per window, 0 = whole document */
+                if (optarg)
+                    window = static_cast<unsigned>(atoi(optarg));
+                break;
+            }
+            case longopt::OPT_PAGES: { /**< Page ranges, "1-3,40-45" */
+                if (optarg)
+                    pageRanges = optarg;
+                break;
+            }
+            case longopt::OPT_RASTER: { /**< Page images instead of a PDF */
+                if (optarg)
+                    rasterFormat = optarg;
+                break;
+            }
+            case longopt::OPT_DPI: { /**< Page image resolution */
+                if (optarg)
+                    dpi = atof(optarg);
+                break;
+            }
+            case longopt::OPT_DETERMINISTIC: { /**< Repeatable output */
+                fixed = true;
+                break;
+            }
+            case longopt::OPT_CACHE_DIR: { /**< On-disk render cache */
+                if (optarg)
+                    cacheDir = optarg;
+                break;
+            }
+            case longopt::OPT_IMAGE_DPI: { /**< Downscale images */
+                if (optarg)
+                    imageDpi = static_cast<unsigned>(atoi(optarg));
+                break;
+            }
+            case longopt::OPT_IMAGE_QUALITY: { /**< Their JPEG quality */
+                if (optarg)
+                    imgQuality = atoi(optarg);
+                break;
+            }
             default:
                 break;
         }
@@ -362,23 +508,24 @@ int main(int argc, char *argv[]) {
         const char *calbFile = strdup((std::filesystem::current_path().string() + "/wkgtk-html2pdf-cal-" + get_calibration_datestamp() + ".pdf").c_str());
         html_tree   dom("html");
         calib(&dom);
-        const char *html = dom.get_html();
 
+        // Streamed from the tree, to the file and into WebKit
         std::ofstream file(std::filesystem::current_path().string() + "/wkgtk-html2pdf-cal-" + get_calibration_datestamp() + ".html");
         if (file) {
-            file << html;
+            process_nodes(&dom, [](const char *data, size_t size, void *out) {
+                return static_cast<bool>(static_cast<std::ofstream *>(out)->write(data, static_cast<std::streamsize>(size)));
+            }, &file);
             file.close();
         }
-        pdf.set_param(
-            html,
-            calbFile
-        );
+
+        // Readable in the file, compact for WebKit to parse
+        dom.compact();
+        pdf.set_param_from_tree(&dom, calbFile);
         pdf.layout(pageSize.c_str(), "portrait");
         pdf.make_pdf();
         std::cout << "Calibration document generated - " << calbFile
                   << "To test measurements on a physical device enusre that scaling and fit is disabled."
                   << std::endl;
-        PDF_FreeHTML(html);
         exit(0);
     }
 
@@ -419,6 +566,27 @@ int main(int argc, char *argv[]) {
      * above.
      */
     pdf.layout(pageSize.c_str(), orientation.c_str());
+    pdf.post_process(passes);
+    pdf.compression_level(level);
+    pdf.split(doSplit);
+    pdf.chunks(chunks);
+    pdf.window(window);
+    pdf.page_ranges(pageRanges.c_str());
+    pdf.raster(rasterFormat.c_str(), dpi);
+    pdf.deterministic(fixed);
+    pdf.image_dpi(imageDpi, imgQuality);
+    if (!cacheDir.empty())
+        PDFprinter::cache_renders(0, cacheDir.c_str());
+
+    for (const auto &insert : inserts) {
+        std::ifstream     in(insert.second, std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (data.empty()) {
+            std::cerr << "Unable to read " << insert.second << std::endl;
+            continue;
+        }
+        PDFprinter::cache_pages(insert.first.c_str(), reinterpret_cast<const unsigned char *>(data.data()), data.size());
+    }
     pdf.make_pdf();
 
     return (0);
@@ -0,0 +1,174 @@
+#include "base64.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BASE64_X86
+#include <immintrin.h>
+#endif
+
+namespace phtml {
+
+    namespace {
+        const char encodingTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        /**
+         * A kernel encodes whole 12 or 24 byte blocks of the @p n bytes at
+         * @p in and returns the bytes it used; @p avail is what may be read
+         * from @p in (loads are 16 bytes wide).
+         */
+        typedef size_t (*block_fn)(const unsigned char *in, size_t n, size_t avail, char *out);
+
+        size_t blocks_scalar(const unsigned char *, size_t, size_t, char *) {
+            return 0;
+        }
+
+        inline void encode_3(const unsigned char *in, char *out) {
+            const unsigned v = (unsigned(in[0]) << 16) | (unsigned(in[1]) << 8) | in[2];
+            out[0]           = encodingTable[v >> 18];
+            out[1]           = encodingTable[(v >> 12) & 0x3f];
+            out[2]           = encodingTable[(v >> 6) & 0x3f];
+            out[3]           = encodingTable[v & 0x3f];
+        }
+
+#ifdef BASE64_X86
+        /*
+         * W. Muła and D. Lemire, "Faster Base64 Encoding and Decoding Using
+         * AVX2 Instructions": spread 12 bytes over four 32 bit lanes, cut
+         * each lane into four 6 bit indices with two multiplies, then map
+         * the indices to ASCII with one byte shuffle of offsets.
+         */
+        __attribute__((target("ssse3"))) inline __m128i encode_12(__m128i in) {
+            in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+            const __m128i t0      = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+            const __m128i t1      = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+            const __m128i t2      = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+            const __m128i t3      = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+            const __m128i indices = _mm_or_si128(t1, t3);
+
+            // 0-25 -> 13, 26-51 -> 0, 52-61 -> 1-10, 62 -> 11, 63 -> 12
+            __m128i       reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+            const __m128i upper   = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+            reduced               = _mm_or_si128(reduced, _mm_and_si128(upper, _mm_set1_epi8(13)));
+
+            const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+            return _mm_add_epi8(_mm_shuffle_epi8(offsets, reduced), indices);
+        }
+
+        __attribute__((target("avx2"))) inline __m256i encode_24(__m256i in) {
+            in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+            const __m256i t0      = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+            const __m256i t1      = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+            const __m256i t2      = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+            const __m256i t3      = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+            const __m256i indices = _mm256_or_si256(t1, t3);
+
+            __m256i       reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+            const __m256i upper   = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+            reduced               = _mm256_or_si256(reduced, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+
+            const __m256i offsets = _mm256_setr_epi8(
+                'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0
+            );
+            return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, reduced), indices);
+        }
+
+        __attribute__((target("ssse3"))) size_t blocks_ssse3(const unsigned char *in, size_t n, size_t avail, char *out) {
+            size_t done = 0;
+            for (; n - done >= 12 && avail - done >= 16; done += 12) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + done));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + done / 3 * 4), encode_12(block));
+            }
+            return done;
+        }
+
+        __attribute__((target("avx2"))) size_t blocks_avx2(const unsigned char *in, size_t n, size_t avail, char *out) {
+            size_t done = 0;
+            for (; n - done >= 24 && avail - done >= 28; done += 24) {
+                const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + done));
+                const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + done + 12));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + done / 3 * 4), encode_24(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1)));
+            }
+            return done + blocks_ssse3(in + done, n - done, avail - done, out + done / 3 * 4);
+        }
+#endif
+
+        struct kernel {
+                const char *name   = "scalar";
+                block_fn    blocks = blocks_scalar;
+
+                kernel() {
+#ifdef BASE64_X86
+                    __builtin_cpu_init();
+                    if (__builtin_cpu_supports("avx2")) {
+                        name   = "avx2";
+                        blocks = blocks_avx2;
+                    } else if (__builtin_cpu_supports("ssse3")) {
+                        name   = "ssse3";
+                        blocks = blocks_ssse3;
+                    }
+#endif
+                }
+        };
+
+        const kernel &active() {
+            static const kernel k;
+            return k;
+        }
+    } // namespace
+
+    size_t base64_size(size_t len, size_t lineLength) {
+        lineLength  -= lineLength % 4;
+        size_t chars = (len + 2) / 3 * 4;
+        if (lineLength && chars)
+            chars += (chars - 1) / lineLength * 2;
+        return chars;
+    }
+
+    size_t base64_encode(const unsigned char *in, size_t len, char *out, size_t lineLength) {
+        lineLength                -= lineLength % 4;
+        const size_t   lineBytes   = lineLength ? lineLength / 4 * 3 : len;
+        const block_fn blocks      = active().blocks;
+        char          *o           = out;
+
+        for (size_t pos = 0; pos < len;) {
+            if (pos) {
+                *o++ = '\r';
+                *o++ = '\n';
+            }
+
+            const size_t n    = std::min(lineBytes, len - pos);
+            const size_t full = n - n % 3;
+            size_t       done = blocks(in + pos, full, len - pos, o);
+            o                += done / 3 * 4;
+            for (; done < full; done += 3, o += 4)
+                encode_3(in + pos + done, o);
+
+            // Only the last line can end part way through a group
+            if (n != full) {
+                unsigned char last[3] = {in[pos + full], n - full > 1 ? in[pos + full + 1] : static_cast<unsigned char>(0), 0};
+                encode_3(last, o);
+                if (n - full == 1)
+                    o[2] = '=';
+                o[3]  = '=';
+                o    += 4;
+            }
+            pos += n;
+        }
+        return static_cast<size_t>(o - out);
+    }
+
+    std::string base64_encode(const unsigned char *in, size_t len, size_t lineLength) {
+        std::string out(base64_size(len, lineLength), '\0');
+        base64_encode(in, len, out.data(), lineLength);
+        return out;
+    }
+
+    const char *base64_kernel() {
+        return active().name;
+    }
+
+} // namespace phtml
@@ -0,0 +1,38 @@
+#ifndef BASE64_H
+#define BASE64_H
+#include <cstddef>
+#include <string>
+
+namespace phtml {
+
+    /**
+     * @brief base64_size
+     * @param len Bytes to encode
+     * @param lineLength Characters per line, a multiple of 4 (0 = one line)
+     * @return The characters base64_encode() writes, line breaks included
+     */
+    size_t base64_size(size_t len, size_t lineLength = 0);
+
+    /**
+     * @brief base64_encode
+     * Encode @p len bytes into @p out in one pass, with "\r\n" between
+     * lines of @p lineLength characters (none after the last).
+     *
+     * Uses AVX2 or SSSE3 when the CPU has them, plain C++ otherwise.
+     *
+     * @param out At least base64_size(len, lineLength) characters.
+     * @return The characters written.
+     */
+    size_t base64_encode(const unsigned char *in, size_t len, char *out, size_t lineLength = 0);
+
+    std::string base64_encode(const unsigned char *in, size_t len, size_t lineLength = 0);
+
+    /**
+     * @brief base64_kernel
+     * @return "avx2", "ssse3" or "scalar", whichever base64_encode() uses.
+     */
+    const char *base64_kernel();
+
+} // namespace phtml
+
+#endif // BASE64_H
@@ -0,0 +1,94 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace phtml {
+
+    /**
+     * @brief fnv1a
+     * 64 bit FNV-1a of @p size bytes, continuing from @p h.  Fast and
+     * well spread but not collision resistant: use it for buckets and
+     * confirm matches with a full compare.
+     */
+    inline uint64_t fnv1a(const void *data, size_t size, uint64_t h = 0xcbf29ce484222325ULL) {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; ++i)
+            h = (h ^ p[i]) * 0x100000001b3ULL;
+        return h;
+    }
+
+    inline uint64_t fnv1a(const std::string &s) {
+        return fnv1a(s.data(), s.size());
+    }
+
+    /**
+     * @brief render_hash
+     *
+     * The content address of a render.  XXH3 is not a dependency, so two
+     * independent 64 bit hashes (FNV-1a over bytes and a multiply / rotate
+     * over 8 byte words) give 128 bits; each field is preceded by its size
+     * so adjacent fields can not run into each other.
+     */
+    struct render_hash {
+            uint64_t m_fnv = 0xcbf29ce484222325ULL;
+            uint64_t m_mix = 0x9e3779b97f4a7c15ULL;
+
+            void add(const void *data, size_t size) {
+                bytes(&size, sizeof(size));
+                bytes(data, size);
+            }
+            void add(const char *text) {
+                add(text, text ? std::strlen(text) : 0);
+            }
+            void add(const std::string &text) {
+                add(text.data(), text.size());
+            }
+            template <typename T> void add_value(const T &value) {
+                add(&value, sizeof(value));
+            }
+            std::string hex() const {
+                char out[33];
+                std::snprintf(out, sizeof(out), "%016llx%016llx", static_cast<unsigned long long>(m_fnv), static_cast<unsigned long long>(final_mix()));
+                return out;
+            }
+
+        private:
+            void bytes(const void *data, size_t size) {
+                const unsigned char *p = static_cast<const unsigned char *>(data);
+                m_fnv                  = fnv1a(p, size, m_fnv);
+
+                size_t i = 0;
+                for (; i + 8 <= size; i += 8) {
+                    uint64_t word;
+                    std::memcpy(&word, p + i, 8);
+                    mix(word);
+                }
+                if (i < size) {
+                    uint64_t word = 0;
+                    std::memcpy(&word, p + i, size - i);
+                    mix(word ^ (static_cast<uint64_t>(size - i) << 59));
+                }
+            }
+            void mix(uint64_t word) {
+                word *= 0x87c37b91114253d5ULL;
+                word  = (word << 31) | (word >> 33);
+                m_mix ^= word;
+                m_mix  = ((m_mix << 27) | (m_mix >> 37)) * 0x4cf5ad432745937fULL + 0x52dce729;
+            }
+            uint64_t final_mix() const {
+                uint64_t h = m_mix;
+                h ^= h >> 33;
+                h *= 0xff51afd7ed558ccdULL;
+                h ^= h >> 33;
+                h *= 0xc4ceb9fe1a85ec53ULL;
+                return h ^ (h >> 33);
+            }
+    };
+
+} // namespace phtml
+
+#endif // CONTENT_HASH_H
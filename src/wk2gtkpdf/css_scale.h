@@ -0,0 +1,17 @@
+#ifndef CSS_SCALE_H
+#define CSS_SCALE_H
+
+namespace phtml {
+
+    /**
+     * @brief scale_css_to_pdf
+     * PDF points per CSS pixel for a page @p pdf_page_width_pts wide that
+     * WebKit laid out @p css_page_width_px wide.
+     */
+    inline double scale_css_to_pdf(double pdf_page_width_pts, double css_page_width_px) {
+        return pdf_page_width_pts / css_page_width_px;
+    }
+
+} // namespace phtml
+
+#endif // CSS_SCALE_H
@@ -1,22 +1,114 @@
 #include "encode_image.h"
 
+#include "base64.h"
 #include "iclog.h"
 
 #include <algorithm>
-#include <fstream>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <fcntl.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 using std::string;
 
 namespace phtml {
 
+    typedef std::shared_ptr<const std::string> image_ptr;
+
+    /**
+     * @brief image_cache
+     *
+     * Encoded images for every encode_image in the process, keyed by the
+     * file and its inode, size and modification time so an edited image
+     * is encoded afresh.  An LRU capped at m_limit bytes; an encode_image
+     * holding an entry keeps it alive after it is dropped here.
+     */
+    struct image_cache {
+            typedef std::list<std::string>                     lru_list;
+            typedef std::pair<image_ptr, lru_list::iterator> entry;
+
+            std::mutex                   m_mutex;
+            size_t                       m_limit = 0;
+            size_t                       m_size  = 0;
+            lru_list                     m_lru; // most recent first
+            std::map<std::string, entry> m_images;
+
+            static image_cache &get() {
+                static image_cache cache;
+                return cache;
+            }
+            bool enabled() {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_limit != 0;
+            }
+            void configure(size_t limit) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_limit = limit;
+                evict();
+            }
+            image_ptr find(const std::string &key) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto                        hit = m_images.find(key);
+                if (hit == m_images.end())
+                    return nullptr;
+                m_lru.splice(m_lru.begin(), m_lru, hit->second.second);
+                return hit->second.first;
+            }
+            void put(const std::string &key, const image_ptr &image) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (image->size() > m_limit || m_images.count(key))
+                    return;
+                m_lru.push_front(key);
+                m_images[key] = {image, m_lru.begin()};
+                m_size += image->size();
+                evict();
+            }
+
+        private:
+            void evict() {
+                while (m_size > m_limit && !m_lru.empty()) {
+                    auto last = m_images.find(m_lru.back());
+                    m_size -= last->second.first->size();
+                    m_images.erase(last);
+                    m_lru.pop_back();
+                }
+            }
+    };
+
     struct encode_image_impl {
-            std::string m_fullPath;
-            std::string m_resultBuffer; // To hold the final C-string for the caller
+            std::string          m_fullPath;
+            std::string          m_resultBuffer;   // Built here, then shared as m_result
+            image_ptr            m_result;         // To hold the final C-string for the caller
+            std::string          m_key;            // Cache key, empty when not cached
+            std::string          m_mime;
+            const unsigned char *m_data = nullptr; // Caller's bytes, not copied
+            size_t               m_size = 0;
+            bool                 m_ok   = false;
+
+            // downscale(): the box printed in and the resolution wanted over it
+            double   m_widthMM  = 0;
+            double   m_heightMM = 0;
+            unsigned m_dpi      = 0;
+            int      m_quality  = 85;
+            bool     m_scaled   = false;
 
             // Graft your private methods here as members of the impl
-            std::string base64_encode(const unsigned char *bytes, size_t len);
+            void        base64_encode(const unsigned char *bytes, size_t len);
+            void        encode(const unsigned char *bytes, size_t len);
+            bool        shrink(const unsigned char *bytes, size_t len, gchar *&out, gsize &outSize);
             std::string image_type(const std::string &file);
-            std::string process_image();
+            image_ptr   build();
+            image_ptr   process_image();
     };
 
     encode_image::encode_image(const char *fPath)
@@ -24,98 +116,212 @@ namespace phtml {
         m_pimpl->m_fullPath = fPath ? fPath : "";
     }
 
+    encode_image::encode_image(const void *data, size_t size, const char *name)
+        : m_pimpl(new encode_image_impl()) {
+        m_pimpl->m_fullPath = name ? name : "";
+        m_pimpl->m_data     = static_cast<const unsigned char *>(data);
+        m_pimpl->m_size     = data ? size : 0;
+    }
+
     encode_image::~encode_image() {
         delete m_pimpl;
     }
 
     const char *encode_image::b64_image() {
-        // Build the string inside the impl
-        std::string imageName = m_pimpl->m_fullPath.substr(m_pimpl->m_fullPath.find_last_of("/") + 1);
+        // Build the string inside the impl, once
+        if (!m_pimpl->m_result)
+            m_pimpl->m_result = m_pimpl->build();
+
+        return m_pimpl->m_result->c_str();
+    }
 
-        m_pimpl->m_resultBuffer = "\"data:" + m_pimpl->image_type(imageName) + ";base64,";
-        m_pimpl->m_resultBuffer.append(m_pimpl->process_image());
-        m_pimpl->m_resultBuffer.append("\"");
+    void encode_image::downscale(double widthMM, double heightMM, unsigned dpi, int quality) {
+        m_pimpl->m_widthMM  = std::max(0.0, widthMM);
+        m_pimpl->m_heightMM = std::max(0.0, heightMM);
+        m_pimpl->m_dpi      = dpi;
+        m_pimpl->m_quality  = std::min(quality, 100);
+    }
 
-        return m_pimpl->m_resultBuffer.c_str();
+    void encode_image::cache(size_t maxBytes) {
+        image_cache::get().configure(maxBytes);
     }
 
-    const struct b64 {
-            /* clang-format off */
-                const char m_encodingTable[64] = {
-                    'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
-                    'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
-                    'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
-                    'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
-                    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'
-                };
-            /* clang-format on */
-
-            const int m_modTable[3]   = {0, 2, 1};
-            char     *m_decodingTable = nullptr;
-    } base64;
+    /**
+     * @brief encode_image::encode_batch
+     *
+     * One worker per core (the calling thread is one of them), each taking
+     * the next image until the batch is done.
+     */
+    size_t encode_image::encode_batch(encode_image *const *images, size_t count, unsigned threads) {
+        if (!images || !count)
+            return 0;
+
+        unsigned workers = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+        workers          = static_cast<unsigned>(std::min<size_t>(workers, count));
+
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> encoded{0};
+        auto                work = [&]() {
+            for (size_t i = next++; i < count; i = next++) {
+                if (images[i] && (images[i]->b64_image(), images[i]->m_pimpl->m_ok))
+                    ++encoded;
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < workers; ++t)
+            pool.emplace_back(work);
+
+        work();
+
+        for (std::thread &t : pool)
+            t.join();
+
+        wkJlog << iclog::loglevel::debug << iclog::category::CORE << iclog_FUNCTION
+               << "Encoded " << encoded.load() << " of " << count << " images on " << workers << " threads"
+               << iclog::endl;
+
+        return encoded;
+    }
+
+    /**
+     * @brief encode_image_impl::build
+     * @return The data URI, from the cache when it has it
+     */
+    image_ptr encode_image_impl::build() {
+        std::string imageName = m_fullPath.substr(m_fullPath.find_last_of("/") + 1);
+
+        m_mime = image_type(imageName);
+        if (m_data)
+            encode(m_data, m_size);
+        else if (image_ptr hit = process_image())
+            return hit;
+
+        if (!m_ok)
+            m_resultBuffer = "\"data:" + m_mime + ";base64,";
+        m_resultBuffer.append("\"");
+
+        image_ptr result = std::make_shared<const std::string>(std::move(m_resultBuffer));
+        m_resultBuffer.clear();
+        if (m_ok && !m_key.empty())
+            image_cache::get().put(m_key, result);
+        return result;
+    }
 
     /**
      * @brief encode_image::base64_encode
      * @param bytes_to_encode
      * @param in_len
-     * @return
      *
-     * Do the encoding
+     * Encode straight onto the end of the result buffer, sized once up
+     * front with room for the closing quote.
      */
-    string encode_image_impl::base64_encode(unsigned char const *bytes_to_encode, size_t in_len) {
+    void encode_image_impl::base64_encode(unsigned char const *bytes_to_encode, size_t in_len) {
 
         wkJlog << iclog::loglevel::debug << iclog::category::CORE << iclog_FUNCTION
                << "Encoding image"
                << iclog::endl;
 
-        string        ret;
-        int           i = 0;
-        int           j = 0;
-        unsigned char char_array_3[3];
-        unsigned char char_array_4[4];
-
-        while (in_len--) {
-            char_array_3[i++] = *(bytes_to_encode++);
-            if (i == 3) {
-                char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-                char_array_4[1] = static_cast<unsigned char>(
-                    ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4)
-                );
-                char_array_4[2] = static_cast<unsigned char>(
-                    ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6)
-                );
-                char_array_4[3] = char_array_3[2] & 0x3f;
-
-                for (i = 0; (i < 4); i++) {
-                    ret += base64.m_encodingTable[char_array_4[i]];
-                }
-                i = 0;
-            }
+        const size_t at    = m_resultBuffer.size();
+        const size_t chars = phtml::base64_size(in_len, 72);
+        m_resultBuffer.reserve(at + chars + 1);
+        m_resultBuffer.resize(at + chars);
+        phtml::base64_encode(bytes_to_encode, in_len, m_resultBuffer.data() + at, 72);
+    }
+
+    /**
+     * @brief encode_image_impl::encode
+     * @param bytes
+     * @param len
+     *
+     * The data URI of the image, downscaled first if asked, into
+     * m_resultBuffer.
+     */
+    void encode_image_impl::encode(const unsigned char *bytes, size_t len) {
+        gchar *smaller = nullptr;
+        gsize  size    = 0;
+        if (m_dpi && shrink(bytes, len, smaller, size)) {
+            bytes = reinterpret_cast<const unsigned char *>(smaller);
+            len   = size;
         }
 
-        if (i) {
-            for (j = i; j < 3; j++) {
-                char_array_3[j] = '\0';
-            }
+        m_resultBuffer = "\"data:" + m_mime + ";base64,";
+        base64_encode(bytes, len);
+        g_free(smaller);
+        m_ok = true;
+    }
 
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = static_cast<unsigned char>(
-                ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4)
-            );
-            char_array_4[2] = static_cast<unsigned char>(
-                ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6)
-            );
-            char_array_4[3] = char_array_3[2] & 0x3f;
-
-            for (j = 0; (j < i + 1); j++) {
-                ret += base64.m_encodingTable[char_array_4[j]];
-            }
+    /**
+     * @brief size_prepared
+     *
+     * The loader knows the image size: ask for no more pixels than the
+     * box needs at m_dpi.  JPEG decodes straight to the smaller scale.
+     */
+    static void size_prepared(GdkPixbufLoader *loader, gint width, gint height, gpointer user_data) {
+        encode_image_impl *impl  = static_cast<encode_image_impl *>(user_data);
+        const double       scale = std::max(impl->m_widthMM / 25.4 * impl->m_dpi / width, impl->m_heightMM / 25.4 * impl->m_dpi / height);
+        if (scale <= 0 || scale >= 1)
+            return;
+
+        impl->m_scaled = true;
+        gdk_pixbuf_loader_set_size(loader, std::max(1, static_cast<int>(std::lround(width * scale))), std::max(1, static_cast<int>(std::lround(height * scale))));
+    }
 
-            while ((i++ < 3)) {
-                ret += '=';
+    /**
+     * @brief encode_image_impl::shrink
+     * @param bytes
+     * @param len
+     * @param out Set to the new image, g_free() it
+     * @param outSize
+     * @return false to embed the image as it is: vector or animated, small
+     * enough already, not decodable, or no smaller once re-encoded
+     *
+     * Re-encoded as JPEG at m_quality, or as PNG when the image has
+     * transparency or m_quality is 0.
+     */
+    bool encode_image_impl::shrink(const unsigned char *bytes, size_t len, gchar *&out, gsize &outSize) {
+        if (m_mime.empty() || m_mime == "image/svg+xml" || m_mime == "image/gif")
+            return false;
+
+        m_scaled                = false;
+        GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+        g_signal_connect(loader, "size-prepared", G_CALLBACK(size_prepared), this);
+
+        // A failed write closes the loader itself
+        GError    *error  = NULL;
+        bool       loaded = gdk_pixbuf_loader_write(loader, bytes, len, &error) && gdk_pixbuf_loader_close(loader, &error);
+        GdkPixbuf *pixbuf = loaded && m_scaled ? gdk_pixbuf_loader_get_pixbuf(loader) : NULL;
+        if (error) {
+            wkJlog << iclog::loglevel::warning << iclog::category::CORE << iclog_FUNCTION
+                   << "Cannot decode " << m_fullPath << " to downscale it: " << error->message
+                   << iclog::endl;
+            g_error_free(error);
+        }
+
+        bool smaller = false;
+        if (pixbuf) {
+            GdkPixbuf  *oriented = gdk_pixbuf_apply_embedded_orientation(pixbuf);
+            const bool  png      = gdk_pixbuf_get_has_alpha(oriented) || m_quality <= 0;
+            std::string quality  = std::to_string(std::max(m_quality, 1));
+            bool        saved    = png ? gdk_pixbuf_save_to_buffer(oriented, &out, &outSize, "png", NULL, NULL)
+                                       : gdk_pixbuf_save_to_buffer(oriented, &out, &outSize, "jpeg", NULL, "quality", quality.c_str(), NULL);
+            smaller              = saved && outSize < len;
+
+            wkJlog << iclog::loglevel::debug << iclog::category::CORE << iclog_FUNCTION
+                   << "Downscaled " << m_fullPath << " to " << gdk_pixbuf_get_width(oriented) << " x " << gdk_pixbuf_get_height(oriented)
+                   << ", " << len << " bytes to " << (saved ? static_cast<size_t>(outSize) : len)
+                   << iclog::endl;
+
+            if (smaller) {
+                m_mime = png ? "image/png" : "image/jpeg";
+            } else {
+                g_free(out);
+                out = nullptr;
             }
+            g_object_unref(oriented);
         }
-        return ret;
+        g_object_unref(loader);
+        return smaller;
     }
 
     /**
@@ -171,36 +377,80 @@ namespace phtml {
 
     /**
      * @brief encode_image::process_image
-     * @return A properly formatted and encoded base64 image string
+     *
+     * Map the file and encode from the mapping. Anything that cannot be
+     * mapped (a pipe, say) is read into one buffer instead.
+     *
+     * @return The cached data URI if there is one, otherwise nullptr with
+     * the encoding appended to m_resultBuffer
      */
-    string encode_image_impl::process_image() {
+    image_ptr encode_image_impl::process_image() {
 
-        std::ifstream file(m_fullPath);
-        if (file.fail()) {
+        const int fd = open(m_fullPath.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
             wkJlog << iclog::loglevel::error << iclog::category::CORE << iclog_FUNCTION
-                   << "Cannot read " << m_fullPath
+                   << "Cannot read " << m_fullPath << ": " << strerror(errno)
                    << iclog::endl;
 
-            return ("");
+            if (fd >= 0)
+                close(fd);
+            return nullptr;
         }
 
-        std::string attachment((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-        string      encodedImage;
-        if (file.is_open()) {
-            file.close();
-            encodedImage = base64_encode(
-                reinterpret_cast<const unsigned char *>(attachment.c_str()),
-                attachment.size()
-            );
+        if (S_ISREG(st.st_mode) && image_cache::get().enabled()) {
+            m_key = m_fullPath + '\n' + std::to_string(st.st_dev) + ':' + std::to_string(st.st_ino) + ':' + std::to_string(st.st_size) + ':' +
+                    std::to_string(st.st_mtim.tv_sec) + '.' + std::to_string(st.st_mtim.tv_nsec);
+            if (m_dpi)
+                m_key += '\n' + std::to_string(m_widthMM) + 'x' + std::to_string(m_heightMM) + '@' + std::to_string(m_dpi) + ':' + std::to_string(m_quality);
+            if (image_ptr hit = image_cache::get().find(m_key)) {
+                close(fd);
+                m_ok = true;
+
+                wkJlog << iclog::loglevel::debug << iclog::category::CORE << iclog_FUNCTION
+                       << "Using the cached encoding of " << m_fullPath
+                       << iclog::endl;
+
+                return hit;
+            }
+        }
+
+        if (S_ISREG(st.st_mode) && st.st_size > 0) {
+            const size_t size = static_cast<size_t>(st.st_size);
+            void        *map  = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                close(fd);
+                madvise(map, size, MADV_SEQUENTIAL);
+                encode(static_cast<const unsigned char *>(map), size);
+                munmap(map, size);
+                return nullptr;
+            }
         }
 
-        const unsigned maxLineLen = 72;
+        std::vector<unsigned char> attachment(S_ISREG(st.st_mode) && st.st_size > 0 ? static_cast<size_t>(st.st_size) : 65536);
+        size_t                     got = 0;
+        for (;;) {
+            if (got == attachment.size())
+                attachment.resize(got * 2);
+
+            const ssize_t n = read(fd, attachment.data() + got, attachment.size() - got);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0) {
+                wkJlog << iclog::loglevel::error << iclog::category::CORE << iclog_FUNCTION
+                       << "Cannot read " << m_fullPath << ": " << strerror(errno)
+                       << iclog::endl;
 
-        for (unsigned i = maxLineLen; i < encodedImage.size(); i += maxLineLen) {
-            encodedImage.insert(i, "\r\n");
-            i += 2;
+                close(fd);
+                return nullptr;
+            }
+            if (n == 0)
+                break;
+            got += static_cast<size_t>(n);
         }
+        close(fd);
 
-        return (encodedImage);
+        encode(attachment.data(), got);
+        return nullptr;
     }
 } // namespace phtml
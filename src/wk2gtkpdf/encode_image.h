@@ -1,5 +1,6 @@
 #ifndef ENCODE_IMAGE_H
 #define ENCODE_IMAGE_H
+#include <cstddef>
 
 #ifndef B64ENC_API
 #define B64ENC_API __attribute__((visibility("default")))
@@ -11,11 +12,47 @@ namespace phtml {
         public:
             // Use raw C-strings to keep the ABI "Virgin"
             encode_image(const char *fPath);
+
+            /**
+             * @brief encode_image
+             * Encode bytes already in memory, a database blob say. They
+             * are not copied so must outlive b64_image().
+             * @param name File name or bare extension ("png") for the mime type
+             */
+            encode_image(const void *data, size_t size, const char *name);
             ~encode_image();
 
-            // Returns the full "data:image/..." string as a C-string
+            // Returns the full "data:image/..." string as a C-string,
+            // valid for the life of this object
             const char *b64_image();
 
+            /**
+             * @brief downscale
+             * Before encoding, shrink the image to @p dpi over the box it
+             * is printed in, @p widthMM by @p heightMM (0 for either
+             * follows the other), and write it as JPEG at @p quality, or
+             * PNG when it has transparency or @p quality is 0.  SVG, GIF
+             * and images small enough already are embedded as they are.
+             * Call before b64_image().
+             */
+            void downscale(double widthMM, double heightMM, unsigned dpi, int quality = 85);
+
+            /**
+             * @brief cache
+             * Keep encoded image files for every encode_image in the
+             * process, up to @p maxBytes, least recently used dropped
+             * first. 0 (the default) turns it off and empties it.
+             */
+            static void cache(size_t maxBytes);
+
+            /**
+             * @brief encode_batch
+             * Encode @p images on a pool of @p threads (0 = one per core);
+             * b64_image() on each then returns at once.
+             * @return The number read and encoded
+             */
+            static size_t encode_batch(encode_image *const *images, size_t count, unsigned threads = 0);
+
         private:
             encode_image_impl *m_pimpl;
     };
@@ -0,0 +1,207 @@
+#include "html_escape.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#define HTML_ESCAPE_X86
+#include <immintrin.h>
+#endif
+
+namespace phtml {
+
+    namespace {
+        /**
+         * The entity for each character that has one, and how many
+         * characters longer than the character it is.
+         */
+        struct entity_table {
+                const char   *text[256]  = {};
+                unsigned char size[256]  = {};
+                unsigned char extra[256] = {};
+
+                constexpr entity_table() {
+                    set('&', "&amp;");
+                    set('"', "&quot;");
+                    set('\'', "&apos;");
+                    set('<', "&lt;");
+                    set('>', "&gt;");
+                    set('/', "&#x2F;");
+                }
+
+            private:
+                constexpr void set(unsigned char c, const char *entity) {
+                    unsigned char n = 0;
+                    while (entity[n])
+                        ++n;
+                    text[c]  = entity;
+                    size[c]  = n;
+                    extra[c] = n - 1;
+                }
+        };
+        constexpr entity_table entities;
+
+        typedef size_t (*measure_fn)(const char *in, size_t len);
+        typedef char *(*write_fn)(const char *in, size_t len, char *out);
+
+        inline char *put(unsigned char c, char *out) {
+            if (!entities.text[c]) {
+                *out = static_cast<char>(c);
+                return out + 1;
+            }
+            std::memcpy(out, entities.text[c], entities.size[c]);
+            return out + entities.size[c];
+        }
+
+        size_t measure_scalar(const char *in, size_t len) {
+            size_t extra = 0;
+            for (size_t i = 0; i < len; ++i)
+                extra += entities.extra[static_cast<unsigned char>(in[i])];
+            return len + extra;
+        }
+
+        char *write_scalar(const char *in, size_t len, char *out) {
+            for (size_t i = 0; i < len; ++i)
+                out = put(static_cast<unsigned char>(in[i]), out);
+            return out;
+        }
+
+        /**
+         * A block with special characters at the bits of @p mask: copy the
+         * clean runs between them and the entity for each.
+         */
+        template <typename Mask> char *write_block(const char *in, size_t width, Mask mask, char *out) {
+            size_t at = 0;
+            while (mask) {
+                const size_t hit = static_cast<size_t>(__builtin_ctzll(mask));
+                std::memcpy(out, in + at, hit - at);
+                out  += hit - at;
+                out   = put(static_cast<unsigned char>(in[hit]), out);
+                at    = hit + 1;
+                mask &= mask - 1;
+            }
+            std::memcpy(out, in + at, width - at);
+            return out + width - at;
+        }
+
+        template <typename Mask> size_t extra_in_block(const char *in, Mask mask) {
+            size_t extra = 0;
+            for (; mask; mask &= mask - 1)
+                extra += entities.extra[static_cast<unsigned char>(in[__builtin_ctzll(mask)])];
+            return extra;
+        }
+
+#ifdef HTML_ESCAPE_X86
+        // SSE2 is in every x86-64 CPU, no dispatch needed for it
+        inline unsigned special_16(const char *in) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+            __m128i       m = _mm_cmpeq_epi8(v, _mm_set1_epi8('&'));
+            m               = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+            m               = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+            m               = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+            m               = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+            m               = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+            return static_cast<unsigned>(_mm_movemask_epi8(m));
+        }
+
+        size_t measure_sse2(const char *in, size_t len) {
+            size_t i = 0, extra = 0;
+            for (; i + 16 <= len; i += 16) {
+                if (unsigned mask = special_16(in + i))
+                    extra += extra_in_block(in + i, mask);
+            }
+            return i + extra + measure_scalar(in + i, len - i);
+        }
+
+        char *write_sse2(const char *in, size_t len, char *out) {
+            size_t i = 0;
+            for (; i + 16 <= len; i += 16) {
+                if (unsigned mask = special_16(in + i)) {
+                    out = write_block(in + i, 16, mask, out);
+                } else {
+                    std::memcpy(out, in + i, 16);
+                    out += 16;
+                }
+            }
+            return write_scalar(in + i, len - i, out);
+        }
+
+        __attribute__((target("avx2"))) inline unsigned special_32(const char *in) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+            __m256i       m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&'));
+            m               = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+            m               = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')));
+            m               = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+            m               = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+            m               = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')));
+            return static_cast<unsigned>(_mm256_movemask_epi8(m));
+        }
+
+        __attribute__((target("avx2"))) size_t measure_avx2(const char *in, size_t len) {
+            size_t i = 0, extra = 0;
+            for (; i + 32 <= len; i += 32) {
+                if (unsigned mask = special_32(in + i))
+                    extra += extra_in_block(in + i, mask);
+            }
+            return i + extra + measure_sse2(in + i, len - i);
+        }
+
+        __attribute__((target("avx2"))) char *write_avx2(const char *in, size_t len, char *out) {
+            size_t i = 0;
+            for (; i + 32 <= len; i += 32) {
+                if (unsigned mask = special_32(in + i)) {
+                    out = write_block(in + i, 32, mask, out);
+                } else {
+                    std::memcpy(out, in + i, 32);
+                    out += 32;
+                }
+            }
+            return write_sse2(in + i, len - i, out);
+        }
+#endif
+
+        struct kernel {
+                const char *name    = "scalar";
+                measure_fn  measure = measure_scalar;
+                write_fn    write   = write_scalar;
+
+                kernel() {
+#ifdef HTML_ESCAPE_X86
+                    name    = "sse2";
+                    measure = measure_sse2;
+                    write   = write_sse2;
+
+                    __builtin_cpu_init();
+                    if (__builtin_cpu_supports("avx2")) {
+                        name    = "avx2";
+                        measure = measure_avx2;
+                        write   = write_avx2;
+                    }
+#endif
+                }
+        };
+
+        const kernel &active() {
+            static const kernel k;
+            return k;
+        }
+    } // namespace
+
+    size_t html_escaped_size(const char *in, size_t len) {
+        return active().measure(in, len);
+    }
+
+    size_t html_escape(const char *in, size_t len, char *out) {
+        return static_cast<size_t>(active().write(in, len, out) - out);
+    }
+
+    std::string html_escape(const char *in, size_t len) {
+        std::string out(html_escaped_size(in, len), '\0');
+        html_escape(in, len, out.data());
+        return out;
+    }
+
+    const char *html_escape_kernel() {
+        return active().name;
+    }
+
+} // namespace phtml
@@ -0,0 +1,37 @@
+#ifndef HTML_ESCAPE_H
+#define HTML_ESCAPE_H
+#include <cstddef>
+#include <string>
+
+namespace phtml {
+
+    /**
+     * @brief html_escaped_size
+     * @return The characters html_escape() writes for @p len characters
+     * of @p in.
+     */
+    size_t html_escaped_size(const char *in, size_t len);
+
+    /**
+     * @brief html_escape
+     * Replace & " ' < > and / with their entities in one pass.
+     *
+     * Runs of 16 (SSE2) or 32 (AVX2, when the CPU has it) characters with
+     * nothing to escape are copied whole.
+     *
+     * @param out At least html_escaped_size(in, len) characters.
+     * @return The characters written.
+     */
+    size_t html_escape(const char *in, size_t len, char *out);
+
+    std::string html_escape(const char *in, size_t len);
+
+    /**
+     * @brief html_escape_kernel
+     * @return "avx2", "sse2" or "scalar", whichever html_escape() uses.
+     */
+    const char *html_escape_kernel();
+
+} // namespace phtml
+
+#endif // HTML_ESCAPE_H
@@ -1,15 +1,29 @@
 #include "ichtmltopdf++.h"
+#include "content_hash.h"
+#include "encode_image.h"
 #include "iclog.h"
+#include "image_swap.h"
 #include "index_pdf.h"
+#include "pdf_compact.h"
+#include "pdf_postprocess.h"
+#include "pdf_recompress.h"
+#include "pretty_html.h"
 
 #include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <gtk/gtk.h>
 #include <iomanip>
 #include <iostream>
 #include <json-c/json.h>
+#include <list>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <random>
 #include <sstream>
@@ -127,7 +141,9 @@ namespace phtml {
         "JSON.stringify({ "
         "    toc: window.tocPage, "
         "    indexPositions: window.indexPositions, "
-        "    targetData: window.targetData "
+        "    targetData: window.targetData, "
+        "    split: window.splitMarks, "
+        "    cached: window.cachedMarks "
         "});";
 
     const char *js_code_enhanced =
@@ -213,9 +229,417 @@ namespace phtml {
         "JSON.stringify({ "
         "    toc: window.tocPage, "
         "    indexPositions: window.indexPositions, "
-        "    targetData: window.targetData "
+        "    targetData: window.targetData, "
+        "    split: window.splitMarks, "
+        "    cached: window.cachedMarks "
         "});";
 
+    /**
+     * @brief js_code_split
+     *
+     * Every .page carrying a data-split attribute starts a new output
+     * document, the attribute value names it.  Runs ahead of the index
+     * scripts (which add the marks to their JSON) or on its own.
+     */
+    const char *js_code_split =
+        "window.splitMarks = []; "
+        "document.querySelectorAll('.page').forEach((p, i) => { "
+        "    if (p.hasAttribute('data-split')) "
+        "        window.splitMarks.push({ page: i + 1, name: p.getAttribute('data-split') }); "
+        "}); ";
+
+    /**
+     * @brief js_code_cached
+     *
+     * Every .page carrying a data-cached-pages attribute is a placeholder
+     * for pages held in the page cache under the attribute value.
+     */
+    const char *js_code_cached =
+        "window.cachedMarks = []; "
+        "document.querySelectorAll('.page').forEach((p, i) => { "
+        "    if (p.hasAttribute('data-cached-pages')) "
+        "        window.cachedMarks.push({ page: i + 1, key: p.getAttribute('data-cached-pages') }); "
+        "}); ";
+
+    /**
+     * @brief js_code_merge
+     *
+     * Mail merge: called with one record, every element with a data-field
+     * attribute takes the text of that field.  Fields the record does not
+     * have go back to the text the template was loaded with.  Reading
+     * offsetHeight flushes the layout before printing.
+     */
+    const char *js_code_merge =
+        "(function (record) { "
+        "    const fields = document.querySelectorAll('[data-field]'); "
+        "    if (!window.mergeDefaults) "
+        "        window.mergeDefaults = Array.from(fields, f => f.textContent); "
+        "    let bound = 0; "
+        "    fields.forEach((f, i) => { "
+        "        const name = f.getAttribute('data-field'); "
+        "        if (Object.prototype.hasOwnProperty.call(record, name)) { "
+        "            f.textContent = record[name] === null ? '' : String(record[name]); "
+        "            bound++; "
+        "        } else { "
+        "            f.textContent = window.mergeDefaults[i]; "
+        "        } "
+        "    }); "
+        "    void document.body.offsetHeight; "
+        "    return bound; "
+        "})";
+
+    /**
+     * @brief js_code_images
+     *
+     * Local images and the largest box each is drawn in, in CSS pixels,
+     * for image_dpi().  SVG is resolution free and GIF may be animated,
+     * both are left alone.
+     */
+    const char *js_code_images =
+        "(function () { "
+        "    const found = {}; "
+        "    Array.from(document.images).forEach((img, i) => { "
+        "        const src = img.currentSrc || img.src; "
+        "        if (!src.startsWith('file:') || /\\.(svg|gif)$/i.test(src) || !img.naturalWidth) "
+        "            return; "
+        "        const r = img.getBoundingClientRect(); "
+        "        const f = found[src] || (found[src] = { src: src, naturalWidth: img.naturalWidth, naturalHeight: img.naturalHeight, width: 0, height: 0, images: [] }); "
+        "        f.width = Math.max(f.width, r.width); "
+        "        f.height = Math.max(f.height, r.height); "
+        "        f.images.push(i); "
+        "    }); "
+        "    return JSON.stringify(Object.values(found)); "
+        "})(); ";
+
+    /**
+     * @brief js_code_raster
+     *
+     * The box of every .page to cut a page image from, in document
+     * coordinates.  Pages outside window.rasterRanges are hidden first so
+     * the snapshot only covers what is wanted.  Without .page elements the
+     * whole document is one image.
+     */
+    const char *js_code_raster =
+        "window.pageBoxes = []; "
+        "document.querySelectorAll('.page').forEach((p, i) => { "
+        "    const n = i + 1; "
+        "    if (window.rasterRanges.length && !window.rasterRanges.some(r => n >= r[0] && (!r[1] || n <= r[1]))) { "
+        "        p.style.display = 'none'; "
+        "        return; "
+        "    } "
+        "    window.pageBoxes.push({ page: n, element: p }); "
+        "}); "
+        "if (!document.querySelector('.page')) "
+        "    window.pageBoxes.push({ page: 1, element: document.documentElement }); "
+        "JSON.stringify(window.pageBoxes.map(b => { "
+        "    const r = b.element.getBoundingClientRect(); "
+        "    return { page: b.page, x: r.left + window.scrollX, y: r.top + window.scrollY, width: r.width, height: r.height }; "
+        "})); ";
+
+    /**
+     * @brief page_cache
+     *
+     * Printed documents kept by key for every PDFprinter in the process.
+     * Entries are shared, a job splicing one in holds its own reference so
+     * it can be replaced or dropped at any time.
+     */
+    struct page_cache {
+            std::mutex                                                m_mutex;
+            std::map<std::string, std::shared_ptr<const std::string>> m_docs;
+
+            static page_cache &get() {
+                static page_cache cache;
+                return cache;
+            }
+            void put(const std::string &key, std::string pdf) {
+                auto                        doc = std::make_shared<const std::string>(std::move(pdf));
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_docs[key] = doc;
+            }
+            std::shared_ptr<const std::string> find(const std::string &key) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto                        it = m_docs.find(key);
+                return it == m_docs.end() ? nullptr : it->second;
+            }
+            bool empty() {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_docs.empty();
+            }
+    };
+
+    /**
+     * @brief render_store
+     *
+     * Finished documents by content address (render_hash) for every
+     * PDFprinter in the process: an LRU in memory capped at m_limit bytes
+     * and, optionally, one file per document in m_dir.
+     *
+     * Single flight: the first job for a key renders it, identical jobs
+     * arriving meanwhile wait for that result instead of starting WebKit.
+     */
+    struct render_store {
+            struct flight {
+                    bool                               done = false;
+                    std::shared_ptr<const std::string> doc;
+            };
+            typedef std::list<std::string>                                              lru_list;
+            typedef std::pair<std::shared_ptr<const std::string>, lru_list::iterator> entry;
+
+            std::mutex                                     m_mutex;
+            std::condition_variable                        m_cond;
+            size_t                                         m_limit = 0;
+            size_t                                         m_size  = 0;
+            std::string                                    m_dir;
+            lru_list                                       m_lru; // most recent first
+            std::map<std::string, entry>                   m_docs;
+            std::map<std::string, std::shared_ptr<flight>> m_flights;
+
+            static render_store &get() {
+                static render_store store;
+                return store;
+            }
+            bool enabled() {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_limit || !m_dir.empty();
+            }
+            void configure(size_t limit, const char *dir) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_limit = limit;
+                m_dir   = dir ? dir : "";
+                while (m_dir.size() > 1 && m_dir.back() == '/')
+                    m_dir.pop_back();
+                evict();
+            }
+
+            /**
+             * @brief acquire
+             * @param key
+             * @param wait Wait for a render of the same key in progress
+             * @param doc Set on a hit
+             * @return true if the caller is to render @p key and then
+             * release() it
+             */
+            bool acquire(const std::string &key, bool wait, std::shared_ptr<const std::string> &doc) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                auto                         hit = m_docs.find(key);
+                if (hit != m_docs.end()) {
+                    m_lru.splice(m_lru.begin(), m_lru, hit->second.second);
+                    doc = hit->second.first;
+                    return false;
+                }
+
+                auto running = m_flights.find(key);
+                if (running != m_flights.end()) {
+                    if (!wait)
+                        return false;
+                    std::shared_ptr<flight> f = running->second;
+                    m_cond.wait(lock, [&f] { return f->done; });
+                    doc = f->doc; // empty if that render failed
+                    return false;
+                }
+
+                m_flights[key]  = std::make_shared<flight>();
+                std::string dir = m_dir;
+                lock.unlock();
+
+                if (!dir.empty()) {
+                    std::ifstream file(dir + "/" + key + ".pdf", std::ios::binary);
+                    std::string   data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                    if (!data.empty()) {
+                        doc = std::make_shared<const std::string>(std::move(data));
+                        release(key, doc, false);
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            /**
+             * @brief release
+             * Publish the result of a render to the waiting jobs and keep
+             * it (an empty @p doc just ends the flight).
+             */
+            void release(const std::string &key, std::shared_ptr<const std::string> doc, bool persist = true) {
+                std::string dir;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (doc && m_limit && doc->size() <= m_limit && !m_docs.count(key)) {
+                        m_lru.push_front(key);
+                        m_docs[key] = {doc, m_lru.begin()};
+                        m_size += doc->size();
+                        evict();
+                    }
+                    auto running = m_flights.find(key);
+                    if (running != m_flights.end()) {
+                        running->second->done = true;
+                        running->second->doc  = doc;
+                        m_flights.erase(running);
+                    }
+                    dir = m_dir;
+                }
+                m_cond.notify_all();
+
+                // Written aside and renamed, a reader never sees half a file
+                if (doc && persist && !dir.empty()) {
+                    std::string path = dir + "/" + key + ".pdf";
+                    std::string temp = path + "." + std::to_string(reinterpret_cast<uintptr_t>(doc.get()));
+                    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+                    bool          ok = static_cast<bool>(file.write(doc->data(), doc->size()));
+                    file.close();
+                    if (ok && std::rename(temp.c_str(), path.c_str()) == 0)
+                        return;
+                    wkJlog << iclog::loglevel::warning << iclog::category::CORE
+                           << "Unable to write the render cache file " << path
+                           << iclog::endl;
+                    std::remove(temp.c_str());
+                }
+            }
+
+        private:
+            void evict() {
+                while (m_size > m_limit && !m_lru.empty()) {
+                    auto last = m_docs.find(m_lru.back());
+                    m_size -= last->second.first->size();
+                    m_docs.erase(last);
+                    m_lru.pop_back();
+                }
+            }
+    };
+
+    /**
+     * @brief tree_sources
+     *
+     * The html_trees being loaded through tree_scheme, by the host of the
+     * URI each is loaded from.  The rest of that URI is the path of the
+     * base URI, so relative links resolve as they would in the page of
+     * set_param() and are read from the same files.
+     */
+    struct tree_sources {
+            struct source {
+                    const html_tree *dom;
+                    std::string      path; // of the page itself
+            };
+            std::mutex                    m_mutex;
+            std::map<std::string, source> m_sources;
+
+            static tree_sources &get() {
+                static tree_sources sources;
+                return sources;
+            }
+            void add(const std::string &host, const html_tree *dom, const std::string &path) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_sources[host] = {dom, path};
+            }
+            void remove(const std::string &host) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_sources.erase(host);
+            }
+            bool find(const std::string &host, source &found) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto                        it = m_sources.find(host);
+                if (it == m_sources.end())
+                    return false;
+                found = it->second;
+                return true;
+            }
+    };
+
+    static const char *tree_scheme = "wk2gtkpdf-tree";
+
+    /**
+     * @brief TreeInputStream
+     * A GInputStream over an html_stream, WebKit reads it on a worker
+     * thread while the page loads.
+     */
+    struct TreeInputStream {
+            GInputStream parent;
+            html_stream *source;
+    };
+    struct TreeInputStreamClass {
+            GInputStreamClass parent_class;
+    };
+    G_DEFINE_TYPE(TreeInputStream, tree_input_stream, G_TYPE_INPUT_STREAM)
+
+    static gssize tree_input_stream_read(GInputStream *stream, void *buffer, gsize count, GCancellable *, GError **) {
+        return static_cast<gssize>(reinterpret_cast<TreeInputStream *>(stream)->source->read(static_cast<char *>(buffer), count));
+    }
+
+    static void tree_input_stream_finalize(GObject *object) {
+        delete reinterpret_cast<TreeInputStream *>(object)->source;
+        G_OBJECT_CLASS(tree_input_stream_parent_class)->finalize(object);
+    }
+
+    static void tree_input_stream_class_init(TreeInputStreamClass *klass) {
+        G_OBJECT_CLASS(klass)->finalize      = tree_input_stream_finalize;
+        G_INPUT_STREAM_CLASS(klass)->read_fn = tree_input_stream_read;
+    }
+
+    static void tree_input_stream_init(TreeInputStream *stream) {
+        stream->source = nullptr;
+    }
+
+    /**
+     * @brief tree_scheme_request
+     *
+     * The page is read from its tree as WebKit asks for it, anything else
+     * under the same host is the local file at that path.
+     */
+    static void tree_scheme_request(WebKitURISchemeRequest *request, gpointer) {
+        const std::string    uri  = webkit_uri_scheme_request_get_uri(request);
+        const size_t         from = std::strlen(tree_scheme) + 3; // "://"
+        tree_sources::source found;
+        if (!tree_sources::get().find(uri.substr(from, uri.find('/', from) - from), found)) {
+            GError *error = g_error_new(G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Nothing is loading from %s", uri.c_str());
+            webkit_uri_scheme_request_finish_error(request, error);
+            g_error_free(error);
+            return;
+        }
+
+        gchar *path = g_uri_unescape_string(webkit_uri_scheme_request_get_path(request), nullptr);
+        if (path && found.path == path) {
+            TreeInputStream *stream = static_cast<TreeInputStream *>(g_object_new(tree_input_stream_get_type(), nullptr));
+            stream->source          = new html_stream(found.dom);
+            webkit_uri_scheme_request_finish(request, G_INPUT_STREAM(stream), -1, "text/html");
+            g_object_unref(stream);
+            g_free(path);
+            return;
+        }
+
+        GError           *error = nullptr;
+        GFile            *file  = g_file_new_for_path(path ? path : "");
+        GFileInputStream *in    = g_file_read(file, nullptr, &error);
+        if (in) {
+            gchar *type = g_content_type_guess(path, nullptr, 0, nullptr);
+            gchar *mime = g_content_type_get_mime_type(type);
+            webkit_uri_scheme_request_finish(request, G_INPUT_STREAM(in), -1, mime);
+            g_free(mime);
+            g_free(type);
+            g_object_unref(in);
+        } else {
+            webkit_uri_scheme_request_finish_error(request, error);
+            g_error_free(error);
+        }
+        g_object_unref(file);
+        g_free(path);
+    }
+
+    /**
+     * @brief register_tree_scheme
+     * Serve tree_scheme in @p context, as a local scheme so its pages may
+     * use file: URIs as well.
+     */
+    static void register_tree_scheme(WebKitWebContext *context) {
+#ifdef USE_WEBKIT_6
+        // Every view shares the default context
+        static bool registered = false;
+        if (registered)
+            return;
+        registered = true;
+#endif
+        webkit_web_context_register_uri_scheme(context, tree_scheme, tree_scheme_request, nullptr, nullptr);
+        webkit_security_manager_register_uri_scheme_as_local(webkit_web_context_get_security_manager(context), tree_scheme);
+    }
+
     /**
      * @brief isoPaperSizes
      * - This is a list of standard well known page
@@ -299,7 +723,18 @@ namespace phtml {
             char                    *default_stylesheet = nullptr;
             bool                     m_makeBlob         = false;
             index_mode               m_doIndex          = index_mode::OFF;
+            unsigned                 m_passes           = PDF_PASS_NONE;
+            int                      m_level            = 9;
             int                      m_tocPage          = index_pdf::UNSET;
+            bool                     m_split            = false;
+            bool                     m_splice           = false;
+            unsigned                 m_chunks           = 1;
+            unsigned                 m_window           = 0;
+            bool                     m_chunk            = false; // one piece of a chunked job
+            bool                     m_deterministic    = false;
+            unsigned                 m_imageDpi         = 0; // image_dpi(), 0 = images as they are
+            int                      m_imageQuality     = 85;
+            const html_tree         *m_htmlTree         = nullptr; // set_param_from_tree()
             std::mutex              *wait_mutex         = nullptr;
             std::condition_variable *wait_cond          = nullptr;
             int                     *wait_data          = nullptr;
@@ -322,6 +757,62 @@ namespace phtml {
             size_t      m_indexDataCount    = 0;
             size_t      m_indexDataCapacity = 0;
 
+            // data-split marks (page, name) and the parts cut at them
+            std::vector<std::pair<int, std::string>>                        m_splitMarks;
+            std::vector<std::pair<std::string, std::vector<unsigned char>>> m_parts;
+
+            // data-cached-pages placeholders (page, key) and the key this job is cached under
+            std::vector<std::pair<int, std::string>> m_cachedMarks;
+            std::string                              m_cacheKey;
+
+            // m_htmlTree loaded through tree_scheme (host, path of the page), no host when it is built into html_txt
+            std::string m_treeHost;
+            std::string m_treePath;
+
+            // Page images instead of a PDF ("png" or "jpeg"), cut from the .page boxes (CSS pixels)
+            struct page_box {
+                    int    page;
+                    double x;
+                    double y;
+                    double w;
+                    double h;
+            };
+            std::string           m_raster;
+            double                m_dpi     = 96;
+            int                   m_quality = 85;
+            std::vector<page_box> m_pageBoxes;
+
+            // Mail merge: each record is bound into the one loaded view and printed in turn
+            struct merge_record {
+                    size_t      number;
+                    std::string data;    // JSON object
+                    std::string printed; // where WebKit prints it
+                    std::string dest;    // where it ends up ("" to keep it for get_blobs())
+                    PDF_Anchor *anchors = nullptr;
+                    size_t      count   = 0;
+                    int         tocPage = index_pdf::UNSET;
+                    bool        done    = false;
+            };
+            std::vector<merge_record>             m_records;
+            size_t                                m_record = 0;
+            std::chrono::steady_clock::time_point m_recordStart;
+
+            // make_pdf_from_view(): the callers view and who to tell when it is printed
+            bool                      m_external = false;
+            bool                      m_failed   = false;
+            bool                      m_scripts  = false; // the views own enable-javascript
+            std::string               m_viewTemp;
+            PDFprinter::view_callback m_done     = nullptr;
+            PDFprinter               *m_owner    = nullptr;
+            void                     *m_doneData = nullptr;
+
+            // The pages to print (first, last), 1 based, sorted and merged; last 0 = to the end
+            std::vector<std::pair<int, int>> m_pageRanges;
+
+            // Every link target of a chunk (id -> title, position), matched across chunks
+            typedef std::map<std::string, std::pair<std::string, PDF_LinkData>> link_targets;
+            link_targets                                                        m_targets;
+
             ~PDFprinter_impl() {
                 wkJlog << iclog::loglevel::debug << iclog::category::CORE << iclog_FUNCTION
                        << "Cleaning up class object."
@@ -359,14 +850,56 @@ namespace phtml {
                        << iclog::endl;
             }
 
-            void  read_file_to_blob();
+            void  read_file_to_blob(const char *path);
+            void  write_blob_to_file(const char *path);
+            void  finish_output(const std::string &tempFile);
+            void  split_output();
+            void  splice_output();
+            void  raster_pages(cairo_surface_t *snapshot, double zoom);
+            void  raster_output();
+            bool  buffered() const;
+            void  fix_metadata(std::vector<unsigned char> &bytes) const;
+            std::string render_key() const;
+            bool  render_cached();
+            void  tree_source();
+            void  render();
+            int   page_position(int page, bool next = false) const;
+            void  select_pages();
             char *read_file(const char *fullPath);
+            void  prepare_print();
+            void  run_worker();
             void  make_pdf_int();
             void  make_pdf_ext();
+            size_t make_merge(const char *const *records, size_t count);
+            bool  make_pdf_chunked();
+            bool  make_pdf_windowed();
+
+            std::unique_ptr<PDFprinter_impl> make_part(const std::string &html) const;
+            void                             adopt_part(PDFprinter_impl &part, int offset, link_targets &targets, std::vector<PDF_Anchor> &anchors);
+            void                             link_parts(const link_targets &targets, std::vector<PDF_Anchor> &anchors);
 
             static int cb_worker(void *p);
     };
 
+    static gboolean merge_next(gpointer user_data);
+    static gboolean view_finish(gpointer user_data);
+
+    /**
+     * @brief merge_advance
+     * @param impl
+     *
+     * Bind the next record, or end the job after the last.
+     */
+    static void merge_advance(PDFprinter_impl *impl) {
+        if (++impl->m_record < impl->m_records.size()) {
+            g_idle_add(merge_next, impl);
+            return;
+        }
+        if (impl->m_innerLoop)
+            g_main_loop_quit(impl->m_innerLoop);
+        impl->m_processing = false;
+    }
+
     /**
      * @brief print_finished
      * @param print_operation
@@ -381,6 +914,32 @@ namespace phtml {
         wkJlog << iclog::loglevel::debug << iclog::category::CORE
                << "Print operation finished." << iclog::endl;
 
+        // The callers view: finish once WebKit is out of this signal
+        if (impl->m_external) {
+            g_idle_add(view_finish, impl);
+            return;
+        }
+
+        // Mail merge: keep what this record needs to finish and move on
+        if (impl->m_record < impl->m_records.size()) {
+            PDFprinter_impl::merge_record &rec = impl->m_records[impl->m_record];
+            rec.done                           = true;
+            rec.anchors                        = impl->m_indexData;
+            rec.count                          = impl->m_indexDataCount;
+            rec.tocPage                        = impl->m_tocPage;
+            impl->m_indexData                  = nullptr;
+            impl->m_indexDataCount             = 0;
+
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - impl->m_recordStart).count();
+            wkJlog << iclog::loglevel::info << iclog::category::CORE
+                   << "Merged record " << rec.number << " in " << static_cast<long>(ms) << "ms"
+                   << (impl->m_record ? "" : " (with the load)")
+                   << iclog::endl;
+
+            merge_advance(impl);
+            return;
+        }
+
         // This is what breaks the loop in cb_worker
         if (impl->m_innerLoop) {
             g_main_loop_quit(impl->m_innerLoop);
@@ -389,6 +948,30 @@ namespace phtml {
         impl->m_processing = false;
     }
 
+    /**
+     * @brief extraction_failed
+     * @param impl
+     *
+     * The positions could not be read and nothing is printed: end the job
+     * so that nobody waits for it.  The callers view reports the failure to
+     * the make_pdf_from_view() callback, a mail merge skips the record and
+     * any other job stops as print_finished() would.
+     */
+    static void extraction_failed(PDFprinter_impl *impl) {
+        if (impl->m_external) {
+            impl->m_failed = true;
+            g_idle_add(view_finish, impl);
+            return;
+        }
+        if (impl->m_record < impl->m_records.size()) {
+            merge_advance(impl);
+            return;
+        }
+        if (impl->m_innerLoop)
+            g_main_loop_quit(impl->m_innerLoop);
+        impl->m_processing = false;
+    }
+
     /**
      * @brief javascript_callback
      * @param web_view
@@ -403,7 +986,8 @@ namespace phtml {
         GAsyncResult  *result,
         gpointer       user_data
     ) {
-        GError *error = NULL;
+        PDFprinter_impl *impl  = static_cast<PDFprinter_impl *>(user_data);
+        GError          *error = NULL;
 
         JSCValue *js_result = webkit_web_view_evaluate_javascript_finish(
             web_view,
@@ -415,6 +999,7 @@ namespace phtml {
             wkJlog << iclog::loglevel::error << iclog::category::CORE
                    << "JavaScript error: " << error->message << iclog::endl;
             g_error_free(error);
+            extraction_failed(impl);
             return;
         }
 
@@ -425,6 +1010,7 @@ namespace phtml {
             wkJlog << iclog::loglevel::error << iclog::category::CORE
                    << "Failed to convert JavaScript result to string" << iclog::endl;
             g_object_unref(js_result);
+            extraction_failed(impl);
             return;
         }
 
@@ -438,11 +1024,10 @@ namespace phtml {
                    << "Failed to parse JSON" << iclog::endl;
             g_free(json_string);
             g_object_unref(js_result);
+            extraction_failed(impl);
             return;
         }
 
-        PDFprinter_impl *impl = static_cast<PDFprinter_impl *>(user_data);
-
         json_object *toc_obj, *page_obj;
         if (json_object_object_get_ex(root, "toc", &toc_obj)) {
             if (json_object_object_get_ex(toc_obj, "page", &page_obj)) {
@@ -450,6 +1035,28 @@ namespace phtml {
             }
         }
 
+        impl->m_splitMarks.clear();
+        json_object *split = json_object_object_get(root, "split");
+        if (split && json_object_get_type(split) == json_type_array) {
+            size_t len = json_object_array_length(split);
+            for (size_t i = 0; i < len; ++i) {
+                json_object *val  = json_object_array_get_idx(split, i);
+                const char  *name = json_object_get_string(json_object_object_get(val, "name"));
+                impl->m_splitMarks.emplace_back(json_object_get_int(json_object_object_get(val, "page")), name ? name : "");
+            }
+        }
+
+        impl->m_cachedMarks.clear();
+        json_object *cached = json_object_object_get(root, "cached");
+        if (cached && json_object_get_type(cached) == json_type_array) {
+            size_t len = json_object_array_length(cached);
+            for (size_t i = 0; i < len; ++i) {
+                json_object *val = json_object_array_get_idx(cached, i);
+                const char  *key = json_object_get_string(json_object_object_get(val, "key"));
+                impl->m_cachedMarks.emplace_back(json_object_get_int(json_object_object_get(val, "page")), key ? key : "");
+            }
+        }
+
         json_object *indexPositions = json_object_object_get(root, "indexPositions");
 
         if (indexPositions && json_object_get_type(indexPositions) == json_type_array) {
@@ -493,6 +1100,21 @@ namespace phtml {
         // 3. MATCH TARGETS (Using Hash Lookup)
         // 3. MATCH TARGETS (Using Hash Lookup)
         json_object *targets = json_object_object_get(root, "targetData");
+        if (targets && impl->m_chunk) {
+            impl->m_targets.clear();
+            json_object_object_foreach(targets, id, target_val) {
+                const char  *t_title = json_object_get_string(json_object_object_get(target_val, "title"));
+                PDF_LinkData t       = {};
+                t.xPos               = json_object_get_double(json_object_object_get(target_val, "x"));
+                t.yPos               = json_object_get_double(json_object_object_get(target_val, "y"));
+                t.w                  = json_object_get_double(json_object_object_get(target_val, "width"));
+                t.h                  = json_object_get_double(json_object_object_get(target_val, "height"));
+                t.page_width         = json_object_get_double(json_object_object_get(target_val, "page_width"));
+                t.page_height        = json_object_get_double(json_object_object_get(target_val, "page_height"));
+                t.pageNo             = json_object_get_int(json_object_object_get(target_val, "page"));
+                impl->m_targets.emplace(id, std::make_pair(std::string(t_title ? t_title : ""), t));
+            }
+        }
         if (targets) {
             for (size_t i = 0; i < impl->m_indexDataCount; ++i) {
                 PDF_Anchor  &s          = impl->m_indexData[i];
@@ -514,6 +1136,9 @@ namespace phtml {
             }
         }
 
+        // Renumber everything for the pages actually printed
+        impl->select_pages();
+
         for (size_t i = 0; i != impl->m_indexDataCount; ++i) {
             PDF_Anchor &a = impl->m_indexData[i];
             wkJlog << iclog::loglevel::debug << iclog::category::CORE
@@ -532,120 +1157,578 @@ namespace phtml {
     }
 
     /**
-     * @brief web_view_load_changed
+     * @brief raster_done
+     * @param impl
+     *
+     * Ends the job as print_finished() would, nothing is printed.
+     */
+    static void raster_done(PDFprinter_impl *impl) {
+        if (impl->m_innerLoop)
+            g_main_loop_quit(impl->m_innerLoop);
+        impl->m_processing = false;
+    }
+
+    /**
+     * @brief snapshot_callback
      * @param web_view
-     * @param load_event
+     * @param result
      * @param user_data
      *
-     * Web load monitor callback
+     * The whole (remaining) document as one image, cut into pages.
      */
-    static void web_view_load_changed(WebKitWebView *web_view, WebKitLoadEvent load_event, void *user_data) {
-
-        PDFprinter_impl *impl = static_cast<PDFprinter_impl *>(user_data);
-
-        switch (load_event) {
-            case WEBKIT_LOAD_STARTED:
-                wkJlog << iclog::loglevel::debug << iclog::category::CORE
-                       << "WEBKIT LOAD STARTED." << iclog::endl;
+    static void snapshot_callback(WebKitWebView *web_view, GAsyncResult *result, gpointer user_data) {
+        PDFprinter_impl *impl  = static_cast<PDFprinter_impl *>(user_data);
+        GError          *error = NULL;
 
-                break;
-            case WEBKIT_LOAD_REDIRECTED:
-                break;
-            case WEBKIT_LOAD_COMMITTED:
-                wkJlog << iclog::loglevel::debug << iclog::category::CORE
-                       << "The load is being performed. Current URI is the final one and it "
-                          "won't change unless a new "
-                       << "load is requested or a navigation within the same page is "
-                          "performed."
-                       << iclog::endl;
-                break;
+#ifdef USE_WEBKIT_6
+        cairo_surface_t *snapshot = nullptr;
+        GdkTexture      *texture  = webkit_web_view_get_snapshot_finish(web_view, result, &error);
+        if (texture) {
+            // GDK_MEMORY_DEFAULT is cairo's ARGB32
+            snapshot = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, gdk_texture_get_width(texture), gdk_texture_get_height(texture));
+            cairo_surface_flush(snapshot);
+            gdk_texture_download(texture, cairo_image_surface_get_data(snapshot), cairo_image_surface_get_stride(snapshot));
+            cairo_surface_mark_dirty(snapshot);
+            g_object_unref(texture);
+        }
+#else
+        cairo_surface_t *snapshot = webkit_web_view_get_snapshot_finish(web_view, result, &error);
+#endif
 
-            case WEBKIT_LOAD_FINISHED:
-                wkJlog << iclog::loglevel::debug << iclog::category::CORE
-                       << "WEBKIT LOAD FINISHED - extracting positions" << iclog::endl;
+        if (error) {
+            wkJlog << iclog::loglevel::error << iclog::category::CORE
+                   << "Snapshot failed: " << error->message << iclog::endl;
+            g_error_free(error);
+        }
+        if (snapshot) {
+            impl->raster_pages(snapshot, webkit_web_view_get_zoom_level(web_view));
+            cairo_surface_destroy(snapshot);
+        }
+        raster_done(impl);
+    }
 
-                // Check if we need to extract positions (i.e., index generation)
-                if (impl->m_doIndex != index_mode::OFF) {
-                    // Enable JavaScript for extraction
-                    WebKitSettings *view_settings = webkit_web_view_get_settings(web_view);
-                    webkit_settings_set_enable_javascript(view_settings, true);
+    /**
+     * @brief raster_boxes_callback
+     * @param web_view
+     * @param result
+     * @param user_data
+     *
+     * Keeps the page boxes and asks for a snapshot, zoomed in when the
+     * images need more than 96 DPI so they are not scaled up.
+     */
+    static void raster_boxes_callback(WebKitWebView *web_view, GAsyncResult *result, gpointer user_data) {
+        PDFprinter_impl *impl  = static_cast<PDFprinter_impl *>(user_data);
+        GError          *error = NULL;
 
-                    const char *js_to_run = (impl->m_doIndex == index_mode::ENHANCED)
-                                                ? js_code_enhanced
-                                                : js_code_classic;
+        JSCValue *js_result = webkit_web_view_evaluate_javascript_finish(web_view, result, &error);
+        if (error) {
+            wkJlog << iclog::loglevel::error << iclog::category::CORE
+                   << "JavaScript error: " << error->message << iclog::endl;
+            g_error_free(error);
+            raster_done(impl);
+            return;
+        }
 
-                    // Evaluate JS to extract positions
+        gchar       *json_string = jsc_value_to_string(js_result);
+        json_object *root        = json_string ? json_tokener_parse(json_string) : nullptr;
 
-                    wkJlog << iclog::loglevel::debug << iclog::category::CORE
-                           << "Extracting coordinates using:\n"
-                           << js_to_run
-                           << iclog::endl;
-                    webkit_web_view_evaluate_javascript(
-                        web_view,
-                        js_to_run, // script
-                        -1,        // length (use -1 for null-terminated string)
-                        NULL,      // world_name
-                        NULL,      // source_uri
-                        NULL,      // cancellable
-                        (GAsyncReadyCallback)javascript_callback,
-                        user_data
-                    );
-
-                } else {
-                    // No extraction needed — proceed directly to print
-                    wkJlog << iclog::loglevel::debug << iclog::category::CORE
-                           << "No index extraction required — printing directly" << iclog::endl;
-
-                    webkit_print_operation_print(impl->m_print_operation);
-                }
-                break;
+        impl->m_pageBoxes.clear();
+        if (root && json_object_get_type(root) == json_type_array) {
+            size_t len = json_object_array_length(root);
+            for (size_t i = 0; i < len; ++i) {
+                json_object              *val = json_object_array_get_idx(root, i);
+                PDFprinter_impl::page_box box = {};
+                box.page                      = json_object_get_int(json_object_object_get(val, "page"));
+                box.x                         = json_object_get_double(json_object_object_get(val, "x"));
+                box.y                         = json_object_get_double(json_object_object_get(val, "y"));
+                box.w                         = json_object_get_double(json_object_object_get(val, "width"));
+                box.h                         = json_object_get_double(json_object_object_get(val, "height"));
+                if (box.w > 0 && box.h > 0)
+                    impl->m_pageBoxes.push_back(box);
+            }
+        }
+        if (root)
+            json_object_put(root);
+        g_free(json_string);
+        g_object_unref(js_result);
 
-            default:
-                // Ignore other load states (STARTED, COMMITTED, etc.)
-                break;
+        if (impl->m_pageBoxes.empty()) {
+            wkJlog << iclog::loglevel::error << iclog::category::CORE
+                   << "No pages to make images of" << iclog::endl;
+            raster_done(impl);
+            return;
         }
-    }
 
-    ////////////////////////////////////////////////////////////////////////////////////
+        webkit_web_view_set_zoom_level(web_view, std::max(1.0, impl->m_dpi / 96.0));
+        webkit_web_view_get_snapshot(web_view, WEBKIT_SNAPSHOT_REGION_FULL_DOCUMENT, WEBKIT_SNAPSHOT_OPTIONS_NONE, NULL, (GAsyncReadyCallback)snapshot_callback, user_data);
+    }
 
     /**
-     * @brief PDFprinter_impl::cb_worker
-     * @param p - cast to pimpl
-     * @return
+     * @brief print_view
+     * @param web_view
+     * @param impl
      *
-     * Callback to generate PDF from HTML
+     * The document is laid out: extract the positions the job needs, then
+     * print (from javascript_callback()), or print straight away.
      */
-    int PDFprinter_impl::cb_worker(void *p) {
-
-        PDFprinter_impl *impl = reinterpret_cast<PDFprinter_impl *>(p);
+    static void print_view(WebKitWebView *web_view, PDFprinter_impl *impl) {
+        // Check if we need to extract positions (i.e., index generation, split or cached page marks)
+        if (impl->m_doIndex != index_mode::OFF || impl->m_split || impl->m_splice) {
+            // Enable JavaScript for extraction
+            WebKitSettings *view_settings = webkit_web_view_get_settings(web_view);
+            webkit_settings_set_enable_javascript(view_settings, true);
+
+            std::string script = impl->m_split ? js_code_split : "";
+            if (impl->m_splice)
+                script += js_code_cached;
+            if (impl->m_doIndex == index_mode::OFF)
+                script += "JSON.stringify({ split: window.splitMarks, cached: window.cachedMarks });";
+            else
+                script += (impl->m_doIndex == index_mode::ENHANCED) ? js_code_enhanced : js_code_classic;
+
+            // A merge or the callers view can run it again in the same page, keep its declarations local
+            if (!impl->m_records.empty() || impl->m_external)
+                script = "{ " + script + " }";
+            const char *js_to_run = script.c_str();
+
+            // Evaluate JS to extract positions
 
-        wkJlog << iclog::loglevel::debug << iclog::category::CORE
-               << "Applying print settings" << iclog::endl;
-        impl->m_print_settings = gtk_print_settings_new();
-        gtk_print_settings_set_printer(impl->m_print_settings, "Print to File");
-        gtk_print_settings_set(impl->m_print_settings, GTK_PRINT_SETTINGS_OUTPUT_FILE_FORMAT, "pdf");
-
-        GtkPageSetup *page_setup = gtk_page_setup_new();
-        gtk_page_setup_set_top_margin(page_setup, 0, GTK_UNIT_MM);
-        gtk_page_setup_set_bottom_margin(page_setup, 0, GTK_UNIT_MM);
-
-        if (impl->key_file_data != NULL) {
+            wkJlog << iclog::loglevel::debug << iclog::category::CORE
+                   << "Extracting coordinates using:\n"
+                   << js_to_run
+                   << iclog::endl;
+            webkit_web_view_evaluate_javascript(
+                web_view,
+                js_to_run, // script
+                -1,        // length (use -1 for null-terminated string)
+                NULL,      // world_name
+                NULL,      // source_uri
+                NULL,      // cancellable
+                (GAsyncReadyCallback)javascript_callback,
+                impl
+            );
 
+        } else {
+            // No extraction needed — proceed directly to print
             wkJlog << iclog::loglevel::debug << iclog::category::CORE
-                   << "Applying page setup:\n"
-                   << impl->key_file_data << iclog::endl;
-            GKeyFile *key_file = g_key_file_new();
-            g_key_file_load_from_data(key_file, impl->key_file_data, (gsize)-1, G_KEY_FILE_NONE, NULL);
-            gtk_page_setup_load_key_file(page_setup, key_file, NULL, NULL);
-            gtk_print_settings_load_key_file(impl->m_print_settings, key_file, NULL, NULL);
+                   << "No index extraction required — printing directly" << iclog::endl;
 
-            g_key_file_free(key_file);
+            webkit_print_operation_print(impl->m_print_operation);
         }
+    }
 
-        gtk_print_settings_set(impl->m_print_settings, GTK_PRINT_SETTINGS_OUTPUT_URI, impl->out_uri);
+    /**
+     * @brief merge_bound
+     * @param web_view
+     * @param result
+     * @param user_data
+     *
+     * A record is in the page: point a print operation at its output and
+     * print it the usual way.
+     */
+    static void merge_bound(WebKitWebView *web_view, GAsyncResult *result, gpointer user_data) {
+        PDFprinter_impl               *impl  = static_cast<PDFprinter_impl *>(user_data);
+        PDFprinter_impl::merge_record &rec   = impl->m_records[impl->m_record];
+        GError                        *error = NULL;
 
-#ifdef USE_WEBKIT_6
-        // 1. Create the Headless settings first
+        JSCValue *js_result = webkit_web_view_evaluate_javascript_finish(web_view, result, &error);
+        if (error) {
+            wkJlog << iclog::loglevel::error << iclog::category::CORE
+                   << "Unable to bind merge record " << rec.number << ": " << error->message
+                   << iclog::endl;
+            g_error_free(error);
+            merge_advance(impl);
+            return;
+        }
+        wkJlog << iclog::loglevel::debug << iclog::category::CORE
+               << "Bound " << jsc_value_to_int32(js_result) << " fields of merge record " << rec.number
+               << iclog::endl;
+        g_object_unref(js_result);
+
+        // The operation of the previous record has finished, each print gets its own
+        if (impl->m_record) {
+            GtkPageSetup *page_setup = webkit_print_operation_get_page_setup(impl->m_print_operation);
+            g_object_ref(page_setup);
+            g_signal_handlers_disconnect_by_data(impl->m_print_operation, impl);
+            g_object_unref(impl->m_print_operation);
+
+            impl->m_print_operation = webkit_print_operation_new(web_view);
+            g_object_ref_sink(impl->m_print_operation);
+            webkit_print_operation_set_page_setup(impl->m_print_operation, page_setup);
+            g_signal_connect(impl->m_print_operation, "finished", G_CALLBACK(print_finished), impl);
+            g_object_unref(page_setup);
+        }
+
+        std::string uri = "file://" + rec.printed;
+        gtk_print_settings_set(impl->m_print_settings, GTK_PRINT_SETTINGS_OUTPUT_URI, uri.c_str());
+        webkit_print_operation_set_print_settings(impl->m_print_operation, impl->m_print_settings);
+
+        print_view(web_view, impl);
+    }
+
+    /**
+     * @brief merge_next
+     * @param user_data
+     * @return G_SOURCE_REMOVE
+     *
+     * Bind the current record into the loaded template.
+     */
+    static gboolean merge_next(gpointer user_data) {
+        PDFprinter_impl *impl = static_cast<PDFprinter_impl *>(user_data);
+        impl->m_recordStart   = std::chrono::steady_clock::now();
+        impl->m_tocPage       = index_pdf::UNSET;
+
+        WebKitSettings *view_settings = webkit_web_view_get_settings(impl->m_web_view);
+        webkit_settings_set_enable_javascript(view_settings, true);
+
+        std::string script = std::string(js_code_merge) + "(" + impl->m_records[impl->m_record].data + ");";
+        webkit_web_view_evaluate_javascript(impl->m_web_view, script.c_str(), -1, NULL, NULL, NULL, (GAsyncReadyCallback)merge_bound, impl);
+        return G_SOURCE_REMOVE;
+    }
+
+    /**
+     * @brief view_ready
+     * @param web_view
+     * @param impl
+     *
+     * The document is loaded and its images are final: bind the merge
+     * records, take page images or print.
+     */
+    static void view_ready(WebKitWebView *web_view, PDFprinter_impl *impl) {
+        // Mail merge: the template is loaded once, the records are bound in turn
+        if (!impl->m_records.empty()) {
+            merge_next(impl);
+            return;
+        }
+
+        // Page images: find the page boxes, then take one snapshot of them all
+        if (!impl->m_raster.empty()) {
+            WebKitSettings *view_settings = webkit_web_view_get_settings(web_view);
+            webkit_settings_set_enable_javascript(view_settings, true);
+
+            std::string script = "window.rasterRanges = [";
+            for (const auto &range : impl->m_pageRanges)
+                script += "[" + std::to_string(range.first) + "," + std::to_string(range.second) + "],";
+            script += "]; ";
+            script += js_code_raster;
+
+            webkit_web_view_evaluate_javascript(web_view, script.c_str(), -1, NULL, NULL, NULL, (GAsyncReadyCallback)raster_boxes_callback, impl);
+            return;
+        }
+
+        print_view(web_view, impl);
+    }
+
+    /**
+     * @brief images_swapped
+     * @param web_view
+     * @param result
+     * @param user_data
+     *
+     * The downscaled images are decoded in the page.
+     */
+    static void images_swapped(WebKitWebView *web_view, GAsyncResult *result, gpointer user_data) {
+        PDFprinter_impl *impl  = static_cast<PDFprinter_impl *>(user_data);
+        GError          *error = NULL;
+
+        JSCValue *js_result = webkit_web_view_call_async_javascript_function_finish(web_view, result, &error);
+        if (error) {
+            wkJlog << iclog::loglevel::warning << iclog::category::CORE
+                   << "Unable to swap in the downscaled images: " << error->message
+                   << iclog::endl;
+            g_error_free(error);
+        } else {
+            wkJlog << iclog::loglevel::debug << iclog::category::CORE
+                   << "Swapped in " << jsc_value_to_int32(js_result) << " downscaled images"
+                   << iclog::endl;
+        }
+        if (js_result)
+            g_object_unref(js_result);
+
+        view_ready(web_view, impl);
+    }
+
+    /**
+     * @brief images_found
+     * @param web_view
+     * @param result
+     * @param user_data
+     *
+     * Shrink every local image drawn at more than m_imageDpi to what its
+     * largest box needs (see encode_image::downscale()), on all cores,
+     * then swap the results into the page as data URIs.
+     */
+    static void images_found(WebKitWebView *web_view, GAsyncResult *result, gpointer user_data) {
+        PDFprinter_impl *impl  = static_cast<PDFprinter_impl *>(user_data);
+        GError          *error = NULL;
+
+        JSCValue    *js_result = webkit_web_view_evaluate_javascript_finish(web_view, result, &error);
+        gchar       *json      = js_result ? jsc_value_to_string(js_result) : NULL;
+        json_object *root      = json ? json_tokener_parse(json) : NULL;
+        if (error) {
+            wkJlog << iclog::loglevel::warning << iclog::category::CORE
+                   << "Unable to find the images to downscale: " << error->message
+                   << iclog::endl;
+            g_error_free(error);
+        }
+        g_free(json);
+        if (js_result)
+            g_object_unref(js_result);
+
+        std::vector<std::unique_ptr<encode_image>> images;
+        std::vector<std::string>                   indices;
+        const double                               perPixel = impl->m_imageDpi / 96.0;
+        size_t                                     count    = root && json_object_is_type(root, json_type_array) ? json_object_array_length(root) : 0;
+        for (size_t i = 0; i < count; ++i) {
+            json_object *img    = json_object_array_get_idx(root, i);
+            json_object *value  = NULL;
+            auto         number = [&img, &value](const char *key) {
+                return json_object_object_get_ex(img, key, &value) ? json_object_get_double(value) : 0.0;
+            };
+
+            const double width  = number("width");
+            const double height = number("height");
+            const double scale  = std::max(width * perPixel / std::max(1.0, number("naturalWidth")), height * perPixel / std::max(1.0, number("naturalHeight")));
+
+            json_object *src = NULL;
+            if (scale <= 0 || scale >= 1 || !json_object_object_get_ex(img, "src", &src) || !json_object_object_get_ex(img, "images", &value))
+                continue;
+
+            gchar *path = g_filename_from_uri(json_object_get_string(src), NULL, NULL);
+            if (!path)
+                continue;
+
+            images.push_back(std::make_unique<encode_image>(path));
+            images.back()->downscale(width * 25.4 / 96, height * 25.4 / 96, impl->m_imageDpi, impl->m_imageQuality);
+            indices.push_back(json_object_to_json_string_ext(value, JSON_C_TO_STRING_PLAIN));
+            g_free(path);
+        }
+        if (root)
+            json_object_put(root);
+
+        if (images.empty()) {
+            view_ready(web_view, impl);
+            return;
+        }
+
+        std::vector<encode_image *> batch;
+        for (auto &image : images)
+            batch.push_back(image.get());
+        encode_image::encode_batch(batch.data(), batch.size());
+
+        std::vector<image_swap> swaps;
+        for (size_t i = 0; i < images.size(); ++i)
+            swaps.push_back({std::move(indices[i]), images[i]->b64_image()});
+        std::string script = image_swap_script(swaps);
+
+        webkit_web_view_call_async_javascript_function(web_view, script.c_str(), -1, NULL, NULL, NULL, NULL, (GAsyncReadyCallback)images_swapped, impl);
+    }
+
+    /**
+     * @brief web_view_load_changed
+     * @param web_view
+     * @param load_event
+     * @param user_data
+     *
+     * Web load monitor callback
+     */
+    static void web_view_load_changed(WebKitWebView *web_view, WebKitLoadEvent load_event, void *user_data) {
+
+        PDFprinter_impl *impl = static_cast<PDFprinter_impl *>(user_data);
+
+        switch (load_event) {
+            case WEBKIT_LOAD_STARTED:
+                wkJlog << iclog::loglevel::debug << iclog::category::CORE
+                       << "WEBKIT LOAD STARTED." << iclog::endl;
+
+                break;
+            case WEBKIT_LOAD_REDIRECTED:
+                break;
+            case WEBKIT_LOAD_COMMITTED:
+                wkJlog << iclog::loglevel::debug << iclog::category::CORE
+                       << "The load is being performed. Current URI is the final one and it "
+                          "won't change unless a new "
+                       << "load is requested or a navigation within the same page is "
+                          "performed."
+                       << iclog::endl;
+                break;
+
+            case WEBKIT_LOAD_FINISHED:
+                wkJlog << iclog::loglevel::debug << iclog::category::CORE
+                       << "WEBKIT LOAD FINISHED - extracting positions" << iclog::endl;
+
+                // Downscale the images first if asked
+                if (impl->m_imageDpi) {
+                    WebKitSettings *view_settings = webkit_web_view_get_settings(web_view);
+                    webkit_settings_set_enable_javascript(view_settings, true);
+                    webkit_web_view_evaluate_javascript(web_view, js_code_images, -1, NULL, NULL, NULL, (GAsyncReadyCallback)images_found, impl);
+                    break;
+                }
+
+                view_ready(web_view, impl);
+                break;
+
+            default:
+                // Ignore other load states (STARTED, COMMITTED, etc.)
+                break;
+        }
+    }
+
+    /**
+     * @brief PDFprinter_impl::prepare_print
+     *
+     * Print settings and page setup from the layout, and a print operation
+     * for m_web_view that writes to out_uri.
+     */
+    void PDFprinter_impl::prepare_print() {
+        wkJlog << iclog::loglevel::debug << iclog::category::CORE
+               << "Applying print settings" << iclog::endl;
+        if (m_print_settings)
+            g_object_unref(m_print_settings);
+        m_print_settings = gtk_print_settings_new();
+        gtk_print_settings_set_printer(m_print_settings, "Print to File");
+        gtk_print_settings_set(m_print_settings, GTK_PRINT_SETTINGS_OUTPUT_FILE_FORMAT, "pdf");
+
+        GtkPageSetup *page_setup = gtk_page_setup_new();
+        gtk_page_setup_set_top_margin(page_setup, 0, GTK_UNIT_MM);
+        gtk_page_setup_set_bottom_margin(page_setup, 0, GTK_UNIT_MM);
+
+        if (key_file_data != NULL) {
+
+            wkJlog << iclog::loglevel::debug << iclog::category::CORE
+                   << "Applying page setup:\n"
+                   << key_file_data << iclog::endl;
+            GKeyFile *key_file = g_key_file_new();
+            g_key_file_load_from_data(key_file, key_file_data, (gsize)-1, G_KEY_FILE_NONE, NULL);
+            gtk_page_setup_load_key_file(page_setup, key_file, NULL, NULL);
+            gtk_print_settings_load_key_file(m_print_settings, key_file, NULL, NULL);
+
+            g_key_file_free(key_file);
+        }
+
+        gtk_print_settings_set(m_print_settings, GTK_PRINT_SETTINGS_OUTPUT_URI, out_uri);
+
+        if (!m_pageRanges.empty()) {
+            // GTK counts from 0, an open end is clamped to the last page
+            std::vector<GtkPageRange> ranges;
+            for (const auto &range : m_pageRanges)
+                ranges.push_back({range.first - 1, range.second ? range.second - 1 : G_MAXINT - 1});
+            gtk_print_settings_set_print_pages(m_print_settings, GTK_PRINT_PAGES_RANGES);
+            gtk_print_settings_set_page_ranges(m_print_settings, ranges.data(), static_cast<int>(ranges.size()));
+        }
+
+        // WebKit2GTK print is async - schedules work and returns immediately
+        m_print_operation = webkit_print_operation_new(m_web_view);
+        g_object_ref_sink(m_print_operation);
+
+        webkit_print_operation_set_print_settings(m_print_operation, m_print_settings);
+        webkit_print_operation_set_page_setup(m_print_operation, page_setup);
+        g_object_unref(page_setup);
+        g_signal_connect(m_print_operation, "finished", G_CALLBACK(print_finished), this);
+    }
+
+    /**
+     * @brief print_failed
+     * @param op
+     * @param error
+     * @param user_data
+     *
+     * Reported to the make_pdf_from_view() callback ("finished" follows).
+     */
+    static void print_failed(WebKitPrintOperation *op __attribute__((unused)), GError *error, gpointer user_data) {
+        PDFprinter_impl *impl = static_cast<PDFprinter_impl *>(user_data);
+        wkJlog << iclog::loglevel::error << iclog::category::CORE
+               << "Printing the view failed: " << (error ? error->message : "unknown error")
+               << iclog::endl;
+        impl->m_failed = true;
+    }
+
+    /**
+     * @brief view_loaded
+     * @param web_view
+     * @param load_event
+     * @param user_data
+     *
+     * The callers view was still loading when make_pdf_from_view() was
+     * called.
+     */
+    static void view_loaded(WebKitWebView *web_view, WebKitLoadEvent load_event, void *user_data) {
+        if (load_event != WEBKIT_LOAD_FINISHED)
+            return;
+        g_signal_handlers_disconnect_by_func(web_view, (gpointer)view_loaded, user_data);
+        print_view(web_view, static_cast<PDFprinter_impl *>(user_data));
+    }
+
+    /**
+     * @brief view_start
+     * @param user_data
+     * @return G_SOURCE_REMOVE
+     *
+     * On the GTK thread: print the callers view as it is laid out.
+     */
+    static gboolean view_start(gpointer user_data) {
+        PDFprinter_impl *impl = static_cast<PDFprinter_impl *>(user_data);
+        impl->m_scripts       = webkit_settings_get_enable_javascript(webkit_web_view_get_settings(impl->m_web_view));
+
+        impl->prepare_print();
+        g_signal_connect(impl->m_print_operation, "failed", G_CALLBACK(print_failed), impl);
+
+        if (webkit_web_view_is_loading(impl->m_web_view)) {
+            g_signal_connect(impl->m_web_view, "load-changed", G_CALLBACK(view_loaded), impl);
+            return G_SOURCE_REMOVE;
+        }
+        print_view(impl->m_web_view, impl);
+        return G_SOURCE_REMOVE;
+    }
+
+    /**
+     * @brief view_finish
+     * @param user_data
+     * @return G_SOURCE_REMOVE
+     *
+     * Hand the view back as it was, then index, post process and write the
+     * result as make_pdf() would and call the callback.  The printer may
+     * be deleted by the callback, nothing touches it afterwards.
+     */
+    static gboolean view_finish(gpointer user_data) {
+        PDFprinter_impl *impl = static_cast<PDFprinter_impl *>(user_data);
+
+        g_signal_handlers_disconnect_by_data(impl->m_print_operation, impl);
+        g_signal_handlers_disconnect_by_data(impl->m_web_view, impl);
+        g_object_unref(impl->m_print_operation);
+        impl->m_print_operation = nullptr;
+
+        webkit_settings_set_enable_javascript(webkit_web_view_get_settings(impl->m_web_view), impl->m_scripts);
+        g_object_unref(impl->m_web_view);
+        impl->m_web_view = nullptr;
+
+        const bool ok = !impl->m_failed;
+        if (ok)
+            impl->finish_output(impl->m_viewTemp);
+        else
+            std::remove(impl->m_viewTemp.c_str());
+        impl->m_external = false;
+
+        if (impl->m_done)
+            impl->m_done(impl->m_owner, ok, impl->m_doneData);
+        return G_SOURCE_REMOVE;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////
+
+    /**
+     * @brief PDFprinter_impl::cb_worker
+     * @param p - cast to pimpl
+     * @return
+     *
+     * Callback to generate PDF from HTML
+     */
+    int PDFprinter_impl::cb_worker(void *p) {
+
+        PDFprinter_impl *impl = reinterpret_cast<PDFprinter_impl *>(p);
+
+#ifdef USE_WEBKIT_6
+        // 1. Create the Headless settings first
         WebKitSettings *settings = webkit_settings_new();
         webkit_settings_set_hardware_acceleration_policy(settings, WEBKIT_HARDWARE_ACCELERATION_POLICY_NEVER);
 
@@ -707,13 +1790,7 @@ namespace phtml {
 
         // g_object_ref_sink(G_OBJECT(impl->m_web_view));
 
-        // WebKit2GTK print is async - schedules work and returns immediately
-        impl->m_print_operation = webkit_print_operation_new(impl->m_web_view);
-        g_object_ref_sink(impl->m_print_operation);
-
-        webkit_print_operation_set_print_settings(impl->m_print_operation, impl->m_print_settings);
-        webkit_print_operation_set_page_setup(impl->m_print_operation, page_setup);
-        g_signal_connect(impl->m_print_operation, "finished", G_CALLBACK(print_finished), impl);
+        impl->prepare_print();
 
         // INNER LOOP: Created here, runs until WebKit2GTK print completes
         impl->m_innerLoop = g_main_loop_new(nullptr, false);
@@ -726,12 +1803,24 @@ namespace phtml {
                    << iclog::endl;
             webkit_web_view_load_html(impl->m_web_view, impl->html_txt, impl->in_uri);
             // webkit_web_view_load_html(web_view, impl->html_txt, impl->base_uri);
+        } else if (!impl->m_treeHost.empty()) {
+            // Read from the tree as it loads, relative links still resolve against in_uri
+            std::string uri = std::string(tree_scheme) + "://" + impl->m_treeHost + (impl->in_uri + 7);
+            wkJlog << iclog::loglevel::debug << iclog::category::CORE
+                   << "Streaming the html tree from " << uri
+                   << iclog::endl;
+            register_tree_scheme(webkit_web_view_get_context(impl->m_web_view));
+            webkit_settings_set_default_charset(view_settings, "utf-8");
+            tree_sources::get().add(impl->m_treeHost, impl->m_htmlTree, impl->m_treePath);
+            webkit_web_view_load_uri(impl->m_web_view, uri.c_str());
         } else {
             webkit_web_view_load_uri(impl->m_web_view, impl->in_uri);
         }
 
         // Run inner loop until print callback signals completion
         g_main_loop_run(impl->m_innerLoop);
+        if (!impl->m_treeHost.empty())
+            tree_sources::get().remove(impl->m_treeHost);
 
         wkJlog << iclog::loglevel::debug << iclog::category::CORE
                << "Performing PDF generation loop cleanup operations."
@@ -801,6 +1890,8 @@ namespace phtml {
 
     static std::string generate_uuid_string() {
         static std::mt19937             gen(std::random_device{}());
+        static std::mutex               genMutex; // Chunks of one job print at the same time
+        std::lock_guard<std::mutex>     lock(genMutex);
         std::uniform_int_distribution<> dis(0, 255);
 
         std::vector<unsigned> sets{4, 2, 2, 2, 6};
@@ -899,26 +1990,23 @@ namespace phtml {
 
     /**
      * @brief PDFprinter::read_file_to_blob
+     * @param path
      *
      * If the caller wishes to conduct post processing then we return a
      * blob rather than a file.
      *
-     * This method creates the Blob and then deletes the file.
+     * This method creates the Blob, the caller deletes the file.
      *
      */
-    void PDFprinter_impl::read_file_to_blob() {
-        // 1. Safety check for out_uri
-        if (!out_uri || std::strlen(out_uri) < 7) {
+    void PDFprinter_impl::read_file_to_blob(const char *path) {
+        // 1. Safety check for path
+        if (!path || !*path) {
             wkJlog << iclog::loglevel::error << iclog::category::CORE
-                   << "Invalid out_uri for blob generation" << iclog::endl;
+                   << "Invalid path for blob generation" << iclog::endl;
             return;
         }
 
-        // 2. Strip "file://" without std::string overhead
-        // out_uri + 7 points to the start of the path after "file://"
-        const char *path = out_uri + 7;
-
-        // 3. Open in binary mode
+        // 2. Open in binary mode
         std::ifstream file(path, std::ios::binary | std::ios::ate);
         if (!file.is_open()) {
             wkJlog << iclog::loglevel::error << iclog::category::CORE
@@ -926,24 +2014,607 @@ namespace phtml {
             return;
         }
 
-        // 4. Size and Read
-        std::streamsize size = file.tellg();
-        if (size <= 0)
-            return;
+        // 3. Size and Read
+        std::streamsize size = file.tellg();
+        if (size <= 0)
+            return;
+
+        file.seekg(0, std::ios::beg);
+
+        // m_binPDF is a private std::vector<unsigned char>, so this is safe internally
+        m_binPDF.resize(static_cast<size_t>(size));
+
+        if (file.read(reinterpret_cast<char *>(m_binPDF.data()), size)) {
+            wkJlog << iclog::loglevel::info << iclog::category::CORE
+                   << "Generated BLOB: " << path << " size=" << m_binPDF.size() << iclog::endl;
+        } else {
+            wkJlog << iclog::loglevel::error << iclog::category::CORE
+                   << "Error reading PDF file contents" << iclog::endl;
+            m_binPDF.clear();
+        }
+    }
+
+    /**
+     * @brief PDFprinter_impl::write_blob_to_file
+     * @param path
+     *
+     * Writes the post processed PDF to the callers output file and
+     * releases the buffer.
+     */
+    void PDFprinter_impl::write_blob_to_file(const char *path) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open() || !file.write(reinterpret_cast<const char *>(m_binPDF.data()), m_binPDF.size())) {
+            wkJlog << iclog::loglevel::error << iclog::category::CORE
+                   << "Failed to write PDF file: " << path << iclog::endl;
+        }
+        m_binPDF.clear();
+        m_binPDF.shrink_to_fit();
+    }
+
+    /**
+     * @brief PDFprinter_impl::finish_output
+     * @param tempFile The file WebKit printed to (if it was not the destination)
+     *
+     * Everything after WebKit has finished: anchors, post-print passes and
+     * the blob.  When the result is needed in memory the index is written
+     * beside the temporary file rather than to the destination.
+     */
+    void PDFprinter_impl::finish_output(const std::string &tempFile) {
+        const bool  buffered = this->buffered();
+        std::string printed  = tempFile;
+
+        // Page images were made from a snapshot, nothing was printed
+        if (!m_raster.empty()) {
+            raster_output();
+            return;
+        }
+
+        // A chunk only hands its pages and positions back to the whole job
+        if (m_chunk) {
+            read_file_to_blob(tempFile.c_str());
+            std::remove(tempFile.c_str());
+            return;
+        }
+
+        // CREATE INDEX (if requested)
+        if ((m_doIndex == index_mode::CLASSIC) || (m_doIndex == index_mode::ENHANCED)) {
+            std::string indexed = buffered ? tempFile + ".idx" : std::string(m_destFile ? m_destFile : "");
+
+            index_pdf idx(m_indexData, m_indexDataCount, m_tocPage);
+            idx.create_anchors(tempFile.c_str(), indexed.c_str());
+            std::remove(tempFile.c_str());
+            printed = indexed;
+        }
+
+        if (!buffered)
+            return;
+
+        // GENERATE BLOB
+        wkJlog << iclog::loglevel::debug << iclog::category::CORE << iclog_FUNCTION
+               << "Making BLOB" << iclog::endl;
+        read_file_to_blob(printed.c_str());
+        std::remove(printed.c_str());
+        if (m_deterministic)
+            fix_metadata(m_binPDF);
+
+        // CACHE (as printed, before any placeholders are filled)
+        if (!m_cacheKey.empty() && !m_binPDF.empty()) {
+            page_cache::get().put(m_cacheKey, std::string(m_binPDF.begin(), m_binPDF.end()));
+            wkJlog << iclog::loglevel::info << iclog::category::CORE
+                   << "Cached " << m_binPDF.size() << " bytes of pages as \"" << m_cacheKey << "\""
+                   << iclog::endl;
+        }
+
+        // SPLICE IN CACHED PAGES
+        if (!m_cachedMarks.empty())
+            splice_output();
+
+        // SPLIT (post processing runs per part)
+        if (m_split) {
+            split_output();
+            return;
+        }
+
+        // POST PROCESS (if requested)
+        if (m_passes != PDF_PASS_NONE) {
+            pdf_postprocess post(m_passes, m_level);
+            post.run(m_binPDF);
+            if (m_deterministic)
+                fix_metadata(m_binPDF); // a rewrite brings a new /ID
+        }
+
+        // WRITE THE RESULT (unless the caller asked for a blob)
+        if (!m_makeBlob && m_destFile)
+            write_blob_to_file(m_destFile);
+    }
+
+    /**
+     * @brief PDFprinter_impl::buffered
+     * @return true if the printed file has to pass through memory
+     */
+    bool PDFprinter_impl::buffered() const {
+        return m_makeBlob || m_passes != PDF_PASS_NONE || m_split || m_splice || !m_cacheKey.empty() || m_deterministic;
+    }
+
+    /**
+     * @brief PDFprinter_impl::fix_metadata
+     * @param bytes A PDF
+     *
+     * Deterministic output: /CreationDate and /ModDate in the document
+     * information become 2000-01-01 00:00 and the /ID strings of every
+     * trailer are taken from render_key().  pdf_compact finds the values,
+     * stream data is never touched.  The bytes are changed in place at the
+     * same length so the cross-reference offsets stay valid.
+     */
+    void PDFprinter_impl::fix_metadata(std::vector<unsigned char> &bytes) const {
+        static const char date[] = "20000101000000";
+        const std::string key    = render_key();
+
+        std::vector<std::pair<size_t, size_t>> dates, ids;
+        if (!pdf_compact().metadata(std::string(bytes.begin(), bytes.end()), dates, ids)) {
+            wkJlog << iclog::loglevel::warning << iclog::category::CORE << iclog_FUNCTION
+                   << "Unable to read the PDF, its dates and /ID are left as they are"
+                   << iclog::endl;
+            return;
+        }
+
+        for (const auto &value : dates) {
+            size_t digit = 0;
+            for (size_t i = value.first + 1; i + 1 < value.second; ++i) {
+                if (std::isdigit(bytes[i]))
+                    bytes[i] = digit < 14 ? date[digit++] : '0';
+            }
+        }
+
+        for (const auto &value : ids) {
+            bool   hex   = false;
+            size_t digit = 0;
+            for (size_t i = value.first + 1; i + 1 < value.second; ++i) {
+                if (bytes[i] == '<' || bytes[i] == '>') {
+                    hex   = bytes[i] == '<';
+                    digit = 0;
+                } else if (hex && std::isxdigit(bytes[i])) {
+                    bytes[i] = key[digit++ % key.size()];
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief PDFprinter_impl::render_key
+     * @return The content address of this job: everything that changes
+     * the bytes produced
+     */
+    std::string PDFprinter_impl::render_key() const {
+        render_hash hash;
+        hash.add(APP_VERSION);
+        hash.add(html_txt);
+        hash.add(in_uri);
+        hash.add(key_file_data);
+        hash.add(default_stylesheet);
+        hash.add_value(m_doIndex);
+        hash.add_value(m_passes);
+        hash.add_value(m_level);
+        for (const auto &range : m_pageRanges) {
+            hash.add_value(range.first);
+            hash.add_value(range.second);
+        }
+        hash.add(m_raster);
+        hash.add_value(m_dpi);
+        hash.add_value(m_quality);
+        hash.add_value(m_deterministic);
+        hash.add_value(m_imageDpi);
+        hash.add_value(m_imageQuality);
+        if (m_record < m_records.size())
+            hash.add(m_records[m_record].data);
+        return hash.hex();
+    }
+
+    /**
+     * @brief PDFprinter_impl::tree_source
+     *
+     * Stream the tree of set_param_from_tree() into the view, unless the
+     * job needs the page as text: chunks() and window() cut it, the render
+     * cache hashes it and image_dpi() looks for file: images in it.  Only
+     * pages with a file: base URI can be served, see tree_scheme_request().
+     */
+    void PDFprinter_impl::tree_source() {
+        m_treeHost.clear();
+        if (!m_htmlTree)
+            return;
+
+        delete[] html_txt;
+        html_txt = nullptr;
+
+        const bool local = in_uri && std::strncmp(in_uri, "file:///", 8) == 0;
+        if (local && m_chunks == 1 && !m_window && !m_imageDpi && !render_store::get().enabled()) {
+            gchar *path = g_uri_unescape_string(in_uri + 7, nullptr);
+            m_treePath  = path ? path : "";
+            m_treeHost  = generate_uuid_string();
+            g_free(path);
+            return;
+        }
+
+        std::string page;
+        process_nodes(m_htmlTree, [](const char *data, size_t size, void *out) {
+            static_cast<std::string *>(out)->append(data, size);
+            return true;
+        }, &page);
+        cstring_cpy(page.c_str(), html_txt);
+        wkJlog << iclog::loglevel::debug << iclog::category::CORE
+               << "Built the html tree into a page of " << page.size() << " bytes"
+               << iclog::endl;
+    }
+
+    /**
+     * @brief PDFprinter_impl::render_cached
+     * @return true if the job was answered by, or rendered through, the
+     * render cache
+     *
+     * Not with split(), cache_pages() or while the page cache could
+     * splice pages in.  A hit has no anchors for get_anchors().
+     */
+    bool PDFprinter_impl::render_cached() {
+        render_store &store = render_store::get();
+        if (!html_txt || m_split || m_splice || !m_cacheKey.empty() || !store.enabled())
+            return false;
+
+        // GUI mode renders on the callers own loop, waiting there would stall the render it waits for
+        const std::string                  key  = render_key();
+        const bool                         wait = WKGTK_run_mode != WKGTKRunMode::UNSET;
+        std::shared_ptr<const std::string> doc;
+        if (!store.acquire(key, wait, doc)) {
+            if (!doc)
+                return false;
+            wkJlog << iclog::loglevel::info << iclog::category::CORE
+                   << "Render cache hit " << key << " (" << doc->size() << " bytes)"
+                   << iclog::endl;
+            m_binPDF.assign(doc->begin(), doc->end());
+            if (!m_makeBlob && m_destFile)
+                write_blob_to_file(m_destFile);
+            return true;
+        }
+
+        // Keep the result in memory to share it, then hand it over as usual
+        const bool makeBlob = m_makeBlob;
+        m_makeBlob          = true;
+        render();
+        m_makeBlob = makeBlob;
+
+        if (m_parts.empty() && !m_binPDF.empty())
+            doc = std::make_shared<const std::string>(m_binPDF.begin(), m_binPDF.end());
+        store.release(key, doc);
+
+        if (!m_makeBlob && m_destFile) {
+            if (!m_parts.empty())
+                raster_output();
+            else
+                write_blob_to_file(m_destFile);
+        }
+        return true;
+    }
+
+    /**
+     * @brief PDFprinter_impl::page_position
+     * @param page A page of the whole document (1 based)
+     * @param next Take the first printed page after @p page if it is not printed
+     * @return Where the page lands in the printed document (1 based), 0 if it
+     * is not printed
+     */
+    int PDFprinter_impl::page_position(int page, bool next) const {
+        if (m_pageRanges.empty())
+            return page;
+
+        int before = 0;
+        for (const auto &range : m_pageRanges) {
+            if (page < range.first)
+                return next ? before + 1 : 0;
+            if (!range.second || page <= range.second)
+                return before + page - range.first + 1;
+            before += range.second - range.first + 1;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief PDFprinter_impl::select_pages
+     *
+     * The page script numbers the whole document.  With page ranges set,
+     * move every page number onto the printed document.  Links from or to
+     * a page that is not printed are dropped, a split mark moves to the
+     * next printed page and a cached page placeholder that is not printed
+     * is forgotten.
+     */
+    void PDFprinter_impl::select_pages() {
+        if (m_pageRanges.empty())
+            return;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < m_indexDataCount; ++i) {
+            PDF_Anchor a    = m_indexData[i];
+            int        from = page_position(a.index.pageNo);
+            int        to   = a.target.pageNo > 0 ? page_position(a.target.pageNo) : 0;
+            if (!from || (a.target.pageNo > 0 && !to)) {
+                free((void *)a.linkName);
+                free((void *)a.index.title);
+                free((void *)a.target.title);
+                continue;
+            }
+            a.index.pageNo = from;
+            if (to)
+                a.target.pageNo = to;
+            m_indexData[kept++] = a;
+        }
+        if (kept != m_indexDataCount) {
+            wkJlog << iclog::loglevel::info << iclog::category::CORE
+                   << "Dropped " << static_cast<unsigned long>(m_indexDataCount - kept) << " links outside the printed pages"
+                   << iclog::endl;
+        }
+        m_indexDataCount = kept;
+
+        if (m_tocPage != index_pdf::UNSET) {
+            int toc   = page_position(m_tocPage + 1);
+            m_tocPage = toc ? toc - 1 : index_pdf::UNSET;
+        }
+
+        // A group keeps its name while any of its pages are printed
+        std::vector<std::pair<int, std::string>> marks;
+        for (auto &mark : m_splitMarks) {
+            int page = page_position(mark.first, true);
+            if (!page)
+                continue;
+            if (!marks.empty() && marks.back().first == page)
+                marks.back().second = std::move(mark.second);
+            else
+                marks.emplace_back(page, std::move(mark.second));
+        }
+        m_splitMarks = std::move(marks);
+
+        marks.clear();
+        for (auto &mark : m_cachedMarks) {
+            int page = page_position(mark.first);
+            if (page)
+                marks.emplace_back(page, std::move(mark.second));
+        }
+        m_cachedMarks = std::move(marks);
+    }
+
+    /**
+     * @brief PDFprinter_impl::splice_output
+     *
+     * Put the cached pages in place of each data-cached-pages placeholder.
+     * A key missing from the cache leaves its placeholder page as it was
+     * printed.
+     */
+    void PDFprinter_impl::splice_output() {
+        std::vector<std::shared_ptr<const std::string>>     held;
+        std::vector<std::pair<size_t, const std::string *>> inserts;
+        for (const auto &mark : m_cachedMarks) {
+            auto doc = page_cache::get().find(mark.second);
+            if (!doc || mark.first < 1) {
+                wkJlog << iclog::loglevel::warning << iclog::category::CORE
+                       << "No cached pages for \"" << mark.second << "\", placeholder page " << mark.first << " kept"
+                       << iclog::endl;
+                continue;
+            }
+            inserts.emplace_back(mark.first - 1, doc.get());
+            held.push_back(std::move(doc));
+        }
+        if (inserts.empty())
+            return;
+
+        std::string         pdf(m_binPDF.begin(), m_binPDF.end()), out;
+        std::vector<size_t> pageMap;
+        pdf_compact         splicer;
+        if (!splicer.splice(pdf, inserts, out, &pageMap)) {
+            wkJlog << iclog::loglevel::error << iclog::category::CORE
+                   << "Unable to splice in the cached pages, placeholders kept"
+                   << iclog::endl;
+            return;
+        }
+
+        wkJlog << iclog::loglevel::info << iclog::category::CORE
+               << "Spliced cached pages into " << inserts.size() << " placeholders"
+               << iclog::endl;
+        m_binPDF.assign(out.begin(), out.end());
+
+        // The data-split marks were counted before the placeholders grew
+        for (auto &mark : m_splitMarks) {
+            if (mark.first >= 1 && static_cast<size_t>(mark.first) <= pageMap.size())
+                mark.first = static_cast<int>(pageMap[mark.first - 1]) + 1;
+        }
+    }
+
+    /**
+     * @brief part_path
+     * @param dest The callers output file, "out.pdf"
+     * @param name The data-split value
+     * @param part
+     * @return "out-<name>.pdf", or "out-<part + 1>.pdf" for an unnamed part
+     */
+    static std::string part_path(const std::string &dest, const std::string &name, size_t part) {
+        std::string base = dest, ext;
+        size_t      dot  = base.rfind('.');
+        if (dot != std::string::npos && (base.rfind('/') == std::string::npos || dot > base.rfind('/'))) {
+            ext = base.substr(dot);
+            base.erase(dot);
+        }
+
+        std::string label = name.empty() ? std::to_string(part + 1) : name;
+        for (char &c : label) {
+            if (c == '/' || c == '\\' || std::iscntrl(static_cast<unsigned char>(c)))
+                c = '_';
+        }
+        return base + "-" + label + ext;
+    }
+
+    /**
+     * @brief append_png
+     *
+     * cairo PNG writer into a std::vector<unsigned char>.
+     */
+    static cairo_status_t append_png(void *closure, const unsigned char *data, unsigned int length) {
+        auto *out = static_cast<std::vector<unsigned char> *>(closure);
+        out->insert(out->end(), data, data + length);
+        return CAIRO_STATUS_SUCCESS;
+    }
+
+    /**
+     * @brief PDFprinter_impl::raster_pages
+     * @param snapshot The document at @p zoom
+     * @param zoom
+     *
+     * Cuts each page box out of the snapshot at m_dpi, on white, and
+     * encodes it as PNG (cairo) or JPEG (gdk-pixbuf) into m_parts under its
+     * page number.
+     */
+    void PDFprinter_impl::raster_pages(cairo_surface_t *snapshot, double zoom) {
+        const double scale = m_dpi / 96.0;
+        const bool   jpeg  = m_raster == "jpeg" || m_raster == "jpg";
+
+        m_parts.clear();
+        for (const page_box &box : m_pageBoxes) {
+            int              width  = std::max(1, static_cast<int>(std::lround(box.w * scale)));
+            int              height = std::max(1, static_cast<int>(std::lround(box.h * scale)));
+            cairo_surface_t *page   = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+            cairo_t         *cr     = cairo_create(page);
+
+            cairo_set_source_rgb(cr, 1, 1, 1);
+            cairo_paint(cr);
+            cairo_scale(cr, scale / zoom, scale / zoom);
+            cairo_set_source_surface(cr, snapshot, -box.x * zoom, -box.y * zoom);
+            cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+            cairo_paint(cr);
+            cairo_destroy(cr);
+            cairo_surface_flush(page);
+
+            std::vector<unsigned char> image;
+            if (jpeg) {
+                // cairo RGB24 is a native endian 0x00RRGGBB per pixel
+                GdkPixbuf     *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+                unsigned char *src    = cairo_image_surface_get_data(page);
+                int            stride = cairo_image_surface_get_stride(page);
+                for (int y = 0; pixbuf && y < height; ++y) {
+                    const uint32_t *in  = reinterpret_cast<const uint32_t *>(src + y * stride);
+                    guchar         *out = gdk_pixbuf_get_pixels(pixbuf) + y * gdk_pixbuf_get_rowstride(pixbuf);
+                    for (int x = 0; x < width; ++x) {
+                        *out++ = (in[x] >> 16) & 0xff;
+                        *out++ = (in[x] >> 8) & 0xff;
+                        *out++ = in[x] & 0xff;
+                    }
+                }
+
+                gchar      *buffer  = nullptr;
+                gsize       size    = 0;
+                std::string quality = std::to_string(std::clamp(m_quality, 1, 100));
+                if (pixbuf && gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &size, "jpeg", NULL, "quality", quality.c_str(), NULL))
+                    image.assign(buffer, buffer + size);
+                g_free(buffer);
+                if (pixbuf)
+                    g_object_unref(pixbuf);
+            } else {
+                cairo_surface_write_to_png_stream(page, append_png, &image);
+            }
+            cairo_surface_destroy(page);
+
+            if (image.empty()) {
+                wkJlog << iclog::loglevel::error << iclog::category::CORE
+                       << "Unable to encode page " << box.page << " as " << m_raster
+                       << iclog::endl;
+                continue;
+            }
+            m_parts.emplace_back(std::to_string(box.page), std::move(image));
+        }
+        m_pageBoxes.clear();
+    }
+
+    /**
+     * @brief PDFprinter_impl::raster_output
+     *
+     * A single image is the result, as a PDF would be (get_blob() or the
+     * output file).  Several are written beside the output file as
+     * "out-<page>.png", or kept for get_blobs().
+     */
+    void PDFprinter_impl::raster_output() {
+        wkJlog << iclog::loglevel::info << iclog::category::CORE
+               << "Made " << m_parts.size() << " " << m_raster << " page images at " << m_dpi << " DPI"
+               << iclog::endl;
+
+        if (m_parts.size() == 1) {
+            m_binPDF.swap(m_parts.front().second);
+            m_parts.clear();
+            if (!m_makeBlob && m_destFile)
+                write_blob_to_file(m_destFile);
+            return;
+        }
+        if (m_makeBlob || !m_destFile)
+            return;
+
+        for (size_t i = 0; i < m_parts.size(); ++i) {
+            m_binPDF.swap(m_parts[i].second);
+            write_blob_to_file(part_path(m_destFile, m_parts[i].first, i).c_str());
+        }
+        m_parts.clear();
+    }
+
+    /**
+     * @brief PDFprinter_impl::split_output
+     *
+     * Cut the printed document at the data-split marks.  Each part is
+     * post processed and written (or kept for get_blobs()) as soon as it
+     * is cut so a file run never holds more than one part.
+     */
+    void PDFprinter_impl::split_output() {
+        std::vector<size_t>      firstPages;
+        std::vector<std::string> names;
+        if (m_splitMarks.empty() || m_splitMarks.front().first > 1)
+            names.push_back("");
+        for (const auto &mark : m_splitMarks) {
+            if (mark.first < 1 || (!firstPages.empty() && static_cast<size_t>(mark.first - 1) <= firstPages.back()))
+                continue;
+            firstPages.push_back(mark.first - 1);
+            names.push_back(mark.second);
+        }
+
+        std::string pdf(m_binPDF.begin(), m_binPDF.end());
+        m_parts.clear();
 
-        file.seekg(0, std::ios::beg);
+        pdf_compact splitter;
+        size_t      parts = 0;
+        bool        ok    = splitter.split(pdf, firstPages, [this, &names, &parts](size_t part, std::string &data) {
+            std::vector<unsigned char> bytes(data.begin(), data.end());
+            if (m_passes != PDF_PASS_NONE) {
+                pdf_postprocess post(m_passes, m_level);
+                post.run(bytes);
+            }
+            if (m_deterministic)
+                fix_metadata(bytes);
 
-        // m_binPDF is a private std::vector<unsigned char>, so this is safe internally
-        m_binPDF.resize(static_cast<size_t>(size));
+            std::string name = part < names.size() ? names[part] : "";
+            ++parts;
+            if (m_makeBlob || !m_destFile) {
+                m_parts.emplace_back(name, std::move(bytes));
+            } else {
+                m_binPDF.swap(bytes);
+                write_blob_to_file(part_path(m_destFile, name, part).c_str());
+            }
+        });
 
-        if (file.read(reinterpret_cast<char *>(m_binPDF.data()), size)) {
-            wkJlog << iclog::loglevel::info << iclog::category::CORE
-                   << "Generated BLOB: " << path << " size=" << m_binPDF.size() << iclog::endl;
-        } else {
+        if (!ok) {
             wkJlog << iclog::loglevel::error << iclog::category::CORE
-                   << "Error reading PDF file contents" << iclog::endl;
-            m_binPDF.clear();
+                   << "Unable to split the document, writing it whole"
+                   << iclog::endl;
+            m_binPDF.assign(pdf.begin(), pdf.end());
+            if (!m_makeBlob && m_destFile)
+                write_blob_to_file(m_destFile);
+            return;
         }
+
+        wkJlog << iclog::loglevel::info << iclog::category::CORE
+               << "Split into " << parts << " documents"
+               << iclog::endl;
+        m_binPDF.clear();
+        m_binPDF.shrink_to_fit();
     }
 
     /******************************************************************************/
@@ -964,14 +2635,16 @@ namespace phtml {
      * @see layout() for custom page setup without print settings.
      */
     void PDFprinter::set_param(const char *html, const char *printSettings, const char *outFile, index_mode createIndex) {
-        m_pimpl->m_doIndex = createIndex;
+        m_pimpl->m_doIndex  = createIndex;
+        m_pimpl->m_htmlTree = nullptr;
         cstring_cpy(html, m_pimpl->html_txt);
         cstring_cpy(outFile, m_pimpl->m_destFile);
         cstring_cpy(printSettings, m_pimpl->key_file_data);
     }
 
     void PDFprinter::set_param_from_file(const char *htmlFile, const char *printSettings, const char *outFile, index_mode createIndex) {
-        m_pimpl->m_doIndex = createIndex;
+        m_pimpl->m_doIndex  = createIndex;
+        m_pimpl->m_htmlTree = nullptr;
         cstring_cpy(outFile, m_pimpl->m_destFile);
         cstring_cpy(printSettings, m_pimpl->key_file_data);
 
@@ -992,13 +2665,15 @@ namespace phtml {
      * @see set_param(std::string, std::string, std::string) for print settings.
      */
     void PDFprinter::set_param(const char *html, const char *outFile, index_mode createIndex) {
-        m_pimpl->m_doIndex = createIndex;
+        m_pimpl->m_doIndex  = createIndex;
+        m_pimpl->m_htmlTree = nullptr;
         cstring_cpy(outFile, m_pimpl->m_destFile);
         cstring_cpy(html, m_pimpl->html_txt);
     }
 
     void PDFprinter::set_param_from_file(const char *htmlFile, const char *outFile, index_mode createIndex) {
-        m_pimpl->m_doIndex = createIndex;
+        m_pimpl->m_doIndex  = createIndex;
+        m_pimpl->m_htmlTree = nullptr;
         cstring_cpy(outFile, m_pimpl->m_destFile);
 
         delete[] m_pimpl->html_txt;
@@ -1025,18 +2700,40 @@ namespace phtml {
      * @see get_blob() to retrieve the PDF as a binary blob.
      */
     void PDFprinter::set_param(const char *html, index_mode createIndex) {
-        m_pimpl->m_doIndex = createIndex;
+        m_pimpl->m_doIndex  = createIndex;
+        m_pimpl->m_htmlTree = nullptr;
         cstring_cpy(html, m_pimpl->html_txt);
         m_pimpl->m_makeBlob = true;
     }
 
     void PDFprinter::set_param_from_file(const char *htmlFile, index_mode createIndex) {
-        m_pimpl->m_doIndex = createIndex;
+        m_pimpl->m_doIndex  = createIndex;
+        m_pimpl->m_htmlTree = nullptr;
 
         delete[] m_pimpl->html_txt;
         m_pimpl->html_txt = m_pimpl->read_file(htmlFile ? htmlFile : "");
     }
 
+    /**
+     * @brief Configure PDF generation from an html_tree, without building
+     * its page as one string.
+     *
+     * @param dom The root, process_nodes() need not be called.
+     * @param outFile Output file path, nullptr for get_blob().
+     *
+     * WebKit reads the tree a chunk at a time while it loads the page, so
+     * the tree must stay alive and unchanged until make_pdf() returns.
+     */
+    void PDFprinter::set_param_from_tree(const html_tree *dom, const char *outFile, index_mode createIndex) {
+        m_pimpl->m_doIndex  = createIndex;
+        m_pimpl->m_htmlTree = dom;
+        m_pimpl->m_makeBlob = outFile == nullptr;
+        cstring_cpy(outFile, m_pimpl->m_destFile);
+
+        delete[] m_pimpl->html_txt;
+        m_pimpl->html_txt = nullptr;
+    }
+
     /******************************************************************************/
     /*  LAYOUT                                                                    */
     /******************************************************************************/
@@ -1125,32 +2822,442 @@ namespace phtml {
     /*  MAKE PDF                                                                  */
     /******************************************************************************/
     /**
-     * @brief PDFprinter::make_pdf
+     * @brief find_ci
+     * Case insensitive find of a lower case @p what.
+     */
+    static size_t find_ci(const std::string &s, const char *what, size_t from = 0) {
+        size_t len = std::strlen(what);
+        for (size_t i = from; i + len <= s.size(); ++i) {
+            size_t j = 0;
+            while (j < len && std::tolower(static_cast<unsigned char>(s[i + j])) == what[j])
+                ++j;
+            if (j == len)
+                return i;
+        }
+        return std::string::npos;
+    }
+
+    /**
+     * @brief has_page_class
+     * @param tag The text of an opening tag, "<div class=...>"
+     * @return true if "page" is one of its classes
+     */
+    static bool has_page_class(const std::string &tag) {
+        size_t pos = 0;
+        while ((pos = find_ci(tag, "class", pos)) != std::string::npos) {
+            bool   word = pos > 0 && std::isspace(static_cast<unsigned char>(tag[pos - 1]));
+            size_t eq   = tag.find_first_not_of(" \t\r\n", pos + 5);
+            pos += 5;
+            if (!word || eq == std::string::npos || tag[eq] != '=')
+                continue;
+
+            size_t b = tag.find_first_not_of(" \t\r\n", eq + 1), e;
+            if (b == std::string::npos)
+                return false;
+            if (tag[b] == '"' || tag[b] == '\'') {
+                e = tag.find(tag[b], b + 1);
+                ++b;
+            } else {
+                e = tag.find_first_of(" \t\r\n>", b);
+            }
+            std::istringstream classes(tag.substr(b, e == std::string::npos ? std::string::npos : e - b));
+            std::string        name;
+            while (classes >> name) {
+                if (name == "page")
+                    return true;
+            }
+            return false;
+        }
+        return false;
+    }
+
+    /**
+     * @brief html_pages
      *
-     * Generate the pdf.
+     * Where the top level .page elements of a document start.  Every
+     * piece built from them keeps the whole <head>, and any body content
+     * before the first page or after the last (scripts, styles) is
+     * repeated in each.
+     */
+    struct html_pages {
+            std::string         head;
+            std::string         trail;
+            std::vector<size_t> starts; // each page, then the end of the last
+
+            size_t      count() const { return starts.empty() ? 0 : starts.size() - 1; }
+            std::string piece(const std::string &html, size_t first, size_t last) const {
+                return head + html.substr(starts[first], starts[last] - starts[first]) + trail;
+            }
+    };
+
+    /**
+     * @brief find_pages
+     * @param html
+     * @param pages
+     * @return false if the body is not a run of at least two top level
+     * .page elements
      */
+    static bool find_pages(const std::string &html, html_pages &pages) {
+        static const char *const voidTags[] = {"area", "base", "br", "col", "embed", "hr", "img", "input", "link", "meta", "source", "track", "wbr"};
+
+        size_t body = find_ci(html, "<body");
+        if (body == std::string::npos || (body = html.find('>', body)) == std::string::npos)
+            return false;
+        size_t bodyStart = body + 1;
+        size_t bodyEnd   = html.size();
+        for (size_t at = bodyStart; (at = find_ci(html, "</body", at)) != std::string::npos; ++at)
+            bodyEnd = at;
+
+        std::vector<size_t> starts;
+        size_t              lastEnd = std::string::npos;
+        int                 depth   = 0;
+        bool                inPage  = false;
+        for (size_t pos = bodyStart; pos < bodyEnd;) {
+            size_t lt = html.find('<', pos);
+            if (lt == std::string::npos || lt >= bodyEnd)
+                break;
+            if (html.compare(lt, 4, "<!--") == 0) {
+                size_t end = html.find("-->", lt + 4);
+                pos        = end == std::string::npos ? bodyEnd : end + 3;
+                continue;
+            }
 
-    void PDFprinter_impl::make_pdf_int() {
+            // The end of the tag, skipping quoted attribute values
+            size_t gt    = lt + 1;
+            char   quote = 0;
+            for (; gt < bodyEnd; ++gt) {
+                if (quote) {
+                    if (html[gt] == quote)
+                        quote = 0;
+                } else if (html[gt] == '"' || html[gt] == '\'') {
+                    quote = html[gt];
+                } else if (html[gt] == '>') {
+                    break;
+                }
+            }
+            if (gt >= bodyEnd)
+                break;
+            pos = gt + 1;
 
-        // DIRECTLY CREATE THE PDF
-        if (m_doIndex == index_mode::OFF && m_destFile) {
-            // Use std::string as a local "calculator" only
-            std::string full_uri  = "file://";
-            full_uri             += m_destFile;
-            cstring_cpy(full_uri.c_str(), out_uri);
+            if (html[lt + 1] == '/') {
+                if (--depth == 0 && inPage) {
+                    lastEnd = pos;
+                    inPage  = false;
+                }
+                continue;
+            }
+            if (!std::isalpha(static_cast<unsigned char>(html[lt + 1])))
+                continue; // <!DOCTYPE>, <?...?>
+
+            size_t      nameEnd = html.find_first_of(" \t\r\n/>", lt + 1);
+            std::string name    = html.substr(lt + 1, nameEnd - lt - 1);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+
+            if (name == "script" || name == "style") {
+                size_t end = find_ci(html, ("</" + name).c_str(), pos);
+                pos        = end == std::string::npos ? bodyEnd : end;
+                ++depth; // closed by the end tag found above
+            } else if (html[gt - 1] == '/' || std::find_if(std::begin(voidTags), std::end(voidTags), [&name](const char *v) { return name == v; }) != std::end(voidTags)) {
+                // Nothing to close
+            } else {
+                if (depth == 0 && has_page_class(html.substr(lt, pos - lt))) {
+                    starts.push_back(lt);
+                    inPage = true;
+                }
+                ++depth;
+            }
         }
-        std::string tempFile;
-        // PREVENT TEMP FILE GENERATION OVERRIDE IN TEST MODE
 
-        tempFile = "/tmp/" + generate_uuid_string();
+        if (starts.size() < 2 || lastEnd == std::string::npos || lastEnd < starts.back())
+            return false;
 
-        // POST PROCESS (index or create blob)
-        if ((m_doIndex != index_mode::OFF) || m_makeBlob) {
-            std::string fullUri = "file://" + tempFile;
-            cstring_cpy(fullUri.c_str(), out_uri);
+        starts.push_back(lastEnd);
+        pages.head   = html.substr(0, starts.front());
+        pages.trail  = html.substr(lastEnd);
+        pages.starts = std::move(starts);
+        return true;
+    }
+
+    /**
+     * @brief PDFprinter_impl::make_part
+     * @param html One piece of the document
+     * @return A printer for the piece that keeps its pages in memory
+     */
+    std::unique_ptr<PDFprinter_impl> PDFprinter_impl::make_part(const std::string &html) const {
+        auto part = std::make_unique<PDFprinter_impl>();
+        cstring_cpy(html.c_str(), part->html_txt);
+        cstring_cpy(in_uri, part->in_uri);
+        cstring_cpy(key_file_data, part->key_file_data);
+        cstring_cpy(default_stylesheet, part->default_stylesheet);
+        part->m_doIndex      = m_doIndex;
+        part->m_split        = m_split;
+        part->m_splice       = m_splice;
+        part->m_imageDpi     = m_imageDpi;
+        part->m_imageQuality = m_imageQuality;
+        part->m_makeBlob     = true;
+        part->m_chunk        = true;
+        return part;
+    }
+
+    /**
+     * @brief PDFprinter_impl::adopt_part
+     * @param part A printed piece
+     * @param offset The pages ahead of it
+     * @param targets Every link target seen so far
+     * @param anchors Every link seen so far
+     *
+     * Everything a piece numbered from its own first page moves on by the
+     * pages ahead of it.  The anchor strings change hands with the structs.
+     */
+    void PDFprinter_impl::adopt_part(PDFprinter_impl &part, int offset, link_targets &targets, std::vector<PDF_Anchor> &anchors) {
+        for (auto &target : part.m_targets) {
+            target.second.second.pageNo += offset;
+            targets.emplace(target.first, target.second);
+        }
+        for (auto &mark : part.m_splitMarks)
+            m_splitMarks.emplace_back(mark.first + offset, mark.second);
+        for (auto &mark : part.m_cachedMarks)
+            m_cachedMarks.emplace_back(mark.first + offset, mark.second);
+        if (m_tocPage == index_pdf::UNSET && part.m_tocPage != index_pdf::UNSET)
+            m_tocPage = part.m_tocPage + offset;
+
+        for (size_t j = 0; j < part.m_indexDataCount; ++j) {
+            anchors.push_back(part.m_indexData[j]);
+            if (anchors.back().index.pageNo > 0)
+                anchors.back().index.pageNo += offset;
+        }
+        free(part.m_indexData);
+        part.m_indexData      = nullptr;
+        part.m_indexDataCount = 0;
+    }
+
+    /**
+     * @brief PDFprinter_impl::link_parts
+     * @param targets
+     * @param anchors
+     *
+     * Points every link at its target, wherever the target was printed,
+     * and takes the anchors over as the index data of the whole job.
+     */
+    void PDFprinter_impl::link_parts(const link_targets &targets, std::vector<PDF_Anchor> &anchors) {
+        if (m_indexData) {
+            PDF_FreeAnchors({m_indexData, m_indexDataCount});
+            m_indexData      = nullptr;
+            m_indexDataCount = 0;
+        }
+
+        for (PDF_Anchor &a : anchors) {
+            auto it = targets.find(a.linkName ? a.linkName : "");
+            if (it != targets.end()) {
+                free((void *)a.target.title);
+                a.target       = it->second.second;
+                a.target.title = strdup(it->second.first.c_str());
+            }
+        }
+
+        if (!anchors.empty() && (m_indexData = (PDF_Anchor *)calloc(anchors.size(), sizeof(PDF_Anchor)))) {
+            std::copy(anchors.begin(), anchors.end(), m_indexData);
+            m_indexDataCount = anchors.size();
+        }
+        anchors.clear();
+    }
+
+    /**
+     * @brief PDFprinter_impl::make_pdf_chunked
+     * @return false if the document can not be cut (nothing was printed)
+     *
+     * Prints the pieces of the document on their own WebViews at the same
+     * time, each in its own WebProcess, then joins the results.  Link
+     * positions, the toc page and the split and cached page marks are
+     * moved on by the pages ahead of their piece so that indexing and the
+     * later stages see one document.
+     */
+    bool PDFprinter_impl::make_pdf_chunked() {
+        unsigned   count = m_chunks ? m_chunks : std::max(1u, std::thread::hardware_concurrency());
+        html_pages pages;
+        if (count < 2 || !html_txt || !find_pages(html_txt, pages))
+            return false;
+
+        count = std::min<unsigned>(count, pages.count());
+        std::vector<std::unique_ptr<PDFprinter_impl>> parts;
+        std::vector<size_t>                           pageCounts;
+        for (unsigned i = 0; i < count; ++i) {
+            size_t first = pages.count() * i / count;
+            size_t last  = pages.count() * (i + 1) / count;
+            parts.push_back(make_part(pages.piece(html_txt, first, last)));
+            pageCounts.push_back(last - first);
+        }
+        pages = html_pages();
+
+        wkJlog << iclog::loglevel::info << iclog::category::CORE
+               << "Printing " << static_cast<unsigned>(parts.size()) << " chunks in parallel"
+               << iclog::endl;
+
+        auto                     start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (auto &part : parts)
+            workers.emplace_back([&part]() { part->make_pdf_int(); });
+        for (auto &worker : workers)
+            worker.join();
+
+        std::vector<std::string> docs;
+        for (auto &part : parts) {
+            if (part->m_binPDF.empty()) {
+                wkJlog << iclog::loglevel::error << iclog::category::CORE
+                       << "A chunk failed to print, printing the document whole"
+                       << iclog::endl;
+                return false;
+            }
+            docs.emplace_back(part->m_binPDF.begin(), part->m_binPDF.end());
+            part->m_binPDF.clear();
+            part->m_binPDF.shrink_to_fit();
+        }
+
+        std::string merged;
+        pdf_compact merger;
+        if (!merger.merge(docs, merged)) {
+            wkJlog << iclog::loglevel::error << iclog::category::CORE
+                   << "Unable to join the chunks, printing the document whole"
+                   << iclog::endl;
+            return false;
+        }
+        docs.clear();
+
+        link_targets            targets;
+        std::vector<PDF_Anchor> anchors;
+        int                     offset = 0;
+        m_splitMarks.clear();
+        m_cachedMarks.clear();
+        for (size_t i = 0; i < parts.size(); ++i) {
+            adopt_part(*parts[i], offset, targets, anchors);
+            offset += static_cast<int>(pageCounts[i]);
+        }
+        link_parts(targets, anchors);
+        parts.clear();
+
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        wkJlog << iclog::loglevel::info << iclog::category::CORE
+               << "Printed and joined " << static_cast<unsigned>(pageCounts.size()) << " chunks in " << static_cast<long>(ms) << "ms"
+               << iclog::endl;
+
+        m_binPDF.assign(merged.begin(), merged.end());
+        merged.clear();
+        if (m_doIndex == index_mode::OFF && !buffered()) {
+            if (m_destFile)
+                write_blob_to_file(m_destFile);
+            return true;
+        }
+
+        // Carry on as if WebKit had printed the whole document to a temporary file
+        std::string tempFile = "/tmp/" + generate_uuid_string();
+        write_blob_to_file(tempFile.c_str());
+        finish_output(tempFile);
+        return true;
+    }
+
+    /**
+     * @brief PDFprinter_impl::make_pdf_windowed
+     * @return false if the document can not be cut or a window failed
+     * (nothing was written)
+     *
+     * Prints the document a window of pages at a time, one after the
+     * other.  Each window gets a fresh WebView whose WebProcess is gone
+     * before the next starts, and its pages are appended to the output
+     * file straight away, so neither the DOM nor the PDF of the whole
+     * document is ever held at once.
+     */
+    bool PDFprinter_impl::make_pdf_windowed() {
+        html_pages pages;
+        if (!m_window || !html_txt || !find_pages(html_txt, pages) || pages.count() <= m_window)
+            return false;
+
+        // Without an index or a later stage the windows go straight to the destination
+        const bool  direct = m_doIndex == index_mode::OFF && !buffered();
+        std::string path   = direct ? std::string(m_destFile ? m_destFile : "") : "/tmp/" + generate_uuid_string();
+        if (path.empty())
+            return false;
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            wkJlog << iclog::loglevel::error << iclog::category::CORE
+                   << "Failed to write PDF file: " << path.c_str() << iclog::endl;
+            return false;
+        }
+        auto sink = [&file](const std::string &data) { file.write(data.data(), data.size()); };
+
+        const size_t windows = (pages.count() + m_window - 1) / m_window;
+        wkJlog << iclog::loglevel::info << iclog::category::CORE
+               << "Printing " << pages.count() << " pages in " << windows << " windows of " << m_window
+               << iclog::endl;
+
+        auto                    start = std::chrono::steady_clock::now();
+        pdf_compact             joiner;
+        link_targets            targets;
+        std::vector<PDF_Anchor> anchors;
+        m_splitMarks.clear();
+        m_cachedMarks.clear();
+        for (size_t first = 0; first < pages.count(); first += m_window) {
+            size_t last = std::min(first + m_window, pages.count());
+            auto   part = make_part(pages.piece(html_txt, first, last));
+            part->make_pdf_int();
+
+            std::string doc(part->m_binPDF.begin(), part->m_binPDF.end());
+            part->m_binPDF.clear();
+            part->m_binPDF.shrink_to_fit();
+            if (doc.empty() || !joiner.append(doc, sink)) {
+                wkJlog << iclog::loglevel::error << iclog::category::CORE
+                       << "Window at page " << static_cast<unsigned long>(first + 1) << " failed to print, printing the document whole"
+                       << iclog::endl;
+                file.close();
+                std::remove(path.c_str());
+                for (PDF_Anchor &a : anchors) {
+                    free((void *)a.linkName);
+                    free((void *)a.index.title);
+                    free((void *)a.target.title);
+                }
+                m_splitMarks.clear();
+                m_cachedMarks.clear();
+                m_tocPage = index_pdf::UNSET;
+                return false;
+            }
+            adopt_part(*part, static_cast<int>(first), targets, anchors);
+        }
+        pages = html_pages();
+
+        joiner.finish(sink);
+        file.close();
+        link_parts(targets, anchors);
+
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        wkJlog << iclog::loglevel::info << iclog::category::CORE
+               << "Printed " << windows << " windows in " << static_cast<long>(ms) << "ms"
+               << iclog::endl;
+
+        if (!direct)
+            finish_output(path);
+        return true;
+    }
+
+    /**
+     * @brief PDFprinter_impl::run_worker
+     *
+     * Run cb_worker() on the GTK thread and wait for it to finish: queued
+     * to the internal loop, or called directly and pumped in GUI mode.
+     */
+    void PDFprinter_impl::run_worker() {
+        if (WKGTK_run_mode == WKGTKRunMode::UNSET) {
+            m_processing = true;
+
+            // Direct call (already on the correct thread)
+            cb_worker(this);
+
+            // The "ncurses-style" pump to keep the window alive
+            while (m_processing) {
+                g_main_context_iteration(NULL, TRUE);
+            }
+            return;
         }
 
-        // MAKE THE PDF
         std::thread t([this]() {
             std::mutex              wait_mutex;
             std::condition_variable wait_cond;
@@ -1180,23 +3287,38 @@ namespace phtml {
 
         wkJlog << iclog::loglevel::debug << iclog::category::CORE << iclog_FUNCTION
                << "Exited PDF genertation process thread." << iclog::endl;
+    }
 
-        // CREATE INDEX (if requested)
-        if (!tempFile.empty()) {
-            if ((m_doIndex == index_mode::CLASSIC) || (m_doIndex == index_mode::ENHANCED)) {
+    /**
+     * @brief PDFprinter::make_pdf
+     *
+     * Generate the pdf.
+     */
 
-                index_pdf idx(m_indexData, m_indexDataCount, m_tocPage);
-                idx.create_anchors(tempFile.c_str(), m_destFile);
-                std::remove(tempFile.c_str());
-            }
+    void PDFprinter_impl::make_pdf_int() {
+
+        // DIRECTLY CREATE THE PDF
+        if (m_doIndex == index_mode::OFF && m_destFile) {
+            // Use std::string as a local "calculator" only
+            std::string full_uri  = "file://";
+            full_uri             += m_destFile;
+            cstring_cpy(full_uri.c_str(), out_uri);
         }
+        std::string tempFile;
+        // PREVENT TEMP FILE GENERATION OVERRIDE IN TEST MODE
+
+        tempFile = "/tmp/" + generate_uuid_string();
 
-        // GENERATE BLOB (if requested)
-        if (m_makeBlob) {
-            wkJlog << iclog::loglevel::debug << iclog::category::CORE << iclog_FUNCTION
-                   << "Making BLOB" << iclog::endl;
-            read_file_to_blob();
+        // POST PROCESS (index, optimise or create blob)
+        if ((m_doIndex != index_mode::OFF) || buffered()) {
+            std::string fullUri = "file://" + tempFile;
+            cstring_cpy(fullUri.c_str(), out_uri);
         }
+
+        // MAKE THE PDF
+        run_worker();
+
+        finish_output(tempFile);
     }
 
     void PDFprinter_impl::make_pdf_ext() {
@@ -1211,48 +3333,202 @@ namespace phtml {
 
         std::string tempFile = "/tmp/" + generate_uuid_string();
 
-        // POST PROCESS (index or create blob)
-        if ((m_doIndex != index_mode::OFF) || m_makeBlob) {
+        // POST PROCESS (index, optimise or create blob)
+        if ((m_doIndex != index_mode::OFF) || buffered()) {
             std::string fullUri = "file://" + tempFile;
             cstring_cpy(fullUri.c_str(), out_uri);
         }
 
         // MAKE THE PDF
-        m_processing = true;
-
-        // Direct call (already on the correct thread)
-        cb_worker(this);
+        run_worker();
 
-        // The "ncurses-style" pump to keep the window alive
-        while (m_processing) {
-            g_main_context_iteration(NULL, TRUE);
-        }
+        finish_output(tempFile);
+    }
 
-        // CREATE INDEX (if requested)
-        if ((m_doIndex == index_mode::CLASSIC) || (m_doIndex == index_mode::ENHANCED)) {
+    /**
+     * @brief PDFprinter_impl::make_merge
+     * @param records JSON objects
+     * @param count
+     * @return The records printed
+     *
+     * One WebView and one load for every record; index, post-print passes
+     * and the output of each record follow once the view is gone.
+     */
+    size_t PDFprinter_impl::make_merge(const char *const *records, size_t count) {
+        m_parts.clear();
+        m_records.clear();
+        for (size_t i = 0; i < count; ++i) {
+            json_object *obj = records[i] ? json_tokener_parse(records[i]) : nullptr;
+            if (!obj || json_object_get_type(obj) != json_type_object) {
+                wkJlog << iclog::loglevel::error << iclog::category::LIB
+                       << "Merge record " << static_cast<unsigned long>(i + 1) << " is not a JSON object, skipped"
+                       << iclog::endl;
+                json_object_put(obj);
+                continue;
+            }
 
-            index_pdf idx(m_indexData, m_indexDataCount, m_tocPage);
-            idx.create_anchors(tempFile.c_str(), m_destFile);
-            std::remove(tempFile.c_str());
+            // Re-serialised, so only data reaches the page
+            merge_record rec;
+            rec.number = i + 1;
+            rec.data   = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN);
+            json_object_put(obj);
+            rec.dest    = m_destFile && !m_makeBlob ? part_path(m_destFile, "", i) : "";
+            rec.printed = m_doIndex == index_mode::OFF && !buffered() && !rec.dest.empty() ? rec.dest : "/tmp/" + generate_uuid_string();
+            m_records.push_back(std::move(rec));
         }
+        if (m_records.empty())
+            return 0;
+
+        // Nothing is split, spliced or kept in the page cache
+        const bool        split    = m_split;
+        const std::string cacheKey = m_cacheKey;
+        m_split                    = false;
+        m_splice                   = false;
+        m_cacheKey.clear();
+
+        auto start = std::chrono::steady_clock::now();
+        m_record   = 0;
+        cstring_cpy(("file://" + m_records.front().printed).c_str(), out_uri);
+        run_worker();
+
+        char  *destFile = m_destFile;
+        size_t printed  = 0;
+        for (m_record = 0; m_record < m_records.size(); ++m_record) {
+            merge_record &rec = m_records[m_record];
+            if (!rec.done) {
+                if (rec.printed != rec.dest)
+                    std::remove(rec.printed.c_str());
+                continue;
+            }
+
+            m_indexData         = rec.anchors;
+            m_indexDataCount    = rec.count;
+            m_indexDataCapacity = rec.count;
+            m_tocPage           = rec.tocPage;
+            rec.anchors         = nullptr;
+            m_destFile          = rec.dest.empty() ? nullptr : rec.dest.data();
+            finish_output(rec.printed);
+            if (!m_destFile && !m_binPDF.empty())
+                m_parts.emplace_back(std::to_string(rec.number), std::move(m_binPDF));
+            m_binPDF.clear();
 
-        // GENERATE BLOB (if requested)
-        if (m_makeBlob) {
-            wkJlog << iclog::loglevel::debug << iclog::category::CORE << iclog_FUNCTION
-                   << "Making BLOB" << iclog::endl;
-            read_file_to_blob();
+            if (m_indexData) {
+                PDF_AnchorList list = {m_indexData, m_indexDataCount};
+                PDF_FreeAnchors(list);
+                m_indexData = nullptr;
+            }
+            m_indexDataCount    = 0;
+            m_indexDataCapacity = 0;
+            ++printed;
         }
+        m_destFile = destFile;
+        m_split    = split;
+        m_cacheKey = cacheKey;
+        m_records.clear();
+        m_record = 0;
+
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        wkJlog << iclog::loglevel::info << iclog::category::CORE
+               << "Merged " << static_cast<unsigned long>(printed) << " of " << static_cast<unsigned long>(count) << " records in " << static_cast<long>(ms) << "ms"
+               << iclog::endl;
+        return printed;
     }
 
-    void PDFprinter::make_pdf() {
+    /**
+     * @brief PDFprinter_impl::render
+     *
+     * Print the job one way or another: in chunks, in windows or whole.
+     */
+    void PDFprinter_impl::render() {
+        // Pieces are cut from the whole document, a page range already makes it small
+        if (m_pageRanges.empty() && m_raster.empty() && WKGTK_run_mode != WKGTKRunMode::UNSET) {
+            if (m_chunks != 1 && make_pdf_chunked())
+                return;
+            if (m_window && make_pdf_windowed())
+                return;
+        }
 
         if (WKGTK_run_mode == WKGTKRunMode::UNSET) {
             // USE THE CALLERS OWN INSTANCE OF THE PRIAMRY GTK CONTEXT (No Thread)
-            return m_pimpl->make_pdf_ext();
+            return make_pdf_ext();
         } else {
             // USE INTERNAL INSTACNE: threaded version
-            return m_pimpl->make_pdf_int();
+            return make_pdf_int();
+        }
+    }
+
+    void PDFprinter::make_pdf() {
+        // Only look for placeholders when there is something to put in them
+        m_pimpl->m_splice = !page_cache::get().empty();
+        m_pimpl->m_cachedMarks.clear();
+        m_pimpl->tree_source();
+
+        if (!m_pimpl->render_cached())
+            m_pimpl->render();
+    }
+
+    bool PDFprinter::make_pdf_from_view(WebKitWebView *webView, const char *outFile, view_callback done, void *userData) {
+        PDFprinter_impl *impl = m_pimpl;
+        if (!webView || impl->m_external) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << (webView ? "The view of this printer is still printing" : "No view to print")
+                   << iclog::endl;
+            return false;
         }
+
+        impl->m_external = true;
+        impl->m_failed   = false;
+        impl->m_done     = done;
+        impl->m_owner    = this;
+        impl->m_doneData = userData;
+        impl->m_makeBlob = outFile == nullptr;
+        cstring_cpy(outFile, impl->m_destFile);
+
+        // As make_pdf(): placeholders only when there is something to put in them
+        impl->m_splice = !page_cache::get().empty();
+        impl->m_cachedMarks.clear();
+
+        impl->m_viewTemp   = "/tmp/" + generate_uuid_string();
+        const bool  direct = impl->m_doIndex == index_mode::OFF && impl->m_destFile && !impl->buffered();
+        std::string uri    = "file://" + (direct ? std::string(impl->m_destFile) : impl->m_viewTemp);
+        cstring_cpy(uri.c_str(), impl->out_uri);
+
+        // Runs at once on the GTK thread, otherwise queued to it
+        impl->m_web_view = WEBKIT_WEB_VIEW(g_object_ref(webView));
+        g_main_context_invoke(nullptr, view_start, impl);
+        return true;
+    }
+
+    size_t PDFprinter::merge(const char *const *records, size_t count) {
+        if (!records || !count)
+            return 0;
+        m_pimpl->tree_source();
+        return m_pimpl->make_merge(records, count);
+    }
+
+    void PDFprinter::post_process(unsigned passes) {
+        m_pimpl->m_passes = passes;
+    }
+
+    void PDFprinter::compression_level(int level) {
+        m_pimpl->m_level = level;
+    }
+
+    int PDFprinter::max_compression_level() {
+        return pdf_recompress::max_level();
+    }
+
+    void PDFprinter::deterministic(bool enable) {
+        m_pimpl->m_deterministic = enable;
+    }
+
+    void PDFprinter::image_dpi(unsigned dpi, int quality) {
+        m_pimpl->m_imageDpi     = dpi;
+        m_pimpl->m_imageQuality = quality;
+    }
+
+    void PDFprinter::cache_renders(size_t maxBytes, const char *directory) {
+        render_store::get().configure(maxBytes, directory && *directory ? directory : nullptr);
     }
 
     PDF_Blob PDFprinter::get_blob() {
@@ -1279,6 +3555,118 @@ namespace phtml {
         return blob;
     }
 
+    void PDFprinter::chunks(unsigned count) {
+        m_pimpl->m_chunks = count;
+    }
+
+    void PDFprinter::window(unsigned pages) {
+        m_pimpl->m_window = pages;
+    }
+
+    void PDFprinter::page_ranges(const char *ranges) {
+        m_pimpl->m_pageRanges.clear();
+
+        std::vector<std::pair<int, int>> parsed;
+        std::istringstream               list(ranges ? ranges : "");
+        std::string                      item;
+        while (std::getline(list, item, ',')) {
+            item.erase(std::remove_if(item.begin(), item.end(), [](unsigned char c) { return std::isspace(c); }), item.end());
+            if (item.empty())
+                continue;
+
+            size_t dash  = item.find('-');
+            int    first = std::atoi(item.substr(0, dash).c_str());
+            int    last  = dash == std::string::npos ? first : std::atoi(item.substr(dash + 1).c_str());
+            bool   open  = dash != std::string::npos && dash + 1 == item.size();
+            if (first < 1 || item.find_first_not_of("0123456789-") != std::string::npos || std::count(item.begin(), item.end(), '-') > 1 || (!open && last < first)) {
+                wkJlog << iclog::loglevel::error << iclog::category::LIB
+                       << "Invalid page range \"" << item << "\", printing every page"
+                       << iclog::endl;
+                return;
+            }
+            parsed.emplace_back(first, open ? 0 : last);
+        }
+
+        // Sorted without overlaps, so the printed order is the document order
+        std::sort(parsed.begin(), parsed.end());
+        for (const auto &range : parsed) {
+            auto &ranges = m_pimpl->m_pageRanges;
+            if (!ranges.empty() && (!ranges.back().second || range.first <= ranges.back().second + 1)) {
+                if (ranges.back().second && (!range.second || range.second > ranges.back().second))
+                    ranges.back().second = range.second;
+            } else {
+                ranges.push_back(range);
+            }
+        }
+    }
+
+    void PDFprinter::raster(const char *format, double dpi, int quality) {
+        std::string f = format ? format : "";
+        std::transform(f.begin(), f.end(), f.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (!f.empty() && f != "png" && f != "jpeg" && f != "jpg") {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "Unknown image format \"" << f << "\", making a PDF"
+                   << iclog::endl;
+            f.clear();
+        }
+        m_pimpl->m_raster  = f;
+        m_pimpl->m_dpi     = dpi > 0 ? dpi : 96;
+        m_pimpl->m_quality = quality;
+    }
+
+    void PDFprinter::split(bool enable) {
+        m_pimpl->m_split = enable;
+    }
+
+    void PDFprinter::cache_pages(const char *key) {
+        m_pimpl->m_cacheKey = key ? key : "";
+    }
+
+    bool PDFprinter::cache_pages(const char *key, const unsigned char *data, size_t size) {
+        if (!key || !*key || !data || !size)
+            return false;
+        page_cache::get().put(key, std::string(reinterpret_cast<const char *>(data), size));
+        return true;
+    }
+
+    void PDFprinter::drop_cached_pages(const char *key) {
+        page_cache                 &cache = page_cache::get();
+        std::lock_guard<std::mutex> lock(cache.m_mutex);
+        if (key)
+            cache.m_docs.erase(key);
+        else
+            cache.m_docs.clear();
+    }
+
+    PDF_BlobList PDFprinter::get_blobs() {
+        PDF_BlobList list = {nullptr, nullptr, 0};
+        if (m_pimpl->m_parts.empty())
+            return list;
+
+        list.blobs = (PDF_Blob *)calloc(m_pimpl->m_parts.size(), sizeof(PDF_Blob));
+        list.names = (char **)calloc(m_pimpl->m_parts.size(), sizeof(char *));
+        if (!list.blobs || !list.names) {
+            free(list.blobs);
+            free(list.names);
+            return {nullptr, nullptr, 0};
+        }
+
+        for (auto &part : m_pimpl->m_parts) {
+            PDF_Blob &blob = list.blobs[list.count];
+            blob.data      = (unsigned char *)malloc(part.second.size());
+            if (blob.data) {
+                std::memcpy(blob.data, part.second.data(), part.second.size());
+                blob.size = part.second.size();
+            }
+            list.names[list.count] = strdup(part.first.c_str());
+            ++list.count;
+        }
+
+        m_pimpl->m_parts.clear();
+        m_pimpl->m_parts.shrink_to_fit();
+        return list;
+    }
+
     PDF_AnchorList PDFprinter::get_anchors() {
         PDF_AnchorList list;
         list.anchors = m_pimpl->m_indexData;
@@ -1318,3 +3706,12 @@ void PDF_FreeBlob(PDF_Blob blob) {
         free(blob.data);
     }
 }
+
+void PDF_FreeBlobList(PDF_BlobList list) {
+    for (size_t i = 0; i < list.count; ++i) {
+        PDF_FreeBlob(list.blobs[i]);
+        free(list.names[i]);
+    }
+    free(list.blobs);
+    free(list.names);
+}
@@ -11,7 +11,8 @@
 #define APP_VERSION "unknown"
 #endif
 
-typedef struct _GMainLoop GMainLoop;
+typedef struct _GMainLoop     GMainLoop;
+typedef struct _WebKitWebView WebKitWebView;
 struct sd_bus;
 
 #ifdef __cplusplus
@@ -45,6 +46,12 @@ struct PDF_Blob {
         size_t         size;
 };
 
+struct PDF_BlobList {
+        PDF_Blob *blobs;
+        char    **names; // The data-split value of each part ("" if unnamed)
+        size_t    count;
+};
+
 struct PaperSize {
         const char *sizeName;
         double      shortMM;
@@ -54,6 +61,7 @@ struct PaperSize {
 PDF_API const char *wk2gtkpdf_version();
 PDF_API void        PDF_FreeAnchors(PDF_AnchorList list);
 PDF_API void        PDF_FreeBlob(PDF_Blob blob);
+PDF_API void        PDF_FreeBlobList(PDF_BlobList list);
 
 #ifdef __cplusplus
 }
@@ -65,8 +73,25 @@ enum class index_mode {
     ENHANCED,
 };
 
+/**
+ * @brief pdf_pass
+ *
+ * Optional post-print stages, combined as a bitmask.
+ *
+ * @see PDFprinter::post_process()
+ */
+typedef enum : unsigned {
+    PDF_PASS_NONE        = 0x00,
+    PDF_PASS_OPTIMISE    = 0x01, /**< Object streams and a compressed cross-reference stream */
+    PDF_PASS_LINEARISE   = 0x02, /**< "Fast Web View", page 1 is shown before the download completes */
+    PDF_PASS_DEDUPLICATE = 0x04, /**< Merge identical images, fonts and content streams */
+    PDF_PASS_RECOMPRESS  = 0x08, /**< Re-deflate streams in parallel at compression_level() */
+    PDF_PASS_GREYSCALE   = 0x10, /**< Colours, shadings and images to grey, text and vectors stay vectors */
+} pdf_pass;
+
 namespace phtml {
     struct PDFprinter_impl;
+    class html_tree;
 
     class PDF_API PDFprinter {
         public:
@@ -79,6 +104,20 @@ namespace phtml {
             PDF_API void     set_param_from_file(const char *htmlFile, const char *printSettings, const char *outFile, index_mode createIndex = index_mode::OFF);
             PDF_API void     set_param_from_file(const char *htmlFile, const char *outFile, index_mode createIndex = index_mode::OFF);
             PDF_API void     set_param_from_file(const char *htmlFile, index_mode createIndex = index_mode::OFF);
+            /**
+             * @brief PDFprinter::set_param_from_tree
+             *
+             * Print an html_tree as WebKit reads it, a chunk at a time,
+             * instead of building its page as one string first.  Keep the
+             * tree alive and unchanged until make_pdf() returns.
+             *
+             * chunks(), window(), image_dpi(), the render cache and a base
+             * URI that is not file: need the whole page; with those the
+             * tree is built into it once, as process_nodes() would.
+             *
+             * @param outFile nullptr for get_blob()
+             */
+            PDF_API void     set_param_from_tree(const html_tree *dom, const char *outFile = nullptr, index_mode createIndex = index_mode::OFF);
             /**
              * @brief PDFprinter::make_pdf
              *
@@ -90,8 +129,140 @@ namespace phtml {
              * Await completion before exiting.
              */
             PDF_API void     make_pdf();
+            /**
+             * @brief view_callback
+             * Called on the GTK thread when make_pdf_from_view() is done,
+             * @p ok is false if WebKit could not print.  Collect the
+             * result with get_blob() / get_anchors() here; the printer may
+             * be deleted.
+             */
+            typedef void (*view_callback)(PDFprinter *printer, bool ok, void *userData);
+            /**
+             * @brief make_pdf_from_view
+             * Print a WebKitWebView the application already shows, e.g. for
+             * "Save as PDF", without a second view or a second load.  The
+             * index, post-print passes and other options of make_pdf()
+             * apply; the view is left as it was found.
+             *
+             * Returns at once, @p done reports completion.  A view that is
+             * still loading is printed when the load finishes.
+             *
+             * @param webView Owned by the caller (a reference is held until done).
+             * @param outFile The PDF to write, or NULL to keep it for get_blob().
+             * @param done May be NULL.
+             * @param userData Passed to @p done.
+             *
+             * @return false if there is no view or this printer is busy
+             * with one.
+             *
+             * @note The printer must outlive the job.  Pages are laid out
+             * for print by WebKit as usual; chunks(), window(), merge()
+             * and raster() do not apply.
+             */
+            PDF_API bool     make_pdf_from_view(WebKitWebView *webView, const char *outFile = nullptr, view_callback done = nullptr, void *userData = nullptr);
+            /**
+             * @brief merge
+             * Mail merge: load the HTML of set_param() once and print it
+             * once per record.  Each element with a data-field="name"
+             * attribute takes the text of that field of the record; a
+             * field the record does not have keeps the template text.
+             * There is one WebView, one load and one style resolution
+             * for the whole run, so only the print is repeated.
+             *
+             * With an output file record n is written beside it as
+             * "out-<n>.pdf"; in blob mode collect them with get_blobs(),
+             * named by record number.  Index and post-print passes apply
+             * to each record.
+             *
+             * @param records JSON objects, e.g. {"name": "Ann", "due": "12.50"}.
+             * @param count
+             *
+             * @return The number of records printed (a record that is not
+             * a JSON object is skipped).  The time taken by each is logged
+             * at LOG_INFO.
+             *
+             * @note split(), chunks(), window(), raster() and cache_pages()
+             * do not apply.
+             */
+            PDF_API size_t   merge(const char *const *records, size_t count);
             PDF_API void     layout(const char *pageSize, const char *oreintation);
             PDF_API void     layout(double width, double height);
+            /**
+             * @brief post_process
+             * Select the post-print passes run after indexing and before the
+             * file is written or the blob returned.
+             *
+             * @param passes A combination of pdf_pass flags (PDF_PASS_NONE to disable).
+             *
+             * @note The size before and after, and the time taken, are logged at
+             * LOG_INFO.
+             */
+            PDF_API void     post_process(unsigned passes);
+            /**
+             * @brief page_ranges
+             * Print only some pages, for a quick first page preview or to
+             * regenerate part of a document.
+             *
+             * @param ranges 1 based, e.g. "1", "40-45" or "1-3,10-" (an open
+             * end runs to the last page).  NULL or "" prints every page.
+             *
+             * @note Index links and bookmarks are renumbered for the printed
+             * pages; links from or to a page that is not printed are
+             * dropped.  chunks() and window() are ignored with a range.
+             */
+            PDF_API void     page_ranges(const char *ranges);
+            /**
+             * @brief raster
+             * Make page images instead of a PDF, e.g. thumbnails or
+             * previews, from one WebKit snapshot of the laid out document.
+             * Each .page element is one image (the whole document when
+             * there are none); page_ranges() limits which.
+             *
+             * A single image is the result in place of the PDF: the output
+             * file or get_blob().  Several are written beside the output
+             * file as "out-<page>.png", or returned by get_blobs() named
+             * by page number.
+             *
+             * @param format "png" or "jpeg" (NULL or "" for a PDF, Default).
+             * @param dpi Image resolution, 96 is one pixel per CSS pixel.
+             * @param quality JPEG quality 1 - 100.
+             *
+             * @note Index, split and post-print passes do not apply.
+             */
+            PDF_API void     raster(const char *format, double dpi = 96, int quality = 85);
+            /**
+             * @brief compression_level
+             * Deflate level used by PDF_PASS_RECOMPRESS.
+             *
+             * @param level 0 - max_compression_level(), default 9.
+             */
+            PDF_API void     compression_level(int level);
+            /**
+             * @brief max_compression_level
+             * @return 12 when built with libdeflate, 9 with zlib.
+             */
+            PDF_API static int max_compression_level();
+            /**
+             * @brief deterministic
+             * The same input gives the same bytes: creation and
+             * modification dates are fixed at 2000-01-01 and the document
+             * /ID is derived from the input rather than the time.
+             */
+            PDF_API void     deterministic(bool enable);
+            /**
+             * @brief image_dpi
+             * Shrink local (file:) images to @p dpi over the box each is
+             * laid out in before printing, so WebKit and cairo handle no
+             * more pixels than the page needs (see encode_image::downscale()).
+             *
+             * @param dpi 0 to print images as they are (Default).
+             * @param quality JPEG quality 1 - 100 for images without
+             * transparency, 0 to keep them lossless as PNG.
+             *
+             * @note Not for make_pdf_from_view(), the callers page is left
+             * alone.
+             */
+            PDF_API void     image_dpi(unsigned dpi, int quality = 85);
             /**
              * @brief get_blob
              * Returns a Binary Large Object (PDF data).
@@ -102,6 +273,99 @@ namespace phtml {
              * @return A PDF_Blob struct containing the data pointer and size.
              */
             PDF_API PDF_Blob get_blob();
+            /**
+             * @brief split
+             * Cut the printed document into one PDF per group of pages.  A
+             * group starts at each .page element with a data-split attribute
+             * and its value names the part; pages ahead of the first mark
+             * form an unnamed part.
+             *
+             * With an output file each part is written beside it as
+             * "out-<name>.pdf" ("out-<n>.pdf" when unnamed); in blob mode
+             * collect them with get_blobs().  Post-print passes run on each
+             * part.  Links to a page in another part are removed.
+             */
+            PDF_API void     split(bool enable);
+            /**
+             * @brief chunks
+             * Print a large document as @p count pieces at the same time,
+             * each on its own WebView and WebProcess, and join the
+             * results.  The document is cut between top level .page
+             * elements; every piece keeps the whole <head>.  Index links,
+             * data-split and data-cached-pages marks work across pieces.
+             *
+             * @param count 1 = off (Default), 0 = one per core.
+             *
+             * @note Pieces are laid out independently: a .page must not
+             * rely on the layout of another (counters, flowing content).
+             * Ignored in GUI mode (icGTK::init() not called).
+             */
+            PDF_API void     chunks(unsigned count);
+            /**
+             * @brief window
+             * Print a large document @p pages .page elements at a time,
+             * one window after the other, appending each to the output as
+             * it is done.  The WebProcess of a window is gone before the
+             * next starts, so peak memory follows the window rather than
+             * the document.  The same cutting rules and limits as chunks()
+             * apply; chunks() is tried first.
+             *
+             * @param pages 0 = off (Default).
+             */
+            PDF_API void     window(unsigned pages);
+            /**
+             * @brief get_blobs
+             * Returns the parts of a split() document, in page order.
+             *
+             * @note OWNERSHIP: The caller takes ownership of the list, the blobs and the names.
+             * @warning You MUST call PDF_FreeBlobList() when finished to prevent memory leaks.
+             *
+             * @return A PDF_BlobList struct.
+             */
+            PDF_API PDF_BlobList get_blobs();
+            /**
+             * @brief cache_pages
+             * Keep the pages this printer makes in the process wide page
+             * cache under @p key (NULL or "" to stop).  The normal output
+             * is still written or returned.
+             *
+             * Later jobs reference them with a placeholder page,
+             * <div class="page" data-cached-pages="key"></div>, which is
+             * replaced by every cached page after printing.  Links and
+             * bookmarks to pages after the placeholder stay correct; page
+             * numbers the HTML works out for itself count it as one page.
+             */
+            PDF_API void     cache_pages(const char *key);
+            /**
+             * @brief cache_pages
+             * Add an existing PDF (e.g. from get_blob()) to the page cache.
+             * The data is copied.
+             */
+            PDF_API static bool cache_pages(const char *key, const unsigned char *data, size_t size);
+            /**
+             * @brief drop_cached_pages
+             * Remove @p key from the page cache, or everything when NULL.
+             */
+            PDF_API static void drop_cached_pages(const char *key);
+            /**
+             * @brief cache_renders
+             * Keep finished documents for every PDFprinter in the process,
+             * addressed by a hash of the HTML text, base URI, print
+             * settings, stylesheet, index mode and output options.  A
+             * repeated job is answered without WebKit; identical jobs in
+             * flight at the same time wait for one render.
+             *
+             * @param maxBytes Memory for the least recently used documents
+             * (0 = none).
+             * @param directory Also keep each document as a file here, for
+             * later runs (NULL = memory only).
+             *
+             * @note Off by default.  Images and stylesheets the HTML links
+             * to are not part of the address.  split() and cache_pages()
+             * jobs, and jobs while the page cache is in use, always print.
+             * A cached result has no get_anchors().
+             */
+            PDF_API static void cache_renders(size_t maxBytes, const char *directory = nullptr);
 
             /**
              * @brief get_anchors
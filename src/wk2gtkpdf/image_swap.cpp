@@ -0,0 +1,67 @@
+#include "image_swap.h"
+
+#include <cstring>
+
+namespace phtml {
+
+    namespace {
+        /**
+         * Given swaps, [[image indices], data URI] pairs: point the images
+         * at their downscaled copies and resolve once they are decoded, so
+         * the print does not catch them blank.
+         */
+        const char *js_code_swap =
+            "return Promise.all(swaps.map(s => Promise.all(s[0].map(i => { "
+            "    const img = document.images[i]; "
+            "    if (img.parentElement && img.parentElement.tagName === 'PICTURE') "
+            "        img.parentElement.querySelectorAll('source').forEach(source => source.remove()); "
+            "    img.removeAttribute('srcset'); "
+            "    img.src = s[1]; "
+            "    return img.decode().catch(() => null); "
+            "})))).then(() => swaps.length); ";
+
+        /**
+         * The URI inside the quotes, empty if it has no mime type or no
+         * data.
+         */
+        std::string_view usable(std::string_view uri) {
+            if (uri.size() < 2 || uri.front() != '"' || uri.back() != '"')
+                return {};
+            uri = uri.substr(1, uri.size() - 2);
+
+            const size_t data = uri.find(";base64,");
+            if (!uri.starts_with("data:") || data == std::string_view::npos || data == 5 || data + 8 == uri.size())
+                return {};
+            return uri;
+        }
+    } // namespace
+
+    std::string image_swap_script(const std::vector<image_swap> &swaps) {
+        size_t size = 0;
+        for (const image_swap &s : swaps)
+            size += s.indices.size() + s.uri.size() + 4;
+
+        std::string script = "const swaps = [";
+        script.reserve(size + 32 + std::strlen(js_code_swap));
+        for (const image_swap &s : swaps) {
+            std::string_view uri = usable(s.uri);
+            if (uri.empty())
+                continue;
+
+            // base64 ignores the line breaks, a string literal can not hold them
+            script += "[" + s.indices + ",\"";
+            for (char c : uri) {
+                if (c == '\r' || c == '\n')
+                    continue;
+                if (c == '"' || c == '\\')
+                    script += '\\';
+                script += c;
+            }
+            script += "\"],";
+        }
+        script += "]; ";
+        script += js_code_swap;
+        return script;
+    }
+
+} // namespace phtml
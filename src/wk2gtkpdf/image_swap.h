@@ -0,0 +1,33 @@
+#ifndef IMAGE_SWAP_H
+#define IMAGE_SWAP_H
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace phtml {
+
+    /**
+     * @brief image_swap
+     * Images to point at a new copy: their indices in document.images as
+     * a JSON array, and the data URI as encode_image::b64_image() gives
+     * it, quoted and with its base64 broken over lines.
+     */
+    struct image_swap {
+            std::string      indices;
+            std::string_view uri;
+    };
+
+    /**
+     * @brief image_swap_script
+     * The body of an async function that points the images at their data
+     * URIs and resolves to the number swapped once they are decoded.
+     *
+     * Each URI is written as a single line JavaScript string.  One with no
+     * data (an unreadable file) or no mime type (an unknown extension) is
+     * left out and its images keep their source.
+     */
+    std::string image_swap_script(const std::vector<image_swap> &swaps);
+
+} // namespace phtml
+
+#endif // IMAGE_SWAP_H
@@ -1,5 +1,6 @@
 #include "index_pdf.h"
 
+#include "css_scale.h"
 #include "iclog.h"
 
 #include <podofo/podofo.h>
@@ -53,10 +54,6 @@ index_pdf::~index_pdf() {
     delete m_pimpl;
 }
 
-static double scale_css_to_pdf(double pdf_page_width_pts, double css_page_width_px) {
-    return pdf_page_width_pts / css_page_width_px;
-}
-
 /**
  * @brief index_pdf::parseNumbering
  * @param title
@@ -210,8 +207,8 @@ void index_pdf_impl::do_annotation(PdfMemDocument &pdfDoc) {
             continue;
         }
 
-        double scaleSrc = scale_css_to_pdf(pdfSrcW, cssSrcW);
-        double scaleDst = scale_css_to_pdf(pdfDstW, cssDstW);
+        double scaleSrc = phtml::scale_css_to_pdf(pdfSrcW, cssSrcW);
+        double scaleDst = phtml::scale_css_to_pdf(pdfDstW, cssDstW);
 
         // convert source rect: CSS top-left -> PDF bottom-left
         double src_left_pts   = a.index.xPos * scaleSrc;
@@ -471,8 +468,8 @@ void index_pdf_impl::do_annotation(PdfMemDocument &pdfDoc) {
         PdfRect srcMedia = pSrcPage->GetMediaBox();
         PdfRect dstMedia = pDstPage->GetMediaBox();
 
-        double scaleSrc = scale_css_to_pdf(srcMedia.GetWidth(), a.index.page_width);
-        double scaleDst = scale_css_to_pdf(dstMedia.GetHeight(), a.target.page_height);
+        double scaleSrc = phtml::scale_css_to_pdf(srcMedia.GetWidth(), a.index.page_width);
+        double scaleDst = phtml::scale_css_to_pdf(dstMedia.GetHeight(), a.target.page_height);
 
         // Y-axis logic (Bottom-up in PDF)
         double  src_bottom_pts = (a.index.page_height - (a.index.yPos + a.index.h)) * scaleSrc;
@@ -0,0 +1,2439 @@
+#include "pdf_compact.h"
+
+#include "iclog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+/******************************************************************************/
+/*  LEXER                                                                      */
+/******************************************************************************/
+
+/*
+ * Just enough of a PDF tokenizer to find dictionary keys and "n g R"
+ * references in the object bodies.  Stream data is never handed to it.
+ */
+namespace {
+
+    enum class tok { END, NUMBER, NAME, STRING, DICT_OPEN, DICT_CLOSE, ARRAY_OPEN, ARRAY_CLOSE, KEYWORD };
+
+    struct token {
+            tok    type;
+            size_t begin;
+            size_t end;
+    };
+
+    inline bool is_ws(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+    }
+
+    inline bool is_delim(char c) {
+        return c == '(' || c == ')' || c == '<' || c == '>' || c == '[' || c == ']' || c == '{' || c == '}' || c == '/' || c == '%';
+    }
+
+    token next_token(const std::string &s, size_t end, size_t &pos) {
+        while (pos < end) {
+            if (is_ws(s[pos])) {
+                ++pos;
+            } else if (s[pos] == '%') {
+                while (pos < end && s[pos] != '\n' && s[pos] != '\r')
+                    ++pos;
+            } else {
+                break;
+            }
+        }
+        if (pos >= end)
+            return {tok::END, end, end};
+
+        size_t b = pos;
+        char   c = s[pos];
+        switch (c) {
+            case '<':
+                if (pos + 1 < end && s[pos + 1] == '<') {
+                    pos += 2;
+                    return {tok::DICT_OPEN, b, pos};
+                }
+                while (pos < end && s[pos] != '>')
+                    ++pos;
+                pos = std::min(pos + 1, end);
+                return {tok::STRING, b, pos};
+            case '>':
+                if (pos + 1 < end && s[pos + 1] == '>') {
+                    pos += 2;
+                    return {tok::DICT_CLOSE, b, pos};
+                }
+                ++pos;
+                return {tok::KEYWORD, b, pos};
+            case '[':
+                ++pos;
+                return {tok::ARRAY_OPEN, b, pos};
+            case ']':
+                ++pos;
+                return {tok::ARRAY_CLOSE, b, pos};
+            case '(': {
+                int depth = 0;
+                while (pos < end) {
+                    char ch = s[pos++];
+                    if (ch == '\\') {
+                        ++pos;
+                    } else if (ch == '(') {
+                        ++depth;
+                    } else if (ch == ')' && --depth == 0) {
+                        break;
+                    }
+                }
+                pos = std::min(pos, end);
+                return {tok::STRING, b, pos};
+            }
+            case '/':
+                ++pos;
+                while (pos < end && !is_ws(s[pos]) && !is_delim(s[pos]))
+                    ++pos;
+                return {tok::NAME, b, pos};
+            default:
+                while (pos < end && !is_ws(s[pos]) && !is_delim(s[pos]))
+                    ++pos;
+                if (pos == b)
+                    ++pos; // stray ')', '{' or '}'
+                if ((c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.')
+                    return {tok::NUMBER, b, pos};
+                return {tok::KEYWORD, b, pos};
+        }
+    }
+
+    inline bool is_integer(const std::string &s, const token &t) {
+        if (t.type != tok::NUMBER)
+            return false;
+        for (size_t i = t.begin; i < t.end; ++i) {
+            if (s[i] < '0' || s[i] > '9')
+                return false;
+        }
+        return true;
+    }
+
+    inline bool token_is(const std::string &s, const token &t, const char *text) {
+        size_t len = strlen(text);
+        return t.end - t.begin == len && s.compare(t.begin, len, text) == 0;
+    }
+
+    inline unsigned long to_ulong(const std::string &s, const token &t) {
+        return strtoul(s.c_str() + t.begin, nullptr, 10);
+    }
+
+    /**
+     * Skips one complete value (a "n g R" triple counts as one value)
+     * and reports its extent.
+     */
+    bool skip_value(const std::string &s, size_t end, size_t &pos, size_t &vb, size_t &ve) {
+        token t = next_token(s, end, pos);
+        vb      = t.begin;
+        switch (t.type) {
+            case tok::END:
+            case tok::DICT_CLOSE:
+            case tok::ARRAY_CLOSE:
+                return false;
+            case tok::DICT_OPEN:
+            case tok::ARRAY_OPEN: {
+                int depth = 1;
+                while (depth > 0) {
+                    token u = next_token(s, end, pos);
+                    if (u.type == tok::END)
+                        return false;
+                    if (u.type == tok::DICT_OPEN || u.type == tok::ARRAY_OPEN)
+                        ++depth;
+                    else if (u.type == tok::DICT_CLOSE || u.type == tok::ARRAY_CLOSE)
+                        --depth;
+                }
+                ve = pos;
+                return true;
+            }
+            case tok::NUMBER:
+                if (is_integer(s, t)) {
+                    size_t save = pos;
+                    token  g    = next_token(s, end, pos);
+                    if (is_integer(s, g)) {
+                        token r = next_token(s, end, pos);
+                        if (token_is(s, r, "R")) {
+                            ve = pos;
+                            return true;
+                        }
+                    }
+                    pos = save;
+                }
+                ve = t.end;
+                return true;
+            default:
+                ve = t.end;
+                return true;
+        }
+    }
+
+    /**
+     * Finds /key in the dictionary starting at @p from, returns the extent
+     * of its value.
+     */
+    bool dict_get(const std::string &s, size_t from, size_t end, const char *key, size_t &vb, size_t &ve) {
+        size_t pos = from;
+        if (next_token(s, end, pos).type != tok::DICT_OPEN)
+            return false;
+
+        size_t keyLen = strlen(key);
+        while (true) {
+            token k = next_token(s, end, pos);
+            if (k.type != tok::NAME)
+                return false;
+            size_t b, e;
+            if (!skip_value(s, end, pos, b, e))
+                return false;
+            if (k.end - k.begin == keyLen + 1 && s.compare(k.begin + 1, keyLen, key) == 0) {
+                vb = b;
+                ve = e;
+                return true;
+            }
+        }
+    }
+
+    /**
+     * Appends every object number referenced in [from, end).
+     */
+    void collect_refs(const std::string &s, size_t from, size_t end, std::vector<unsigned> &refs) {
+        size_t pos = from;
+        token  prev2{tok::END, 0, 0}, prev1{tok::END, 0, 0};
+        while (true) {
+            token t = next_token(s, end, pos);
+            if (t.type == tok::END)
+                break;
+            if (token_is(s, t, "R") && is_integer(s, prev1) && is_integer(s, prev2)) {
+                refs.push_back(to_ulong(s, prev2));
+                prev1 = prev2 = {tok::END, 0, 0};
+                continue;
+            }
+            prev2 = prev1;
+            prev1 = t;
+        }
+    }
+
+    /**
+     * Appends every unsigned integer in [from, end).
+     */
+    void collect_ints(const std::string &s, size_t from, size_t end, std::vector<unsigned> &values) {
+        size_t pos = from;
+        while (true) {
+            token t = next_token(s, end, pos);
+            if (t.type == tok::END)
+                break;
+            if (is_integer(s, t))
+                values.push_back(to_ulong(s, t));
+        }
+    }
+
+    /**
+     * As collect_refs() but ignores the value of /Parent in a top level
+     * dictionary; following it would pull the whole page tree into every
+     * page's closure.
+     */
+    void collect_child_refs(const std::string &s, size_t from, size_t end, std::vector<unsigned> &refs) {
+        size_t pos = from;
+        if (next_token(s, end, pos).type != tok::DICT_OPEN) {
+            collect_refs(s, from, end, refs);
+            return;
+        }
+        while (true) {
+            token k = next_token(s, end, pos);
+            if (k.type != tok::NAME)
+                return;
+            size_t b, e;
+            if (!skip_value(s, end, pos, b, e))
+                return;
+            if (!token_is(s, k, "/Parent"))
+                collect_refs(s, b, e, refs);
+        }
+    }
+
+    /**
+     * Copies [from, end) rewriting every "n g R" to "map[n] 0 R".
+     */
+    std::string renumber(const std::string &s, size_t from, size_t end, const std::vector<unsigned> &map) {
+        std::string out;
+        out.reserve(end - from);
+        size_t pos    = from;
+        size_t copied = from;
+        token  prev2{tok::END, 0, 0}, prev1{tok::END, 0, 0};
+        while (true) {
+            token t = next_token(s, end, pos);
+            if (t.type == tok::END)
+                break;
+            if (token_is(s, t, "R") && is_integer(s, prev1) && is_integer(s, prev2)) {
+                unsigned long n      = to_ulong(s, prev2);
+                unsigned      target = n < map.size() ? map[n] : 0;
+                out.append(s, copied, prev2.begin - copied);
+                if (target)
+                    out += std::to_string(target) + " 0 R";
+                else
+                    out += "null";
+                copied = t.end;
+                prev1 = prev2 = {tok::END, 0, 0};
+                continue;
+            }
+            prev2 = prev1;
+            prev1 = t;
+        }
+        out.append(s, copied, end - copied);
+        return out;
+    }
+
+    /**
+     * Copies [from, end) leaving out every "n g R" with drop[n] set.
+     */
+    std::string without_refs(const std::string &s, size_t from, size_t end, const std::vector<bool> &drop) {
+        std::string out;
+        out.reserve(end - from);
+        size_t pos    = from;
+        size_t copied = from;
+        token  prev2{tok::END, 0, 0}, prev1{tok::END, 0, 0};
+        while (true) {
+            token t = next_token(s, end, pos);
+            if (t.type == tok::END)
+                break;
+            if (token_is(s, t, "R") && is_integer(s, prev1) && is_integer(s, prev2)) {
+                unsigned long n = to_ulong(s, prev2);
+                if (n < drop.size() && drop[n]) {
+                    out.append(s, copied, prev2.begin - copied);
+                    copied = t.end;
+                }
+                prev1 = prev2 = {tok::END, 0, 0};
+                continue;
+            }
+            prev2 = prev1;
+            prev1 = t;
+        }
+        out.append(s, copied, end - copied);
+        return out;
+    }
+
+    bool deflate_buffer(const std::string &in, std::string &out) {
+        uLongf len = compressBound(in.size());
+        out.resize(len);
+        if (compress2(reinterpret_cast<Bytef *>(out.data()), &len, reinterpret_cast<const Bytef *>(in.data()), in.size(), Z_BEST_COMPRESSION) != Z_OK)
+            return false;
+        out.resize(len);
+        return true;
+    }
+
+    bool inflate_buffer(const std::string &in, std::string &out) {
+        z_stream zs{};
+        if (inflateInit(&zs) != Z_OK)
+            return false;
+        zs.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+        zs.avail_in = in.size();
+
+        char buf[65536];
+        int  rc;
+        do {
+            zs.next_out  = reinterpret_cast<Bytef *>(buf);
+            zs.avail_out = sizeof(buf);
+            rc           = inflate(&zs, Z_NO_FLUSH);
+            out.append(buf, sizeof(buf) - zs.avail_out);
+        } while (rc == Z_OK && (zs.avail_in || !zs.avail_out));
+        inflateEnd(&zs);
+        // A missing end of stream marker is common and harmless
+        return rc == Z_STREAM_END || rc == Z_OK || (rc == Z_BUF_ERROR && !out.empty());
+    }
+
+    /**
+     * Reverses the PNG row predictors (/Predictor 10 - 15) used on
+     * cross-reference streams.
+     */
+    bool unpredict(std::string &data, size_t rowLen, size_t bpp) {
+        std::string out;
+        std::string prior(rowLen, '\0');
+        out.reserve(data.size());
+        for (size_t pos = 0; pos + rowLen + 1 <= data.size(); pos += rowLen + 1) {
+            unsigned char filter = data[pos];
+            std::string   row    = data.substr(pos + 1, rowLen);
+            for (size_t i = 0; i < rowLen; ++i) {
+                unsigned a = i >= bpp ? static_cast<unsigned char>(row[i - bpp]) : 0;
+                unsigned b = static_cast<unsigned char>(prior[i]);
+                unsigned c = i >= bpp ? static_cast<unsigned char>(prior[i - bpp]) : 0;
+                unsigned x = static_cast<unsigned char>(row[i]);
+                switch (filter) {
+                    case 0:
+                        break;
+                    case 1:
+                        x += a;
+                        break;
+                    case 2:
+                        x += b;
+                        break;
+                    case 3:
+                        x += (a + b) / 2;
+                        break;
+                    case 4: {
+                        int p  = static_cast<int>(a + b) - static_cast<int>(c);
+                        int pa = abs(p - static_cast<int>(a));
+                        int pb = abs(p - static_cast<int>(b));
+                        int pc = abs(p - static_cast<int>(c));
+                        x += (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                        break;
+                    }
+                    default:
+                        return false;
+                }
+                row[i] = static_cast<char>(x);
+            }
+            out += row;
+            prior.swap(row);
+        }
+        data.swap(out);
+        return true;
+    }
+
+    long dict_int(const std::string &s, size_t from, size_t end, const char *key, long def) {
+        size_t vb, ve;
+        if (!dict_get(s, from, end, key, vb, ve))
+            return def;
+        return strtol(s.c_str() + vb, nullptr, 10);
+    }
+
+    /**
+     * Decodes stream data whose dictionary is [from, end).  Only what PDF
+     * writers use for cross-reference and object streams is supported:
+     * no filter, or /FlateDecode with an optional PNG predictor.
+     */
+    bool decode_stream(const std::string &s, size_t from, size_t end, const std::string &raw, std::string &out) {
+        size_t vb, ve;
+        if (!dict_get(s, from, end, "Filter", vb, ve)) {
+            out = raw;
+            return true;
+        }
+        std::string filter = s.substr(vb, ve - vb);
+        if (filter != "/FlateDecode" && filter.find("/FlateDecode") == std::string::npos)
+            return false;
+        if (filter[0] == '[' && filter.find('/', filter.find("/FlateDecode") + 1) != std::string::npos)
+            return false; // a chain of filters
+        if (!inflate_buffer(raw, out))
+            return false;
+
+        if (!dict_get(s, from, end, "DecodeParms", vb, ve) || s[vb] != '<')
+            return true;
+        long predictor = dict_int(s, vb, ve, "Predictor", 1);
+        if (predictor < 10)
+            return predictor == 1;
+        long colors  = dict_int(s, vb, ve, "Colors", 1);
+        long bits    = dict_int(s, vb, ve, "BitsPerComponent", 8);
+        long columns = dict_int(s, vb, ve, "Columns", 1);
+        if (colors < 1 || bits < 1 || columns < 1)
+            return false;
+        size_t bpp = std::max<size_t>(1, colors * bits / 8);
+        return unpredict(out, (colors * bits * columns + 7) / 8, bpp);
+    }
+
+    /**
+     * Sets /key in a dictionary, replacing any existing value.
+     */
+    std::string set_key(const std::string &dict, const char *key, const std::string &value) {
+        size_t vb, ve;
+        if (dict_get(dict, 0, dict.size(), key, vb, ve))
+            return dict.substr(0, vb) + value + dict.substr(ve);
+        size_t close = dict.rfind(">>");
+        if (close == std::string::npos)
+            return dict;
+        return dict.substr(0, close) + "/" + key + " " + value + " " + dict.substr(close);
+    }
+
+    std::string padded(size_t value, int width = 10) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%0*zu", width, value);
+        return buf;
+    }
+
+    /*
+     * MSB first bit writer for the linearisation hint tables.
+     */
+    class bit_writer {
+        public:
+            void write(unsigned long value, int bits) {
+                for (int i = bits - 1; i >= 0; --i) {
+                    m_acc = (m_acc << 1) | ((value >> i) & 1);
+                    if (++m_count == 8) {
+                        m_out.push_back(static_cast<char>(m_acc));
+                        m_acc   = 0;
+                        m_count = 0;
+                    }
+                }
+            }
+            void flush() {
+                if (m_count)
+                    write(0, 8 - m_count);
+            }
+            std::string &data() {
+                flush();
+                return m_out;
+            }
+
+        private:
+            std::string m_out;
+            unsigned    m_acc   = 0;
+            int         m_count = 0;
+    };
+
+    int bits_for(unsigned long value) {
+        int n = 0;
+        while (value) {
+            ++n;
+            value >>= 1;
+        }
+        return n;
+    }
+
+} // namespace
+
+/******************************************************************************/
+/*  IMPLEMENTATION                                                             */
+/******************************************************************************/
+
+struct pdf_compact_impl {
+        struct object {
+                bool                  present  = false;
+                bool                  isStream = false;
+                unsigned              gen      = 0;
+                std::string           body;        // everything between "obj" and "endobj"
+                size_t                dictEnd  = 0; // end of the value preceding "stream"
+                unsigned              inStream = 0; // the /ObjStm holding it (PDF 1.5)
+                size_t                at       = 0; // where body starts in the file, 0 in an /ObjStm
+                std::vector<unsigned> refs;         // children, /Parent excluded
+        };
+
+        std::string                            m_version;
+        std::string                            m_trailer;
+        std::vector<std::pair<size_t, size_t>> m_trailers; // every trailer or /XRef dictionary in the file
+        std::vector<object>                    m_objects;
+        std::vector<bool>                      m_reachable;
+
+        // What append() has written so far, finish() completes the file
+        struct append_state {
+                size_t              written = 0;
+                unsigned            next    = 4; // 1 Catalog, 2 Pages, 3 Outlines
+                std::vector<size_t> offsets = std::vector<size_t>(4, 0);
+                std::string         header;
+                std::string         version;
+                std::string         kids;
+                size_t              pages     = 0;
+                unsigned            info      = 0;
+                unsigned            firstItem = 0;
+                unsigned            lastItem  = 0;
+                long                itemCount = 0;
+                std::string         pending; // the last top level bookmark, waiting for its /Next
+        };
+        std::unique_ptr<append_state> m_append;
+
+        // The document open_base() read, overlay() writes it out again
+        struct overlay_base;
+        std::unique_ptr<overlay_base> m_base;
+
+        bool parse(const std::string &pdf);
+        bool read_xref_stream(const std::string &pdf, size_t off, std::vector<long> &offsets, size_t &tb, size_t &te);
+        bool stream_data(unsigned num, std::string &data);
+        bool unpack_objects();
+        void mark_reachable();
+        bool trailer_value(const char *key, std::string &value);
+        bool trailer_ref(const char *key, unsigned &num);
+        bool dict_ref(unsigned num, const char *key, unsigned &ref);
+        bool is_type(unsigned num, const char *type);
+        unsigned annots(unsigned page, std::vector<unsigned> &annots);
+        unsigned link_target(unsigned annot, const std::vector<bool> &isPage);
+
+        void closure(unsigned start, const std::vector<bool> &stop, std::vector<bool> &seen, std::vector<unsigned> &order);
+        bool page_tree(unsigned pagesRoot, std::vector<unsigned> &pages, std::vector<bool> &stop, bool inherit);
+        bool resolve(const std::string &s, size_t vb, size_t ve, char open, std::string &value);
+};
+
+struct pdf_compact_impl::overlay_base {
+        pdf_compact_impl      doc;
+        std::vector<unsigned> pages;
+};
+
+/**
+ * @brief pdf_compact_impl::parse
+ * @param pdf
+ * @return
+ *
+ * Reads the cross-reference sections (following /Prev), tables or
+ * streams, and cuts the file into objects.  Each object runs from its
+ * offset to the next known offset.
+ */
+bool pdf_compact_impl::parse(const std::string &pdf) {
+    m_trailer.clear();
+    m_trailers.clear();
+    m_objects.clear();
+    m_reachable.clear();
+    if (pdf.compare(0, 5, "%PDF-") != 0)
+        return false;
+    m_version = pdf.substr(5, 3);
+
+    size_t sx = pdf.rfind("startxref");
+    if (sx == std::string::npos)
+        return false;
+    size_t pos = sx + 9;
+    token  t   = next_token(pdf, pdf.size(), pos);
+    if (!is_integer(pdf, t))
+        return false;
+    size_t xrefOff = to_ulong(pdf, t);
+
+    std::vector<long>   offsets;
+    std::vector<size_t> boundaries;
+    for (int section = 0; section < 64; ++section) {
+        if (xrefOff >= pdf.size())
+            return false;
+        boundaries.push_back(xrefOff);
+
+        size_t tb, te;
+        if (pdf.compare(xrefOff, 4, "xref") != 0) {
+            if (!read_xref_stream(pdf, xrefOff, offsets, tb, te))
+                return false;
+        } else {
+            pos = xrefOff + 4;
+            while (true) {
+                token first = next_token(pdf, pdf.size(), pos);
+                if (token_is(pdf, first, "trailer"))
+                    break;
+                token count = next_token(pdf, pdf.size(), pos);
+                if (!is_integer(pdf, first) || !is_integer(pdf, count))
+                    return false;
+                unsigned long start = to_ulong(pdf, first);
+                unsigned long n     = to_ulong(pdf, count);
+                if (start + n > 8388607)
+                    return false;
+                if (offsets.size() < start + n)
+                    offsets.resize(start + n, -1);
+                m_objects.resize(offsets.size());
+                for (unsigned long i = 0; i < n; ++i) {
+                    token off  = next_token(pdf, pdf.size(), pos);
+                    token gen  = next_token(pdf, pdf.size(), pos);
+                    token type = next_token(pdf, pdf.size(), pos);
+                    if (type.type == tok::END)
+                        return false;
+                    // The newest section is read first and wins
+                    if (offsets[start + i] == -1) {
+                        offsets[start + i] = token_is(pdf, type, "n") ? static_cast<long>(to_ulong(pdf, off)) : 0;
+                        m_objects[start + i].gen = to_ulong(pdf, gen);
+                    }
+                }
+            }
+            if (!skip_value(pdf, pdf.size(), pos, tb, te))
+                return false;
+        }
+        if (m_trailer.empty())
+            m_trailer = pdf.substr(tb, te - tb);
+        m_trailers.emplace_back(tb, te);
+
+        size_t vb, ve;
+        if (!dict_get(pdf, tb, te, "Prev", vb, ve))
+            break;
+        xrefOff = strtoul(pdf.c_str() + vb, nullptr, 10);
+    }
+
+    size_t vb, ve;
+    if (dict_get(m_trailer, 0, m_trailer.size(), "Encrypt", vb, ve))
+        return false;
+    if (dict_get(m_trailer, 0, m_trailer.size(), "Size", vb, ve)) {
+        unsigned long size = strtoul(m_trailer.c_str() + vb, nullptr, 10);
+        if (size < offsets.size()) {
+            offsets.resize(size);
+            m_objects.resize(size);
+        }
+    }
+    // Object 0 heads the free list, everything below counts on it
+    if (offsets.empty()) {
+        offsets.assign(1, -1);
+        m_objects.resize(1);
+    }
+
+    for (long off : offsets) {
+        // A truncated or damaged file
+        if (off > 0 && static_cast<size_t>(off) >= pdf.size())
+            return false;
+        if (off > 0)
+            boundaries.push_back(off);
+    }
+    boundaries.push_back(pdf.size());
+    std::sort(boundaries.begin(), boundaries.end());
+
+    for (size_t num = 1; num < offsets.size(); ++num) {
+        if (offsets[num] <= 0)
+            continue;
+        size_t begin = offsets[num];
+        size_t end   = *std::upper_bound(boundaries.begin(), boundaries.end(), begin);
+
+        pos          = begin;
+        token n      = next_token(pdf, end, pos);
+        token g      = next_token(pdf, end, pos);
+        token obj    = next_token(pdf, end, pos);
+        if (!is_integer(pdf, n) || to_ulong(pdf, n) != num || !is_integer(pdf, g) || !token_is(pdf, obj, "obj"))
+            return false;
+
+        size_t b, e;
+        if (!skip_value(pdf, end, pos, b, e))
+            return false;
+
+        object &o = m_objects[num];
+        token   k = next_token(pdf, end, pos);
+        if (token_is(pdf, k, "stream")) {
+            size_t es = pdf.rfind("endstream", end);
+            if (es == std::string::npos || es < k.end)
+                return false;
+            o.isStream = true;
+            o.body     = pdf.substr(b, es + 9 - b);
+        } else {
+            o.body = pdf.substr(b, e - b);
+        }
+        o.dictEnd = e - b;
+        o.at      = b;
+        o.present = true;
+        collect_child_refs(o.body, 0, o.dictEnd, o.refs);
+    }
+    return unpack_objects();
+}
+
+/**
+ * @brief pdf_compact_impl::read_xref_stream
+ * @param pdf
+ * @param off Offset of the "n g obj" of the /XRef stream
+ * @param offsets
+ * @param tb Start of the stream dictionary, which doubles as the trailer
+ * @param te End of the stream dictionary
+ * @return
+ *
+ * PDF 1.5 cross-reference stream.  Objects kept in an object stream are
+ * given offset 0 and remember the stream, unpack_objects() reads them once
+ * every uncompressed object is known.
+ */
+bool pdf_compact_impl::read_xref_stream(const std::string &pdf, size_t off, std::vector<long> &offsets, size_t &tb, size_t &te) {
+    size_t pos = off;
+    token  n   = next_token(pdf, pdf.size(), pos);
+    token  g   = next_token(pdf, pdf.size(), pos);
+    token  obj = next_token(pdf, pdf.size(), pos);
+    if (!is_integer(pdf, n) || !is_integer(pdf, g) || !token_is(pdf, obj, "obj"))
+        return false;
+    if (!skip_value(pdf, pdf.size(), pos, tb, te))
+        return false;
+    token k = next_token(pdf, pdf.size(), pos);
+    if (!token_is(pdf, k, "stream"))
+        return false;
+
+    size_t data = k.end;
+    if (data < pdf.size() && pdf[data] == '\r')
+        ++data;
+    if (data < pdf.size() && pdf[data] == '\n')
+        ++data;
+    long length = dict_int(pdf, tb, te, "Length", -1);
+    if (length < 0 || data + length > pdf.size())
+        return false;
+
+    std::string table;
+    if (!decode_stream(pdf, tb, te, pdf.substr(data, length), table))
+        return false;
+
+    size_t vb, ve;
+    if (!dict_get(pdf, tb, te, "W", vb, ve))
+        return false;
+    std::vector<unsigned> w;
+    collect_ints(pdf, vb, ve, w);
+    if (w.size() != 3 || w[0] > 4 || w[1] > 8 || w[2] > 4)
+        return false;
+
+    std::vector<unsigned> index;
+    if (dict_get(pdf, tb, te, "Index", vb, ve))
+        collect_ints(pdf, vb, ve, index);
+    else
+        index = {0, static_cast<unsigned>(dict_int(pdf, tb, te, "Size", 0))};
+    if (index.size() % 2)
+        return false;
+
+    auto field = [&](size_t &at, unsigned width, unsigned long def) {
+        if (!width)
+            return def;
+        unsigned long value = 0;
+        for (unsigned i = 0; i < width; ++i)
+            value = (value << 8) | static_cast<unsigned char>(table[at++]);
+        return value;
+    };
+
+    const size_t rowLen = w[0] + w[1] + w[2];
+    size_t       at     = 0;
+    for (size_t i = 0; i < index.size(); i += 2) {
+        unsigned long start = index[i];
+        unsigned long count = index[i + 1];
+        if (start + count > 8388607 || at + count * rowLen > table.size())
+            return false;
+        if (offsets.size() < start + count)
+            offsets.resize(start + count, -1);
+        m_objects.resize(offsets.size());
+        for (unsigned long j = 0; j < count; ++j) {
+            unsigned long type   = field(at, w[0], 1);
+            unsigned long field2 = field(at, w[1], 0);
+            unsigned long field3 = field(at, w[2], 0);
+            // The newest section is read first and wins
+            if (offsets[start + j] != -1)
+                continue;
+            offsets[start + j] = type == 1 ? static_cast<long>(field2) : 0;
+            if (type == 1)
+                m_objects[start + j].gen = field3;
+            else if (type == 2)
+                m_objects[start + j].inStream = field2;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief pdf_compact_impl::stream_data
+ * Decoded contents of stream object @p num.
+ */
+bool pdf_compact_impl::stream_data(unsigned num, std::string &data) {
+    const object &o = m_objects[num];
+    if (!o.isStream)
+        return false;
+
+    size_t start = o.body.find("stream", o.dictEnd);
+    if (start == std::string::npos)
+        return false;
+    start += 6;
+    if (start < o.body.size() && o.body[start] == '\r')
+        ++start;
+    if (start < o.body.size() && o.body[start] == '\n')
+        ++start;
+
+    size_t vb, ve;
+    if (!dict_get(o.body, 0, o.dictEnd, "Length", vb, ve))
+        return false;
+    std::vector<unsigned> lengthRef;
+    collect_refs(o.body, vb, ve, lengthRef);
+    long length = strtol(o.body.c_str() + vb, nullptr, 10);
+    if (!lengthRef.empty()) {
+        if (lengthRef[0] >= m_objects.size() || !m_objects[lengthRef[0]].present)
+            return false;
+        length = strtol(m_objects[lengthRef[0]].body.c_str(), nullptr, 10);
+    }
+    if (length < 0 || start + length > o.body.size())
+        return false;
+
+    return decode_stream(o.body, 0, o.dictEnd, o.body.substr(start, length), data);
+}
+
+/**
+ * @brief pdf_compact_impl::unpack_objects
+ *
+ * Reads the objects kept in /ObjStm streams.  Each object stream is
+ * decoded once however many objects it holds.
+ */
+bool pdf_compact_impl::unpack_objects() {
+    std::vector<std::vector<unsigned>> wanted(m_objects.size());
+    for (unsigned num = 1; num < m_objects.size(); ++num) {
+        unsigned stm = m_objects[num].inStream;
+        if (!stm)
+            continue;
+        if (stm >= m_objects.size() || !m_objects[stm].present)
+            return false;
+        wanted[stm].push_back(num);
+    }
+
+    for (unsigned stm = 1; stm < wanted.size(); ++stm) {
+        if (wanted[stm].empty())
+            continue;
+        const object &s     = m_objects[stm];
+        long          first = dict_int(s.body, 0, s.dictEnd, "First", -1);
+        long          n     = dict_int(s.body, 0, s.dictEnd, "N", -1);
+        std::string   data;
+        if (first < 0 || n < 0 || !stream_data(stm, data) || static_cast<size_t>(first) > data.size())
+            return false;
+
+        // The header is N pairs of "object-number offset"
+        std::vector<unsigned> header;
+        collect_ints(data, 0, first, header);
+        if (header.size() < static_cast<size_t>(n) * 2)
+            return false;
+
+        for (long i = 0; i < n; ++i) {
+            unsigned num = header[i * 2];
+            if (num >= m_objects.size() || m_objects[num].inStream != stm || m_objects[num].present)
+                continue;
+            size_t b   = first + header[i * 2 + 1];
+            size_t end = i + 1 < n ? first + header[i * 2 + 3] : data.size();
+            size_t pos = b;
+            size_t vb, ve;
+            if (b > data.size() || end > data.size() || !skip_value(data, end, pos, vb, ve))
+                return false;
+
+            object &o = m_objects[num];
+            o.body    = data.substr(vb, ve - vb);
+            o.dictEnd = o.body.size();
+            o.present = true;
+            collect_child_refs(o.body, 0, o.dictEnd, o.refs);
+        }
+    }
+    return true;
+}
+
+void pdf_compact_impl::mark_reachable() {
+    m_reachable.assign(m_objects.size(), false);
+
+    std::vector<unsigned> todo;
+    collect_refs(m_trailer, 0, m_trailer.size(), todo);
+    // /Parent entries point back up the tree, they are always reachable
+    // through /Root so leaving them out of o.refs does not lose objects.
+    while (!todo.empty()) {
+        unsigned num = todo.back();
+        todo.pop_back();
+        if (num >= m_objects.size() || m_reachable[num] || !m_objects[num].present)
+            continue;
+        m_reachable[num] = true;
+        todo.insert(todo.end(), m_objects[num].refs.begin(), m_objects[num].refs.end());
+    }
+}
+
+bool pdf_compact_impl::trailer_value(const char *key, std::string &value) {
+    size_t vb, ve;
+    if (!dict_get(m_trailer, 0, m_trailer.size(), key, vb, ve))
+        return false;
+    value = m_trailer.substr(vb, ve - vb);
+    return true;
+}
+
+bool pdf_compact_impl::trailer_ref(const char *key, unsigned &num) {
+    std::string value;
+    if (!trailer_value(key, value))
+        return false;
+    num = strtoul(value.c_str(), nullptr, 10);
+    return num > 0 && num < m_objects.size() && m_objects[num].present;
+}
+
+bool pdf_compact_impl::dict_ref(unsigned num, const char *key, unsigned &ref) {
+    const object &o = m_objects[num];
+    size_t        vb, ve;
+    if (!dict_get(o.body, 0, o.dictEnd, key, vb, ve))
+        return false;
+    std::vector<unsigned> refs;
+    collect_refs(o.body, vb, ve, refs);
+    if (refs.size() != 1)
+        return false;
+    ref = refs[0];
+    return ref < m_objects.size() && m_objects[ref].present;
+}
+
+bool pdf_compact_impl::is_type(unsigned num, const char *type) {
+    const object &o = m_objects[num];
+    size_t        vb, ve;
+    if (!dict_get(o.body, 0, o.dictEnd, "Type", vb, ve))
+        return false;
+    return o.body.compare(vb, ve - vb, type) == 0 && ve - vb == strlen(type);
+}
+
+/**
+ * @brief pdf_compact_impl::annots
+ * @param page
+ * @param annots The annotations of @p page
+ * @return The object holding the /Annots array, @p page itself or the
+ * array object it refers to; 0 if it has none
+ */
+unsigned pdf_compact_impl::annots(unsigned page, std::vector<unsigned> &annots) {
+    const object &o = m_objects[page];
+    size_t        vb, ve;
+    if (!dict_get(o.body, 0, o.dictEnd, "Annots", vb, ve))
+        return 0;
+    if (o.body[vb] == '[') {
+        collect_refs(o.body, vb, ve, annots);
+        return page;
+    }
+
+    unsigned array = 0;
+    if (!dict_ref(page, "Annots", array) || m_objects[array].body.compare(0, 1, "[") != 0)
+        return 0;
+    collect_refs(m_objects[array].body, 0, m_objects[array].dictEnd, annots);
+    return array;
+}
+
+/**
+ * @brief pdf_compact_impl::link_target
+ * @return The page a /Link annotation goes to through /Dest or a /GoTo
+ * action, 0 for any other annotation or destination
+ */
+unsigned pdf_compact_impl::link_target(unsigned annot, const std::vector<bool> &isPage) {
+    if (annot >= m_objects.size() || !m_objects[annot].present)
+        return 0;
+    const object &o = m_objects[annot];
+    size_t        vb, ve;
+    if (!dict_get(o.body, 0, o.dictEnd, "Subtype", vb, ve) || o.body.compare(vb, ve - vb, "/Link") != 0)
+        return 0;
+
+    // The destination, inline or indirect, in /Dest or the /D of /A
+    const std::string *body = &o.body;
+    unsigned           action = 0;
+    if (!dict_get(o.body, 0, o.dictEnd, "Dest", vb, ve)) {
+        if (!dict_get(o.body, 0, o.dictEnd, "A", vb, ve))
+            return 0;
+        if (o.body[vb] != '<') {
+            if (!dict_ref(annot, "A", action))
+                return 0;
+            body = &m_objects[action].body;
+            vb   = 0;
+            ve   = m_objects[action].dictEnd;
+        }
+        if (!dict_get(*body, vb, ve, "D", vb, ve))
+            return 0;
+    }
+
+    std::vector<unsigned> refs;
+    collect_refs(*body, vb, ve, refs);
+    if (refs.size() == 1 && refs[0] < m_objects.size() && !isPage[refs[0]] && m_objects[refs[0]].present) {
+        const object &dest = m_objects[refs[0]];
+        refs.clear();
+        collect_refs(dest.body, 0, dest.dictEnd, refs);
+    }
+    return !refs.empty() && refs[0] < isPage.size() && isPage[refs[0]] ? refs[0] : 0;
+}
+
+/**
+ * @brief pdf_compact_impl::resolve
+ * @param s
+ * @param vb Start of a value in @p s
+ * @param ve End of the value
+ * @param open '<' for a dictionary, '[' for an array
+ * @param value The value, or the body of the object it refers to
+ * @return false if it is neither that nor a reference to one
+ */
+bool pdf_compact_impl::resolve(const std::string &s, size_t vb, size_t ve, char open, std::string &value) {
+    if (s[vb] == open) {
+        value = s.substr(vb, ve - vb);
+        return true;
+    }
+    std::vector<unsigned> refs;
+    collect_refs(s, vb, ve, refs);
+    if (refs.size() != 1 || refs[0] >= m_objects.size() || !m_objects[refs[0]].present || m_objects[refs[0]].isStream)
+        return false;
+    const object &o = m_objects[refs[0]];
+    if (o.body.empty() || o.body[0] != open)
+        return false;
+    value = o.body;
+    return true;
+}
+
+/**
+ * @brief pdf_compact_impl::closure
+ *
+ * Depth first walk from @p start, not entering anything flagged in
+ * @p stop (other pages, the page tree, the catalog).
+ */
+void pdf_compact_impl::closure(unsigned start, const std::vector<bool> &stop, std::vector<bool> &seen, std::vector<unsigned> &order) {
+    std::vector<unsigned> todo{start};
+    while (!todo.empty()) {
+        unsigned num = todo.back();
+        todo.pop_back();
+        if (num >= m_objects.size() || seen[num] || !m_objects[num].present)
+            continue;
+        if (num != start && stop[num])
+            continue;
+        seen[num] = true;
+        order.push_back(num);
+        const auto &refs = m_objects[num].refs;
+        for (auto it = refs.rbegin(); it != refs.rend(); ++it)
+            todo.push_back(*it);
+    }
+}
+
+/**
+ * @brief pdf_compact_impl::page_tree
+ * @param pagesRoot
+ * @param pages The page objects in document order
+ * @param stop Flags every node of the tree, pages included
+ * @param inherit Copy /Resources, /MediaBox, /CropBox and /Rotate down
+ * from the intermediate nodes into pages that do not set their own
+ * @return false if the tree has no pages
+ */
+bool pdf_compact_impl::page_tree(unsigned pagesRoot, std::vector<unsigned> &pages, std::vector<bool> &stop, bool inherit) {
+    const size_t          count = m_objects.size();
+    std::vector<unsigned> todo{pagesRoot};
+    std::vector<unsigned> parent(count, 0);
+    std::vector<bool>     visited(count, false);
+    while (!todo.empty()) {
+        unsigned num = todo.back();
+        todo.pop_back();
+        if (num >= count || visited[num] || !m_objects[num].present)
+            continue;
+        visited[num] = true;
+        stop[num]    = true;
+
+        const auto &o = m_objects[num];
+        size_t      vb, ve;
+        if (!is_type(num, "/Page") && dict_get(o.body, 0, o.dictEnd, "Kids", vb, ve)) {
+            std::vector<unsigned> kids;
+            collect_refs(o.body, vb, ve, kids);
+            for (unsigned kid : kids) {
+                if (kid < count && !visited[kid] && !parent[kid])
+                    parent[kid] = num;
+            }
+            todo.insert(todo.end(), kids.rbegin(), kids.rend());
+        } else {
+            pages.push_back(num);
+        }
+    }
+
+    if (inherit) {
+        static const char *const keys[] = {"Resources", "MediaBox", "CropBox", "Rotate"};
+        for (unsigned num : pages) {
+            object     &o = m_objects[num];
+            std::string extra;
+            size_t      vb, ve;
+            for (const char *key : keys) {
+                if (dict_get(o.body, 0, o.dictEnd, key, vb, ve))
+                    continue;
+                for (unsigned up = parent[num]; up; up = parent[up]) {
+                    const object &node = m_objects[up];
+                    if (dict_get(node.body, 0, node.dictEnd, key, vb, ve)) {
+                        extra += std::string(" /") + key + " " + node.body.substr(vb, ve - vb);
+                        break;
+                    }
+                }
+            }
+            size_t close = o.body.rfind(">>", o.dictEnd);
+            if (extra.empty() || o.isStream || close == std::string::npos)
+                continue;
+            o.body.insert(close, extra + " ");
+            o.dictEnd += extra.size() + 1;
+            o.refs.clear();
+            collect_child_refs(o.body, 0, o.dictEnd, o.refs);
+        }
+    }
+    return !pages.empty();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+
+pdf_compact::pdf_compact()
+    : m_pimpl(new pdf_compact_impl()) {
+}
+
+pdf_compact::~pdf_compact() {
+    delete m_pimpl;
+}
+
+/******************************************************************************/
+/*  OBJECT STREAMS                                                             */
+/******************************************************************************/
+
+/**
+ * @brief pdf_compact::pack_objects
+ * @param pdf
+ * @return
+ *
+ * Streams stay where they are (they can not live in an object stream);
+ * everything else with generation 0 is packed into /ObjStm groups of up
+ * to 100 objects and the cross-reference table becomes a compressed
+ * /XRef stream.
+ */
+bool pdf_compact::pack_objects(std::string &pdf) {
+    pdf_compact_impl &d = *m_pimpl;
+    if (!d.parse(pdf))
+        return false;
+    d.mark_reachable();
+
+    static const size_t groupSize = 100;
+
+    struct entry {
+            unsigned char type = 0;
+            size_t        f2   = 0;
+            unsigned      f3   = 0;
+    };
+    std::vector<entry> xref(std::max<size_t>(1, d.m_objects.size()));
+    xref[0] = {0, 0, 65535};
+
+    std::string version = d.m_version < "1.5" ? std::string("1.5") : d.m_version;
+    std::string out     = "%PDF-" + version + "\n%\xE2\xE3\xCF\xD3\n";
+    out.reserve(pdf.size());
+
+    std::vector<unsigned> packed;
+    for (unsigned num = 1; num < d.m_objects.size(); ++num) {
+        if (!d.m_reachable[num])
+            continue;
+        const auto &o = d.m_objects[num];
+        if (o.isStream || o.gen != 0) {
+            xref[num] = {1, out.size(), o.gen};
+            out += std::to_string(num) + " " + std::to_string(o.gen) + " obj\n" + o.body + "\nendobj\n";
+        } else {
+            packed.push_back(num);
+        }
+    }
+
+    unsigned next = d.m_objects.size();
+    for (size_t first = 0; first < packed.size(); first += groupSize) {
+        size_t      last = std::min(first + groupSize, packed.size());
+        unsigned    stm  = next++;
+        std::string header, data;
+        for (size_t i = first; i < last; ++i) {
+            unsigned num = packed[i];
+            header += std::to_string(num) + " " + std::to_string(data.size()) + " ";
+            data += d.m_objects[num].body + "\n";
+            xref[num] = {2, stm, static_cast<unsigned>(i - first)};
+        }
+        std::string raw = header + data, compressed;
+        if (!deflate_buffer(raw, compressed))
+            return false;
+
+        xref.resize(next);
+        xref[stm] = {1, out.size(), 0};
+        out += std::to_string(stm) + " 0 obj\n<< /Type /ObjStm /N " + std::to_string(last - first) + " /First " + std::to_string(header.size()) + " /Filter /FlateDecode /Length " + std::to_string(compressed.size()) + " >>\nstream\n";
+        out += compressed;
+        out += "\nendstream\nendobj\n";
+    }
+
+    unsigned xrefNum = next++;
+    xref.resize(next);
+    size_t xrefOff = out.size();
+    xref[xrefNum]  = {1, xrefOff, 0};
+
+    int w2 = 1;
+    while ((xrefOff >> (8 * w2)) != 0)
+        ++w2;
+
+    std::string rows;
+    rows.reserve(xref.size() * (3 + w2));
+    for (const entry &e : xref) {
+        rows.push_back(static_cast<char>(e.type));
+        for (int i = w2 - 1; i >= 0; --i)
+            rows.push_back(static_cast<char>((e.f2 >> (8 * i)) & 0xff));
+        rows.push_back(static_cast<char>((e.f3 >> 8) & 0xff));
+        rows.push_back(static_cast<char>(e.f3 & 0xff));
+    }
+    std::string compressed;
+    if (!deflate_buffer(rows, compressed))
+        return false;
+
+    std::string dict = "<< /Type /XRef /Size " + std::to_string(xref.size()) + " /W [ 1 " + std::to_string(w2) + " 2 ]";
+    std::string value;
+    for (const char *key : {"Root", "Info", "ID"}) {
+        if (d.trailer_value(key, value))
+            dict += std::string(" /") + key + " " + value;
+    }
+    dict += " /Filter /FlateDecode /Length " + std::to_string(compressed.size()) + " >>";
+
+    out += std::to_string(xrefNum) + " 0 obj\n" + dict + "\nstream\n";
+    out += compressed;
+    out += "\nendstream\nendobj\nstartxref\n" + std::to_string(xrefOff) + "\n%%EOF\n";
+
+    wkJlog << iclog::loglevel::debug << iclog::category::LIB
+           << "Packed " << packed.size() << " objects into " << (xrefNum - d.m_objects.size()) << " object streams"
+           << iclog::endl;
+
+    pdf.swap(out);
+    return true;
+}
+
+/******************************************************************************/
+/*  LINEARISATION                                                              */
+/******************************************************************************/
+
+/**
+ * @brief pdf_compact::linearise
+ * @param pdf
+ * @return
+ *
+ * File layout (Annex F, parts 1 - 11):
+ *
+ *   header, linearisation dictionary, first page cross-reference table and
+ *   trailer, catalog and document level objects, primary hint stream,
+ *   first page objects, remaining pages (page object first), objects
+ *   shared between pages, everything else, main cross-reference table.
+ *
+ * The first page section holds the highest object numbers, the rest is
+ * numbered from 1 so the two tables are contiguous.  The hint stream
+ * depends on the offsets and the offsets on the hint stream length, so
+ * the layout is repeated until the length settles.
+ */
+bool pdf_compact::linearise(std::string &pdf) {
+    pdf_compact_impl &d = *m_pimpl;
+    if (!d.parse(pdf))
+        return false;
+    d.mark_reachable();
+
+    const size_t count = d.m_objects.size();
+
+    unsigned root = 0, pagesRoot = 0;
+    if (!d.trailer_ref("Root", root) || !d.dict_ref(root, "Pages", pagesRoot))
+        return false;
+
+    // Walk the page tree
+    std::vector<unsigned> pages;
+    std::vector<bool>     stop(count, false);
+    stop[root] = true;
+    if (!d.page_tree(pagesRoot, pages, stop, false))
+        return false;
+
+    // Part 4: catalog plus what it needs to open the document
+    std::vector<unsigned> part4{root};
+    std::vector<bool>     placed(count, false);
+    placed[root] = true;
+    {
+        const auto &o   = d.m_objects[root];
+        size_t      pos = 0;
+        next_token(o.body, o.dictEnd, pos);
+        while (true) {
+            token k = next_token(o.body, o.dictEnd, pos);
+            if (k.type != tok::NAME)
+                break;
+            size_t b, e;
+            if (!skip_value(o.body, o.dictEnd, pos, b, e))
+                break;
+            if (token_is(o.body, k, "/Pages") || token_is(o.body, k, "/Outlines") || token_is(o.body, k, "/Names") || token_is(o.body, k, "/Dests") || token_is(o.body, k, "/StructTreeRoot") || token_is(o.body, k, "/Metadata"))
+                continue;
+            std::vector<unsigned> refs;
+            collect_refs(o.body, b, e, refs);
+            for (unsigned r : refs) {
+                std::vector<unsigned> order;
+                d.closure(r, stop, placed, order);
+                part4.insert(part4.end(), order.begin(), order.end());
+            }
+        }
+    }
+
+    // Parts 6 and 7: what each page needs
+    std::vector<std::vector<unsigned>> closures(pages.size());
+    for (size_t i = 0; i < pages.size(); ++i) {
+        std::vector<bool> seen = placed;
+        d.closure(pages[i], stop, seen, closures[i]);
+    }
+
+    std::vector<unsigned> part6 = closures[0];
+    std::vector<bool>     firstPage(count, false);
+    for (unsigned num : part6) {
+        firstPage[num] = true;
+        placed[num]    = true;
+    }
+
+    std::vector<unsigned> users(count, 0);
+    for (size_t i = 1; i < pages.size(); ++i) {
+        for (unsigned num : closures[i])
+            ++users[num];
+    }
+
+    std::vector<std::vector<unsigned>> part7(pages.size());
+    std::vector<unsigned>              part8;
+    std::vector<bool>                  shared(count, false);
+    for (size_t i = 1; i < pages.size(); ++i) {
+        for (unsigned num : closures[i]) {
+            if (placed[num])
+                continue;
+            if (users[num] > 1 && num != pages[i]) {
+                if (!shared[num]) {
+                    shared[num] = true;
+                    part8.push_back(num);
+                }
+            } else {
+                part7[i].push_back(num);
+                placed[num] = true;
+            }
+        }
+    }
+    for (unsigned num : part8)
+        placed[num] = true;
+
+    // Part 9: page tree, outlines, info and the rest
+    std::vector<unsigned> part9;
+    for (unsigned num = 1; num < count; ++num) {
+        if (d.m_reachable[num] && !placed[num])
+            part9.push_back(num);
+    }
+
+    // Numbering: main section first, first page section last
+    std::vector<unsigned> map(count, 0);
+    unsigned              next = 1;
+    for (size_t i = 1; i < pages.size(); ++i) {
+        for (unsigned num : part7[i])
+            map[num] = next++;
+    }
+    for (unsigned num : part8)
+        map[num] = next++;
+    for (unsigned num : part9)
+        map[num] = next++;
+
+    const unsigned mainCount = next; // includes object 0
+    const unsigned linNum    = next++;
+    for (unsigned num : part4)
+        map[num] = next++;
+    const unsigned hintNum = next++;
+    for (unsigned num : part6)
+        map[num] = next++;
+    const unsigned total      = next;
+    const unsigned firstCount = total - mainCount;
+
+    std::vector<std::string> text(count);
+    for (unsigned num = 1; num < count; ++num) {
+        if (!map[num])
+            continue;
+        const auto &o = d.m_objects[num];
+        text[num]     = std::to_string(map[num]) + " 0 obj\n" + renumber(o.body, 0, o.dictEnd, map) + o.body.substr(o.dictEnd) + "\nendobj\n";
+    }
+
+    auto trailer_entry = [&](const char *key) -> std::string {
+        std::string value;
+        if (!d.trailer_value(key, value))
+            return "";
+        return std::string(" /") + key + " " + renumber(value, 0, value.size(), map);
+    };
+    const std::string rootEntry = trailer_entry("Root");
+    const std::string infoEntry = trailer_entry("Info");
+    const std::string idEntry   = trailer_entry("ID");
+
+    std::string version = d.m_version < "1.4" ? std::string("1.4") : d.m_version;
+    std::string header  = "%PDF-" + version + "\n%\xE2\xE3\xCF\xD3\n";
+
+    auto lin_text = [&](size_t L, size_t hOff, size_t hLen, size_t E, size_t T) {
+        return std::to_string(linNum) + " 0 obj\n<< /Linearized 1 /L " + padded(L) + " /H [ " + padded(hOff) + " " + padded(hLen) + " ] /O " + std::to_string(map[pages[0]]) + " /E " + padded(E) + " /N " + std::to_string(pages.size()) + " /T " + padded(T) + " >>\nendobj\n";
+    };
+    auto first_xref_text = [&](const std::vector<size_t> &offs, size_t prev) {
+        std::string s = "xref\n" + std::to_string(mainCount) + " " + std::to_string(firstCount) + "\n";
+        for (size_t off : offs)
+            s += padded(off) + " 00000 n\r\n";
+        s += "trailer\n<< /Size " + std::to_string(total) + " /Prev " + padded(prev) + rootEntry + infoEntry + idEntry + " >>\nstartxref\n0\n%%EOF\n";
+        return s;
+    };
+
+    auto sum_len = [&](const std::vector<unsigned> &objs) {
+        size_t n = 0;
+        for (unsigned num : objs)
+            n += text[num].size();
+        return n;
+    };
+
+    // Shared object identifiers: first page objects, then part 8
+    std::vector<long> sharedId(count, -1);
+    {
+        long id = 0;
+        for (unsigned num : part6)
+            sharedId[num] = id++;
+        for (unsigned num : part8)
+            sharedId[num] = id++;
+    }
+    std::vector<std::vector<unsigned long>> pageShared(pages.size());
+    for (size_t i = 1; i < pages.size(); ++i) {
+        for (unsigned num : closures[i]) {
+            if (firstPage[num] || shared[num])
+                pageShared[i].push_back(sharedId[num]);
+        }
+    }
+
+    std::vector<size_t> pageLen(pages.size()), pageObjs(pages.size());
+    pageLen[0]  = sum_len(part6);
+    pageObjs[0] = part6.size();
+    for (size_t i = 1; i < pages.size(); ++i) {
+        pageLen[i]  = sum_len(part7[i]);
+        pageObjs[i] = part7[i].size();
+    }
+
+    const size_t linLen   = lin_text(0, 0, 0, 0, 0).size();
+    const size_t fxrefOff = header.size() + linLen;
+    const size_t fxrefLen = first_xref_text(std::vector<size_t>(firstCount), 0).size();
+    const size_t part4Off = fxrefOff + fxrefLen;
+    const size_t hintOff  = part4Off + sum_len(part4);
+
+    size_t hintPad = 0;
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        const size_t hintObjLen = (std::to_string(hintNum) + " 0 obj\n<< /S " + padded(0) + " /Length " + padded(hintPad) + " >>\nstream\n").size() + hintPad + strlen("\nendstream\nendobj\n");
+        const size_t part6Off   = hintOff + hintObjLen;
+        const size_t E          = part6Off + pageLen[0];
+
+        std::vector<size_t> newOffset(total, 0);
+        newOffset[linNum]  = header.size();
+        newOffset[hintNum] = hintOff;
+        size_t cursor      = part4Off;
+        for (unsigned num : part4) {
+            newOffset[map[num]] = cursor;
+            cursor += text[num].size();
+        }
+        cursor = part6Off;
+        for (unsigned num : part6) {
+            newOffset[map[num]] = cursor;
+            cursor += text[num].size();
+        }
+        for (size_t i = 1; i < pages.size(); ++i) {
+            for (unsigned num : part7[i]) {
+                newOffset[map[num]] = cursor;
+                cursor += text[num].size();
+            }
+        }
+        const size_t part8Off = cursor;
+        for (unsigned num : part8) {
+            newOffset[map[num]] = cursor;
+            cursor += text[num].size();
+        }
+        for (unsigned num : part9) {
+            newOffset[map[num]] = cursor;
+            cursor += text[num].size();
+        }
+        const size_t mainOff = cursor;
+
+        std::string mainXref = "xref\n0 " + std::to_string(mainCount) + "\n0000000000 65535 f\r\n";
+        for (unsigned n = 1; n < mainCount; ++n)
+            mainXref += padded(newOffset[n]) + " 00000 n\r\n";
+        mainXref += "trailer\n<< /Size " + std::to_string(mainCount) + " >>\nstartxref\n" + std::to_string(fxrefOff) + "\n%%EOF\n";
+
+        // /T points at the end of line before the first entry
+        const size_t T = mainOff + strlen("xref\n0 ") + std::to_string(mainCount).size();
+        const size_t L = mainOff + mainXref.size();
+
+        // Hint table offsets are given as if the hint stream were not there
+        auto adjusted = [&](size_t off) { return off >= hintOff ? off - hintObjLen : off; };
+
+        // Page offset hint table (F.4.1)
+        size_t minObjs = *std::min_element(pageObjs.begin(), pageObjs.end());
+        size_t maxObjs = *std::max_element(pageObjs.begin(), pageObjs.end());
+        size_t minLen  = *std::min_element(pageLen.begin(), pageLen.end());
+        size_t maxLen  = *std::max_element(pageLen.begin(), pageLen.end());
+        size_t maxNShared = 0, maxId = 0;
+        for (const auto &ids : pageShared) {
+            maxNShared = std::max(maxNShared, ids.size());
+            for (unsigned long id : ids)
+                maxId = std::max<size_t>(maxId, id);
+        }
+        int bObjs    = bits_for(maxObjs - minObjs);
+        int bLen     = bits_for(maxLen - minLen);
+        int bNShared = bits_for(maxNShared);
+        int bId      = bits_for(maxId);
+
+        bit_writer pot;
+        pot.write(minObjs, 32);
+        pot.write(adjusted(part6Off), 32);
+        pot.write(bObjs, 16);
+        pot.write(minLen, 32);
+        pot.write(bLen, 16);
+        pot.write(0, 32); // least content stream offset
+        pot.write(0, 16);
+        pot.write(minLen, 32); // least content stream length
+        pot.write(bLen, 16);
+        pot.write(bNShared, 16);
+        pot.write(bId, 16);
+        pot.write(0, 16); // numerator bits
+        pot.write(4, 16); // denominator
+        for (size_t i = 0; i < pages.size(); ++i)
+            pot.write(pageObjs[i] - minObjs, bObjs);
+        pot.flush();
+        for (size_t i = 0; i < pages.size(); ++i)
+            pot.write(pageLen[i] - minLen, bLen);
+        pot.flush();
+        for (size_t i = 0; i < pages.size(); ++i)
+            pot.write(pageShared[i].size(), bNShared);
+        pot.flush();
+        for (size_t i = 0; i < pages.size(); ++i) {
+            for (unsigned long id : pageShared[i])
+                pot.write(id, bId);
+        }
+        pot.flush();
+        for (size_t i = 0; i < pages.size(); ++i)
+            pot.write(pageLen[i] - minLen, bLen);
+        std::string hint = pot.data();
+
+        // Shared object hint table (F.4.2), one object per group
+        const size_t        soht = hint.size();
+        std::vector<size_t> groupLen;
+        for (unsigned num : part6)
+            groupLen.push_back(text[num].size());
+        for (unsigned num : part8)
+            groupLen.push_back(text[num].size());
+        size_t minGroup = *std::min_element(groupLen.begin(), groupLen.end());
+        size_t maxGroup = *std::max_element(groupLen.begin(), groupLen.end());
+        int    bGroup   = bits_for(maxGroup - minGroup);
+
+        bit_writer sot;
+        sot.write(part8.empty() ? 0 : map[part8[0]], 32);
+        sot.write(part8.empty() ? 0 : adjusted(part8Off), 32);
+        sot.write(part6.size(), 32);
+        sot.write(groupLen.size(), 32);
+        sot.write(0, 16); // bits for objects per group
+        sot.write(minGroup, 32);
+        sot.write(bGroup, 16);
+        for (size_t len : groupLen)
+            sot.write(len - minGroup, bGroup);
+        sot.flush();
+        for (size_t i = 0; i < groupLen.size(); ++i)
+            sot.write(0, 1); // no MD5 signatures
+        hint += sot.data();
+
+        if (hint.size() > hintPad) {
+            // Offsets moved with the hint stream, lay out again
+            hintPad = hint.size();
+            continue;
+        }
+        hint.resize(hintPad, '\0');
+
+        std::vector<size_t> firstOffs(newOffset.begin() + mainCount, newOffset.end());
+
+        std::string out;
+        out.reserve(L);
+        out += header;
+        out += lin_text(L, hintOff, hintObjLen, E, T);
+        out += first_xref_text(firstOffs, mainOff);
+        for (unsigned num : part4)
+            out += text[num];
+        out += std::to_string(hintNum) + " 0 obj\n<< /S " + padded(soht) + " /Length " + padded(hintPad) + " >>\nstream\n" + hint + "\nendstream\nendobj\n";
+        for (unsigned num : part6)
+            out += text[num];
+        for (size_t i = 1; i < pages.size(); ++i) {
+            for (unsigned num : part7[i])
+                out += text[num];
+        }
+        for (unsigned num : part8)
+            out += text[num];
+        for (unsigned num : part9)
+            out += text[num];
+        out += mainXref;
+
+        if (out.size() != L)
+            return false;
+
+        wkJlog << iclog::loglevel::debug << iclog::category::LIB
+               << "Linearised " << pages.size() << " pages, " << part8.size() << " shared objects"
+               << iclog::endl;
+
+        pdf.swap(out);
+        return true;
+    }
+    return false;
+}
+
+/******************************************************************************/
+/*  SPLIT                                                                      */
+/******************************************************************************/
+
+/**
+ * @brief pdf_compact::split
+ * @param pdf
+ * @param firstPages Zero based index of the first page of each part
+ * @param sink Called with each finished part, in page order
+ * @return false if the file could not be read (nothing was passed to @p sink)
+ *
+ * Each part gets a new catalog and a flat page tree plus everything its
+ * pages reach.  Fonts and images used on several pages of a part are
+ * written once; a link to a page outside the part is removed from its
+ * page.  Every object is visited once per part that uses it, so the cost
+ * is linear in the size of the output.
+ */
+bool pdf_compact::split(const std::string &pdf, const std::vector<size_t> &firstPages, const std::function<void(size_t part, std::string &data)> &sink) {
+    pdf_compact_impl &d = *m_pimpl;
+    if (!d.parse(pdf))
+        return false;
+
+    const size_t count = d.m_objects.size();
+
+    unsigned root = 0, pagesRoot = 0;
+    if (!d.trailer_ref("Root", root) || !d.dict_ref(root, "Pages", pagesRoot))
+        return false;
+
+    std::vector<unsigned> pages;
+    std::vector<bool>     stop(count, false);
+    stop[root] = true;
+    if (!d.page_tree(pagesRoot, pages, stop, true))
+        return false;
+
+    std::vector<size_t> starts{0};
+    for (size_t first : firstPages) {
+        if (first > starts.back() && first < pages.size())
+            starts.push_back(first);
+    }
+    starts.push_back(pages.size());
+
+    unsigned info    = 0;
+    bool     hasInfo = d.trailer_ref("Info", info);
+
+    // Intermediate nodes all become the new (flat) page tree, object 2
+    std::vector<unsigned> map(count, 0);
+    std::vector<bool>     seen(count, false);
+    std::vector<bool>     isPage(count, false);
+    std::vector<size_t>   partOf(count, 0);
+    for (size_t part = 0; part + 1 < starts.size(); ++part) {
+        for (size_t i = starts[part]; i < starts[part + 1]; ++i)
+            partOf[pages[i]] = part;
+    }
+    for (unsigned num : pages)
+        isPage[num] = true;
+    for (unsigned num = 1; num < count; ++num) {
+        if (stop[num] && !isPage[num] && num != root)
+            map[num] = 2;
+    }
+
+    // Links out of the part being written and the /Annots arrays holding them
+    std::vector<bool> dropped(count, false);
+    std::vector<bool> trimmed(count, false);
+
+    for (size_t part = 0; part + 1 < starts.size(); ++part) {
+        std::vector<unsigned> links, holders;
+        for (size_t i = starts[part]; i < starts[part + 1]; ++i) {
+            std::vector<unsigned> annots;
+            unsigned              holder = d.annots(pages[i], annots);
+            for (unsigned annot : annots) {
+                unsigned target = d.link_target(annot, isPage);
+                if (!target || partOf[target] == part)
+                    continue;
+                dropped[annot] = stop[annot] = true;
+                trimmed[holder]              = true;
+                links.push_back(annot);
+                holders.push_back(holder);
+            }
+        }
+
+        std::vector<unsigned> order;
+        for (size_t i = starts[part]; i < starts[part + 1]; ++i)
+            d.closure(pages[i], stop, seen, order);
+        if (hasInfo)
+            d.closure(info, stop, seen, order);
+
+        unsigned next = 3;
+        for (unsigned num : order)
+            map[num] = next++;
+
+        std::string out = "%PDF-" + d.m_version + "\n%\xE2\xE3\xCF\xD3\n";
+        std::vector<size_t> offsets(next, 0);
+
+        std::string kids;
+        for (size_t i = starts[part]; i < starts[part + 1]; ++i)
+            kids += std::to_string(map[pages[i]]) + " 0 R ";
+
+        offsets[1] = out.size();
+        out += "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n";
+        offsets[2] = out.size();
+        out += "2 0 obj\n<< /Type /Pages /Kids [ " + kids + "] /Count " + std::to_string(starts[part + 1] - starts[part]) + " >>\nendobj\n";
+
+        for (unsigned num : order) {
+            const auto &o     = d.m_objects[num];
+            offsets[map[num]] = out.size();
+            if (trimmed[num]) {
+                std::string body = without_refs(o.body, 0, o.dictEnd, dropped);
+                out += std::to_string(map[num]) + " 0 obj\n" + renumber(body, 0, body.size(), map) + o.body.substr(o.dictEnd) + "\nendobj\n";
+            } else {
+                out += std::to_string(map[num]) + " 0 obj\n" + renumber(o.body, 0, o.dictEnd, map) + o.body.substr(o.dictEnd) + "\nendobj\n";
+            }
+        }
+
+        size_t xrefOff = out.size();
+        out += "xref\n0 " + std::to_string(next) + "\n0000000000 65535 f \n";
+        for (unsigned num = 1; num < next; ++num)
+            out += padded(offsets[num]) + " 00000 n \n";
+        out += "trailer\n<< /Size " + std::to_string(next) + " /Root 1 0 R";
+        if (hasInfo)
+            out += " /Info " + std::to_string(map[info]) + " 0 R";
+        out += " >>\nstartxref\n" + std::to_string(xrefOff) + "\n%%EOF\n";
+
+        // Only touch what this part used, the next one starts clean
+        for (unsigned num : order) {
+            seen[num] = false;
+            map[num]  = 0;
+        }
+        for (unsigned num : links)
+            dropped[num] = stop[num] = false;
+        for (unsigned num : holders)
+            trimmed[num] = false;
+
+        sink(part, out);
+    }
+
+    wkJlog << iclog::loglevel::debug << iclog::category::LIB
+           << "Split " << pages.size() << " pages into " << (starts.size() - 1) << " documents"
+           << iclog::endl;
+    return true;
+}
+
+/******************************************************************************/
+/*  MERGE AND SPLICE                                                           */
+/******************************************************************************/
+
+namespace {
+
+    /*
+     * One document taking part in merge() or splice().
+     */
+    struct merge_input {
+            pdf_compact_impl                         doc;
+            std::vector<unsigned>                    pages;
+            std::vector<bool>                        stop;
+            std::vector<bool>                        seen;
+            std::vector<unsigned>                    map;
+            std::vector<unsigned>                    order;
+            std::vector<std::pair<unsigned, size_t>> redirects; // dropped page -> input standing in for it
+            unsigned                                 firstItem   = 0;
+            unsigned                                 lastItem    = 0;
+            unsigned                                 info        = 0;
+            long                                     itemCount   = 0;
+            bool                                     keepOutline = true;
+
+            bool open(const std::string &pdf);
+    };
+
+    /*
+     * Parses @p pdf and maps its page tree nodes to the new object 2, its
+     * catalog to 1 and its outline root to 3.
+     */
+    bool merge_input::open(const std::string &pdf) {
+        if (!doc.parse(pdf))
+            return false;
+
+        const size_t count = doc.m_objects.size();
+        unsigned     root = 0, pagesRoot = 0;
+        if (!doc.trailer_ref("Root", root) || !doc.dict_ref(root, "Pages", pagesRoot))
+            return false;
+
+        stop.assign(count, false);
+        seen.assign(count, false);
+        stop[root] = true;
+        if (!doc.page_tree(pagesRoot, pages, stop, true))
+            return false;
+
+        map.assign(count, 0);
+        std::vector<bool> isPage(count, false);
+        for (unsigned num : pages)
+            isPage[num] = true;
+        for (unsigned num = 1; num < count; ++num) {
+            if (stop[num] && !isPage[num] && num != root)
+                map[num] = 2;
+        }
+        map[root] = 1;
+
+        unsigned outlines = 0;
+        if (doc.dict_ref(root, "Outlines", outlines) && doc.dict_ref(outlines, "First", firstItem)) {
+            const auto &o  = doc.m_objects[outlines];
+            stop[outlines] = true;
+            map[outlines]  = 3;
+            itemCount      = std::abs(dict_int(o.body, 0, o.dictEnd, "Count", 0));
+
+            // Follow /Next to the last item, a loop ends the walk
+            std::vector<bool> walked(count, false);
+            unsigned          next = 0;
+            walked[lastItem = firstItem] = true;
+            while (doc.dict_ref(lastItem, "Next", next) && !walked[next])
+                walked[lastItem = next] = true;
+        }
+        doc.trailer_ref("Info", info);
+        return true;
+    }
+
+    /**
+     * Writes the pages listed in @p sequence (input, page object) as one
+     * document.  Object 1 is the catalog, 2 the flat page tree and 3 the
+     * outline joining the top level bookmarks of every input that keeps
+     * its outline.
+     */
+    void assemble(std::vector<merge_input> &inputs, const std::vector<std::pair<size_t, unsigned>> &sequence, std::string &out) {
+        for (const auto &entry : sequence) {
+            merge_input &in = inputs[entry.first];
+            in.doc.closure(entry.second, in.stop, in.seen, in.order);
+        }
+
+        std::string version   = "1.4";
+        unsigned    next      = 4; // 1 Catalog, 2 Pages, 3 Outlines
+        long        itemCount = 0;
+        bool        haveInfo  = false;
+        for (merge_input &in : inputs) {
+            if (in.keepOutline && in.firstItem) {
+                in.doc.closure(in.firstItem, in.stop, in.seen, in.order);
+                itemCount += in.itemCount;
+            } else {
+                in.firstItem = in.lastItem = 0;
+            }
+
+            if (in.info && !haveInfo) {
+                in.doc.closure(in.info, in.stop, in.seen, in.order);
+                haveInfo = true;
+            } else {
+                in.info = 0;
+            }
+
+            version = std::max(version, in.doc.m_version);
+            for (unsigned num : in.order)
+                in.map[num] = next++;
+        }
+        for (merge_input &in : inputs) {
+            for (const auto &r : in.redirects) {
+                const merge_input &other = inputs[r.second];
+                in.map[r.first]          = other.pages.empty() ? 0 : other.map[other.pages.front()];
+            }
+        }
+
+        std::string text = "%PDF-" + version + "\n%\xE2\xE3\xCF\xD3\n";
+        std::vector<size_t> offsets(next, 0);
+
+        std::string kids;
+        for (const auto &entry : sequence)
+            kids += std::to_string(inputs[entry.first].map[entry.second]) + " 0 R ";
+
+        unsigned firstItem = 0, lastItem = 0;
+        for (const merge_input &in : inputs) {
+            if (in.firstItem) {
+                if (!firstItem)
+                    firstItem = in.map[in.firstItem];
+                lastItem = in.map[in.lastItem];
+            }
+        }
+
+        offsets[1] = text.size();
+        text += "1 0 obj\n<< /Type /Catalog /Pages 2 0 R";
+        if (firstItem)
+            text += " /Outlines 3 0 R /PageMode /UseOutlines";
+        text += " >>\nendobj\n";
+        offsets[2] = text.size();
+        text += "2 0 obj\n<< /Type /Pages /Kids [ " + kids + "] /Count " + std::to_string(sequence.size()) + " >>\nendobj\n";
+        offsets[3] = text.size();
+        text += "3 0 obj\n<< /Type /Outlines";
+        if (firstItem)
+            text += " /First " + std::to_string(firstItem) + " 0 R /Last " + std::to_string(lastItem) + " 0 R /Count " + std::to_string(itemCount);
+        text += " >>\nendobj\n";
+
+        // Link the top level bookmarks of neighbouring inputs
+        unsigned prevLast = 0;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            merge_input &in = inputs[i];
+
+            unsigned nextFirst = 0;
+            for (size_t j = i + 1; j < inputs.size() && !nextFirst; ++j)
+                nextFirst = inputs[j].firstItem ? inputs[j].map[inputs[j].firstItem] : 0;
+
+            for (unsigned num : in.order) {
+                const auto &o    = in.doc.m_objects[num];
+                std::string body = renumber(o.body, 0, o.dictEnd, in.map);
+                if (num == in.firstItem && prevLast)
+                    body = set_key(body, "Prev", std::to_string(prevLast) + " 0 R");
+                if (num == in.lastItem && nextFirst)
+                    body = set_key(body, "Next", std::to_string(nextFirst) + " 0 R");
+
+                offsets[in.map[num]] = text.size();
+                text += std::to_string(in.map[num]) + " 0 obj\n" + body + o.body.substr(o.dictEnd) + "\nendobj\n";
+            }
+            if (in.firstItem)
+                prevLast = in.map[in.lastItem];
+        }
+
+        size_t xrefOff = text.size();
+        text += "xref\n0 " + std::to_string(next) + "\n0000000000 65535 f \n";
+        for (unsigned num = 1; num < next; ++num)
+            text += padded(offsets[num]) + " 00000 n \n";
+        text += "trailer\n<< /Size " + std::to_string(next) + " /Root 1 0 R";
+        for (const merge_input &in : inputs) {
+            if (in.info)
+                text += " /Info " + std::to_string(in.map[in.info]) + " 0 R";
+        }
+        text += " >>\nstartxref\n" + std::to_string(xrefOff) + "\n%%EOF\n";
+
+        out.swap(text);
+    }
+
+} // namespace
+
+/**
+ * @brief pdf_compact::merge
+ * @param pdfs The documents in output order
+ * @param out
+ * @return false if any input could not be read (@p out is untouched)
+ *
+ * Concatenates the page trees into one flat tree and the top level
+ * outline items into one outline, so bookmarks keep working.  Every
+ * object is copied once and renumbered; link and bookmark destinations
+ * point at pages by reference and follow them.  The document information
+ * is taken from the first input that has one.
+ */
+bool pdf_compact::merge(const std::vector<std::string> &pdfs, std::string &out) {
+    std::vector<merge_input>                 inputs(pdfs.size());
+    std::vector<std::pair<size_t, unsigned>> sequence;
+    for (size_t i = 0; i < pdfs.size(); ++i) {
+        if (!inputs[i].open(pdfs[i]))
+            return false;
+        for (unsigned num : inputs[i].pages)
+            sequence.emplace_back(i, num);
+    }
+
+    assemble(inputs, sequence, out);
+
+    wkJlog << iclog::loglevel::debug << iclog::category::LIB
+           << "Merged " << pdfs.size() << " documents, " << sequence.size() << " pages"
+           << iclog::endl;
+    return true;
+}
+
+/**
+ * @brief pdf_compact::splice
+ * @param pdf
+ * @param inserts Zero based page index of @p pdf and the document whose
+ * pages take its place, in any order
+ * @param out
+ * @param pageMap If set, receives the zero based position in @p out of
+ * each page of @p pdf (a placeholder maps to its first replacement page)
+ * @return false if any document could not be read (@p out is untouched)
+ *
+ * Replaces single placeholder pages with every page of another document.
+ * Links and bookmarks pointing at a placeholder land on the first page
+ * put in its place.  Only the outline of @p pdf is kept.
+ */
+bool pdf_compact::splice(const std::string &pdf, const std::vector<std::pair<size_t, const std::string *>> &inserts, std::string &out, std::vector<size_t> *pageMap) {
+    // A document inserted twice is read twice, a page object can only
+    // appear once in the tree
+    std::vector<merge_input> inputs(inserts.size() + 1);
+    if (!inputs[0].open(pdf))
+        return false;
+
+    std::vector<size_t> insertAt(inputs[0].pages.size(), 0);
+    for (size_t i = 0; i < inserts.size(); ++i) {
+        merge_input &in = inputs[i + 1];
+        if (!inserts[i].second || !in.open(*inserts[i].second))
+            return false;
+        in.keepOutline = false;
+
+        size_t page = inserts[i].first;
+        if (page < insertAt.size() && !insertAt[page]) {
+            insertAt[page] = i + 1;
+            inputs[0].redirects.emplace_back(inputs[0].pages[page], i + 1);
+        }
+    }
+
+    std::vector<std::pair<size_t, unsigned>> sequence;
+    if (pageMap)
+        pageMap->clear();
+    for (size_t i = 0; i < inputs[0].pages.size(); ++i) {
+        if (pageMap)
+            pageMap->push_back(sequence.size());
+        if (!insertAt[i]) {
+            sequence.emplace_back(0, inputs[0].pages[i]);
+            continue;
+        }
+        for (unsigned num : inputs[insertAt[i]].pages)
+            sequence.emplace_back(insertAt[i], num);
+    }
+
+    assemble(inputs, sequence, out);
+
+    wkJlog << iclog::loglevel::debug << iclog::category::LIB
+           << "Spliced " << inserts.size() << " documents in, " << sequence.size() << " pages"
+           << iclog::endl;
+    return true;
+}
+
+/**
+ * @brief pdf_compact::append
+ * @param pdf The next document
+ * @param sink Receives the output as it is produced
+ * @return false if @p pdf could not be read (nothing was written for it)
+ *
+ * merge() one document at a time: each is written out as soon as it is
+ * added, so only the document being added is held in memory.  Call
+ * finish() after the last one.
+ */
+bool pdf_compact::append(const std::string &pdf, const std::function<void(const std::string &data)> &sink) {
+    merge_input in;
+    if (!in.open(pdf))
+        return false;
+
+    if (!m_pimpl->m_append)
+        m_pimpl->m_append = std::make_unique<pdf_compact_impl::append_state>();
+    auto &st = *m_pimpl->m_append;
+
+    for (unsigned num : in.pages)
+        in.doc.closure(num, in.stop, in.seen, in.order);
+    if (in.firstItem)
+        in.doc.closure(in.firstItem, in.stop, in.seen, in.order);
+    if (in.info && !st.info)
+        in.doc.closure(in.info, in.stop, in.seen, in.order);
+    else
+        in.info = 0;
+    for (unsigned num : in.order)
+        in.map[num] = st.next++;
+    st.offsets.resize(st.next, 0);
+
+    auto write = [&st, &sink](std::string &text) {
+        st.written += text.size();
+        sink(text);
+    };
+
+    // The header can not wait for the highest version, the catalog says it
+    if (st.header.empty()) {
+        st.header  = in.doc.m_version;
+        st.version = in.doc.m_version;
+        std::string text = "%PDF-" + st.header + "\n%\xE2\xE3\xCF\xD3\n";
+        write(text);
+    }
+    st.version = std::max(st.version, in.doc.m_version);
+
+    for (unsigned num : in.pages)
+        st.kids += std::to_string(in.map[num]) + " 0 R ";
+    st.pages += in.pages.size();
+    if (in.info)
+        st.info = in.map[in.info];
+
+    unsigned prevLast = st.lastItem;
+    if (in.firstItem) {
+        if (!st.pending.empty()) {
+            std::string text        = std::to_string(st.lastItem) + " 0 obj\n" + set_key(st.pending, "Next", std::to_string(in.map[in.firstItem]) + " 0 R") + "\nendobj\n";
+            st.offsets[st.lastItem] = st.written;
+            write(text);
+            st.pending.clear();
+        }
+        if (!st.firstItem)
+            st.firstItem = in.map[in.firstItem];
+        st.lastItem   = in.map[in.lastItem];
+        st.itemCount += in.itemCount;
+    }
+
+    for (unsigned num : in.order) {
+        const auto &o    = in.doc.m_objects[num];
+        std::string body = renumber(o.body, 0, o.dictEnd, in.map);
+        if (num == in.firstItem && prevLast)
+            body = set_key(body, "Prev", std::to_string(prevLast) + " 0 R");
+        if (num == in.lastItem) {
+            st.pending = body;
+            continue;
+        }
+
+        st.offsets[in.map[num]] = st.written;
+        std::string text        = std::to_string(in.map[num]) + " 0 obj\n" + body + o.body.substr(o.dictEnd) + "\nendobj\n";
+        write(text);
+    }
+    return true;
+}
+
+/**
+ * @brief pdf_compact::finish
+ * @param sink
+ * @return false if nothing was appended
+ *
+ * Writes the catalog, page tree, outline and cross-reference table for
+ * the documents given to append(), and starts over.
+ */
+bool pdf_compact::finish(const std::function<void(const std::string &data)> &sink) {
+    if (!m_pimpl->m_append)
+        return false;
+    auto &st = *m_pimpl->m_append;
+
+    std::string text;
+    auto        object = [&st, &text](unsigned num, const std::string &body) {
+        st.offsets[num]  = st.written + text.size();
+        text            += std::to_string(num) + " 0 obj\n" + body + "\nendobj\n";
+    };
+
+    if (!st.pending.empty())
+        object(st.lastItem, st.pending);
+
+    std::string catalog = "<< /Type /Catalog /Pages 2 0 R";
+    if (st.firstItem)
+        catalog += " /Outlines 3 0 R /PageMode /UseOutlines";
+    if (st.version > st.header)
+        catalog += " /Version /" + st.version;
+    object(1, catalog + " >>");
+    object(2, "<< /Type /Pages /Kids [ " + st.kids + "] /Count " + std::to_string(st.pages) + " >>");
+    std::string outlines = "<< /Type /Outlines";
+    if (st.firstItem)
+        outlines += " /First " + std::to_string(st.firstItem) + " 0 R /Last " + std::to_string(st.lastItem) + " 0 R /Count " + std::to_string(st.itemCount);
+    object(3, outlines + " >>");
+
+    size_t xrefOff = st.written + text.size();
+    text += "xref\n0 " + std::to_string(st.next) + "\n0000000000 65535 f \n";
+    for (unsigned num = 1; num < st.next; ++num)
+        text += padded(st.offsets[num]) + " 00000 n \n";
+    text += "trailer\n<< /Size " + std::to_string(st.next) + " /Root 1 0 R";
+    if (st.info)
+        text += " /Info " + std::to_string(st.info) + " 0 R";
+    text += " >>\nstartxref\n" + std::to_string(xrefOff) + "\n%%EOF\n";
+    sink(text);
+
+    wkJlog << iclog::loglevel::debug << iclog::category::LIB
+           << "Appended " << st.pages << " pages, " << (st.written + text.size()) << " bytes"
+           << iclog::endl;
+
+    m_pimpl->m_append.reset();
+    return true;
+}
+
+/******************************************************************************/
+/*  OVERLAY                                                                    */
+/******************************************************************************/
+
+/**
+ * @brief pdf_compact::open_base
+ * @param pdf
+ * @return false if the file could not be read
+ *
+ * Reads the document overlay() draws on.  It is kept until the next call,
+ * so stamping many copies parses it once.
+ */
+bool pdf_compact::open_base(const std::string &pdf) {
+    auto base = std::make_unique<pdf_compact_impl::overlay_base>();
+
+    unsigned root = 0, pagesRoot = 0;
+    if (!base->doc.parse(pdf) || !base->doc.trailer_ref("Root", root) || !base->doc.dict_ref(root, "Pages", pagesRoot))
+        return false;
+    std::vector<bool> stop(base->doc.m_objects.size(), false);
+    if (!base->doc.page_tree(pagesRoot, base->pages, stop, true))
+        return false;
+    base->doc.mark_reachable();
+
+    m_pimpl->m_base = std::move(base);
+    return true;
+}
+
+size_t pdf_compact::base_pages() const {
+    return m_pimpl->m_base ? m_pimpl->m_base->pages.size() : 0;
+}
+
+/**
+ * @brief pdf_compact::base_media_box
+ * @param page Zero based
+ * @param box Lower left x, y and upper right x, y
+ * @return false if there is no such page or it has no usable /MediaBox
+ */
+bool pdf_compact::base_media_box(size_t page, double box[4]) const {
+    if (!m_pimpl->m_base || page >= m_pimpl->m_base->pages.size())
+        return false;
+    pdf_compact_impl               &d = m_pimpl->m_base->doc;
+    const pdf_compact_impl::object &o = d.m_objects[m_pimpl->m_base->pages[page]];
+    size_t                          vb, ve;
+    std::string                     array;
+    if (!dict_get(o.body, 0, o.dictEnd, "MediaBox", vb, ve) || !d.resolve(o.body, vb, ve, '[', array))
+        return false;
+
+    size_t pos = 1, n = 0;
+    for (token t = next_token(array, array.size(), pos); t.type == tok::NUMBER && n < 4; t = next_token(array, array.size(), pos))
+        box[n++] = strtod(array.c_str() + t.begin, nullptr);
+    if (n < 4)
+        return false;
+    if (box[0] > box[2])
+        std::swap(box[0], box[2]);
+    if (box[1] > box[3])
+        std::swap(box[1], box[3]);
+    return true;
+}
+
+/**
+ * @brief pdf_compact::overlay
+ * @param over A document with one page per entry of @p pages
+ * @param pages Zero based page of the base document each page of @p over
+ * is drawn on, in order
+ * @param out
+ * @return false if nothing was opened with open_base(), @p over could not
+ * be read or does not have as many pages (@p out is untouched)
+ *
+ * Each page of @p over becomes a form XObject painted after the base
+ * page's content.  That content is wrapped in q/Q so whatever graphics
+ * state it leaves behind does not move or recolour the overlay.  The
+ * base objects keep their numbers and are copied unchanged apart from the
+ * /Contents and /Resources of the stamped pages; the overlay's objects
+ * are numbered after them.  With no pages @p over is not read and the
+ * base is written out as it is.
+ */
+bool pdf_compact::overlay(const std::string &over, const std::vector<size_t> &pages, std::string &out) {
+    if (!m_pimpl->m_base)
+        return false;
+    pdf_compact_impl            &d    = m_pimpl->m_base->doc;
+    const std::vector<unsigned> &base = m_pimpl->m_base->pages;
+
+    merge_input in;
+    if (!pages.empty() && (!in.open(over) || in.pages.size() != pages.size()))
+        return false;
+    for (size_t page : pages) {
+        if (page >= base.size())
+            return false;
+    }
+
+    // The overlay's resources, numbered after the base objects
+    unsigned next = d.m_objects.size();
+    in.map.assign(in.doc.m_objects.size(), 0);
+    std::vector<std::string> resources(pages.size(), "<< >>");
+    for (size_t i = 0; i < pages.size(); ++i) {
+        const auto &o = in.doc.m_objects[in.pages[i]];
+        size_t      vb, ve;
+        if (!dict_get(o.body, 0, o.dictEnd, "Resources", vb, ve) || !in.doc.resolve(o.body, vb, ve, '<', resources[i]))
+            continue;
+        std::vector<unsigned> refs;
+        collect_refs(resources[i], 0, resources[i].size(), refs);
+        for (unsigned num : refs)
+            in.doc.closure(num, in.stop, in.seen, in.order);
+    }
+    for (unsigned num : in.order)
+        in.map[num] = next++;
+
+    // One form per page, drawn under a name the page does not use yet
+    const unsigned                  save = pages.empty() ? 0 : next++;
+    std::map<std::string, unsigned> restore;
+    std::vector<std::string>        names(pages.size());
+    std::vector<std::string>        pageBodies(pages.size());
+    std::vector<std::string>        boxes(pages.size(), "[ 0 0 612 792 ]");
+    std::vector<unsigned>           forms(pages.size());
+    for (size_t i = 0; i < pages.size(); ++i) {
+        const auto &o = d.m_objects[base[pages[i]]];
+        size_t      vb, ve;
+        if (dict_get(o.body, 0, o.dictEnd, "MediaBox", vb, ve))
+            d.resolve(o.body, vb, ve, '[', boxes[i]);
+
+        std::string res = "<< >>", xobjects = "<< >>";
+        if (dict_get(o.body, 0, o.dictEnd, "Resources", vb, ve))
+            d.resolve(o.body, vb, ve, '<', res);
+        if (dict_get(res, 0, res.size(), "XObject", vb, ve))
+            d.resolve(res, vb, ve, '<', xobjects);
+        names[i] = "wk2gtkpdfStamp";
+        for (int n = 1; dict_get(xobjects, 0, xobjects.size(), names[i].c_str(), vb, ve); ++n)
+            names[i] = "wk2gtkpdfStamp" + std::to_string(n);
+        if (!restore.count(names[i]))
+            restore[names[i]] = next++;
+        forms[i] = next++;
+
+        std::vector<unsigned> contents;
+        if (dict_get(o.body, 0, o.dictEnd, "Contents", vb, ve)) {
+            std::string array;
+            if (d.resolve(o.body, vb, ve, '[', array))
+                collect_refs(array, 0, array.size(), contents);
+            else
+                collect_refs(o.body, vb, ve, contents);
+        }
+        std::string list = "[ " + std::to_string(save) + " 0 R ";
+        for (unsigned num : contents) {
+            if (num < d.m_objects.size() && d.m_objects[num].present)
+                list += std::to_string(num) + " " + std::to_string(d.m_objects[num].gen) + " R ";
+        }
+        list += std::to_string(restore[names[i]]) + " 0 R ]";
+
+        xobjects         = set_key(xobjects, names[i].c_str(), std::to_string(forms[i]) + " 0 R");
+        std::string body = set_key(o.body, "Contents", list);
+        pageBodies[i]    = set_key(body, "Resources", set_key(res, "XObject", xobjects));
+    }
+
+    std::string version = d.m_version;
+    if (!pages.empty())
+        version = std::max(version, in.doc.m_version);
+    std::string         text = "%PDF-" + version + "\n%\xE2\xE3\xCF\xD3\n";
+    std::vector<size_t> offsets(next, 0);
+    std::vector<bool>   used(next, false);
+    auto                object = [&](unsigned num, unsigned gen, const std::string &body) {
+        offsets[num]  = text.size();
+        used[num]     = true;
+        text         += std::to_string(num) + " " + std::to_string(gen) + " obj\n" + body + "\nendobj\n";
+    };
+    auto stream = [](const std::string &dict, const std::string &data) {
+        return "<< " + dict + "/Length " + std::to_string(data.size()) + " >>\nstream\n" + data + "\nendstream";
+    };
+
+    std::vector<int> stamped(base.size(), -1);
+    for (size_t i = 0; i < pages.size(); ++i)
+        stamped[pages[i]] = static_cast<int>(i);
+    std::vector<int> pageOf(d.m_objects.size(), -1);
+    for (size_t p = 0; p < base.size(); ++p)
+        pageOf[base[p]] = stamped[p];
+
+    for (unsigned num = 1; num < d.m_objects.size(); ++num) {
+        const auto &o = d.m_objects[num];
+        if (!d.m_reachable[num])
+            continue;
+        if (pageOf[num] >= 0)
+            object(num, o.gen, pageBodies[pageOf[num]]);
+        else
+            object(num, o.gen, o.body);
+    }
+
+    if (!pages.empty()) {
+        object(save, 0, stream("", "q\n"));
+        for (const auto &r : restore)
+            object(r.second, 0, stream("", "\nQ /" + r.first + " Do\n"));
+    }
+    for (size_t i = 0; i < pages.size(); ++i) {
+        const auto &o = in.doc.m_objects[in.pages[i]];
+        size_t      vb, ve;
+
+        // The form's stream is the page's contents, joined
+        std::string data;
+        if (dict_get(o.body, 0, o.dictEnd, "Contents", vb, ve)) {
+            std::string           array;
+            std::vector<unsigned> contents;
+            if (in.doc.resolve(o.body, vb, ve, '[', array))
+                collect_refs(array, 0, array.size(), contents);
+            else
+                collect_refs(o.body, vb, ve, contents);
+            for (unsigned num : contents) {
+                std::string part;
+                if (num >= in.doc.m_objects.size() || !in.doc.stream_data(num, part))
+                    return false;
+                data += part + "\n";
+            }
+        }
+
+        std::string packed;
+        std::string dict = "/Type /XObject /Subtype /Form /BBox " + boxes[i] + " /Resources " + renumber(resources[i], 0, resources[i].size(), in.map) + " ";
+        if (deflate_buffer(data, packed))
+            object(forms[i], 0, stream(dict + "/Filter /FlateDecode ", packed));
+        else
+            object(forms[i], 0, stream(dict, data));
+    }
+    for (unsigned num : in.order) {
+        const auto &o = in.doc.m_objects[num];
+        object(in.map[num], 0, renumber(o.body, 0, o.dictEnd, in.map) + o.body.substr(o.dictEnd));
+    }
+
+    size_t xrefOff = text.size();
+    text += "xref\n0 " + std::to_string(next) + "\n0000000000 65535 f \n";
+    for (unsigned num = 1; num < next; ++num) {
+        unsigned gen = num < d.m_objects.size() ? d.m_objects[num].gen : 0;
+        text += used[num] ? padded(offsets[num]) + " " + padded(gen, 5) + " n \n" : "0000000000 65535 f \n";
+    }
+    text += "trailer\n<< /Size " + std::to_string(next);
+    static const char *const keys[] = {"Root", "Info", "ID"};
+    for (const char *key : keys) {
+        std::string value;
+        if (d.trailer_value(key, value))
+            text += std::string(" /") + key + " " + value;
+    }
+    text += " >>\nstartxref\n" + std::to_string(xrefOff) + "\n%%EOF\n";
+    out.swap(text);
+
+    wkJlog << iclog::loglevel::debug << iclog::category::LIB
+           << "Overlaid " << pages.size() << " of " << base.size() << " pages"
+           << iclog::endl;
+    return true;
+}
+
+/******************************************************************************/
+/*  METADATA                                                                   */
+/******************************************************************************/
+
+/**
+ * @brief pdf_compact::metadata
+ * @param pdf
+ * @param dates Extent in @p pdf of each /CreationDate and /ModDate string
+ * of the document information dictionary
+ * @param ids Extent of the /ID array of every trailer and cross-reference
+ * stream dictionary, older sections included
+ * @return false if the file could not be read
+ *
+ * Only the dictionaries themselves are looked at, never stream data.  A
+ * value that is not written out in the file (an indirect string, or an
+ * information dictionary kept in an object stream) is not reported.
+ */
+bool pdf_compact::metadata(const std::string &pdf, std::vector<std::pair<size_t, size_t>> &dates, std::vector<std::pair<size_t, size_t>> &ids) {
+    pdf_compact_impl &d = *m_pimpl;
+    dates.clear();
+    ids.clear();
+    if (!d.parse(pdf))
+        return false;
+
+    size_t vb, ve;
+    for (const auto &trailer : d.m_trailers) {
+        if (dict_get(pdf, trailer.first, trailer.second, "ID", vb, ve) && pdf[vb] == '[')
+            ids.emplace_back(vb, ve);
+    }
+
+    unsigned info = 0;
+    if (!d.trailer_ref("Info", info) || d.m_objects[info].inStream)
+        return true;
+    const auto &o = d.m_objects[info];
+    for (const char *key : {"CreationDate", "ModDate"}) {
+        if (dict_get(o.body, 0, o.dictEnd, key, vb, ve) && o.body[vb] == '(')
+            dates.emplace_back(o.at + vb, o.at + ve);
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef PDF_COMPACT_H
+#define PDF_COMPACT_H
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct pdf_compact_impl;
+
+/**
+ * @brief The pdf_compact class
+ *
+ * Byte level rewriter for the classic cross-reference files written by
+ * cairo and PoDoFo.  Neither PoDoFo 0.9 nor 0.10 can write object streams
+ * (and 0.10 dropped linearisation altogether) so, once PoDoFo has cleaned
+ * the document, this class lays the objects out again:
+ *
+ * - pack_objects() moves every non-stream object into compressed object
+ *   streams and writes a compressed cross-reference stream (PDF 1.5).
+ * - linearise() writes a "Fast Web View" file (ISO 32000 Annex F) so that
+ *   viewers can show the first page before the whole file has arrived.
+ * - split() cuts the document into standalone files by page range.
+ * - merge() concatenates documents, outlines included; append() and
+ *   finish() do the same one document at a time.
+ * - splice() puts the pages of other documents in place of placeholder
+ *   pages.
+ * - open_base() reads a document once; overlay() then draws the pages of
+ *   another document over chosen pages of it, as often as needed.
+ * - metadata() finds the /ID and the document dates, for rewriting them
+ *   in place.
+ *
+ * Input may use classic cross-reference tables or PDF 1.5 cross-reference
+ * and object streams.  Objects that can not be reached from the trailer
+ * are dropped by all of them.
+ *
+ * @note Each returns false and leaves the buffer untouched if the file
+ * uses something the rewriter does not handle (encryption, or streams
+ * filtered with anything but /FlateDecode where it needs to read them).
+ */
+class pdf_compact {
+    public:
+        pdf_compact();
+        ~pdf_compact();
+
+        bool pack_objects(std::string &pdf);
+        bool linearise(std::string &pdf);
+        bool split(const std::string &pdf, const std::vector<size_t> &firstPages, const std::function<void(size_t part, std::string &data)> &sink);
+        bool merge(const std::vector<std::string> &pdfs, std::string &out);
+        bool splice(const std::string &pdf, const std::vector<std::pair<size_t, const std::string *>> &inserts, std::string &out, std::vector<size_t> *pageMap = nullptr);
+        bool append(const std::string &pdf, const std::function<void(const std::string &data)> &sink);
+        bool finish(const std::function<void(const std::string &data)> &sink);
+
+        bool   open_base(const std::string &pdf);
+        size_t base_pages() const;
+        bool   base_media_box(size_t page, double box[4]) const;
+        bool   overlay(const std::string &over, const std::vector<size_t> &pages, std::string &out);
+
+        bool metadata(const std::string &pdf, std::vector<std::pair<size_t, size_t>> &dates, std::vector<std::pair<size_t, size_t>> &ids);
+
+    private:
+        struct pdf_compact_impl *m_pimpl;
+};
+
+#endif // PDF_COMPACT_H
@@ -0,0 +1,118 @@
+#include "pdf_merge.h"
+
+#include "iclog.h"
+#include "pdf_compact.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace phtml {
+
+    struct pdf_merge_impl {
+            std::vector<std::string> m_inputs;
+
+            bool run(std::string &out);
+    };
+
+    bool pdf_merge_impl::run(std::string &out) {
+        if (m_inputs.empty())
+            return false;
+
+        auto        start = std::chrono::steady_clock::now();
+        pdf_compact merger;
+        if (!merger.merge(m_inputs, out)) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "Unable to merge " << m_inputs.size() << " documents, unreadable or encrypted input"
+                   << iclog::endl;
+            return false;
+        }
+
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        wkJlog << iclog::loglevel::info << iclog::category::LIB
+               << "Merged " << m_inputs.size() << " documents into " << out.size() << " bytes in " << static_cast<long>(ms) << "ms"
+               << iclog::endl;
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////
+
+    pdf_merge::pdf_merge()
+        : m_pimpl(new pdf_merge_impl()) {
+    }
+
+    pdf_merge::~pdf_merge() {
+        delete m_pimpl;
+    }
+
+    void pdf_merge::add(const unsigned char *data, size_t size) {
+        if (data && size)
+            m_pimpl->m_inputs.emplace_back(reinterpret_cast<const char *>(data), size);
+    }
+
+    bool pdf_merge::add(const char *pdfFile) {
+        std::ifstream in(pdfFile ? pdfFile : "", std::ios::binary | std::ios::ate);
+        if (!in) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "Unable to open " << (pdfFile ? pdfFile : "(null)") << " for merging"
+                   << iclog::endl;
+            return false;
+        }
+
+        // Size the buffer once and read it in one go
+        std::streamsize size = in.tellg();
+        std::string     data(size > 0 ? static_cast<size_t>(size) : 0, '\0');
+        in.seekg(0, std::ios::beg);
+        if (size <= 0 || !in.read(data.data(), size)) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "Unable to read " << pdfFile << " for merging"
+                   << iclog::endl;
+            return false;
+        }
+        m_pimpl->m_inputs.push_back(std::move(data));
+        return true;
+    }
+
+    size_t pdf_merge::count() const {
+        return m_pimpl->m_inputs.size();
+    }
+
+    void pdf_merge::clear() {
+        m_pimpl->m_inputs.clear();
+    }
+
+    PDF_Blob pdf_merge::merge() {
+        PDF_Blob    blob = {nullptr, 0};
+        std::string out;
+        if (!m_pimpl->run(out))
+            return blob;
+
+        // Allocate raw memory for the ABI-safe return
+        blob.data = (unsigned char *)malloc(out.size());
+        if (blob.data) {
+            std::memcpy(blob.data, out.data(), out.size());
+            blob.size = out.size();
+        }
+        return blob;
+    }
+
+    bool pdf_merge::merge(const char *outFile) {
+        std::string out;
+        if (!outFile || !m_pimpl->run(out))
+            return false;
+
+        std::ofstream file(outFile, std::ios::binary | std::ios::trunc);
+        if (!file.write(out.data(), static_cast<std::streamsize>(out.size()))) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "Unable to write " << outFile
+                   << iclog::endl;
+            return false;
+        }
+        return true;
+    }
+
+} // namespace phtml
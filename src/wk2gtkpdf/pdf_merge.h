@@ -0,0 +1,54 @@
+#ifndef PDF_MERGE_H
+#define PDF_MERGE_H
+#include "ichtmltopdf++.h"
+
+namespace phtml {
+    struct pdf_merge_impl;
+
+    /**
+     * @brief The pdf_merge class
+     *
+     * Concatenates finished PDFs (from get_blob(), get_blobs() or files)
+     * in memory.  Each page and everything it uses is copied once and
+     * renumbered, so the cost is linear in the size of the inputs.
+     *
+     * Links between pages and the bookmarks written by the index keep
+     * pointing at the right page; the bookmarks of each input follow on
+     * from those of the one before.
+     *
+     * @note Named destinations, form fields and tagged structure are not
+     * carried over.
+     */
+    class PDF_API pdf_merge {
+        public:
+            PDF_API pdf_merge();
+            PDF_API ~pdf_merge();
+
+            /**
+             * @brief add
+             * Appends a document.  The data is copied, the caller may free
+             * it straight away.
+             */
+            PDF_API void     add(const unsigned char *data, size_t size);
+            PDF_API bool     add(const char *pdfFile);
+            PDF_API size_t   count() const;
+            PDF_API void     clear();
+            /**
+             * @brief merge
+             * Returns all the documents added so far as one PDF.
+             *
+             * @note OWNERSHIP: The caller takes ownership of the allocated memory.
+             * @warning You MUST call PDF_FreeBlob() when finished to prevent memory leaks.
+             *
+             * @return An empty blob if any input could not be read (it is
+             * logged) or nothing was added.
+             */
+            PDF_API PDF_Blob merge();
+            PDF_API bool     merge(const char *outFile);
+
+        private:
+            pdf_merge_impl *m_pimpl;
+    };
+} // namespace phtml
+
+#endif // PDF_MERGE_H
@@ -0,0 +1,1229 @@
+#include "pdf_postprocess.h"
+
+#include "content_hash.h"
+#include "iclog.h"
+#include "pdf_compact.h"
+#include "pdf_recompress.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <map>
+#include <podofo/podofo.h>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+using namespace PoDoFo;
+
+struct pdf_postprocess_impl {
+        unsigned m_passes = PDF_PASS_NONE;
+        int      m_level  = 9;
+
+        bool     clean_save(const std::vector<unsigned char> &in, std::string &out);
+        unsigned deduplicate(PdfMemDocument &doc);
+        void     greyscale(PdfMemDocument &doc);
+        void     recompress(PdfMemDocument &doc);
+};
+
+/**
+ * @brief luma
+ *
+ * Rec. 601 weights, the grey a colour prints as.
+ */
+static double luma(double r, double g, double b) {
+    return 0.299 * r + 0.587 * g + 0.114 * b;
+}
+
+static double cmyk_grey(double c, double m, double y, double k) {
+    return 1.0 - std::min(1.0, 0.3 * c + 0.59 * m + 0.11 * y + k);
+}
+
+static std::string grey_number(double v) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%.4f", std::clamp(v, 0.0, 1.0));
+    std::string s = buf;
+    s.erase(s.find_last_not_of('0') + 1);
+    if (s.back() == '.')
+        s.pop_back();
+    return s;
+}
+
+static bool pdf_white(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+}
+
+static bool pdf_delimiter(char c) {
+    return c == '(' || c == ')' || c == '<' || c == '>' || c == '[' || c == ']' || c == '{' || c == '}' || c == '/' || c == '%';
+}
+
+static size_t skip_white(const std::string &s, size_t i) {
+    while (i < s.size()) {
+        if (s[i] == '%') {
+            while (i < s.size() && s[i] != '\n' && s[i] != '\r')
+                ++i;
+        } else if (pdf_white(s[i])) {
+            ++i;
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * @brief skip_object
+ * @return The end of the content stream token or operand starting at @p i
+ */
+static size_t skip_object(const std::string &s, size_t i) {
+    const size_t n = s.size();
+    if (s[i] == '(') {
+        int depth = 0;
+        for (; i < n; ++i) {
+            if (s[i] == '\\')
+                ++i;
+            else if (s[i] == '(')
+                ++depth;
+            else if (s[i] == ')' && --depth == 0)
+                return i + 1;
+        }
+        return n;
+    }
+    if (s.compare(i, 2, "<<") == 0 || s[i] == '[') {
+        const char *close = s[i] == '[' ? "]" : ">>";
+        i                 = skip_white(s, i + (s[i] == '[' ? 1 : 2));
+        while (i < n && s.compare(i, std::strlen(close), close) != 0)
+            i = skip_white(s, skip_object(s, i));
+        return std::min(n, i + std::strlen(close));
+    }
+    if (s[i] == '<') {
+        size_t end = s.find('>', i);
+        return end == std::string::npos ? n : end + 1;
+    }
+
+    size_t start = i;
+    if (s[i] == '/')
+        ++i;
+    while (i < n && !pdf_white(s[i]) && !pdf_delimiter(s[i]))
+        ++i;
+    return i == start ? i + 1 : i;
+}
+
+/**
+ * @brief grey_pixels
+ * @param data 8 bit samples, replaced by one grey sample per pixel
+ * @param components 3 (RGB) or 4 (CMYK)
+ * @param pixels
+ */
+static bool grey_pixels(std::string &data, unsigned components, size_t pixels) {
+    if ((components != 3 && components != 4) || data.size() < pixels * components)
+        return false;
+
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(data.data());
+    for (size_t p = 0; p < pixels; ++p, in += components) {
+        double grey = components == 3 ? luma(in[0], in[1], in[2]) / 255.0 : cmyk_grey(in[0] / 255.0, in[1] / 255.0, in[2] / 255.0, in[3] / 255.0);
+        data[p]     = static_cast<char>(std::lround(std::clamp(grey, 0.0, 1.0) * 255.0));
+    }
+    data.resize(pixels);
+    return true;
+}
+
+/**
+ * @brief grey_jpeg
+ * @param data DCTDecode stream data, replaced by one grey sample per pixel
+ * @param width
+ * @param height
+ * @return false if gdk-pixbuf can not decode it or the size is not the
+ * one the image dictionary gives
+ *
+ * gdk-pixbuf hands RGB back for every JPEG it reads, CMYK included.  The
+ * EXIF orientation is not applied, PDF viewers ignore it as well.
+ */
+static bool grey_jpeg(std::string &data, size_t width, size_t height) {
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+    GError          *error  = NULL;
+    bool             loaded = gdk_pixbuf_loader_write(loader, reinterpret_cast<const unsigned char *>(data.data()), data.size(), &error) && gdk_pixbuf_loader_close(loader, &error);
+    GdkPixbuf       *pixbuf = loaded ? gdk_pixbuf_loader_get_pixbuf(loader) : NULL;
+    if (error)
+        g_error_free(error);
+
+    bool usable = pixbuf && gdk_pixbuf_get_bits_per_sample(pixbuf) == 8 && gdk_pixbuf_get_n_channels(pixbuf) >= 3
+               && static_cast<size_t>(gdk_pixbuf_get_width(pixbuf)) == width && static_cast<size_t>(gdk_pixbuf_get_height(pixbuf)) == height;
+    if (usable) {
+        const unsigned char *pixels   = gdk_pixbuf_read_pixels(pixbuf);
+        const size_t         stride   = static_cast<size_t>(gdk_pixbuf_get_rowstride(pixbuf));
+        const size_t         channels = static_cast<size_t>(gdk_pixbuf_get_n_channels(pixbuf));
+        data.resize(width * height);
+        for (size_t y = 0; y < height; ++y) {
+            const unsigned char *in = pixels + y * stride;
+            for (size_t x = 0; x < width; ++x, in += channels)
+                data[y * width + x] = static_cast<char>(std::lround(std::clamp(luma(in[0], in[1], in[2]), 0.0, 255.0)));
+        }
+    }
+    g_object_unref(loader);
+    return usable;
+}
+
+/**
+ * @brief grey_inline_image
+ * @param s The content stream
+ * @param dict The span between BI and ID
+ * @param data Where the samples start
+ * @param end Set to the end of EI
+ * @param out The image as grey, if it is unfiltered 8 bit RGB or CMYK
+ * @return true if @p out was set
+ */
+static bool grey_inline_image(const std::string &s, std::pair<size_t, size_t> dict, size_t data, size_t &end, std::string &out) {
+    std::vector<std::pair<std::string, std::string>> entries;
+    for (size_t i = skip_white(s, dict.first); i < dict.second;) {
+        size_t k = skip_object(s, i);
+        size_t v = skip_white(s, k);
+        size_t e = v < dict.second ? skip_object(s, v) : v;
+        entries.emplace_back(s.substr(i, k - i), s.substr(v, e - v));
+        i = skip_white(s, e);
+    }
+
+    unsigned components = 0, bits = 0;
+    size_t   width = 0, height = 0;
+    bool     plain = true;
+    for (const auto &entry : entries) {
+        const std::string &key = entry.first;
+        if (key == "/CS" || key == "/ColorSpace")
+            components = entry.second == "/RGB" || entry.second == "/DeviceRGB" ? 3 : entry.second == "/CMYK" || entry.second == "/DeviceCMYK" ? 4 : 0;
+        else if (key == "/BPC" || key == "/BitsPerComponent")
+            bits = std::atoi(entry.second.c_str());
+        else if (key == "/W" || key == "/Width")
+            width = std::strtoul(entry.second.c_str(), nullptr, 10);
+        else if (key == "/H" || key == "/Height")
+            height = std::strtoul(entry.second.c_str(), nullptr, 10);
+        else if (key == "/F" || key == "/Filter" || key == "/D" || key == "/Decode" || key == "/DP" || key == "/DecodeParms")
+            plain = false;
+    }
+
+    // Unfiltered samples have a known length, anything else ends at the first "EI" on its own
+    size_t length = plain && components && bits == 8 ? width * height * components : 0;
+    size_t ei     = length ? skip_white(s, data + length) : data;
+    if (!length || ei > s.size() || s.compare(ei, 2, "EI") != 0) {
+        for (ei = data; (ei = s.find("EI", ei)) != std::string::npos; ++ei) {
+            if (pdf_white(s[ei - 1]) && (ei + 2 == s.size() || pdf_white(s[ei + 2])))
+                break;
+        }
+        end = ei == std::string::npos ? s.size() : ei + 2;
+        return false;
+    }
+    end = ei + 2;
+
+    std::string samples = s.substr(data, length);
+    grey_pixels(samples, components, width * height);
+    out = "BI";
+    for (const auto &entry : entries) {
+        if (entry.first != "/CS" && entry.first != "/ColorSpace")
+            out += " " + entry.first + " " + entry.second;
+    }
+    out += " /CS /G ID " + samples + "\nEI";
+    return true;
+}
+
+/**
+ * @brief grey_content
+ * @param in A decoded content stream
+ * @param out The stream with every colour set as grey
+ * @return false if nothing changed
+ *
+ * rg/RG and k/K become g/G.  A DeviceRGB or DeviceCMYK colour space
+ * selected with cs/CS becomes DeviceGray and the sc/scn/SC/SCN colours
+ * set in it are converted; the colour space in force is saved and
+ * restored with q/Q.  Patterns, shadings and images are separate objects.
+ */
+static bool grey_content(const std::string &in, std::string &out) {
+    struct colour_spaces {
+            unsigned fill   = 1;
+            unsigned stroke = 1;
+    };
+    std::vector<colour_spaces>            stack(1);
+    std::vector<std::pair<size_t, size_t>> operands;
+    size_t                                copied  = 0;
+    bool                                  changed = false;
+
+    out.clear();
+    auto number = [&in, &operands](size_t k) { return std::strtod(in.c_str() + operands[k].first, nullptr); };
+
+    for (size_t i = skip_white(in, 0); i < in.size(); i = skip_white(in, i)) {
+        const size_t start = i;
+        const char   c     = in[i];
+        i                  = skip_object(in, i);
+
+        if (c == '(' || c == '<' || c == '[' || c == '/' || c == '+' || c == '-' || c == '.' || std::isdigit(static_cast<unsigned char>(c))) {
+            operands.emplace_back(start, i);
+            continue;
+        }
+        const std::string op = in.substr(start, i - start);
+        if (op == "true" || op == "false" || op == "null") {
+            operands.emplace_back(start, i);
+            continue;
+        }
+
+        auto replace = [&](const std::string &text) {
+            size_t from = operands.empty() ? start : operands.front().first;
+            out.append(in, copied, from - copied);
+            out     += text;
+            copied   = i;
+            changed  = true;
+        };
+
+        colour_spaces &state  = stack.back();
+        const bool     stroke = std::isupper(static_cast<unsigned char>(op[0]));
+        unsigned      &space  = stroke ? state.stroke : state.fill;
+
+        if ((op == "rg" || op == "RG") && operands.size() == 3) {
+            replace(grey_number(luma(number(0), number(1), number(2))) + (stroke ? " G" : " g"));
+            space = 3;
+        } else if ((op == "k" || op == "K") && operands.size() == 4) {
+            replace(grey_number(cmyk_grey(number(0), number(1), number(2), number(3))) + (stroke ? " G" : " g"));
+            space = 4;
+        } else if (op == "g" || op == "G") {
+            space = 1;
+        } else if ((op == "cs" || op == "CS") && operands.size() == 1) {
+            std::string name = in.substr(operands[0].first, operands[0].second - operands[0].first);
+            space            = name == "/DeviceRGB" ? 3 : name == "/DeviceCMYK" ? 4 : name == "/DeviceGray" ? 1 : 0;
+            if (space == 3 || space == 4)
+                replace("/DeviceGray " + op);
+        } else if ((op == "sc" || op == "scn" || op == "SC" || op == "SCN") && (space == 3 || space == 4) && operands.size() == space) {
+            double grey = space == 3 ? luma(number(0), number(1), number(2)) : cmyk_grey(number(0), number(1), number(2), number(3));
+            replace(grey_number(grey) + " " + op);
+        } else if (op == "q") {
+            stack.push_back(state);
+        } else if (op == "Q") {
+            if (stack.size() > 1)
+                stack.pop_back();
+        } else if (op == "BI") {
+            size_t dict = skip_white(in, i);
+            size_t id   = dict;
+            while (id < in.size() && in.compare(id, 2, "ID") != 0)
+                id = skip_white(in, skip_object(in, id));
+
+            size_t      end = in.size();
+            std::string image;
+            if (id + 3 <= in.size() && grey_inline_image(in, {dict, id}, id + 3, end, image)) {
+                out.append(in, copied, start - copied);
+                out     += image;
+                copied   = end;
+                changed  = true;
+            }
+            i = end;
+        }
+        operands.clear();
+    }
+
+    if (changed)
+        out.append(in, copied, std::string::npos);
+    return changed;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+
+pdf_postprocess::pdf_postprocess(unsigned passes, int level)
+    : m_pimpl(new pdf_postprocess_impl()) {
+    m_pimpl->m_passes = passes;
+    m_pimpl->m_level  = level;
+}
+
+pdf_postprocess::~pdf_postprocess() {
+    delete m_pimpl;
+}
+
+#ifdef PODOFO_010
+
+/**
+ * @brief merge_key
+ * @param obj
+ * @return An empty string if the object must keep its identity
+ *
+ * Streams (images, forms, font files, content) and the font and graphics
+ * state dictionaries that point at them.  The key is the dictionary
+ * without /Length followed by the raw (still encoded) stream data, so
+ * two objects with the same key are interchangeable.
+ */
+static std::string merge_key(const PdfObject &obj) {
+    if (!obj.IsDictionary())
+        return "";
+
+    const PdfDictionary &src = obj.GetDictionary();
+    if (!obj.HasStream()) {
+        const PdfObject *type = src.GetKey("Type");
+        if (!type || !type->IsName())
+            return "";
+        const PdfName &name = type->GetName();
+        if (name != "Font" && name != "FontDescriptor" && name != "ExtGState")
+            return "";
+    }
+
+    PdfDictionary dict = src;
+    dict.RemoveKey("Length");
+    std::string key = PdfObject(dict).ToString();
+
+    if (obj.HasStream()) {
+        charbuff data = obj.MustGetStream().GetCopy(true);
+        key += '\0';
+        key.append(data.data(), data.size());
+    }
+    return key;
+}
+
+static void remap_refs(PdfObject &obj, const std::map<PdfReference, PdfReference> &replace) {
+    if (obj.IsReference()) {
+        auto it = replace.find(obj.GetReference());
+        if (it != replace.end())
+            obj = PdfObject(it->second);
+    } else if (obj.IsDictionary()) {
+        for (auto &pair : obj.GetDictionary())
+            remap_refs(pair.second, replace);
+    } else if (obj.IsArray()) {
+        for (PdfObject &item : obj.GetArray())
+            remap_refs(item, replace);
+    }
+}
+
+/**
+ * @brief pdf_postprocess_impl::deduplicate
+ * @param doc
+ * @return The number of objects merged
+ *
+ * Every duplicate is pointed at the first copy and removed.  An image
+ * is only identical to another once their soft masks have been merged
+ * (and a font once its font file has), so this repeats until a round
+ * finds nothing new.
+ */
+unsigned pdf_postprocess_impl::deduplicate(PdfMemDocument &doc) {
+    unsigned merged = 0;
+    for (int round = 0; round < 8; ++round) {
+        // The first object with each key, the key kept beside it
+        std::unordered_map<uint64_t, std::vector<std::pair<PdfObject *, std::string>>> buckets;
+        std::map<PdfReference, PdfReference>                                           replace;
+
+        for (PdfObject *obj : doc.GetObjects()) {
+            std::string key = merge_key(*obj);
+            if (key.empty())
+                continue;
+
+            auto      &bucket = buckets[phtml::fnv1a(key)];
+            PdfObject *match  = nullptr;
+            for (const auto &candidate : bucket) {
+                if (candidate.second == key) {
+                    match = candidate.first;
+                    break;
+                }
+            }
+            if (match)
+                replace[obj->GetIndirectReference()] = match->GetIndirectReference();
+            else
+                bucket.emplace_back(obj, std::move(key));
+        }
+        if (replace.empty())
+            break;
+
+        for (PdfObject *obj : doc.GetObjects())
+            remap_refs(*obj, replace);
+        for (const auto &r : replace)
+            doc.GetObjects().RemoveObject(r.first);
+
+        merged += replace.size();
+    }
+    return merged;
+}
+
+/**
+ * @brief recompress_candidate
+ * @param obj
+ * @param encoded Set if the data is already FlateDecode encoded
+ * @return
+ *
+ * Streams with a single FlateDecode filter and no /DecodeParms (so the
+ * dictionary does not change), or with no filter at all.
+ */
+static bool recompress_candidate(PdfObject &obj, bool &encoded) {
+    if (!obj.HasStream() || !obj.IsDictionary())
+        return false;
+
+    PdfDictionary &dict = obj.GetDictionary();
+    if (dict.HasKey("DecodeParms"))
+        return false;
+
+    const PdfObject *filter = dict.GetKey("Filter");
+    if (!filter) {
+        const PdfObject *type = dict.GetKey("Type");
+        encoded               = false;
+        return !(type && type->IsName() && type->GetName() == "Metadata");
+    }
+
+    if (filter->IsArray() && filter->GetArray().GetSize() == 1)
+        filter = &filter->GetArray()[0];
+    encoded = true;
+    return filter->IsName() && filter->GetName() == "FlateDecode";
+}
+
+/**
+ * @brief pdf_postprocess_impl::recompress
+ * @param doc
+ *
+ * The raw data is copied out serially, inflated and deflated again on
+ * every core by pdf_recompress, and written back raw.  Streams that do
+ * not get smaller are left alone.
+ */
+void pdf_postprocess_impl::recompress(PdfMemDocument &doc) {
+    auto start = std::chrono::steady_clock::now();
+
+    pdf_recompress           pool(m_level);
+    std::vector<PdfObject *> targets;
+    for (PdfObject *obj : doc.GetObjects()) {
+        bool encoded = false;
+        if (!recompress_candidate(*obj, encoded))
+            continue;
+        charbuff raw = obj->MustGetStream().GetCopy(true);
+        pool.add(std::string(raw.data(), raw.size()), encoded);
+        targets.push_back(obj);
+    }
+
+    pool.run();
+
+    unsigned    changed = 0;
+    std::string data;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (!pool.result(i, data))
+            continue;
+        targets[i]->MustGetStream().SetData(bufferview(data.data(), data.size()), PdfFilterList{PdfFilterType::FlateDecode}, true);
+        ++changed;
+    }
+
+    long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    wkJlog << iclog::loglevel::info << iclog::category::LIB
+           << "Recompressed " << changed << " of " << targets.size() << " streams on "
+           << pool.threads() << " threads in " << ms << " ms"
+           << iclog::endl;
+}
+
+static PdfObject *resolve(PdfIndirectObjectList &objects, PdfObject *obj) {
+    return obj && obj->IsReference() ? objects.GetObject(obj->GetReference()) : obj;
+}
+
+/**
+ * @brief colour_components
+ * @return 1 grey, 3 RGB, 4 CMYK, 0 anything else
+ */
+static unsigned colour_components(PdfIndirectObjectList &objects, PdfObject *space) {
+    space = resolve(objects, space);
+    if (space && space->IsName()) {
+        const PdfName &name = space->GetName();
+        return name == "DeviceGray" ? 1 : name == "DeviceRGB" ? 3 : name == "DeviceCMYK" ? 4 : 0;
+    }
+    if (!space || !space->IsArray() || space->GetArray().GetSize() < 2 || !space->GetArray()[0].IsName())
+        return 0;
+
+    const PdfName &family = space->GetArray()[0].GetName();
+    if (family == "CalRGB")
+        return 3;
+    if (family == "CalGray")
+        return 1;
+    PdfObject *profile = resolve(objects, &space->GetArray()[1]);
+    if (family != "ICCBased" || !profile || !profile->IsDictionary())
+        return 0;
+    const PdfObject *n = profile->GetDictionary().GetKey("N");
+    return n && n->IsNumber() ? static_cast<unsigned>(n->GetNumber()) : 0;
+}
+
+/**
+ * @brief grey_function
+ * @param apply false to only check
+ * @return true if @p fn is exponential (type 2), or stitches them (type
+ * 3), with RGB or already grey outputs
+ */
+static bool grey_function(PdfIndirectObjectList &objects, PdfObject *fn, bool apply) {
+    fn = resolve(objects, fn);
+    if (!fn || !fn->IsDictionary())
+        return false;
+
+    PdfDictionary   &dict = fn->GetDictionary();
+    const PdfObject *type = dict.GetKey("FunctionType");
+    if (!type || !type->IsNumber())
+        return false;
+    if (type->GetNumber() == 3) {
+        PdfObject *list = resolve(objects, dict.GetKey("Functions"));
+        if (!list || !list->IsArray())
+            return false;
+        for (PdfObject &item : list->GetArray()) {
+            if (!grey_function(objects, &item, apply))
+                return false;
+        }
+        return true;
+    }
+    if (type->GetNumber() != 2)
+        return false;
+
+    for (const char *key : {"C0", "C1"}) {
+        PdfObject *c = dict.GetKey(key);
+        if (!c || (c->IsArray() && c->GetArray().GetSize() == 1))
+            continue; // grey (the defaults are [0] and [1])
+        if (!c->IsArray() || c->GetArray().GetSize() != 3)
+            return false;
+        if (apply) {
+            PdfArray &rgb = c->GetArray();
+            PdfArray  grey;
+            grey.Add(PdfObject(luma(rgb[0].GetReal(), rgb[1].GetReal(), rgb[2].GetReal())));
+            dict.AddKey(PdfName(key), grey);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief grey_shading
+ * @return true if @p dict is (or is a shading pattern holding) an axial,
+ * radial or function based DeviceRGB shading that was made grey
+ */
+static bool grey_shading(PdfIndirectObjectList &objects, PdfDictionary &dict) {
+    PdfObject *shading = dict.GetKey("Shading");
+    if (dict.HasKey("PatternType") && shading && shading->IsDictionary())
+        return grey_shading(objects, shading->GetDictionary());
+
+    const PdfObject *type = dict.GetKey("ShadingType");
+    PdfObject       *fn   = dict.GetKey("Function");
+    if (!type || !type->IsNumber() || type->GetNumber() > 3 || colour_components(objects, dict.GetKey("ColorSpace")) != 3)
+        return false;
+    if (!fn || fn->IsArray() || !grey_function(objects, fn, false))
+        return false;
+
+    grey_function(objects, fn, true);
+    dict.AddKey(PdfName("ColorSpace"), PdfName("DeviceGray"));
+    PdfObject *background = dict.GetKey("Background");
+    if (background && background->IsArray() && background->GetArray().GetSize() == 3) {
+        PdfArray &rgb = background->GetArray();
+        PdfArray  grey;
+        grey.Add(PdfObject(luma(rgb[0].GetReal(), rgb[1].GetReal(), rgb[2].GetReal())));
+        dict.AddKey(PdfName("Background"), grey);
+    }
+    return true;
+}
+
+/**
+ * @brief grey_image
+ * @param obj An RGB or CMYK image
+ * @param components
+ * @return false if the image stays in colour: only 8 bit images with no
+ * filter, FlateDecode (what cairo writes) or DCTDecode are converted.
+ * JPEG data is decoded by grey_jpeg and written back as Flate grey
+ * samples.
+ */
+static bool grey_image(PdfObject &obj, unsigned components) {
+    PdfDictionary   &dict   = obj.GetDictionary();
+    const PdfObject *bits   = dict.GetKey("BitsPerComponent");
+    const PdfObject *width  = dict.GetKey("Width");
+    const PdfObject *height = dict.GetKey("Height");
+    const PdfObject *filter = dict.GetKey("Filter");
+    if (filter && filter->IsArray() && filter->GetArray().GetSize() == 1)
+        filter = &filter->GetArray()[0];
+
+    if (!bits || !bits->IsNumber() || bits->GetNumber() != 8 || !width || !width->IsNumber() || !height || !height->IsNumber() || dict.HasKey("Decode"))
+        return false;
+    const bool jpeg = filter && filter->IsName() && filter->GetName() == "DCTDecode";
+    if (filter && !jpeg && !(filter->IsName() && filter->GetName() == "FlateDecode"))
+        return false;
+
+    // SetData() applies the default (Flate) filter, also in place of DCTDecode
+    charbuff    data = obj.MustGetStream().GetCopy(jpeg);
+    std::string pixels(data.data(), data.size());
+    size_t      w = static_cast<size_t>(width->GetNumber()), h = static_cast<size_t>(height->GetNumber());
+    if (jpeg ? !grey_jpeg(pixels, w, h) : !grey_pixels(pixels, components, w * h))
+        return false;
+
+    dict.RemoveKey("DecodeParms");
+    obj.MustGetStream().SetData(bufferview(pixels.data(), pixels.size()));
+    dict.AddKey(PdfName("ColorSpace"), PdfName("DeviceGray"));
+    return true;
+}
+
+/**
+ * @brief pdf_postprocess_impl::greyscale
+ * @param doc
+ *
+ * Page content, forms and tiling patterns are rewritten by grey_content,
+ * shadings and images are converted in place.  Text stays text.
+ */
+void pdf_postprocess_impl::greyscale(PdfMemDocument &doc) {
+    auto                   start   = std::chrono::steady_clock::now();
+    PdfIndirectObjectList &objects = doc.GetObjects();
+
+    // Only the pages say which streams are page content
+    std::set<PdfReference> contents;
+    for (PdfObject *obj : objects) {
+        const PdfObject *type = obj->IsDictionary() ? obj->GetDictionary().GetKey("Type") : nullptr;
+        if (!type || !type->IsName() || type->GetName() != "Page")
+            continue;
+        const PdfObject *content = obj->GetDictionary().GetKey("Contents");
+        if (content && content->IsReference()) {
+            contents.insert(content->GetReference());
+        } else if (content && content->IsArray()) {
+            for (const PdfObject &item : content->GetArray()) {
+                if (item.IsReference())
+                    contents.insert(item.GetReference());
+            }
+        }
+    }
+
+    unsigned streams = 0, shadings = 0, images = 0, kept = 0;
+    for (PdfObject *obj : objects) {
+        if (!obj->IsDictionary())
+            continue;
+        PdfDictionary &dict = obj->GetDictionary();
+        if (grey_shading(objects, dict))
+            ++shadings;
+        if (!obj->HasStream())
+            continue;
+
+        const PdfObject *subtype = dict.GetKey("Subtype");
+        const PdfObject *pattern = dict.GetKey("PatternType");
+        bool             image   = subtype && subtype->IsName() && subtype->GetName() == "Image";
+        bool             form    = subtype && subtype->IsName() && subtype->GetName() == "Form";
+        if (image) {
+            unsigned components = colour_components(objects, dict.GetKey("ColorSpace"));
+            if ((components == 3 || components == 4) && grey_image(*obj, components))
+                ++images;
+            else if (components == 3 || components == 4)
+                ++kept;
+        } else if (form || (pattern && pattern->IsNumber() && pattern->GetNumber() == 1) || contents.count(obj->GetIndirectReference())) {
+            charbuff    data = obj->MustGetStream().GetCopy();
+            std::string out;
+            if (grey_content(std::string(data.data(), data.size()), out)) {
+                dict.RemoveKey("DecodeParms");
+                obj->MustGetStream().SetData(bufferview(out.data(), out.size()));
+                ++streams;
+            }
+        }
+    }
+
+    long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    wkJlog << iclog::loglevel::info << iclog::category::LIB
+           << "Greyscale: " << streams << " content streams, " << shadings << " shadings and "
+           << images << " images in " << ms << " ms"
+           << iclog::endl;
+    if (kept) {
+        wkJlog << iclog::loglevel::warning << iclog::category::LIB
+               << "Greyscale: " << kept << " images in formats that can not be converted left in colour"
+               << iclog::endl;
+    }
+}
+
+/**
+ * @brief pdf_postprocess_impl::clean_save
+ * @param in
+ * @param out
+ * @return
+ *
+ * Round trip through PoDoFo: unused objects and incremental updates are
+ * dropped and streams cairo leaves unfiltered (ToUnicode maps, small
+ * forms) get the default Flate filter.  XMP metadata stays readable.
+ */
+bool pdf_postprocess_impl::clean_save(const std::vector<unsigned char> &in, std::string &out) {
+    try {
+        PdfMemDocument doc;
+        doc.LoadFromBuffer(bufferview(reinterpret_cast<const char *>(in.data()), in.size()));
+
+        if (m_passes & PDF_PASS_GREYSCALE)
+            greyscale(doc);
+
+        if (m_passes & PDF_PASS_DEDUPLICATE) {
+            unsigned merged = deduplicate(doc);
+            wkJlog << iclog::loglevel::info << iclog::category::LIB
+                   << "Deduplication merged " << merged << " objects"
+                   << iclog::endl;
+        }
+
+        if (m_passes & PDF_PASS_RECOMPRESS) {
+            recompress(doc);
+        } else {
+            for (PdfObject *obj : doc.GetObjects()) {
+                if (!obj->HasStream() || !obj->IsDictionary())
+                    continue;
+
+                PdfDictionary &dict = obj->GetDictionary();
+                if (dict.HasKey("Filter"))
+                    continue;
+                const PdfObject *type = dict.GetKey("Type");
+                if (type && type->IsName() && type->GetName() == "Metadata")
+                    continue;
+
+                PdfObjectStream &stream = obj->MustGetStream();
+                charbuff         data   = stream.GetCopy();
+                stream.SetData(data);
+            }
+        }
+
+        charbuff           buffer;
+        StringStreamDevice device(buffer);
+        doc.Save(device, PdfSaveOptions::Clean | PdfSaveOptions::NoMetadataUpdate);
+        out.assign(buffer.data(), buffer.size());
+
+    } catch (const PdfError &e) {
+        wkJlog << iclog::loglevel::error << iclog::category::LIB
+               << "PoDoFo Error in post processing: " << e.what()
+               << iclog::endl;
+        return false;
+    }
+    return true;
+}
+
+#else
+
+static std::string merge_key(PdfObject *obj) {
+    if (!obj->IsDictionary())
+        return "";
+
+    if (!obj->HasStream()) {
+        const PdfObject *type = obj->GetDictionary().GetKey(PdfName::KeyType);
+        if (!type || !type->IsName())
+            return "";
+        const PdfName &name = type->GetName();
+        if (name != PdfName("Font") && name != PdfName("FontDescriptor") && name != PdfName("ExtGState"))
+            return "";
+    }
+
+    PdfDictionary dict = obj->GetDictionary();
+    dict.RemoveKey(PdfName::KeyLength);
+    std::string key;
+    PdfObject(dict).ToString(key);
+
+    if (obj->HasStream()) {
+        // 0.9.x: GetCopy() is the raw data, GetFilteredCopy() decodes
+        char    *data = nullptr;
+        pdf_long len  = 0;
+        obj->GetStream()->GetCopy(&data, &len);
+        key += '\0';
+        key.append(data, len);
+        podofo_free(data);
+    }
+    return key;
+}
+
+static void remap_refs(PdfObject *obj, const std::map<PdfReference, PdfReference> &replace) {
+    if (obj->IsReference()) {
+        auto it = replace.find(obj->GetReference());
+        if (it != replace.end())
+            *obj = PdfObject(it->second);
+    } else if (obj->IsDictionary()) {
+        TKeyMap &keys = obj->GetDictionary().GetKeys();
+        for (TIKeyMap it = keys.begin(); it != keys.end(); ++it)
+            remap_refs(it->second, replace);
+    } else if (obj->IsArray()) {
+        PdfArray &arr = obj->GetArray();
+        for (PdfArray::iterator it = arr.begin(); it != arr.end(); ++it)
+            remap_refs(&(*it), replace);
+    }
+}
+
+unsigned pdf_postprocess_impl::deduplicate(PdfMemDocument &doc) {
+    PdfVecObjects *objects = doc.GetObjects();
+    unsigned       merged  = 0;
+    for (int round = 0; round < 8; ++round) {
+        std::unordered_map<uint64_t, std::vector<std::pair<PdfObject *, std::string>>> buckets;
+        std::map<PdfReference, PdfReference>                                           replace;
+
+        for (TIVecObjects it = objects->begin(); it != objects->end(); ++it) {
+            std::string key = merge_key(*it);
+            if (key.empty())
+                continue;
+
+            auto      &bucket = buckets[phtml::fnv1a(key)];
+            PdfObject *match  = nullptr;
+            for (const auto &candidate : bucket) {
+                if (candidate.second == key) {
+                    match = candidate.first;
+                    break;
+                }
+            }
+            if (match)
+                replace[(*it)->Reference()] = match->Reference();
+            else
+                bucket.emplace_back(*it, std::move(key));
+        }
+        if (replace.empty())
+            break;
+
+        for (TIVecObjects it = objects->begin(); it != objects->end(); ++it)
+            remap_refs(*it, replace);
+        for (const auto &r : replace)
+            delete objects->RemoveObject(r.first);
+
+        merged += replace.size();
+    }
+    return merged;
+}
+
+static bool recompress_candidate(PdfObject *obj, bool &encoded) {
+    if (!obj->HasStream() || !obj->IsDictionary())
+        return false;
+
+    PdfDictionary &dict = obj->GetDictionary();
+    if (dict.HasKey(PdfName("DecodeParms")))
+        return false;
+
+    const PdfObject *filter = dict.GetKey(PdfName::KeyFilter);
+    if (!filter) {
+        const PdfObject *type = dict.GetKey(PdfName::KeyType);
+        encoded               = false;
+        return !(type && type->IsName() && type->GetName() == PdfName("Metadata"));
+    }
+
+    if (filter->IsArray() && filter->GetArray().GetSize() == 1)
+        filter = &filter->GetArray()[0];
+    encoded = true;
+    return filter->IsName() && filter->GetName() == PdfName("FlateDecode");
+}
+
+void pdf_postprocess_impl::recompress(PdfMemDocument &doc) {
+    auto start = std::chrono::steady_clock::now();
+
+    PdfVecObjects           *objects = doc.GetObjects();
+    pdf_recompress           pool(m_level);
+    std::vector<PdfObject *> targets;
+    std::vector<bool>        wasEncoded;
+    for (TIVecObjects it = objects->begin(); it != objects->end(); ++it) {
+        bool encoded = false;
+        if (!recompress_candidate(*it, encoded))
+            continue;
+
+        char    *raw = nullptr;
+        pdf_long len = 0;
+        (*it)->GetStream()->GetCopy(&raw, &len);
+        pool.add(std::string(raw, len), encoded);
+        podofo_free(raw);
+        targets.push_back(*it);
+        wasEncoded.push_back(encoded);
+    }
+
+    pool.run();
+
+    unsigned    changed = 0;
+    std::string data;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (!pool.result(i, data))
+            continue;
+
+        // SetRawData() leaves the dictionary alone
+        PdfMemoryInputStream input(data.data(), static_cast<pdf_long>(data.size()));
+        targets[i]->GetStream()->SetRawData(&input, static_cast<pdf_long>(data.size()));
+        if (!wasEncoded[i])
+            targets[i]->GetDictionary().AddKey(PdfName::KeyFilter, PdfName("FlateDecode"));
+        ++changed;
+    }
+
+    long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    wkJlog << iclog::loglevel::info << iclog::category::LIB
+           << "Recompressed " << changed << " of " << targets.size() << " streams on "
+           << pool.threads() << " threads in " << ms << " ms"
+           << iclog::endl;
+}
+
+static PdfObject *resolve(PdfVecObjects *objects, PdfObject *obj) {
+    return obj && obj->IsReference() ? objects->GetObject(obj->GetReference()) : obj;
+}
+
+static unsigned colour_components(PdfVecObjects *objects, PdfObject *space) {
+    space = resolve(objects, space);
+    if (space && space->IsName()) {
+        const PdfName &name = space->GetName();
+        return name == PdfName("DeviceGray") ? 1 : name == PdfName("DeviceRGB") ? 3 : name == PdfName("DeviceCMYK") ? 4 : 0;
+    }
+    if (!space || !space->IsArray() || space->GetArray().GetSize() < 2 || !space->GetArray()[0].IsName())
+        return 0;
+
+    const PdfName &family = space->GetArray()[0].GetName();
+    if (family == PdfName("CalRGB"))
+        return 3;
+    if (family == PdfName("CalGray"))
+        return 1;
+    PdfObject *profile = resolve(objects, &space->GetArray()[1]);
+    if (family != PdfName("ICCBased") || !profile || !profile->IsDictionary())
+        return 0;
+    const PdfObject *n = profile->GetDictionary().GetKey(PdfName("N"));
+    return n && n->IsNumber() ? static_cast<unsigned>(n->GetNumber()) : 0;
+}
+
+static bool grey_function(PdfVecObjects *objects, PdfObject *fn, bool apply) {
+    fn = resolve(objects, fn);
+    if (!fn || !fn->IsDictionary())
+        return false;
+
+    PdfDictionary   &dict = fn->GetDictionary();
+    const PdfObject *type = dict.GetKey(PdfName("FunctionType"));
+    if (!type || !type->IsNumber())
+        return false;
+    if (type->GetNumber() == 3) {
+        PdfObject *list = resolve(objects, dict.GetKey(PdfName("Functions")));
+        if (!list || !list->IsArray())
+            return false;
+        PdfArray &arr = list->GetArray();
+        for (PdfArray::iterator it = arr.begin(); it != arr.end(); ++it) {
+            if (!grey_function(objects, &(*it), apply))
+                return false;
+        }
+        return true;
+    }
+    if (type->GetNumber() != 2)
+        return false;
+
+    for (const char *key : {"C0", "C1"}) {
+        PdfObject *c = dict.GetKey(PdfName(key));
+        if (!c || (c->IsArray() && c->GetArray().GetSize() == 1))
+            continue;
+        if (!c->IsArray() || c->GetArray().GetSize() != 3)
+            return false;
+        if (apply) {
+            PdfArray &rgb = c->GetArray();
+            PdfArray  grey;
+            grey.push_back(PdfObject(luma(rgb[0].GetReal(), rgb[1].GetReal(), rgb[2].GetReal())));
+            dict.AddKey(PdfName(key), grey);
+        }
+    }
+    return true;
+}
+
+static bool grey_shading(PdfVecObjects *objects, PdfDictionary &dict) {
+    PdfObject *shading = dict.GetKey(PdfName("Shading"));
+    if (dict.HasKey(PdfName("PatternType")) && shading && shading->IsDictionary())
+        return grey_shading(objects, shading->GetDictionary());
+
+    const PdfObject *type = dict.GetKey(PdfName("ShadingType"));
+    PdfObject       *fn   = dict.GetKey(PdfName("Function"));
+    if (!type || !type->IsNumber() || type->GetNumber() > 3 || colour_components(objects, dict.GetKey(PdfName("ColorSpace"))) != 3)
+        return false;
+    if (!fn || fn->IsArray() || !grey_function(objects, fn, false))
+        return false;
+
+    grey_function(objects, fn, true);
+    dict.AddKey(PdfName("ColorSpace"), PdfName("DeviceGray"));
+    PdfObject *background = dict.GetKey(PdfName("Background"));
+    if (background && background->IsArray() && background->GetArray().GetSize() == 3) {
+        PdfArray &rgb = background->GetArray();
+        PdfArray  grey;
+        grey.push_back(PdfObject(luma(rgb[0].GetReal(), rgb[1].GetReal(), rgb[2].GetReal())));
+        dict.AddKey(PdfName("Background"), grey);
+    }
+    return true;
+}
+
+static bool grey_image(PdfObject *obj, unsigned components) {
+    PdfDictionary   &dict   = obj->GetDictionary();
+    const PdfObject *bits   = dict.GetKey(PdfName("BitsPerComponent"));
+    const PdfObject *width  = dict.GetKey(PdfName::KeyWidth);
+    const PdfObject *height = dict.GetKey(PdfName::KeyHeight);
+    const PdfObject *filter = dict.GetKey(PdfName::KeyFilter);
+    if (filter && filter->IsArray() && filter->GetArray().GetSize() == 1)
+        filter = &filter->GetArray()[0];
+
+    if (!bits || !bits->IsNumber() || bits->GetNumber() != 8 || !width || !width->IsNumber() || !height || !height->IsNumber() || dict.HasKey(PdfName("Decode")))
+        return false;
+    const bool jpeg = filter && filter->IsName() && filter->GetName() == PdfName("DCTDecode");
+    if (filter && !jpeg && !(filter->IsName() && filter->GetName() == PdfName("FlateDecode")))
+        return false;
+
+    // GetCopy() is the raw JPEG, GetFilteredCopy() decodes, Set() applies
+    // the default (Flate) filter
+    char    *data = nullptr;
+    pdf_long len  = 0;
+    if (jpeg)
+        obj->GetStream()->GetCopy(&data, &len);
+    else
+        obj->GetStream()->GetFilteredCopy(&data, &len);
+    std::string pixels(data, len);
+    podofo_free(data);
+    size_t w = static_cast<size_t>(width->GetNumber()), h = static_cast<size_t>(height->GetNumber());
+    if (jpeg ? !grey_jpeg(pixels, w, h) : !grey_pixels(pixels, components, w * h))
+        return false;
+
+    dict.RemoveKey(PdfName("DecodeParms"));
+    obj->GetStream()->Set(pixels.data(), static_cast<pdf_long>(pixels.size()));
+    dict.AddKey(PdfName("ColorSpace"), PdfName("DeviceGray"));
+    return true;
+}
+
+void pdf_postprocess_impl::greyscale(PdfMemDocument &doc) {
+    auto           start   = std::chrono::steady_clock::now();
+    PdfVecObjects *objects = doc.GetObjects();
+
+    std::set<PdfReference> contents;
+    for (TIVecObjects it = objects->begin(); it != objects->end(); ++it) {
+        const PdfObject *type = (*it)->IsDictionary() ? (*it)->GetDictionary().GetKey(PdfName::KeyType) : nullptr;
+        if (!type || !type->IsName() || type->GetName() != PdfName("Page"))
+            continue;
+        const PdfObject *content = (*it)->GetDictionary().GetKey(PdfName("Contents"));
+        if (content && content->IsReference()) {
+            contents.insert(content->GetReference());
+        } else if (content && content->IsArray()) {
+            const PdfArray &arr = content->GetArray();
+            for (PdfArray::const_iterator item = arr.begin(); item != arr.end(); ++item) {
+                if (item->IsReference())
+                    contents.insert(item->GetReference());
+            }
+        }
+    }
+
+    unsigned streams = 0, shadings = 0, images = 0, kept = 0;
+    for (TIVecObjects it = objects->begin(); it != objects->end(); ++it) {
+        PdfObject *obj = *it;
+        if (!obj->IsDictionary())
+            continue;
+        PdfDictionary &dict = obj->GetDictionary();
+        if (grey_shading(objects, dict))
+            ++shadings;
+        if (!obj->HasStream())
+            continue;
+
+        const PdfObject *subtype = dict.GetKey(PdfName::KeySubtype);
+        const PdfObject *pattern = dict.GetKey(PdfName("PatternType"));
+        bool             image   = subtype && subtype->IsName() && subtype->GetName() == PdfName("Image");
+        bool             form    = subtype && subtype->IsName() && subtype->GetName() == PdfName("Form");
+        if (image) {
+            unsigned components = colour_components(objects, dict.GetKey(PdfName("ColorSpace")));
+            if ((components == 3 || components == 4) && grey_image(obj, components))
+                ++images;
+            else if (components == 3 || components == 4)
+                ++kept;
+        } else if (form || (pattern && pattern->IsNumber() && pattern->GetNumber() == 1) || contents.count(obj->Reference())) {
+            char    *data = nullptr;
+            pdf_long len  = 0;
+            obj->GetStream()->GetFilteredCopy(&data, &len);
+            std::string in(data, len), out;
+            podofo_free(data);
+            if (grey_content(in, out)) {
+                dict.RemoveKey(PdfName("DecodeParms"));
+                obj->GetStream()->Set(out.data(), static_cast<pdf_long>(out.size()));
+                ++streams;
+            }
+        }
+    }
+
+    long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    wkJlog << iclog::loglevel::info << iclog::category::LIB
+           << "Greyscale: " << streams << " content streams, " << shadings << " shadings and "
+           << images << " images in " << ms << " ms"
+           << iclog::endl;
+    if (kept) {
+        wkJlog << iclog::loglevel::warning << iclog::category::LIB
+               << "Greyscale: " << kept << " images in formats that can not be converted left in colour"
+               << iclog::endl;
+    }
+}
+
+bool pdf_postprocess_impl::clean_save(const std::vector<unsigned char> &in, std::string &out) {
+    try {
+        PdfMemDocument doc;
+        doc.LoadFromBuffer(reinterpret_cast<const char *>(in.data()), static_cast<long>(in.size()));
+
+        if (m_passes & PDF_PASS_GREYSCALE)
+            greyscale(doc);
+
+        if (m_passes & PDF_PASS_DEDUPLICATE) {
+            unsigned merged = deduplicate(doc);
+            wkJlog << iclog::loglevel::info << iclog::category::LIB
+                   << "Deduplication merged " << merged << " objects"
+                   << iclog::endl;
+        }
+
+        if (m_passes & PDF_PASS_RECOMPRESS) {
+            recompress(doc);
+        } else {
+            // 0.9.x: the object list is a PdfVecObjects pointer
+            PdfVecObjects *objects = doc.GetObjects();
+            for (TIVecObjects it = objects->begin(); it != objects->end(); ++it) {
+                PdfObject *obj = *it;
+                if (!obj->HasStream() || !obj->IsDictionary())
+                    continue;
+
+                PdfDictionary &dict = obj->GetDictionary();
+                if (dict.HasKey(PdfName::KeyFilter))
+                    continue;
+                const PdfObject *type = dict.GetKey(PdfName::KeyType);
+                if (type && type->IsName() && type->GetName() == PdfName("Metadata"))
+                    continue;
+
+                // Set() applies the default (Flate) filter
+                PdfStream *stream = obj->GetStream();
+                char      *data   = nullptr;
+                pdf_long   len    = 0;
+                stream->GetFilteredCopy(&data, &len);
+                stream->Set(data, len);
+                podofo_free(data);
+            }
+        }
+
+        PdfRefCountedBuffer buffer;
+        PdfOutputDevice     device(&buffer);
+        doc.Write(&device);
+        out.assign(buffer.GetBuffer(), device.GetLength());
+
+    } catch (const PdfError &e) {
+        wkJlog << iclog::loglevel::error << iclog::category::LIB
+               << "PoDoFo Error in post processing: " << e.what()
+               << iclog::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif
+
+/**
+ * @brief pdf_postprocess::run
+ * @param pdf
+ * @return false if PoDoFo could not read the document (@p pdf is untouched)
+ *
+ * PoDoFo cleans the document, then pdf_compact writes the final layout.
+ * A linearised file keeps classic cross-reference tables, so asking for
+ * both only linearises.
+ */
+bool pdf_postprocess::run(std::vector<unsigned char> &pdf) {
+    const unsigned passes = m_pimpl->m_passes;
+    if (passes == PDF_PASS_NONE || pdf.empty())
+        return true;
+
+    auto   start  = std::chrono::steady_clock::now();
+    size_t before = pdf.size();
+
+    std::string work;
+    if (!m_pimpl->clean_save(pdf, work))
+        return false;
+
+    // LAYOUT
+    pdf_compact layout;
+    if (passes & PDF_PASS_LINEARISE) {
+        if (passes & PDF_PASS_OPTIMISE) {
+            wkJlog << iclog::loglevel::notice << iclog::category::LIB
+                   << "Linearised output is written without object streams"
+                   << iclog::endl;
+        }
+        if (!layout.linearise(work)) {
+            wkJlog << iclog::loglevel::warning << iclog::category::LIB
+                   << "Unable to linearise, leaving the PoDoFo layout"
+                   << iclog::endl;
+        }
+    } else if (passes & PDF_PASS_OPTIMISE) {
+        if (!layout.pack_objects(work)) {
+            wkJlog << iclog::loglevel::warning << iclog::category::LIB
+                   << "Unable to write object streams, leaving the PoDoFo layout"
+                   << iclog::endl;
+        }
+    }
+
+    pdf.assign(work.begin(), work.end());
+
+    long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    wkJlog << iclog::loglevel::info << iclog::category::LIB
+           << "Post processing: " << before << " -> " << pdf.size() << " bytes in " << ms << " ms"
+           << iclog::endl;
+    return true;
+}
@@ -0,0 +1,26 @@
+#ifndef PDF_POSTPROCESS_H
+#define PDF_POSTPROCESS_H
+#include "ichtmltopdf++.h"
+
+#include <vector>
+
+struct pdf_postprocess_impl;
+
+/**
+ * @brief The pdf_postprocess class
+ *
+ * Runs the post-print passes selected with PDFprinter::post_process()
+ * over a finished PDF held in memory.
+ */
+class pdf_postprocess {
+    public:
+        pdf_postprocess(unsigned passes, int level = 9);
+        ~pdf_postprocess();
+
+        bool run(std::vector<unsigned char> &pdf);
+
+    private:
+        struct pdf_postprocess_impl *m_pimpl;
+};
+
+#endif // PDF_POSTPROCESS_H
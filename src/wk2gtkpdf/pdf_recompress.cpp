@@ -0,0 +1,190 @@
+#include "pdf_recompress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+struct pdf_recompress_impl {
+        struct job {
+                std::string in;
+                std::string out;
+                bool        encoded = false;
+                bool        ok      = false;
+        };
+
+        int              m_level   = 9;
+        unsigned         m_threads = 0;
+        std::vector<job> m_jobs;
+
+        void work(std::atomic<size_t> &next);
+};
+
+/////////////////////////////////////////////////////////////////////////////////////
+
+pdf_recompress::pdf_recompress(int level)
+    : m_pimpl(new pdf_recompress_impl()) {
+    m_pimpl->m_level = std::clamp(level, 0, max_level());
+}
+
+pdf_recompress::~pdf_recompress() {
+    delete m_pimpl;
+}
+
+/**
+ * @brief pdf_recompress::max_level
+ * @return The highest deflate level of the backend, 12 for libdeflate
+ * and 9 for zlib
+ */
+int pdf_recompress::max_level() {
+#ifdef HAVE_LIBDEFLATE
+    return 12;
+#else
+    return 9;
+#endif
+}
+
+/**
+ * @brief pdf_recompress::add
+ * @param data The raw stream data
+ * @param encoded true if @p data is FlateDecode encoded, false if it is plain
+ * @return The index to pass to result()
+ */
+size_t pdf_recompress::add(std::string data, bool encoded) {
+    m_pimpl->m_jobs.emplace_back();
+    m_pimpl->m_jobs.back().in      = std::move(data);
+    m_pimpl->m_jobs.back().encoded = encoded;
+    return m_pimpl->m_jobs.size() - 1;
+}
+
+/**
+ * @brief pdf_recompress::result
+ * @param index
+ * @param out The new FlateDecode data
+ * @return false if the stream could not be decoded or did not get smaller
+ */
+bool pdf_recompress::result(size_t index, std::string &out) {
+    if (index >= m_pimpl->m_jobs.size() || !m_pimpl->m_jobs[index].ok)
+        return false;
+    out.swap(m_pimpl->m_jobs[index].out);
+    return true;
+}
+
+unsigned pdf_recompress::threads() const {
+    return m_pimpl->m_threads;
+}
+
+/**
+ * @brief pdf_recompress::run
+ *
+ * One worker per core (the calling thread is one of them), each taking
+ * the next job until the batch is done.
+ */
+void pdf_recompress::run() {
+    if (m_pimpl->m_jobs.empty())
+        return;
+
+    unsigned cores     = std::max(1u, std::thread::hardware_concurrency());
+    m_pimpl->m_threads = static_cast<unsigned>(std::min<size_t>(cores, m_pimpl->m_jobs.size()));
+
+    std::atomic<size_t>      next{0};
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < m_pimpl->m_threads; ++t)
+        pool.emplace_back([this, &next]() { m_pimpl->work(next); });
+
+    m_pimpl->work(next);
+
+    for (std::thread &t : pool)
+        t.join();
+}
+
+#ifdef HAVE_LIBDEFLATE
+
+void pdf_recompress_impl::work(std::atomic<size_t> &next) {
+    libdeflate_compressor   *compressor   = libdeflate_alloc_compressor(m_level);
+    libdeflate_decompressor *decompressor = libdeflate_alloc_decompressor();
+    if (!compressor || !decompressor) {
+        libdeflate_free_compressor(compressor);
+        libdeflate_free_decompressor(decompressor);
+        return;
+    }
+
+    std::string plain;
+    for (size_t i = next++; i < m_jobs.size(); i = next++) {
+        job               &j   = m_jobs[i];
+        const std::string *src = &j.in;
+
+        if (j.encoded) {
+            // The decoded size is not stored anywhere, grow until it fits
+            plain.resize(std::max<size_t>(j.in.size() * 4, 4096));
+            size_t               actual = 0;
+            libdeflate_result    r;
+            while ((r = libdeflate_zlib_decompress(decompressor, j.in.data(), j.in.size(), plain.data(), plain.size(), &actual)) == LIBDEFLATE_INSUFFICIENT_SPACE)
+                plain.resize(plain.size() * 2);
+            if (r != LIBDEFLATE_SUCCESS)
+                continue;
+            plain.resize(actual);
+            src = &plain;
+        }
+
+        j.out.resize(libdeflate_zlib_compress_bound(compressor, src->size()));
+        size_t len = libdeflate_zlib_compress(compressor, src->data(), src->size(), j.out.data(), j.out.size());
+        j.out.resize(len);
+        j.ok = len > 0 && len < j.in.size();
+    }
+
+    libdeflate_free_compressor(compressor);
+    libdeflate_free_decompressor(decompressor);
+}
+
+#else
+
+static bool inflate_buffer(const std::string &in, std::string &out) {
+    z_stream zs{};
+    if (inflateInit(&zs) != Z_OK)
+        return false;
+
+    out.resize(std::max<size_t>(in.size() * 4, 4096));
+    zs.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+        if (zs.total_out == out.size())
+            out.resize(out.size() * 2);
+        zs.next_out  = reinterpret_cast<Bytef *>(out.data() + zs.total_out);
+        zs.avail_out = static_cast<uInt>(out.size() - zs.total_out);
+        ret          = inflate(&zs, Z_NO_FLUSH);
+    }
+    out.resize(zs.total_out);
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+void pdf_recompress_impl::work(std::atomic<size_t> &next) {
+    std::string plain;
+    for (size_t i = next++; i < m_jobs.size(); i = next++) {
+        job               &j   = m_jobs[i];
+        const std::string *src = &j.in;
+
+        if (j.encoded) {
+            if (!inflate_buffer(j.in, plain))
+                continue;
+            src = &plain;
+        }
+
+        uLongf len = compressBound(src->size());
+        j.out.resize(len);
+        if (compress2(reinterpret_cast<Bytef *>(j.out.data()), &len, reinterpret_cast<const Bytef *>(src->data()), src->size(), m_level) != Z_OK)
+            continue;
+        j.out.resize(len);
+        j.ok = len < j.in.size();
+    }
+}
+
+#endif
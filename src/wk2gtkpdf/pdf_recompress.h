@@ -0,0 +1,35 @@
+#ifndef PDF_RECOMPRESS_H
+#define PDF_RECOMPRESS_H
+#include <cstddef>
+#include <string>
+
+struct pdf_recompress_impl;
+
+/**
+ * @brief The pdf_recompress class
+ *
+ * Inflates and re-deflates a batch of stream buffers across a pool of
+ * threads.  PoDoFo objects are not thread safe, so the caller copies the
+ * raw stream data in with add(), calls run() and writes the results back
+ * serially.
+ *
+ * Uses libdeflate when built with HAVE_LIBDEFLATE, zlib otherwise.
+ */
+class pdf_recompress {
+    public:
+        pdf_recompress(int level);
+        ~pdf_recompress();
+
+        size_t add(std::string data, bool encoded);
+        void   run();
+        bool   result(size_t index, std::string &out);
+
+        unsigned threads() const;
+
+        static int max_level();
+
+    private:
+        struct pdf_recompress_impl *m_pimpl;
+};
+
+#endif // PDF_RECOMPRESS_H
@@ -0,0 +1,438 @@
+#include "pdf_stamper.h"
+
+#include "css_scale.h"
+#include "iclog.h"
+#include "pdf_compact.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <podofo/podofo.h>
+#include <string>
+#include <vector>
+using namespace PoDoFo;
+
+namespace phtml {
+
+    struct pdf_stamper_impl {
+            pdf_compact                        m_layout; // The base document, read once
+            std::string                        m_font  = "Helvetica";
+            size_t                             m_pages = 0;
+            std::map<std::string, std::string> m_images; // Image files are read once
+
+            void               load(const std::string &data);
+            bool               draw(const PDF_Overlay *overlays, size_t count, std::string &out);
+            bool               paint(const PDF_Overlay *overlays, size_t count, std::string &over, std::vector<size_t> &stamped);
+            const std::string &image_bytes(const char *path);
+    };
+
+    /**
+     * @brief stamp_box
+     *
+     * An overlay converted to PDF points, bottom left origin.
+     */
+    struct stamp_box {
+            double x;
+            double y;
+            double w;
+            double h;
+            double scale;
+            double fontSize;
+    };
+
+    static stamp_box place(const PDF_Overlay &o, double left, double bottom, double pdfW, double pdfH) {
+        stamp_box b;
+        b.scale = o.page_width > 0 ? scale_css_to_pdf(pdfW, o.page_width) : 72.0 / 96.0;
+
+        double cssH = o.page_height > 0 ? o.page_height : pdfH / b.scale;
+        b.x         = left + o.xPos * b.scale;
+        b.y         = bottom + (cssH - (o.yPos + o.h)) * b.scale;
+        b.w         = o.w * b.scale;
+        b.h         = o.h * b.scale;
+        b.fontSize  = (o.fontSize > 0 ? o.fontSize : 12.0) * b.scale;
+        return b;
+    }
+
+    static bool on_page(int pageNo, size_t page, size_t pages) {
+        if (pageNo == 0)
+            return true;
+        if (pageNo < 0)
+            return static_cast<long>(pages) + pageNo + 1 == static_cast<long>(page);
+        return static_cast<size_t>(pageNo) == page;
+    }
+
+    static std::string expand(const char *text, size_t page, size_t pages) {
+        std::string out(text);
+        const struct {
+                const char *key;
+                std::string value;
+        } vars[] = {
+            {"{pages}", std::to_string(pages)},
+            {"{page}",  std::to_string(page) },
+        };
+
+        for (const auto &v : vars) {
+            size_t len = std::strlen(v.key);
+            for (size_t pos = out.find(v.key); pos != std::string::npos; pos = out.find(v.key, pos + v.value.size()))
+                out.replace(pos, len, v.value);
+        }
+        return out;
+    }
+
+    static double align_offset(int align, double boxW, double textW) {
+        if (boxW <= 0 || align == 0)
+            return 0;
+        return align == 1 ? (boxW - textW) / 2 : boxW - textW;
+    }
+
+    static bool read_file(const char *path, std::string &data) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in)
+            return false;
+
+        // Size the buffer once and read it in one go
+        std::streamsize size = in.tellg();
+        data.assign(size > 0 ? static_cast<size_t>(size) : 0, '\0');
+        in.seekg(0, std::ios::beg);
+        return size > 0 && in.read(data.data(), size);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////
+
+    pdf_stamper::pdf_stamper(const unsigned char *data, size_t size)
+        : m_pimpl(new pdf_stamper_impl()) {
+        if (data && size)
+            m_pimpl->load(std::string(reinterpret_cast<const char *>(data), size));
+    }
+
+    pdf_stamper::pdf_stamper(const char *pdfFile)
+        : m_pimpl(new pdf_stamper_impl()) {
+        std::string data;
+        if (!read_file(pdfFile ? pdfFile : "", data)) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "Unable to read " << (pdfFile ? pdfFile : "(null)") << " for stamping"
+                   << iclog::endl;
+            return;
+        }
+        m_pimpl->load(data);
+    }
+
+    pdf_stamper::~pdf_stamper() {
+        delete m_pimpl;
+    }
+
+    void pdf_stamper::font(const char *fontName) {
+        m_pimpl->m_font = (fontName && *fontName) ? fontName : "Helvetica";
+    }
+
+    size_t pdf_stamper::page_count() const {
+        return m_pimpl->m_pages;
+    }
+
+    PDF_Blob pdf_stamper::stamp(const PDF_Overlay *overlays, size_t count) {
+        PDF_Blob    blob = {nullptr, 0};
+        std::string out;
+        if (!m_pimpl->draw(overlays, count, out))
+            return blob;
+
+        // Allocate raw memory for the ABI-safe return
+        blob.data = (unsigned char *)malloc(out.size());
+        if (blob.data) {
+            std::memcpy(blob.data, out.data(), out.size());
+            blob.size = out.size();
+        }
+        return blob;
+    }
+
+    bool pdf_stamper::stamp(const PDF_Overlay *overlays, size_t count, const char *outFile) {
+        std::string out;
+        if (!outFile || !m_pimpl->draw(overlays, count, out))
+            return false;
+
+        std::ofstream file(outFile, std::ios::binary | std::ios::trunc);
+        if (!file.write(out.data(), static_cast<std::streamsize>(out.size()))) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "Unable to write " << outFile
+                   << iclog::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////
+
+    void pdf_stamper_impl::load(const std::string &data) {
+        if (!m_layout.open_base(data)) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "Unable to read the stamping base, damaged or encrypted"
+                   << iclog::endl;
+            return;
+        }
+        m_pages = m_layout.base_pages();
+    }
+
+    /**
+     * @brief pdf_stamper_impl::draw
+     *
+     * paint() draws the overlays on a document of their own, one page for
+     * each page they appear on, and pdf_compact lays those pages over the
+     * base.  The base is never loaded into PoDoFo, so a copy costs the
+     * overlays plus writing the base bytes out again.
+     */
+    bool pdf_stamper_impl::draw(const PDF_Overlay *overlays, size_t count, std::string &out) {
+        if (!m_pages)
+            return false;
+
+        auto                start = std::chrono::steady_clock::now();
+        std::string         over;
+        std::vector<size_t> stamped;
+        if (!paint(overlays, count, over, stamped))
+            return false;
+        if (!m_layout.overlay(over, stamped, out)) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "Unable to lay the stamp over the base document"
+                   << iclog::endl;
+            return false;
+        }
+
+        long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        wkJlog << iclog::loglevel::debug << iclog::category::LIB
+               << "Stamped " << count << " overlays on " << stamped.size() << " pages in " << ms << " ms"
+               << iclog::endl;
+        return true;
+    }
+
+    const std::string &pdf_stamper_impl::image_bytes(const char *path) {
+        auto it = m_images.find(path);
+        if (it == m_images.end()) {
+            it = m_images.emplace(path, std::string()).first;
+            if (!read_file(path, it->second))
+                it->second.clear();
+        }
+        return it->second;
+    }
+
+#ifdef PODOFO_010
+
+    static PdfFont *load_font(PdfMemDocument &doc, const std::string &name) {
+        PdfFontSearchParams params;
+        params.AutoSelect = PdfFontAutoSelectBehavior::Standard14;
+
+        PdfFont *font = doc.GetFonts().SearchFont(name, params);
+        if (!font) {
+            wkJlog << iclog::loglevel::warning << iclog::category::LIB
+                   << "Font '" << name << "' not found, using Helvetica"
+                   << iclog::endl;
+            font = &doc.GetFonts().GetStandard14Font(PdfStandard14FontType::Helvetica);
+        }
+        return font;
+    }
+
+    bool pdf_stamper_impl::paint(const PDF_Overlay *overlays, size_t count, std::string &over, std::vector<size_t> &stamped) {
+        try {
+            PdfMemDocument doc;
+
+            // One font and one XObject per image for the whole copy
+            PdfFont                                          *font = nullptr;
+            std::map<std::string, std::unique_ptr<PdfImage>> images;
+
+            for (size_t p = 0; p < m_pages; ++p) {
+                PdfPainter painter;
+                Rect       media;
+                bool       open = false;
+
+                for (size_t i = 0; i < count; ++i) {
+                    const PDF_Overlay &o = overlays[i];
+                    if (!on_page(o.pageNo, p + 1, m_pages))
+                        continue;
+                    if (!open) {
+                        // A page the size of the one it is laid over
+                        double box[4] = {0, 0, 612, 792};
+                        m_layout.base_media_box(p, box);
+                        media = Rect(box[0], box[1], box[2] - box[0], box[3] - box[1]);
+                        painter.SetCanvas(doc.GetPages().CreatePage(media));
+                        stamped.push_back(p);
+                        open = true;
+                    }
+                    stamp_box b = place(o, media.X, media.Y, media.Width, media.Height);
+
+                    if (o.imagePath && *o.imagePath) {
+                        auto it = images.find(o.imagePath);
+                        if (it == images.end()) {
+                            const std::string        &bytes = image_bytes(o.imagePath);
+                            std::unique_ptr<PdfImage> image;
+                            try {
+                                image = doc.CreateImage();
+                                image->LoadFromBuffer(bufferview(bytes.data(), bytes.size()));
+                            } catch (const PdfError &e) {
+                                wkJlog << iclog::loglevel::warning << iclog::category::LIB
+                                       << "Skipping overlay image " << o.imagePath << ": " << e.what()
+                                       << iclog::endl;
+                                image.reset();
+                            }
+                            it = images.emplace(o.imagePath, std::move(image)).first;
+                        }
+                        if (PdfImage *image = it->second.get()) {
+                            double sx = b.w > 0 ? b.w / image->GetWidth() : b.scale;
+                            double sy = b.h > 0 ? b.h / image->GetHeight() : b.scale;
+                            painter.DrawImage(*image, b.x, b.y, sx, sy);
+                        }
+                    }
+
+                    if (o.text && *o.text) {
+                        if (!font)
+                            font = load_font(doc, m_font);
+
+                        std::string  text = expand(o.text, p + 1, m_pages);
+                        PdfTextState state;
+                        state.Font     = font;
+                        state.FontSize = b.fontSize;
+
+                        painter.TextState.SetFont(*font, b.fontSize);
+                        painter.GraphicsState.SetNonStrokingColor(PdfColor(((o.colour >> 16) & 0xff) / 255.0, ((o.colour >> 8) & 0xff) / 255.0, (o.colour & 0xff) / 255.0));
+                        painter.DrawText(text, b.x + align_offset(o.align, b.w, font->GetStringLength(text, state)), b.y);
+                    }
+                }
+                if (open)
+                    painter.FinishDrawing();
+            }
+            if (stamped.empty())
+                return true;
+
+            charbuff           buffer;
+            StringStreamDevice device(buffer);
+            doc.Save(device, PdfSaveOptions::NoMetadataUpdate);
+            over.assign(buffer.data(), buffer.size());
+
+        } catch (const PdfError &e) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "PoDoFo Error in stamp: " << e.what()
+                   << iclog::endl;
+            return false;
+        }
+        return true;
+    }
+
+#else
+
+    static PdfFont *load_font(PdfMemDocument &doc, const std::string &name) {
+        // 0.9.x: CreateFont() picks the standard 14 fonts by name
+        PdfFont *font = doc.CreateFont(name.c_str());
+        if (!font) {
+            wkJlog << iclog::loglevel::warning << iclog::category::LIB
+                   << "Font '" << name << "' not found, using Helvetica"
+                   << iclog::endl;
+            font = doc.CreateFont("Helvetica");
+        }
+        return font;
+    }
+
+    /**
+     * @brief load_image
+     * 0.9.x reads JPEG and PNG from memory only when built with the
+     * libraries for them; anything else goes back to the file.
+     */
+    static void load_image(PdfImage &image, const std::string &bytes, const char *path) {
+        const unsigned char *data = reinterpret_cast<const unsigned char *>(bytes.data());
+#ifdef PODOFO_HAVE_JPEG_LIB
+        if (bytes.size() > 2 && data[0] == 0xff && data[1] == 0xd8) {
+            image.LoadFromJpegData(data, static_cast<pdf_long>(bytes.size()));
+            return;
+        }
+#endif
+#ifdef PODOFO_HAVE_PNG_LIB
+        if (bytes.size() > 8 && std::memcmp(data, "\x89PNG", 4) == 0) {
+            image.LoadFromPngData(data, static_cast<pdf_long>(bytes.size()));
+            return;
+        }
+#endif
+        (void)data;
+        image.LoadFromFile(path);
+    }
+
+    bool pdf_stamper_impl::paint(const PDF_Overlay *overlays, size_t count, std::string &over, std::vector<size_t> &stamped) {
+        try {
+            PdfMemDocument doc;
+
+            PdfFont                                          *font = nullptr;
+            std::map<std::string, std::unique_ptr<PdfImage>> images;
+
+            for (size_t p = 0; p < m_pages; ++p) {
+                PdfPainter painter;
+                PdfRect    media;
+                bool       open = false;
+
+                for (size_t i = 0; i < count; ++i) {
+                    const PDF_Overlay &o = overlays[i];
+                    if (!on_page(o.pageNo, p + 1, m_pages))
+                        continue;
+                    if (!open) {
+                        double box[4] = {0, 0, 612, 792};
+                        m_layout.base_media_box(p, box);
+                        media = PdfRect(box[0], box[1], box[2] - box[0], box[3] - box[1]);
+                        painter.SetPage(doc.CreatePage(media));
+                        stamped.push_back(p);
+                        open = true;
+                    }
+                    stamp_box b = place(o, media.GetLeft(), media.GetBottom(), media.GetWidth(), media.GetHeight());
+
+                    if (o.imagePath && *o.imagePath) {
+                        auto it = images.find(o.imagePath);
+                        if (it == images.end()) {
+                            std::unique_ptr<PdfImage> image(new PdfImage(&doc));
+                            try {
+                                load_image(*image, image_bytes(o.imagePath), o.imagePath);
+                            } catch (const PdfError &e) {
+                                wkJlog << iclog::loglevel::warning << iclog::category::LIB
+                                       << "Skipping overlay image " << o.imagePath << ": " << e.what()
+                                       << iclog::endl;
+                                image.reset();
+                            }
+                            it = images.emplace(o.imagePath, std::move(image)).first;
+                        }
+                        if (PdfImage *image = it->second.get()) {
+                            double sx = b.w > 0 ? b.w / static_cast<double>(image->GetWidth()) : b.scale;
+                            double sy = b.h > 0 ? b.h / static_cast<double>(image->GetHeight()) : b.scale;
+                            painter.DrawImage(b.x, b.y, image, sx, sy);
+                        }
+                    }
+
+                    if (o.text && *o.text) {
+                        if (!font)
+                            font = load_font(doc, m_font);
+
+                        std::string text = expand(o.text, p + 1, m_pages);
+                        font->SetFontSize(static_cast<float>(b.fontSize));
+                        painter.SetFont(font);
+                        painter.SetColor(((o.colour >> 16) & 0xff) / 255.0, ((o.colour >> 8) & 0xff) / 255.0, (o.colour & 0xff) / 255.0);
+
+                        double width = font->GetFontMetrics()->StringWidth(text.c_str());
+                        painter.DrawText(b.x + align_offset(o.align, b.w, width), b.y, PdfString(reinterpret_cast<const pdf_utf8 *>(text.c_str())));
+                    }
+                }
+                if (open)
+                    painter.FinishPage();
+            }
+            if (stamped.empty())
+                return true;
+
+            PdfRefCountedBuffer buffer;
+            PdfOutputDevice     device(&buffer);
+            doc.Write(&device);
+            over.assign(buffer.GetBuffer(), device.GetLength());
+
+        } catch (const PdfError &e) {
+            wkJlog << iclog::loglevel::error << iclog::category::LIB
+                   << "PoDoFo Error in stamp: " << e.what()
+                   << iclog::endl;
+            return false;
+        }
+        return true;
+    }
+
+#endif
+
+} // namespace phtml
@@ -0,0 +1,86 @@
+#ifndef PDF_STAMPER_H
+#define PDF_STAMPER_H
+#include "ichtmltopdf++.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief PDF_Overlay
+ *
+ * A piece of text or an image placed over a rendered page.
+ *
+ * Positions are CSS pixels from the top left of the page, the same units
+ * as PDF_LinkData, and are scaled to the PDF page the same way.  Leave
+ * page_width / page_height at 0 to assume 96 CSS pixels to the inch.
+ */
+struct PDF_Overlay {
+        const char *text;      /**< UTF-8, "{page}" and "{pages}" are replaced; may be NULL */
+        const char *imagePath; /**< JPEG or PNG drawn into the box; may be NULL */
+        int         pageNo;    /**< 1 based, 0 = every page, -1 = the last page */
+        double      xPos;
+        double      yPos;
+        double      w;
+        double      h;         /**< The text baseline sits on the bottom of the box */
+        double      page_width;
+        double      page_height;
+        double      fontSize;  /**< CSS pixels (Default 12) */
+        unsigned    colour;    /**< 0xRRGGBB */
+        int         align;     /**< 0 left, 1 centre, 2 right (within w) */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace phtml {
+    struct pdf_stamper_impl;
+
+    /**
+     * @brief The pdf_stamper class
+     *
+     * Render once, stamp many: load a finished PDF (from get_blob() or a
+     * file) a single time and write any number of copies with different
+     * overlays (watermarks, "page X of Y", serial numbers, barcode text)
+     * without going back through WebKit.
+     *
+     * The base is read once.  Each copy draws its overlays on pages of
+     * their own, all text with one font object and each image file once,
+     * and lays them over the base pages as form XObjects; the base
+     * content is wrapped in q/Q so its graphics state can not move or
+     * recolour the stamp.  Image files are read once per stamper.
+     *
+     * @note An encrypted base can not be stamped.
+     */
+    class PDF_API pdf_stamper {
+        public:
+            PDF_API pdf_stamper(const unsigned char *data, size_t size);
+            PDF_API pdf_stamper(const char *pdfFile);
+            PDF_API ~pdf_stamper();
+
+            /**
+             * @brief font
+             * @param fontName A font known to fontconfig, or one of the
+             * standard 14 PDF fonts (Default Helvetica, not embedded).
+             */
+            PDF_API void     font(const char *fontName);
+            PDF_API size_t   page_count() const;
+            /**
+             * @brief stamp
+             * Returns a copy of the base document with @p overlays drawn on top.
+             *
+             * @note OWNERSHIP: The caller takes ownership of the allocated memory.
+             * @warning You MUST call PDF_FreeBlob() when finished to prevent memory leaks.
+             *
+             * @return An empty blob if the base document could not be read.
+             */
+            PDF_API PDF_Blob stamp(const PDF_Overlay *overlays, size_t count);
+            PDF_API bool     stamp(const PDF_Overlay *overlays, size_t count, const char *outFile);
+
+        private:
+            pdf_stamper_impl *m_pimpl;
+    };
+} // namespace phtml
+
+#endif // PDF_STAMPER_H
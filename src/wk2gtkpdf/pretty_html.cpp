@@ -1,11 +1,23 @@
 #include "pretty_html.h"
 
+#include "html_escape.h"
 #include "iclog.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <new>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 typedef typename iclog::category cat;
 typedef typename iclog::loglevel lvl;
@@ -67,52 +79,361 @@ namespace phtml {
         nullptr
     };
 
+    // Laid out as blocks (or not at all) by default, the whitespace next
+    // to them never shows; compact() leaves it out
+    static const char *const blockLevelTags[]{
+        "address",
+        "article",
+        "aside",
+        "base",
+        "blockquote",
+        "body",
+        "br",
+        "caption",
+        "col",
+        "colgroup",
+        "dd",
+        "details",
+        "dialog",
+        "div",
+        "dl",
+        "dt",
+        "fieldset",
+        "figcaption",
+        "figure",
+        "footer",
+        "form",
+        "h1",
+        "h2",
+        "h3",
+        "h4",
+        "h5",
+        "h6",
+        "head",
+        "header",
+        "hr",
+        "html",
+        "legend",
+        "li",
+        "link",
+        "main",
+        "meta",
+        "nav",
+        "ol",
+        "optgroup",
+        "option",
+        "p",
+        "section",
+        "style",
+        "summary",
+        "table",
+        "tbody",
+        "td",
+        "tfoot",
+        "th",
+        "thead",
+        "title",
+        "tr",
+        "ul",
+        nullptr
+    };
+
+    /**
+     * @brief html_arena
+     *
+     * Monotonic memory for one document.  Nodes, tags and content are
+     * bumped out of blocks that are only ever freed all together, with
+     * the root.  Blocks double from 4 KB up to 1 MB; anything bigger than
+     * half the next block gets a block of its own.
+     */
+    struct html_arena {
+            struct block {
+                    block *next;
+                    size_t size;
+            };
+
+            block *m_blocks = nullptr;
+            char  *m_at     = nullptr;
+            char  *m_end    = nullptr;
+            size_t m_next   = 4096;
+
+            html_arena() = default;
+            html_arena(const html_arena &) = delete;
+            html_arena &operator=(const html_arena &) = delete;
+            ~html_arena() {
+                while (m_blocks) {
+                    block *b = m_blocks;
+                    m_blocks = b->next;
+                    std::free(b);
+                }
+            }
+
+            void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+                uintptr_t at = (reinterpret_cast<uintptr_t>(m_at) + align - 1) & ~(uintptr_t(align) - 1);
+                if (m_at && at + size <= reinterpret_cast<uintptr_t>(m_end)) {
+                    m_at = reinterpret_cast<char *>(at + size);
+                    return reinterpret_cast<void *>(at);
+                }
+
+                if (size + align > m_next / 2) {
+                    uintptr_t own = reinterpret_cast<uintptr_t>(new_block(size + align));
+                    return reinterpret_cast<void *>((own + align - 1) & ~(uintptr_t(align) - 1));
+                }
+
+                m_at   = new_block(m_next);
+                m_end  = m_at + m_next;
+                m_next = std::min<size_t>(m_next * 2, 1 << 20);
+                return allocate(size, align);
+            }
+
+            template <typename T, typename... Args> T *make(Args &&...args) {
+                return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            }
+
+            std::string_view copy(const char *text, size_t size) {
+                char *p = static_cast<char *>(allocate(size + 1, 1));
+                std::memcpy(p, text, size);
+                p[size] = '\0';
+                return {p, size};
+            }
+            std::string_view copy(const char *text) {
+                return text ? copy(text, std::strlen(text)) : copy("", 0);
+            }
+
+            /**
+             * @brief format
+             * printf() straight into the current block, or into one made
+             * big enough when it does not fit.
+             * @return The text, or a null view if the format failed
+             */
+            std::string_view format(const char *fmt, va_list args) {
+                va_list again;
+                va_copy(again, args);
+
+                size_t room = static_cast<size_t>(m_end - m_at);
+                int    n    = vsnprintf(m_at, room, fmt, args);
+                if (n >= 0 && static_cast<size_t>(n) < room) {
+                    std::string_view text(m_at, static_cast<size_t>(n));
+                    m_at += n + 1;
+                    va_end(again);
+                    return text;
+                }
+
+                std::string_view text;
+                if (n >= 0) {
+                    char *p = static_cast<char *>(allocate(static_cast<size_t>(n) + 1, 1));
+                    vsnprintf(p, static_cast<size_t>(n) + 1, fmt, again);
+                    text = std::string_view(p, static_cast<size_t>(n));
+                }
+                va_end(again);
+                return text;
+            }
+
+        private:
+            char *new_block(size_t size) {
+                block *b = static_cast<block *>(std::malloc(sizeof(block) + size));
+                if (!b)
+                    throw std::bad_alloc();
+                b->next  = m_blocks;
+                b->size  = size;
+                m_blocks = b;
+                return reinterpret_cast<char *>(b + 1);
+            }
+    };
+
+    struct html_content {
+            std::string_view text; // or the name of a set_node_slot() slot
+            bool             lineBreak;
+            html_content    *next   = nullptr;
+            bool             slot   = false;
+            bool             escape = false; // the value of the slot
+    };
+
+    /**
+     * @brief html_document
+     * What the root owns for the whole tree.
+     */
+    struct html_document {
+            html_arena  m_arena;
+            std::string m_rootBuffer;
+            bool        m_compact = false; // html_tree::compact()
+    };
+
+    /**
+     * Nodes live in the arena and are never destroyed one by one, so
+     * nothing in a node may own memory of its own.
+     */
     struct html_tree_impl {
             // 1. THE SHARED LUNGS: Every node's 'm_htmlPage' points to the same memory.
-            std::string &m_htmlPage;
+            html_document *m_document;
+            std::string   &m_htmlPage;
+
+            // 2. THE NODE DATA: The tag, its children and its content, in the arena.
+            std::string_view m_htmlTag;
+            status           m_nodestatus   = status::UNPROCESSED;
+            html_tree_impl  *previousBranch = nullptr;
+            html_tree_impl  *m_firstChild   = nullptr;
+            html_tree_impl  *m_lastChild    = nullptr;
+            html_tree_impl  *m_nextSibling  = nullptr;
+            html_content    *m_firstContent = nullptr;
+            html_content    *m_lastContent  = nullptr;
+
+            // The element name (m_htmlTag up to the first space) and its kind
+            size_t m_nameLength = 0;
+            bool   m_blockTag   = false;
+            bool   m_voidTag    = false;
+            bool   m_blockLevel = false;
+
+            html_tree_impl(html_document *document, std::string_view tag, html_tree_impl *parent)
+                : m_document(document),
+                  m_htmlPage(document->m_rootBuffer),
+                  m_htmlTag(tag),
+                  previousBranch(parent) {
+                classify();
+            }
 
-            // 2. THE MASTER STORAGE: Only the ROOT node actually uses this.
-            std::string m_rootBuffer;
+            bool            is_special_tag(std::string_view tag, const char *const table[]);
+            void            classify();
+            html_tree_impl *add_node(std::string_view tag);
+            html_tree      *new_child(std::string_view tag);
+            html_content   *add_content(std::string_view text, bool lineBreak);
+            status          closed();
 
-            // 3. THE NODE DATA: The stuff you had in your original class.
-            std::string              m_htmlTag;
-            std::vector<html_tree *> childNodes;
-            status                   m_nodestatus   = status::UNPROCESSED;
-            html_tree               *previousBranch = nullptr;
+            template <typename Out> void serialise(Out &out);
+            template <typename Out> void open_node(Out &out, unsigned tabs);
+            template <typename Out> void close_node(Out &out, unsigned tabs);
+    };
+    static_assert(std::is_trivially_destructible_v<html_tree_impl> && std::is_trivially_destructible_v<html_content>);
 
-            struct TAG_CONTENT {
-                    std::string text;
-                    bool        lineBreak;
+    /**
+     * @brief html_cursor
+     *
+     * Depth first over a node and its descendants with an explicit stack,
+     * each node opened on the way down and closed on the way back up: linear
+     * in the size of the tree however wide or deep it is, and it can stop
+     * after any node and carry on later.
+     */
+    struct html_cursor {
+            struct frame {
+                    html_tree_impl *node;
+                    html_tree_impl *next;           // the child to visit next
+                    html_tree_impl *last = nullptr; // the child written last
             };
+            html_tree_impl    *m_root;
+            bool               m_started = false;
+            std::vector<frame> m_stack;
 
-            std::vector<TAG_CONTENT> m_tagContent;
+            explicit html_cursor(html_tree_impl *root)
+                : m_root(root) {}
 
-            // --- THE TWO CONSTRUCTORS FOR THE PIMPL ---
+            template <typename Out> bool step(Out &out);
+    };
 
-            // A. For the ROOT: Point the reference to our own 'm_rootBuffer'
-            html_tree_impl(const char *tag)
-                : m_htmlPage(m_rootBuffer),
-                  m_htmlTag(tag) {}
+    /**
+     * The writers html_cursor writes through.  Only the one that fills
+     * get_html() marks the nodes written, so they are not written again.
+     */
 
-            // B. For the CHILDREN: Point the reference to the PARENT'S 'm_htmlPage'
-            // Child Constructor
-            html_tree_impl(const char *tag, std::string &master, html_tree *parent)
-                : m_htmlPage(master),
-                  m_htmlTag(tag),
-                  previousBranch(parent) {}
-
-            bool        is_special_tag(const std::string &tag, const char *const table[]);
-            bool        is_leaf_node();
-            std::string handle_special_characters(std::string text);
-            status      closed();
-            void        open_node(unsigned tabs = 0);
-            void        close_node(unsigned tabs = 0);
+    /**
+     * @brief html_size
+     * Counts what html_tree_impl::serialise() would write.
+     */
+    struct html_size {
+            static constexpr bool marks  = false;
+            size_t                m_size = 0;
+
+            void append(const char *, size_t n) { m_size += n; }
+            void append(size_t n, char) { m_size += n; }
+            void slot(const html_content &) {}
+    };
+
+    /**
+     * @brief html_writer
+     * Appends to a string, reserved from html_size first.
+     */
+    struct html_writer {
+            static constexpr bool marks = true;
+            std::string          &m_out;
+
+            void append(const char *text, size_t n) { m_out.append(text, n); }
+            void append(size_t n, char c) { m_out.append(n, c); }
+            void slot(const html_content &) {}
+    };
+
+    /**
+     * @brief html_chunk
+     * Appends to the chunk html_stream_impl hands out next.
+     */
+    struct html_chunk {
+            static constexpr bool marks = false;
+            std::string          &m_out;
+
+            void append(const char *text, size_t n) { m_out.append(text, n); }
+            void append(size_t n, char c) { m_out.append(n, c); }
+            void slot(const html_content &) {}
+    };
+
+    /**
+     * @brief html_template_impl
+     * The html of the tree with the slots left out, and where each goes.
+     */
+    struct html_template_impl {
+            struct span {
+                    size_t offset; // into m_literal
+                    size_t slot;
+                    bool   escape;
+            };
+            std::string                                  m_literal;
+            std::vector<span>                            m_spans;
+            std::vector<std::string>                     m_names;
+            std::unordered_map<std::string_view, size_t> m_slots; // by name, into m_names
+
+            html_template_impl(const html_tree *primaryNode);
+            size_t slot(std::string_view name);
+            void   value_lengths(const char *const *values, size_t *lengths) const;
+            size_t size(const char *const *values, const size_t *lengths) const;
+            size_t write(const char *const *values, const size_t *lengths, char *out) const;
+    };
+
+    /**
+     * @brief html_compiler
+     * Appends to the literal html of a template, noting the slots.
+     */
+    struct html_compiler {
+            static constexpr bool marks = false;
+            html_template_impl   &m_template;
+
+            void append(const char *text, size_t n) { m_template.m_literal.append(text, n); }
+            void append(size_t n, char c) { m_template.m_literal.append(n, c); }
+            void slot(const html_content &s) { m_template.m_spans.push_back({m_template.m_literal.size(), m_template.slot(s.text), s.escape}); }
+    };
+
+    /**
+     * @brief html_stream_impl
+     *
+     * What get_html() already holds (the doctype, or the whole page once
+     * process_nodes() has run) is handed out as it is, the nodes not yet
+     * written then follow a chunk at a time.
+     */
+    struct html_stream_impl {
+            std::string_view m_head;
+            html_cursor      m_cursor;
+            bool             m_more;
+            size_t           m_chunkSize;
+            std::string      m_chunk;
+            std::string_view m_pending; // what read() has not copied yet
+
+            html_stream_impl(const html_tree *primaryNode, size_t chunkSize);
+            std::string_view next();
     };
 
 } // namespace phtml
 
 phtml::html_tree::html_tree(const char *htmlTag, bool includeHeader)
-    : m_pimpl(new html_tree_impl(htmlTag)) {
+    : m_pimpl(nullptr) {
+    html_document *document = new html_document();
+    m_pimpl                 = document->m_arena.make<html_tree_impl>(document, document->m_arena.copy(htmlTag), nullptr);
+
     // INITIALISE THE MASTER PAGE (Only happens once)
     if (includeHeader) {
         // Only add if we're going to a web server
@@ -124,20 +445,24 @@ phtml::html_tree::html_tree(const char *htmlTag, bool includeHeader)
     m_pimpl->m_nodestatus = status::UNPROCESSED;
 }
 
-// THE CHILD (Private - used by new_node)
+// THE CHILD (Private - kept for the ABI, new_node uses the one below)
 phtml::html_tree::html_tree(const char *htmlTag, html_tree *parent_handle)
-    : m_pimpl(new html_tree_impl(htmlTag, parent_handle->m_pimpl->m_htmlPage, parent_handle)) {
-    m_pimpl->m_nodestatus = status::UNPROCESSED;
-}
+    : m_pimpl(parent_handle->m_pimpl->add_node(parent_handle->m_pimpl->m_document->m_arena.copy(htmlTag))) {}
+
+// A handle for a node already in the arena (Private - used by new_node)
+phtml::html_tree::html_tree(html_tree_impl *node)
+    : m_pimpl(node) {}
 
 /**************************************/
 /*  DESTRUCTOR                        */
 /**************************************/
+/**
+ * Only the root is ever destroyed, the children and their handles go
+ * with its arena.
+ */
 phtml::html_tree::~html_tree() {
-    for (html_tree *it : m_pimpl->childNodes) {
-        delete it;
-    }
-    delete m_pimpl;
+    if (m_pimpl && !m_pimpl->previousBranch)
+        delete m_pimpl->m_document;
     m_pimpl = nullptr;
 }
 
@@ -149,7 +474,7 @@ phtml::html_tree::~html_tree() {
  *
  * Check if element should be closed
  */
-bool phtml::html_tree_impl::is_special_tag(const string &tag, const char *const table[]) {
+bool phtml::html_tree_impl::is_special_tag(std::string_view tag, const char *const table[]) {
     for (int i = 0; table[i] != nullptr; ++i) {
         if (tag == table[i])
             return true;
@@ -158,43 +483,38 @@ bool phtml::html_tree_impl::is_special_tag(const string &tag, const char *const
 }
 
 /**
- * @brief html_tree::handle_special_characters
- * @param text
- * @return The string with the designated characters replaced by the escape
- * sequences.
- *
- * Search the string for characters that require escaping and escape them
+ * @brief html_tree_impl::add_node
+ * @param tag Already in the arena
+ * @return A new last child
  */
-string phtml::html_tree_impl::handle_special_characters(string text) {
-
-    string subjectString(text);
-
-    struct FIND_REPLACE {
-            string search;
-            string replace;
-    };
-
-    // ADD ALL ESCAPE SEQUENCES HERE
-    // NOTE THAT THE AMPERSAND CHAR MUST BE FIRST OTHERWISE IT WILL STRIP OUT THE
-    // AMPERSANDS FROM ANY ESCAPE SEQUENCES THAT PRECEDE IT
-    vector<FIND_REPLACE> FRStrings{
-        {"&",  "&amp;" },
-        {"\"", "&quot;"},
-        {"'",  "&apos;"},
-        {"<",  "&lt;"  },
-        {">",  "&gt;"  },
-        {"/",  "&#x2F;"}
-    };
+phtml::html_tree_impl *phtml::html_tree_impl::add_node(std::string_view tag) {
+    html_tree_impl *child = m_document->m_arena.make<html_tree_impl>(m_document, tag, this);
+    if (m_lastChild)
+        m_lastChild->m_nextSibling = child;
+    else
+        m_firstChild = child;
+    m_lastChild = child;
+    return child;
+}
 
-    for (FIND_REPLACE &it : FRStrings) {
-        size_t start_pos = 0;
-        while ((start_pos = subjectString.find(it.search, start_pos)) != std::string::npos) {
-            subjectString.replace(start_pos, it.search.length(), it.replace);
-            start_pos += it.replace.length(); // Handles case where 'to' is a substring of 'from'
-        }
-    }
+phtml::html_tree *phtml::html_tree_impl::new_child(std::string_view tag) {
+    html_tree_impl *node = add_node(tag);
+    return new (m_document->m_arena.allocate(sizeof(html_tree), alignof(html_tree))) html_tree(node);
+}
 
-    return (subjectString);
+/**
+ * @brief html_tree_impl::add_content
+ * @param text Already in the arena
+ * @param lineBreak
+ */
+phtml::html_content *phtml::html_tree_impl::add_content(std::string_view text, bool lineBreak) {
+    html_content *content = m_document->m_arena.make<html_content>(text, lineBreak);
+    if (m_lastContent)
+        m_lastContent->next = content;
+    else
+        m_firstContent = content;
+    m_lastContent = content;
+    return content;
 }
 
 /**
@@ -205,51 +525,46 @@ string phtml::html_tree_impl::handle_special_characters(string text) {
  * Create a new node
  */
 phtml::html_tree *phtml::html_tree::new_node(const char *htmlTag) {
-    // We pass 'this' (the current node) as the parent of the new child
-    html_tree *child = new html_tree(htmlTag, this);
-    m_pimpl->childNodes.push_back(child);
-    return child;
+    return m_pimpl->new_child(m_pimpl->m_document->m_arena.copy(htmlTag));
 }
 
 phtml::html_tree *phtml::html_tree::new_node_f(const char *format, ...) {
-    char   *buffer = nullptr;
     va_list args;
     va_start(args, format);
-    html_tree *result = nullptr;
-
-    if (vasprintf(&buffer, format, args) != -1) {
-        result = new_node(buffer);
-        free(buffer);
-    }
+    std::string_view tag = m_pimpl->m_document->m_arena.format(format, args);
     va_end(args);
-    return result;
+
+    return tag.data() ? m_pimpl->new_child(tag) : nullptr;
 }
 
 void phtml::html_tree::set_node_content_f(const char *format, ...) {
-    char   *buffer = nullptr;
     va_list args;
     va_start(args, format);
-    // vasprintf handles the size calculation and allocation for you
-    if (vasprintf(&buffer, format, args) != -1) {
-        // Call your existing ABI-safe method
-        set_node_content(buffer);
-        free(buffer); // Clean up the temporary string
-    }
+    // Formatted straight into the arena
+    std::string_view text = m_pimpl->m_document->m_arena.format(format, args);
     va_end(args);
+
+    if (text.data())
+        m_pimpl->add_content(text, false);
 }
 
 /**
- * @brief html_tree::is_leaf_node
- * @return
+ * @brief html_tree_impl::classify
  *
- * Does this element have children
+ * Find the element name and whether it is a block or void element once,
+ * rather than every time the node is written.
  */
-bool phtml::html_tree_impl::is_leaf_node() {
-    return ((childNodes.empty()) ? true : false);
+void phtml::html_tree_impl::classify() {
+    m_nameLength          = std::min(m_htmlTag.find(' '), m_htmlTag.size());
+    std::string_view name = m_htmlTag.substr(0, m_nameLength);
+    m_blockTag            = is_special_tag(name, blockTags);
+    m_voidTag             = is_special_tag(name, voidTags);
+    m_blockLevel          = is_special_tag(name, blockLevelTags);
 }
 
 /**
  * @brief html_tree::open_node
+ * @param out
  * @param tabs
  *
  * Apply an open "<" to the declaration, also indent the node
@@ -257,68 +572,112 @@ bool phtml::html_tree_impl::is_leaf_node() {
  *
  * Apply a ">" at the end of the element instantiation.
  */
-void phtml::html_tree_impl::open_node(unsigned tabs) {
-    if (tabs)
-        m_htmlPage.append(tabs, '\t');
-
-    std::string tag = m_htmlTag.substr(0, m_htmlTag.find_first_of(" "));
-    bool        blockTag(is_special_tag(tag, blockTags));
-
-    m_htmlPage.append("<" + m_htmlTag + ">");
-
-    if (!blockTag)
-        m_htmlPage.append("\n");
-
-    if (!m_tagContent.empty()) {
-        for (phtml::html_tree_impl::TAG_CONTENT &s : m_tagContent) {
-
-            if (blockTag) {
-                m_htmlPage.append(s.text);
-                if ((s.lineBreak) && (&s != &m_tagContent.back()))
-                    m_htmlPage.append("<br>");
-            } else {
-                m_htmlPage.append(tabs + 1, '\t');
-                m_htmlPage.append(s.text);
-                if ((s.lineBreak) && (&s != &m_tagContent.back()))
-                    m_htmlPage.append("<br>");
+template <typename Out> void phtml::html_tree_impl::open_node(Out &out, unsigned tabs) {
+    const bool pretty = !m_document->m_compact;
+    if (pretty)
+        out.append(tabs, '\t');
+    out.append("<", 1);
+    out.append(m_htmlTag.data(), m_htmlTag.size());
+    out.append(">", 1);
+
+    if (!m_blockTag && pretty)
+        out.append(1, '\n');
+
+    for (const html_content *s = m_firstContent; s; s = s->next) {
+        if (!m_blockTag && pretty)
+            out.append(tabs + 1, '\t');
+        if (s->slot)
+            out.slot(*s);
+        else
+            out.append(s->text.data(), s->text.size());
+        if ((s->lineBreak) && (s->next))
+            out.append("<br>", 4);
+        if (!m_blockTag && (pretty || (s->next && !s->lineBreak)))
+            out.append(1, '\n');
+    }
 
-                m_htmlPage.append("\n");
-            }
-        }
+    if constexpr (Out::marks) {
+        m_nodestatus = status::OPEN;
+        if (PHTML_DEBUG)
+            wkJlog
+                << lvl::debug << cat::LIB_HTML << iclog_FUNCTION
+                << string(m_htmlTag)
+                << iclog::endl;
     }
-    m_nodestatus = status::OPEN;
-    wkJlog
-        << lvl::debug << cat::LIB_HTML << iclog_FUNCTION
-        << m_htmlTag
-        << iclog::endl;
 }
 
 /**
  * @brief html_tree::close_node
+ * @param out
  * @param tabs - the number of indent tabs
  *
  * Close the element
  */
-void phtml::html_tree_impl::close_node(unsigned tabs) {
+template <typename Out> void phtml::html_tree_impl::close_node(Out &out, unsigned tabs) {
+    if (!m_voidTag) {
+        const bool pretty = !m_document->m_compact;
+        if (!m_blockTag && pretty)
+            out.append(tabs, '\t');
+
+        out.append("</", 2);
+        out.append(m_htmlTag.data(), m_nameLength);
+        out.append(">\n", pretty ? 2 : 1);
+    }
 
-    string tag(m_htmlTag.substr(0, m_htmlTag.find_first_of(" ")));
+    if constexpr (Out::marks) {
+        m_nodestatus = status::CLOSED;
+        if (PHTML_DEBUG)
+            wkJlog
+                << lvl::debug << cat::LIB_HTML << iclog_FUNCTION
+                << "Closed " << string(m_htmlTag.substr(0, m_nameLength))
+                << iclog::endl;
+    }
+}
 
-    if (!is_special_tag(tag, voidTags)) {
+/**
+ * @brief html_cursor::step
+ * @param out
+ * @return false once the root is closed
+ *
+ * Open or close one node.
+ */
+template <typename Out> bool phtml::html_cursor::step(Out &out) {
+    if (!m_started) {
+        m_started = true;
+        m_root->open_node(out, 0);
+        m_stack.push_back({m_root, m_root->m_firstChild});
+        return true;
+    }
 
-        if (!is_special_tag(tag, blockTags)) {
-            if (tabs)
-                m_htmlPage.append(tabs, '\t');
+    frame &top = m_stack.back();
+    if (top.next) {
+        html_tree_impl *child = top.next;
+        top.next              = child->m_nextSibling;
+        if (child->closed() != status::CLOSED) { // else written by an earlier process_nodes()
+            // Compact: one line break where the whitespace of pretty output could show
+            if (m_root->m_document->m_compact && !child->m_blockLevel && (top.last ? !top.last->m_blockLevel : top.node->m_firstContent != nullptr))
+                out.append(1, '\n');
+            top.last = child;
+            child->open_node(out, static_cast<unsigned>(m_stack.size()));
+            m_stack.push_back({child, child->m_firstChild});
         }
-
-        m_htmlPage.append("</" + tag + ">\n");
+    } else {
+        top.node->close_node(out, static_cast<unsigned>(m_stack.size() - 1));
+        m_stack.pop_back();
     }
+    return !m_stack.empty();
+}
 
-    m_nodestatus = status::CLOSED;
-    if (PHTML_DEBUG)
-        wkJlog
-            << lvl::debug << cat::LIB_HTML << iclog_FUNCTION
-            << "Closed " << tag
-            << iclog::endl;
+/**
+ * @brief html_tree_impl::serialise
+ * @param out
+ *
+ * This node and everything below it, in one go.
+ */
+template <typename Out> void phtml::html_tree_impl::serialise(Out &out) {
+    html_cursor cursor(this);
+    while (cursor.step(out)) {
+    }
 }
 
 /**
@@ -341,10 +700,28 @@ phtml::status phtml::html_tree_impl::closed() { return (m_nodestatus); }
  *
  */
 void phtml::html_tree::set_node_content(const char *content, bool lineBreak, bool escapeSpecialChars) {
-    if (escapeSpecialChars)
-        m_pimpl->m_tagContent.push_back({m_pimpl->handle_special_characters(content), lineBreak});
-    else
-        m_pimpl->m_tagContent.push_back({content, lineBreak});
+    html_arena &arena = m_pimpl->m_document->m_arena;
+    if (escapeSpecialChars && content) {
+        // Measured, then escaped straight into the arena
+        const size_t len  = std::strlen(content);
+        const size_t size = html_escaped_size(content, len);
+        char        *text = static_cast<char *>(arena.allocate(size + 1, 1));
+        html_escape(content, len, text);
+        text[size] = '\0';
+        m_pimpl->add_content({text, size}, lineBreak);
+    } else {
+        m_pimpl->add_content(arena.copy(content), lineBreak);
+    }
+}
+
+void phtml::html_tree::set_node_slot(const char *name, bool lineBreak, bool escapeSpecialChars) {
+    html_content *content = m_pimpl->add_content(m_pimpl->m_document->m_arena.copy(name), lineBreak);
+    content->slot         = true;
+    content->escape       = escapeSpecialChars;
+}
+
+void phtml::html_tree::compact(bool enable) {
+    m_pimpl->m_document->m_compact = enable;
 }
 
 const char *phtml::html_tree::get_html() const {
@@ -354,33 +731,6 @@ const char *phtml::html_tree::get_html() const {
 // END OF CLASS  --  ^^^^^^^^
 //------------------------------------------------------------------------------------------//
 
-/**
- * @brief pretty_html::find_first_open_sibling
- * @param parent
- * @return
- *
- * Iterate through each node until you find the first one that is
- * not marked closed.
- */
-phtml::html_tree *phtml::find_first_open_sibling(html_tree *parent) {
-
-    html_tree *workNode = nullptr;
-
-    for (html_tree *it : parent->m_pimpl->childNodes) {
-        if (it->m_pimpl->closed() != status::CLOSED) {
-            workNode = it;
-            if (PHTML_DEBUG)
-                wkJlog
-                    << lvl::debug << cat::LIB_HTML << iclog_FUNCTION
-                    << "found child node"
-                    << iclog::endl;
-            break;
-        }
-    }
-
-    return (workNode);
-}
-
 /**
  * @brief pretty_html::process_nodes
  * @param primaryNode
@@ -390,72 +740,231 @@ phtml::html_tree *phtml::find_first_open_sibling(html_tree *parent) {
  * to generate the html.
  *
  * The HTML itself is contained within the std::string attached to
- * the primary html_tree instance.
+ * the primary html_tree instance, which is measured first and then
+ * grown once.
  */
 void phtml::process_nodes(html_tree *primaryNode) {
-    html_tree *curNode = primaryNode;
+    html_tree_impl *root = primaryNode->m_pimpl;
+    if (root->closed() == status::CLOSED)
+        return;
 
-    unsigned tabs = 0;
-    while (primaryNode->m_pimpl->closed() != status::CLOSED) {
+    html_size size;
+    root->serialise(size);
+    root->m_htmlPage.reserve(root->m_htmlPage.size() + size.m_size + 1);
 
-        if (curNode->m_pimpl->closed() == status::UNPROCESSED) {
-            curNode->m_pimpl->open_node(tabs);
-            ++tabs;
-            if (PHTML_DEBUG)
-                wkJlog
-                    << lvl::debug << cat::LIB_HTML << iclog_FUNCTION
-                    << "opening unprocessed node"
-                    << iclog::endl;
-        }
+    html_writer writer{root->m_htmlPage};
+    root->serialise(writer);
+
+    if (PHTML_DEBUG)
+        wkJlog
+            << lvl::debug << cat::LIB_HTML << iclog_FUNCTION
+            << "Wrote " << size.m_size << " bytes of html"
+            << iclog::endl;
+}
+
+/******************************************************************************/
+/*  STREAMING                                                                 */
+/******************************************************************************/
+phtml::html_stream_impl::html_stream_impl(const html_tree *primaryNode, size_t chunkSize)
+    : m_head(primaryNode->m_pimpl->m_htmlPage),
+      m_cursor(primaryNode->m_pimpl),
+      m_more(primaryNode->m_pimpl->closed() != status::CLOSED),
+      m_chunkSize(chunkSize ? chunkSize : 65536) {
+    m_chunk.reserve(m_chunkSize);
+}
 
-        // if the current node is a leaf node and it is open then close it
-        if ((curNode->m_pimpl->is_leaf_node()) && (curNode->m_pimpl->closed() == status::OPEN)) {
+/**
+ * @brief html_stream_impl::next
+ * @return The next piece of the page, empty at the end.  Valid until the
+ * next call.
+ */
+std::string_view phtml::html_stream_impl::next() {
+    if (!m_head.empty()) {
+        std::string_view piece = m_head.substr(0, m_chunkSize);
+        m_head.remove_prefix(piece.size());
+        return piece;
+    }
+
+    m_chunk.clear();
+    html_chunk out{m_chunk};
+    while (m_more && m_chunk.size() < m_chunkSize)
+        m_more = m_cursor.step(out);
+    return m_chunk;
+}
+
+phtml::html_stream::html_stream(const html_tree *primaryNode, size_t chunkSize)
+    : m_pimpl(new html_stream_impl(primaryNode, chunkSize)) {}
+
+phtml::html_stream::~html_stream() {
+    delete m_pimpl;
+}
+
+size_t phtml::html_stream::read(char *buffer, size_t size) {
+    if (m_pimpl->m_pending.empty())
+        m_pimpl->m_pending = m_pimpl->next();
+
+    const size_t n = std::min(size, m_pimpl->m_pending.size());
+    std::memcpy(buffer, m_pimpl->m_pending.data(), n);
+    m_pimpl->m_pending.remove_prefix(n);
+    return n;
+}
+
+bool phtml::process_nodes(const html_tree *primaryNode, html_sink sink, void *userData, size_t chunkSize) {
+    html_stream_impl stream(primaryNode, chunkSize);
+    for (std::string_view piece = stream.next(); !piece.empty(); piece = stream.next()) {
+        if (!sink(piece.data(), piece.size(), userData))
+            return false;
+    }
+    return true;
+}
 
-            --tabs;
-            curNode->m_pimpl->close_node(tabs);
-            if (PHTML_DEBUG)
+bool phtml::process_nodes(const html_tree *primaryNode, int fd, size_t chunkSize) {
+    auto write_all = [](const char *data, size_t size, void *userData) {
+        const int fd = *static_cast<int *>(userData);
+        while (size) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
                 wkJlog
-                    << lvl::debug << cat::LIB_HTML << iclog_FUNCTION
-                    << "closing leaf node"
+                    << lvl::error << cat::LIB_HTML << iclog_FUNCTION
+                    << "Unable to write html: " << strerror(errno)
                     << iclog::endl;
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
         }
+        return true;
+    };
+    return process_nodes(primaryNode, write_all, &fd, chunkSize);
+}
 
-        // NEXT NODE
-        // find the next node to work on
-        // first of all we need to see if the node has any open children
-        html_tree *sibling = find_first_open_sibling(curNode);
+/******************************************************************************/
+/*  TEMPLATES                                                                 */
+/******************************************************************************/
+/**
+ * @brief html_template_impl::html_template_impl
+ *
+ * Written as process_nodes() would, into the literal html.  A tree that
+ * was already processed has no slots left to find.
+ */
+phtml::html_template_impl::html_template_impl(const html_tree *primaryNode) {
+    html_tree_impl *root = primaryNode->m_pimpl;
+    m_literal            = root->m_htmlPage;
+    if (root->closed() == status::CLOSED) {
+        wkJlog
+            << lvl::warning << cat::LIB_HTML << iclog_FUNCTION
+            << "The tree was processed before it was compiled, it has no slots"
+            << iclog::endl;
+        return;
+    }
 
-        // if the node does have children then we need to drill down to the first unclosed child
-        if (sibling) {
+    html_size size;
+    root->serialise(size);
+    m_literal.reserve(m_literal.size() + size.m_size);
 
-            curNode = sibling;
-            if (PHTML_DEBUG)
-                wkJlog
-                    << lvl::debug << cat::LIB_HTML << iclog_FUNCTION
-                    << "setting current node to child"
-                    << iclog::endl;
+    html_compiler compiler{*this};
+    root->serialise(compiler);
+    m_literal.shrink_to_fit();
 
-        }
+    m_slots.clear();
+    for (size_t i = 0; i < m_names.size(); ++i)
+        m_slots.emplace(m_names[i], i);
+}
 
-        // if it has no children then it can be closed regardless of whether it is a leaf node
-        // or not.
-        else {
+size_t phtml::html_template_impl::slot(std::string_view name) {
+    auto it = m_slots.find(name);
+    if (it != m_slots.end())
+        return it->second;
+    // The name stays in the arena of the tree until compiled, then points into m_names
+    m_slots.emplace(name, m_names.size());
+    m_names.emplace_back(name);
+    return m_names.size() - 1;
+}
 
-            // if the current node has no open children then close it
-            if (curNode->m_pimpl->closed() == status::OPEN) {
-                --tabs;
-                curNode->m_pimpl->close_node(tabs);
-            }
+void phtml::html_template_impl::value_lengths(const char *const *values, size_t *lengths) const {
+    for (size_t i = 0; i < m_names.size(); ++i)
+        lengths[i] = values && values[i] ? std::strlen(values[i]) : 0;
+}
 
-            // we can then make our way back up to the parent node
-            curNode = curNode->m_pimpl->previousBranch;
-            if (PHTML_DEBUG)
-                wkJlog
-                    << lvl::debug << cat::LIB_HTML << iclog_FUNCTION
-                    << "returninng to previous branch"
-                    << iclog::endl;
+size_t phtml::html_template_impl::size(const char *const *values, const size_t *lengths) const {
+    size_t size = m_literal.size();
+    for (const span &s : m_spans)
+        size += s.escape && lengths[s.slot] ? html_escaped_size(values[s.slot], lengths[s.slot]) : lengths[s.slot];
+    return size;
+}
+
+/**
+ * @brief html_template_impl::write
+ * The literal html between the slots, each slot escaped or copied as it
+ * is, one after the other.
+ */
+size_t phtml::html_template_impl::write(const char *const *values, const size_t *lengths, char *out) const {
+    char  *o    = out;
+    size_t from = 0;
+    for (const span &s : m_spans) {
+        std::memcpy(o, m_literal.data() + from, s.offset - from);
+        o    += s.offset - from;
+        from  = s.offset;
+
+        const size_t len = lengths[s.slot];
+        if (!len)
+            continue;
+        if (s.escape) {
+            o += html_escape(values[s.slot], len, o);
+        } else {
+            std::memcpy(o, values[s.slot], len);
+            o += len;
         }
     }
+    std::memcpy(o, m_literal.data() + from, m_literal.size() - from);
+    o += m_literal.size() - from;
+    return static_cast<size_t>(o - out);
+}
+
+phtml::html_template::html_template(const html_tree *primaryNode)
+    : m_pimpl(new html_template_impl(primaryNode)) {}
+
+phtml::html_template::~html_template() {
+    delete m_pimpl;
+}
+
+size_t phtml::html_template::slot_count() const {
+    return m_pimpl->m_names.size();
+}
+
+const char *phtml::html_template::slot_name(size_t slot) const {
+    return slot < m_pimpl->m_names.size() ? m_pimpl->m_names[slot].c_str() : nullptr;
+}
+
+size_t phtml::html_template::find_slot(const char *name) const {
+    auto it = m_pimpl->m_slots.find(name ? name : "");
+    return it == m_pimpl->m_slots.end() ? m_pimpl->m_names.size() : it->second;
+}
+
+size_t phtml::html_template::size(const char *const *values) const {
+    std::vector<size_t> lengths(m_pimpl->m_names.size());
+    m_pimpl->value_lengths(values, lengths.data());
+    return m_pimpl->size(values, lengths.data());
+}
+
+size_t phtml::html_template::render(const char *const *values, char *out) const {
+    std::vector<size_t> lengths(m_pimpl->m_names.size());
+    m_pimpl->value_lengths(values, lengths.data());
+    return m_pimpl->write(values, lengths.data(), out);
+}
+
+char *phtml::html_template::render(const char *const *values) const {
+    std::vector<size_t> lengths(m_pimpl->m_names.size());
+    m_pimpl->value_lengths(values, lengths.data());
+
+    const size_t size = m_pimpl->size(values, lengths.data());
+    char        *html = static_cast<char *>(malloc(size + 1));
+    if (!html)
+        return nullptr;
+    html[m_pimpl->write(values, lengths.data(), html)] = '\0';
+    return html;
 }
 
 void PDF_FreeHTML(const char *html) {
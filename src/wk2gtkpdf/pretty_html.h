@@ -13,6 +13,8 @@
 #define PHTML_API __attribute__((visibility("default")))
 #endif
 
+#include <cstddef>
+
 extern "C" {
 /**
  * @brief PDF_FreeHTML
@@ -28,7 +30,33 @@ namespace phtml {
     class PHTML_API html_tree;
     void PHTML_API  process_nodes(html_tree *primaryNode);
     struct html_tree_impl;
-    html_tree *find_first_open_sibling(html_tree *parent);
+    struct html_stream_impl;
+    struct html_template_impl;
+
+    /**
+     * @brief html_sink
+     * Receives the html a piece at a time, in order.
+     * @return false to stop
+     */
+    typedef bool (*html_sink)(const char *data, size_t size, void *userData);
+
+    /**
+     * @brief process_nodes
+     * Write the html of the tree to @p sink in pieces of about @p chunkSize
+     * bytes (more when one element and its content are bigger) instead
+     * of into get_html().  The tree is left as it was, it can be streamed
+     * again or processed as usual afterwards.
+     *
+     * @return false if the sink stopped it
+     */
+    bool PHTML_API process_nodes(const html_tree *primaryNode, html_sink sink, void *userData, size_t chunkSize = 65536);
+
+    /**
+     * @brief process_nodes
+     * As above, written to the file descriptor @p fd (file, pipe or socket).
+     * @return false on a write error
+     */
+    bool PHTML_API process_nodes(const html_tree *primaryNode, int fd, size_t chunkSize = 65536);
 
     class PHTML_API html_tree {
         public:
@@ -44,17 +72,114 @@ namespace phtml {
             void set_node_content(const char *content, bool lineBreak = false, bool escapeSpecialChars = false);
             void set_node_content_f(const char *format, ...) __attribute__((format(printf, 2, 3)));
 
+            /**
+             * @brief set_node_slot
+             * Content filled in later by an html_template, where the
+             * value of the slot @p name goes (escaped unless told not
+             * to).  Written as nothing by process_nodes().
+             */
+            void set_node_slot(const char *name, bool lineBreak = false, bool escapeSpecialChars = true);
+
             // Access the final master string as a C-string
             const char *get_html() const;
 
+            /**
+             * @brief compact
+             * Write the whole document without indentation or whitespace
+             * that can not show: none next to elements laid out as blocks
+             * by default (div, p, table, li ...), one line break between
+             * inline content.  Pages that make those elements inline keep
+             * the pretty output.  Set it on any node before process_nodes()
+             * or streaming.
+             */
+            void compact(bool enable = true);
+
             friend void process_nodes(html_tree *primaryNode);
+            friend struct html_stream_impl;
+            friend struct html_template_impl;
 
         private:
-            // Internal constructor so children can share the root implementation
+            // Internal constructors so children can share the root implementation
             html_tree(const char *htmlTag, html_tree *parent_handle);
+            html_tree(html_tree_impl *node);
             // The only member: The Pimpl pointer
-            html_tree_impl   *m_pimpl;
-            friend html_tree *find_first_open_sibling(html_tree *parent);
+            html_tree_impl *m_pimpl;
+            friend struct html_tree_impl;
+    };
+
+    /**
+     * @brief html_stream
+     * Reads the html of a tree on demand, for consumers that pull (a
+     * GInputStream, a socket that is ready).  Only about one chunk of it
+     * is in memory at a time.  The tree must outlive the stream and not
+     * change while it is read.
+     */
+    class PHTML_API html_stream {
+        public:
+            html_stream(const html_tree *primaryNode, size_t chunkSize = 65536);
+            ~html_stream();
+
+            html_stream(const html_stream &)            = delete;
+            html_stream &operator=(const html_stream &) = delete;
+
+            /**
+             * @brief read
+             * @return The bytes copied to @p buffer, 0 once it is all read
+             */
+            size_t read(char *buffer, size_t size);
+
+        private:
+            html_stream_impl *m_pimpl;
+    };
+
+    /**
+     * @brief html_template
+     * A tree built once with set_node_slot() placeholders, compiled into
+     * its html and the offsets of the slots in it.  render() only copies
+     * that html with the values spliced in, into a buffer of the exact
+     * size, so the same document is made again without building a tree.
+     * The tree is not needed once compiled.
+     */
+    class PHTML_API html_template {
+        public:
+            html_template(const html_tree *primaryNode);
+            ~html_template();
+
+            html_template(const html_template &)            = delete;
+            html_template &operator=(const html_template &) = delete;
+
+            // Slots by first use; a name used twice is one slot
+            size_t      slot_count() const;
+            const char *slot_name(size_t slot) const;
+
+            /**
+             * @brief find_slot
+             * @return The slot called @p name, slot_count() if none is
+             */
+            size_t find_slot(const char *name) const;
+
+            /**
+             * @brief size
+             * @param values One per slot in slot order, nullptr for none
+             * @return The bytes render() writes, without a NUL
+             */
+            size_t size(const char *const *values) const;
+
+            /**
+             * @brief render
+             * @param out At least size(values) bytes
+             * @return The bytes written
+             */
+            size_t render(const char *const *values, char *out) const;
+
+            /**
+             * @brief render
+             * @return The page, release it with PDF_FreeHTML()
+             */
+            char *render(const char *const *values) const;
+
+        private:
+            html_template_impl *m_pimpl;
     };
 
 } // namespace phtml
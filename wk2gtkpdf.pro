@@ -70,17 +70,31 @@ SOURCES += \
         extra-examples/greyscale/greyscale.cpp \
         extra-examples/html-tests/gridtest.cpp \
         extra-examples/indexing-tests/indextest.cpp \
+        misc/benchmarks/base64_bench.cpp \
+        misc/benchmarks/escape_bench.cpp \
+        misc/benchmarks/html_bench.cpp \
+        misc/benchmarks/template_bench.cpp \
+        misc/tests/image_swap_test.cpp \
+        misc/tests/pdf_compact_test.cpp \
         misc/template_maker/template_maker.cpp \
         src/cli++/main.cpp \
         src/cli/main.cpp \
         src/log++/ic_printerlog++.cpp \
+        src/wk2gtkpdf/base64.cpp \
         src/wk2gtkpdf/c_bridge.cpp \
         src/wk2gtkpdf/cairo_painter.cpp \
         src/wk2gtkpdf/encode_image.cpp \
+        src/wk2gtkpdf/html_escape.cpp \
         src/wk2gtkpdf/ichtmltopdf++.cpp \
         src/wk2gtkpdf/ichtmltopdf_int.cpp \
         src/wk2gtkpdf/iclog.cpp \
+        src/wk2gtkpdf/image_swap.cpp \
         src/wk2gtkpdf/index_pdf.cpp \
+        src/wk2gtkpdf/pdf_compact.cpp \
+        src/wk2gtkpdf/pdf_merge.cpp \
+        src/wk2gtkpdf/pdf_postprocess.cpp \
+        src/wk2gtkpdf/pdf_recompress.cpp \
+        src/wk2gtkpdf/pdf_stamper.cpp \
         src/wk2gtkpdf/pretty_html.cpp
 
 DISTFILES += \
@@ -185,11 +199,21 @@ DISTFILES += \
 
 HEADERS += \
         src/log++/ic_printerlog++.h \
+        src/wk2gtkpdf/base64.h \
         src/wk2gtkpdf/c_bridge.h \
         src/wk2gtkpdf/cairo_painter.h \
+        src/wk2gtkpdf/content_hash.h \
+        src/wk2gtkpdf/css_scale.h \
         src/wk2gtkpdf/encode_image.h \
+        src/wk2gtkpdf/html_escape.h \
         src/wk2gtkpdf/ichtmltopdf++.h \
         src/wk2gtkpdf/ichtmltopdf_int.h \
         src/wk2gtkpdf/iclog.h \
+        src/wk2gtkpdf/image_swap.h \
         src/wk2gtkpdf/index_pdf.h \
+        src/wk2gtkpdf/pdf_compact.h \
+        src/wk2gtkpdf/pdf_merge.h \
+        src/wk2gtkpdf/pdf_postprocess.h \
+        src/wk2gtkpdf/pdf_recompress.h \
+        src/wk2gtkpdf/pdf_stamper.h \
         src/wk2gtkpdf/pretty_html.h